@@ -1,12 +1,59 @@
 /*
- * Firmware for transmitting ADC readings to a remote UDP client.
+ * Firmware for transmitting ADC readings to a remote client over WiFi (UDP) or the native USB port.
+ * 
+ * >>Links<<
+ *   The packets are written on the link of the last received command (ctrlLink).
+ *   WiFi  ........  Each packet is a UDP packet (the remote UDP client is the sender of the last command).
+ *   USB  .........  Each packet is framed on the USB serial port (both directions): [0xA5][Length_LSB][Length_MSB][Packet].
+ *                   The serial port only carries frames while USB is the active link (debug messages are disabled).
  * 
  * >>Protocol<<
- *   'S'  .........  Write status to remove UDP client
- *                   Status format: S[Samplerate_LSB][Samplerate_MSB][ADCgain][nADCinputs][nADCbuffers][nADCbufferPos_LSB][nADCbufferPos_MSB][EnabledADCinputs]
+ *   'S'  .........  Write status to remote client
+ *                   Status format: S[Samplerate_LSB][Samplerate_MSB][ADCgain][nADCinputs][nADCbuffers][nADCbufferPos_LSB][nADCbufferPos_MSB][EnabledADCinputs][FR_DECIMATION][nRingFrames_LSB][nRingFrames_MSB][TareInputs]
  *   'Axy'  .......  'y'='1': Enable analog input 'x', 'y'='0': Disable analog input 'x' [x-format: char, y-format: char]
  *   'Gx'  ........  Set gain of the PGA, located before the ADC (ADCgain), to 'x' [x-format: uint8_t].
  *   'Tx'  ........  Retransmit buffer index number 'x' [x-format: uint8_t].
+ *   'D'  .........  Data written to the remote client (retransmitted data is written with 'T' instead of 'D')
+ *                   Data format: D[iBuffer][EnabledInputs][Summary of each enabled input][Samples of each enabled input]
+ *                   Summary format: [Min_LSB][Min_MSB][Max_LSB][Max_MSB][Sum_LSB][Sum][Sum][Sum_MSB][Offset_LSB][Offset_MSB] of the samples in the buffer
+ *                   The tare offset 'Offset' is subtracted from the samples and the summary (0 without automatic tare, see 'Zx').
+ *                   Samples format: N_ADC_BUFFER_POS x [Sample_LSB][Sample_MSB]
+ *                   The flight recorder ('F', 'K' and 'R') is only built with FR_DECIMATION > 0 (ctrlADC.h, default: 0 = disabled), as it samples at
+ *                   FR_DECIMATION*SAMPLE_RATE, and leaves memory for N_ADC_BUFFERS=16 instead of 64 retransmittable buffers.
+ *   'Fxoonn'  ....  Flight recorder: Transmit 'nn' full rate frames, starting 'oo' frames after the first frame of buffer 'x' [x-format: uint8_t, oo-format: int16_t, nn-format: uint16_t, LSB first].
+ *                   The ring is held until all packets are acknowledged ('nn'=0 aborts the transfer). Error 'EF' if the frames are not in the ring.
+ *   'Kxx'  .......  Flight recorder: Acknowledge all bulk packets before packet 'xx' [xx-format: uint16_t, LSB first].
+ *   'R'  .........  Bulk packet written to the remote client (up to FR_WINDOW unacknowledged packets, resent after FR_TIMEOUT ms)
+ *                   The transfer is aborted (and the ring released) after FR_MAX_TIMEOUTS timeouts without a new acknowledge.
+ *                   Bulk format: R[iPacket_LSB][iPacket_MSB][nPackets_LSB][nPackets_MSB][EnabledInputs][Frames]
+ *                   Frames format: nFrames x [Sample_LSB][Sample_MSB] of each enabled input
+ *   'Bxnrrsstt'  .  Burst: Arm a burst of 'ss' samples on 'n' consecutive inputs from input 'x' at 'rr' Hz per input ('rr'=0: maximum rate), which starts when
+ *                   the reading of input 'x' reaches 'tt' ('tt'=0x7fff: start now) [x,n-format: uint8_t, rr,ss-format: uint16_t, tt-format: int16_t, LSB first].
+ *                   'n'=0 disarms the burst. Error 'EB' if the burst settings are invalid.
+ *                   The threshold is checked on each full rate reading of input 'x' (before the decimation of the flight recorder).
+ *                   The bursts are not interleaved with the regular readings (the ADC scans only the burst inputs): All enabled inputs are ADC_MISSING
+ *                   in the data packets ('D') from the remaining readings of the trigger position (buffer 'iBuffer', position 'iBufferPos' of the burst
+ *                   packets, all readings of the position with FR_DECIMATION > 0) until the burst is complete (duration 'Duration' of the burst packets),
+ *                   and at the first position after the burst packets are transmitted. The host fills the burst inputs from the burst, the other
+ *                   enabled inputs are missing during the burst. The samplerate 'rr' is approximated by the ADC prescaler and sample length.
+ *   'Wx'  ........  Burst: Retransmit packet 'x' of the last burst [x-format: uint8_t].
+ *   'B'  .........  Burst packet written to the remote client after the burst (one packet every BURST_TRICKLE_MS between the data packets)
+ *                   Burst format: B[iBurst][iPacket][nPackets][FirstInput][nInputs][nSamples_LSB][nSamples_MSB][Duration (4 bytes, unit: us)][iBuffer][iBufferPos_LSB][iBufferPos_MSB][Age_LSB][Age_MSB][Samples]
+ *                   Age is the time since the start of the burst, when the packet is written [unit: ms, max. 65535]
+ *                   Samples format: [Sample_LSB][Sample_MSB] of each burst input after each other, continued in the next packet
+ *   'I'  .........  Write the scheduler task statistics to the remote client (the maxima restart after each 'I')
+ *                   Scheduler format: I[nTasks][Task statistics of each task]
+ *                   Task statistics format: [Name (8 chars)][Priority][Deferred][Budget_LSB][Budget_MSB][nRuns (4 bytes)][nOverruns_LSB][nOverruns_MSB]
+ *                                           [MaxLatency_LSB][MaxLatency_MSB][MaxRunTime_LSB][MaxRunTime_MSB] (times in us, LSB first)
+ *   'Y'  .........  Sync event written to the remote client for each edge on the sync pulse input (after the data packet of its buffer)
+ *                   Sync format: Y[iEvent][iBuffer][iBufferPos_LSB][iBufferPos_MSB][Fraction_LSB][Fraction_MSB]
+ *                   The edge is 'Fraction'/65536 sample periods after sample 'iBufferPos' of buffer 'iBuffer'. 'iEvent' counts the edges (uint8_t).
+ *   'Yx'  ........  Retransmit sync event 'x' (the last SYNC_N_EVENTS events are kept) [x-format: uint8_t]. Error 'EY' if the event is not kept.
+ *   'Zx'  ........  Enable the automatic tare of the inputs in bit mask 'x' ('x'=0: disable), and restart their offsets [x-format: uint8_t].
+ *                   The offset of an input follows its unloaded buffers (flat, and not above the offset by more than TARE_MAX_LOAD: a faster
+ *                   upward drift of the baseline is not tracked). The lowest unloaded buffer of the first TARE_WINDOW buffers after 'Zx' sets the
+ *                   first offset, so 'Zx' must be sent with the feet off (buffers are only completed while inputs are enabled). An input without
+ *                   an unloaded buffer in this window is not tared until the next 'Zx'. A gain change ('Gx') scales the offsets.
  *   
  * >>Notes<<
  * - To compile the project, the following is needed
@@ -27,8 +74,13 @@
 #include <WiFi101.h>
 #include <WiFiUdp.h>
 
+#include "ctrlLink.h"
 #include "ctrlTimer.h"
 #include "ctrlADC.h"
+#include "ctrlRecorder.h"
+#include "ctrlBurst.h"
+#include "ctrlScheduler.h"
+#include "ctrlSync.h"
 
 // >> Variables <<
 // WiFi AP settings
@@ -36,13 +88,6 @@ const char ssid[] = AP_SSID;
 const char pass[] = AP_PASS;
 int status = WL_IDLE_STATUS;      // WiFi connection status
 
-//The udp library class
-WiFiUDP udp;                      // UDP object
-
-// UDP variables
-IPAddress remoteIP;               // Remote UDP client IP
-uint16_t remotePort = 0;          // Remote UDP client port number
-
 // Buffers
 char readBuffer[255];             // Buffer to hold incoming packet
 char strError[256];               // Buffer to hold error messages
@@ -94,50 +139,91 @@ void setup() {
 
   //initializes the UDP
   //This initializes the transfer buffer
-  udp.begin(UDP_PORT);
+  LINK_Init(UDP_PORT);
+
+  // Add the loop tasks (the priority decides the order, when several tasks are ready in the same loop).
+  ADC_iTransmitTask = SCHED_AddTask(transmitData, "Data", 1, false, 5000, SCHED_ON_POST);
+  SCHED_AddTask(readCommand, "Command", 2, false, 5000, 1);
+#if FR_DECIMATION > 0
+  SCHED_AddTask(transmitRecorder, "Recorder", 3, false, 5000, 1);
+#endif
+  SCHED_AddTask(transmitBurst, "Burst", 3, false, 5000, 1);
+  SCHED_AddTask(transmitSync, "Sync", 3, false, 2000, 1);
+  SCHED_AddTask(checkWiFiStatus, "WiFi", 4, false, 2000, 100);
 
-  // Initialize the ADC.
+  // Initialize the ADC and the DMA controller (used by bursts).
   InitADC();
+  InitBurst();
+
+  // Route the sync pulse input to the capture channel of the sample timer.
+  InitSync();
 
   // Initialize the sample timer.
+#if FR_DECIMATION > 0
+  startTimer(SAMPLE_RATE*FR_DECIMATION);
+#else
   startTimer(SAMPLE_RATE);
+#endif
 }
 
 
 void loop() {
+  // Run the ready tasks
+  SCHED_Run();
+}
+
+// Print the WiFi status, if it has changed (scheduler task).
+void checkWiFiStatus() {
   // Compare the previous status to the current status
   if (status != WiFi.status()) 
   {
-    // The WiFi status has changed, update status variable and print the new status.
+    // The WiFi status has changed, update status variable and print the new status (unless USB is the active link).
     status = WiFi.status();
-    printWiFiStatus(status);
+    if (LINK_Active == LINK_UDP) {
+      printWiFiStatus(status);
+    }
   }
+}
 
-  // Transmit ADC data
+// Transmit ADC data (scheduler task, posted when a buffer is complete).
+void transmitData() {
   if (iBufferTransmit < 0xff)
   {
-    ADC_UdpTransmit(udp, iBufferTransmit, remoteIP, remotePort);
+    ADC_Transmit(iBufferTransmit);
     iBufferTransmit = 0xff;
   }
+}
 
-  // if there's data available, read a packet
-  int packetSize = udp.parsePacket();
+#if FR_DECIMATION > 0
+// Transmit flight recorder data (scheduler task).
+void transmitRecorder() {
+  FR_Transmit();
+}
+#endif
+
+// Transmit burst data (scheduler task).
+void transmitBurst() {
+  BURST_Transmit();
+}
+
+// Transmit sync events (scheduler task).
+void transmitSync() {
+  SYNC_Transmit();
+}
+
+// Read and execute a command from the remote client (scheduler task).
+void readCommand() {
+  // if there's data available (on either link), read a packet into the readBuffer
+  int packetSize = LINK_Read(readBuffer, sizeof(readBuffer));
   if (packetSize) {
-    // Stoe the IP and Port number of the remote UDP client
-    remoteIP = udp.remoteIP();
-    remotePort = udp.remotePort();
-    
-    // Read the packet into the readBuffer
-    int len = udp.read(readBuffer, 255);
-    if (len > 0) {
-      readBuffer[len] = 0; // Terminale the string
+    // Display received data on the serial port (unless USB is the active link).
+    if (LINK_Active == LINK_UDP)
+    {
+      sprintf(strError, "Received: data='%s', size=%i, ", readBuffer, packetSize);
+      Serial.print(strError);
+      LINK_PrintSender();
     }
 
-    // Display received data on the serial port.
-    sprintf(strError, "Received: data='%s', size=%i, port=%i, IP=", readBuffer, packetSize, remotePort);
-    Serial.print(strError);
-    Serial.println(remoteIP);
-
     strError[0] = 0; // Set Error to 0
     switch (readBuffer[0])
     {
@@ -158,24 +244,27 @@ void loop() {
         else if (readBuffer[1] == '0')
         {
           ADC_EnabledInputs = 0x00;
-          UDP_TransmitStatus();
+          TransmitStatus();
         }
         else
         {
           sprintf(strError, "E%c%c%c", readBuffer[0], readBuffer[1], readBuffer[2]);
         }
+#if FR_DECIMATION > 0
+        FR_Reset();
+#endif
         break;
 
       // Transmit status
       case 'S':
-         UDP_TransmitStatus();
+         TransmitStatus();
          break; 
         
       // Retransmit data from buffer
       case 'T':
         if (readBuffer[1] < N_ADC_BUFFERS)
         {
-          ADC_UdpTransmit(udp, (uint8_t)readBuffer[1], remoteIP, remotePort, 'T');
+          ADC_Transmit((uint8_t)readBuffer[1], 'T');
         }
         else
         {
@@ -183,11 +272,79 @@ void loop() {
         }
         break;
 
+#if FR_DECIMATION > 0
+      // Transmit a window of the flight recorder
+      case 'F':
+        if (packetSize < 6 || !FR_StartTransfer((uint8_t)readBuffer[1], (int16_t)((uint8_t)readBuffer[2] | (uint8_t)readBuffer[3] << 8),
+                                                (uint16_t)((uint8_t)readBuffer[4] | (uint8_t)readBuffer[5] << 8)))
+        {
+          sprintf(strError, "EF");
+        }
+        break;
+
+      // Acknowledge flight recorder bulk packets
+      case 'K':
+        if (packetSize >= 3)
+        {
+          FR_Acknowledge((uint16_t)((uint8_t)readBuffer[1] | (uint8_t)readBuffer[2] << 8));
+        }
+        break;
+#endif
+
+      // Arm (or disarm) a burst
+      case 'B':
+        if (packetSize >= 9 && readBuffer[2] == 0)
+        {
+          BURST_Disarm();
+        }
+        else if (packetSize < 9 || !BURST_Arm((uint8_t)readBuffer[1], (uint8_t)readBuffer[2],
+                                             (uint16_t)((uint8_t)readBuffer[3] | (uint8_t)readBuffer[4] << 8),
+                                             (uint16_t)((uint8_t)readBuffer[5] | (uint8_t)readBuffer[6] << 8),
+                                             (int16_t)((uint8_t)readBuffer[7] | (uint8_t)readBuffer[8] << 8)))
+        {
+          sprintf(strError, "EB");
+        }
+        break;
+
+      // Retransmit a burst packet
+      case 'W':
+        if (!BURST_Retransmit((uint8_t)readBuffer[1]))
+        {
+          sprintf(strError, "EW");
+        }
+        break;
+
+      // Retransmit a sync event
+      case 'Y':
+        if (packetSize < 2 || !SYNC_Retransmit((uint8_t)readBuffer[1]))
+        {
+          sprintf(strError, "EY");
+        }
+        break;
+
+      // Enable the automatic tare
+      case 'Z':
+        if (packetSize >= 2)
+        {
+          ADC_SetTare((uint8_t)readBuffer[1]);
+          TransmitStatus();
+        }
+        else
+        {
+          sprintf(strError, "EZ");
+        }
+        break;
+
+      // Transmit the scheduler task statistics
+      case 'I':
+        SCHED_TransmitStats();
+        break;
+
       // Change the ADC gain
       case 'G':
         if (ADC_setGain(readBuffer[1]))
         {
-          UDP_TransmitStatus();
+          TransmitStatus();
         }
         else
         {
@@ -204,27 +361,37 @@ void loop() {
     // Write the error.
     if (strError[0] > 0)
     {
-      // send a reply, to the IP address and port that sent us the packet we received
-      udp.beginPacket(remoteIP, remotePort);
-      udp.write(strError);
-      udp.endPacket();
+      // send a reply, to the client that sent us the packet we received
+      LINK_Begin();
+      LINK_Write((const uint8_t*)strError, strlen(strError));
+      LINK_End();
     }
   }
 }
 
-// Transmit status information to the remote UDP client.
-void UDP_TransmitStatus() {  
-  udp.beginPacket(remoteIP, remotePort);
-  udp.write('S');
-  udp.write((uint8_t)SAMPLE_RATE);
-  udp.write((uint8_t)(SAMPLE_RATE >> 8));
-  udp.write(ADC_Gain);
-  udp.write((uint8_t)N_ADC_INPUT);
-  udp.write((uint8_t)N_ADC_BUFFERS);
-  udp.write((uint8_t)N_ADC_BUFFER_POS);
-  udp.write((uint8_t)(N_ADC_BUFFER_POS >> 8));
-  udp.write(ADC_EnabledInputs);
-  udp.endPacket();
+// Transmit status information to the remote client.
+void TransmitStatus() {  
+  LINK_Begin();
+  LINK_Write('S');
+  LINK_Write((uint8_t)SAMPLE_RATE);
+  LINK_Write((uint8_t)(SAMPLE_RATE >> 8));
+  LINK_Write(ADC_Gain);
+  LINK_Write((uint8_t)N_ADC_INPUT);
+  LINK_Write((uint8_t)N_ADC_BUFFERS);
+  LINK_Write((uint8_t)N_ADC_BUFFER_POS);
+  LINK_Write((uint8_t)(N_ADC_BUFFER_POS >> 8));
+  LINK_Write(ADC_EnabledInputs);
+#if FR_DECIMATION > 0
+  LINK_Write((uint8_t)FR_DECIMATION);
+  LINK_Write((uint8_t)FR_nFrames());
+  LINK_Write((uint8_t)(FR_nFrames() >> 8));
+#else
+  LINK_Write((uint8_t)0);
+  LINK_Write((uint8_t)0);
+  LINK_Write((uint8_t)0);
+#endif
+  LINK_Write(ADC_TareInputs);
+  LINK_End();
 }
 
 // Print Wifi Status to the Serial interface.
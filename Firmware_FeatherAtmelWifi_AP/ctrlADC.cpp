@@ -5,19 +5,156 @@
 
 
 #include "ctrlADC.h"
+#include "ctrlRecorder.h"
+#include "ctrlBurst.h"
+#include "ctrlScheduler.h"
 
 uint8_t ADC_EnabledInputs = 0x00;     // Enabled ADC inputs
 int16_t ADC_buffer[N_ADC_INPUT][N_ADC_BUFFERS][N_ADC_BUFFER_POS]; // ADC buffer
+int16_t ADC_bufferMin[N_ADC_INPUT][N_ADC_BUFFERS]; // Minimum of each buffer
+int16_t ADC_bufferMax[N_ADC_INPUT][N_ADC_BUFFERS]; // Maximum of each buffer
+int32_t ADC_bufferSum[N_ADC_INPUT][N_ADC_BUFFERS]; // Sum of each buffer
+int16_t ADC_bufferOffset[N_ADC_INPUT][N_ADC_BUFFERS]; // Tare offset subtracted from each buffer
+uint8_t ADC_TareInputs = 0x00;        // Inputs with automatic tare
+int32_t ADC_tareOffset[N_ADC_INPUT];  // Offset of each input [unit: 1/2^TARE_FRACTION_BITS ADC codes]
+uint8_t ADC_tareValid = 0x00;         // Inputs, whose offset is set (by an unloaded buffer since the last restart)
+uint8_t ADC_tareWindow = 0;           // Buffers left of the feet-off window after the last restart of the offsets
 uint8_t iBuffer = 0;                  // Biffer index
 int iBufferPos = 0;                   // Buffer position index
-uint8_t iBufferTransmit = 0xff;       // Buffer number to transmit to the remote UDP client (no transmit = 0xff)
+uint8_t iBufferTransmit = 0xff;       // Buffer number to transmit to the remote client (no transmit = 0xff)
+uint8_t iBufferComplete = 0;          // Next complete buffer to summarize
+int ADC_iBlockTask = -1;              // Scheduler task summarizing the complete buffers
+int ADC_iTransmitTask = -1;           // Scheduler task transmitting iBufferTransmit
 int iReadInput = -1;                  // ADC input index to read.
 const uint8_t regInputs[] = {A1, A2, A3, A4, A5}; // MUX regsiter values for the ADC inputs
 uint8_t ADC_Gain = 1;                 // Gain setting the PGA before to the ADC.
+bool ADC_missingPos = false;          // true: The readings of the current buffer position are missing (not written)
+#if FR_DECIMATION > 0
+uint8_t iDecimation = 0;              // Index of the full rate sample in the current buffer position
+int32_t ADC_decimationSum[N_ADC_INPUT]; // Sum of the full rate samples of the current buffer position
+#endif
+
+// Mark the readings of the enabled inputs, from iInputFirst, at the current buffer position as missing.
+// The partial decimation sums of these inputs are dropped, so the first average after a burst (or after the enabled
+// inputs change) only holds samples of its own position.
+void ADC_MarkMissing(int iInputFirst) {
+  for (int iInput=iInputFirst; iInput < N_ADC_INPUT; iInput++)
+  {
+    if (ADC_EnabledInputs & (1 << iInput))
+    {
+      ADC_buffer[iInput][iBuffer][iBufferPos] = ADC_MISSING;
+    }
+#if FR_DECIMATION > 0
+    ADC_decimationSum[iInput] = 0;
+#endif
+  }
+  ADC_missingPos = true;
+}
+
+// Enable the automatic tare of the inputs in bit mask 'Inputs', and restart their offsets. The feet are off for the
+// next TARE_WINDOW buffers (the host sends 'Zx' in a feet-off window), and the lowest unloaded buffer of each input
+// in this window sets its offset. An input without an unloaded buffer in the window is not tared until the next 'Zx'.
+void ADC_SetTare(uint8_t Inputs) {
+  ADC_TareInputs = Inputs;
+  ADC_tareValid = 0x00;
+  ADC_tareWindow = TARE_WINDOW;
+  for (int iInput=0; iInput < N_ADC_INPUT; iInput++)
+  {
+    ADC_tareOffset[iInput] = 0;
+  }
+}
+
+// Scale the offsets to a new gain of the PGA (the offsets stay valid, as the feet may be loaded at the gain change).
+void ADC_ScaleTare(uint8_t GainOld, uint8_t GainNew) {
+  for (int iInput=0; iInput < N_ADC_INPUT; iInput++)
+  {
+    ADC_tareOffset[iInput] = ADC_tareOffset[iInput] / GainOld * GainNew;
+  }
+}
+
+// Update the offset of an input from a complete buffer, and return the offset to subtract [unit: ADC codes]. The
+// buffer is unloaded (swing phase, or feet off), if it is flat and its mean is not above the offset by more than the
+// drift of the baseline (TARE_MAX_LOAD: a faster upward drift, e.g. of a heating sensor, is taken as load and not
+// tracked). The offset follows the unloaded buffers by an exponential average in fixed point. The first offset is
+// only set in the feet-off window after 'Zx', so a patient standing still is not taken as the baseline.
+static int16_t updateTare(int iInput, int16_t Min, int16_t Max, int32_t Sum, int nValid) {
+  if (!(ADC_TareInputs & (1 << iInput))) {
+    return(0);
+  }
+  if (nValid == N_ADC_BUFFER_POS && Max - Min <= TARE_MAX_RANGE)
+  {
+    int32_t Mean = (Sum << TARE_FRACTION_BITS) / N_ADC_BUFFER_POS;
+    if (ADC_tareWindow > 0 && (!(ADC_tareValid & (1 << iInput)) || Mean < ADC_tareOffset[iInput]))
+    {
+      ADC_tareOffset[iInput] = Mean;
+      ADC_tareValid |= 1 << iInput;
+    }
+    else if ((ADC_tareValid & (1 << iInput)) && Mean < ADC_tareOffset[iInput] + (TARE_MAX_LOAD << TARE_FRACTION_BITS))
+    {
+      ADC_tareOffset[iInput] += (Mean - ADC_tareOffset[iInput]) >> TARE_SHIFT;
+    }
+  }
+  return((int16_t)((ADC_tareOffset[iInput] + (1 << (TARE_FRACTION_BITS-1))) >> TARE_FRACTION_BITS));
+}
+
+// Tare and summarize the complete buffers (min, max and sum of the readings, that are not missing), and initiate the
+// transmit of the last one (scheduler task, posted when a buffer is complete). The tare offset is subtracted from the
+// readings of the buffer (the flight recorder and the bursts keep the readings without the offset).
+void ADC_CompleteBlocks() {
+  while (iBufferComplete != iBuffer)
+  {
+    for (int iInput=0; iInput < N_ADC_INPUT; iInput++)
+    {
+      int16_t Min = INT16_MAX;
+      int16_t Max = INT16_MIN;
+      int32_t Sum = 0;
+      int nValid = 0;
+      for (int iPos=0; iPos < N_ADC_BUFFER_POS; iPos++)
+      {
+        int16_t Sample = ADC_buffer[iInput][iBufferComplete][iPos];
+        if (Sample != ADC_MISSING)
+        {
+          Min = Sample < Min ? Sample : Min;
+          Max = Sample > Max ? Sample : Max;
+          Sum += Sample;
+          nValid++;
+        }
+      }
+
+      int16_t Offset = updateTare(iInput, Min, Max, Sum, nValid);
+      if (Offset != 0 && nValid > 0)
+      {
+        for (int iPos=0; iPos < N_ADC_BUFFER_POS; iPos++)
+        {
+          if (ADC_buffer[iInput][iBufferComplete][iPos] != ADC_MISSING)
+          {
+            ADC_buffer[iInput][iBufferComplete][iPos] -= Offset;
+          }
+        }
+        Min -= Offset;
+        Max -= Offset;
+        Sum -= (int32_t)Offset*nValid;
+      }
+      ADC_bufferMin[iInput][iBufferComplete] = Min;
+      ADC_bufferMax[iInput][iBufferComplete] = Max;
+      ADC_bufferSum[iInput][iBufferComplete] = Sum;
+      ADC_bufferOffset[iInput][iBufferComplete] = Offset;
+    }
+    if (ADC_tareWindow > 0) {
+      ADC_tareWindow--;
+    }
+    iBufferTransmit = iBufferComplete;
+    iBufferComplete = (iBufferComplete + 1) % N_ADC_BUFFERS;
+  }
+  SCHED_Post(ADC_iTransmitTask);
+}
 
 // Start a new interupt based ADC reading.
 void ADC_StartRead()
 {
+  if (BURST_Active) {
+    return;                           // The ADC is used by a burst
+  }
   for (int iInput=iReadInput+1; iInput < N_ADC_INPUT; iInput++)
   {
     if (ADC_EnabledInputs & (1 << iInput))
@@ -41,42 +178,80 @@ void ADC_StartRead()
   }
 }
 
-// Transmit data to the remote UDP client.
-void ADC_UdpTransmit(WiFiUDP UDP_in, uint8_t iBuffer_in, IPAddress IP_in, uint16_t Port_in){
-  ADC_UdpTransmit(UDP_in, iBuffer_in, IP_in, Port_in, 'D');
+// Transmit data to the remote client.
+void ADC_Transmit(uint8_t iBuffer_in){
+  ADC_Transmit(iBuffer_in, 'D');
 }
 
-// Transmit data to the remote UDP client.
-void ADC_UdpTransmit(WiFiUDP UDP_in, uint8_t iBuffer_in, IPAddress IP_in, uint16_t Port_in, char DataType) {
-  UDP_in.beginPacket(IP_in, Port_in);
-  UDP_in.write((uint8_t)DataType);
-  UDP_in.write(iBuffer_in);
-  UDP_in.write(ADC_EnabledInputs);
+// Transmit data to the remote client.
+void ADC_Transmit(uint8_t iBuffer_in, char DataType) {
+  LINK_Begin();
+  LINK_Write((uint8_t)DataType);
+  LINK_Write(iBuffer_in);
+  LINK_Write(ADC_EnabledInputs);
+
+  // Write the summary of the buffer (min, max, sum and tare offset of each enabled input)
+  for (int iInput=0; iInput < N_ADC_INPUT; iInput++)
+  {
+    if (ADC_EnabledInputs & (0x1 << iInput))
+    {
+      LINK_Write((uint8_t)ADC_bufferMin[iInput][iBuffer_in]);
+      LINK_Write((uint8_t)(ADC_bufferMin[iInput][iBuffer_in] >> 8));
+      LINK_Write((uint8_t)ADC_bufferMax[iInput][iBuffer_in]);
+      LINK_Write((uint8_t)(ADC_bufferMax[iInput][iBuffer_in] >> 8));
+      for (int iByte=0; iByte < 4; iByte++)
+      {
+        LINK_Write((uint8_t)(ADC_bufferSum[iInput][iBuffer_in] >> (8*iByte)));
+      }
+      LINK_Write((uint8_t)ADC_bufferOffset[iInput][iBuffer_in]);
+      LINK_Write((uint8_t)(ADC_bufferOffset[iInput][iBuffer_in] >> 8));
+    }
+  }
+
+  // Write the samples
   for (int iInput=0; iInput < N_ADC_INPUT; iInput++)
   {
     if (ADC_EnabledInputs & (0x1 << iInput))
     {
       for (int iPos=0; iPos < N_ADC_BUFFER_POS; iPos++)
       {
-        UDP_in.write((uint8_t)ADC_buffer[iInput][iBuffer_in][iPos]);        // Write LSB (byte)
-        UDP_in.write((uint8_t)(ADC_buffer[iInput][iBuffer_in][iPos] >> 8)); // Write MSB (byte)
+        LINK_Write((uint8_t)ADC_buffer[iInput][iBuffer_in][iPos]);        // Write LSB (byte)
+        LINK_Write((uint8_t)(ADC_buffer[iInput][iBuffer_in][iPos] >> 8)); // Write MSB (byte)
       }
     }
   }
-  UDP_in.endPacket();
+  LINK_End();
 }
 
 // Update the buffer indexes.
 void ADC_UpdateBufferIdx(){
   if (ADC_EnabledInputs) // Only update if an ADC input is enabled
   {
+#if FR_DECIMATION > 0
+    // Start a new full rate frame, and only move to the next buffer position after FR_DECIMATION frames
+    FR_NextFrame();
+    iDecimation++;
+    if (iDecimation < FR_DECIMATION)
+    {
+      iReadInput = -1;
+      return;
+    }
+    iDecimation = 0;
+#endif
     iBufferPos++;
     if (iBufferPos == N_ADC_BUFFER_POS)
     {
-      iBufferTransmit = iBuffer;  // Initiate new UDP transmit
       iBuffer++;
       iBuffer = iBuffer % N_ADC_BUFFERS;
       iBufferPos = 0;
+      SCHED_Post(ADC_iBlockTask); // Summarize the buffer, and initiate new transmit
+#if FR_DECIMATION > 0
+      FR_bufferFrame[iBuffer] = FR_iFrame;
+#endif
+    }
+    ADC_missingPos = false;
+    if (BURST_Active) {
+      ADC_MarkMissing(0);
     }
     iReadInput = -1;  
   }
@@ -111,6 +286,7 @@ bool ADC_setGain(uint8_t Gain_in) {
       return(false);
   }
   while (ADC->STATUS.bit.SYNCBUSY) ;  // Wait for clock domain sysch
+  ADC_ScaleTare(ADC_Gain, Gain_in);   // The offsets depend on the gain
   ADC_Gain = Gain_in;
   return(true);
 }
@@ -124,7 +300,37 @@ void ADC_Handler() {
   if (sample & 0x0800) {
     sample |= 0xf000;
   }
-  ADC_buffer[iReadInput][iBuffer][iBufferPos] = (int16_t) sample;
+
+  int16_t Reading = (int16_t) sample; // The burst is triggered by the full rate sample
+
+#if FR_DECIMATION > 0
+  // Store the full rate sample in the flight recorder, and average FR_DECIMATION samples for the ADC buffer
+  FR_Write((int16_t) sample);
+  ADC_decimationSum[iReadInput] += (int16_t) sample;
+  if (iDecimation < FR_DECIMATION-1)
+  {
+    // Start an armed burst if the threshold is reached (the averages of this position are incomplete, and missing)
+    if (BURST_CheckTrigger(iReadInput, Reading))
+    {
+      ADC_MarkMissing(0);
+      return;
+    }
+    ADC_StartRead();
+    return;
+  }
+  sample = (uint16_t)(ADC_decimationSum[iReadInput] / FR_DECIMATION);
+  ADC_decimationSum[iReadInput] = 0;
+#endif
+  if (!ADC_missingPos) {
+    ADC_buffer[iReadInput][iBuffer][iBufferPos] = (int16_t) sample;
+  }
+
+  // Start an armed burst if the threshold is reached (the remaining readings of this position are missing)
+  if (BURST_CheckTrigger(iReadInput, Reading))
+  {
+    ADC_MarkMissing(iReadInput+1);
+    return;
+  }
 
   ADC_StartRead();
   
@@ -177,5 +383,8 @@ void InitADC() {
   ADC->INTFLAG.bit.RESRDY = 0x1;      // Clear ready flag
   while (ADC->STATUS.bit.SYNCBUSY) ;  // Wait for clock domain sysch  
 
+  // Summarize the complete buffers in a deferred task (outside of the interupt handlers)
+  ADC_iBlockTask = SCHED_AddTask(ADC_CompleteBlocks, "ADCblock", 0, true, ADC_BLOCK_BUDGET, SCHED_ON_POST);
+
   NVIC_EnableIRQ(ADC_IRQn);           // Register interupt function
 }
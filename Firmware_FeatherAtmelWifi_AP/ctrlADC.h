@@ -7,26 +7,50 @@
 #define CTRL_ADC_H
 
 #include <Arduino.h>
-#include <WiFi101.h>
-#include <WiFiUdp.h>
+#include "ctrlLink.h"
 
 // ADC defines
 #define REF_PIN A0                // Name of the ADC input to use for reference (ADC in differential mode)
 #define N_ADC_INPUT 5             // Number of ADC inputs
-#define N_ADC_BUFFERS 64          // Number of ADC buffers
 #define N_ADC_BUFFER_POS 16       // Number of positions in each buffer
+#define ADC_MISSING ((int16_t)0x8000) // Sample value of missing readings (e.g. during a burst)
+#define ADC_BLOCK_BUDGET 200      // Time budget of the buffer summary task [unit: us]
+#define TARE_MAX_RANGE 32         // Tare: Maximum range (max-min) of the readings of an unloaded buffer [unit: ADC codes]
+#define TARE_MAX_LOAD 64          // Tare: Maximum mean of an unloaded buffer above the offset (a faster upward drift is not tracked) [unit: ADC codes]
+#define TARE_WINDOW 16            // Tare: Buffers after 'Zx' (feet off), whose lowest unloaded buffer sets the first offset of each input
+#define TARE_SHIFT 3              // Tare: Each unloaded buffer moves the offset by 1/2^TARE_SHIFT of its distance to the buffer mean
+#define TARE_FRACTION_BITS 8      // Tare: Fraction bits of the fixed point offsets
+#ifndef FR_DECIMATION
+#define FR_DECIMATION 0           // Flight recorder: Sample at FR_DECIMATION*SAMPLE_RATE, and transmit the average of FR_DECIMATION samples (0 = disabled, e.g. 8 to enable)
+#endif
+#if FR_DECIMATION > 0
+#define N_ADC_BUFFERS 16          // Number of ADC buffers (the memory is used by the flight recorder ring)
+#else
+#define N_ADC_BUFFERS 64          // Number of ADC buffers
+#endif
 
 // Global variables
 extern uint8_t ADC_EnabledInputs; // Enabled ADC inputs
-extern uint8_t iBufferTransmit;   // Buffer number to transmit to the remote UDP client (no transmit = 0xff)
+extern uint8_t iBufferTransmit;   // Buffer number to transmit to the remote client (no transmit = 0xff)
+extern int ADC_iTransmitTask;     // Scheduler task transmitting iBufferTransmit (posted when a buffer is complete)
 extern uint8_t ADC_Gain;          // Gain setting the PGA before to the ADC.
+extern const uint8_t regInputs[N_ADC_INPUT]; // MUX regsiter values for the ADC inputs
+extern int16_t ADC_bufferMin[N_ADC_INPUT][N_ADC_BUFFERS]; // Minimum of each buffer
+extern int16_t ADC_bufferMax[N_ADC_INPUT][N_ADC_BUFFERS]; // Maximum of each buffer
+extern int32_t ADC_bufferSum[N_ADC_INPUT][N_ADC_BUFFERS]; // Sum of each buffer
+extern int16_t ADC_bufferOffset[N_ADC_INPUT][N_ADC_BUFFERS]; // Tare offset subtracted from each buffer
+extern uint8_t ADC_TareInputs;    // Inputs with automatic tare
 
 void InitADC();                   // Initialize the ADC (change apropritate registers)
 void ADC_StartRead();             // Start a new interupt based ADC reading.
 void ADC_UpdateBufferIdx();       // Update the buffer indexes.
 bool ADC_setGain(uint8_t Gain);   // Set the gain of the PGA before to the ADC.
-// Transmit data to the remote UDP client.
-void ADC_UdpTransmit(WiFiUDP UDP_in, uint8_t iBuffer_in, IPAddress IP_in, uint16_t Port_in);
-void ADC_UdpTransmit(WiFiUDP UDP_in, uint8_t iBuffer_in, IPAddress IP_in, uint16_t Port_in, char DataType);
+void ADC_MarkMissing(int iInputFirst); // Mark the readings at the current buffer position as missing (from input iInputFirst).
+void ADC_CompleteBlocks();        // Tare and summarize the complete buffers, and initiate the transmit (scheduler task).
+void ADC_SetTare(uint8_t Inputs); // Enable the automatic tare of the inputs in bit mask 'Inputs', and restart their offsets.
+void ADC_ScaleTare(uint8_t GainOld, uint8_t GainNew); // Scale the offsets to a new gain of the PGA.
+// Transmit data to the remote client.
+void ADC_Transmit(uint8_t iBuffer_in);
+void ADC_Transmit(uint8_t iBuffer_in, char DataType);
 
 #endif /* CTRL_ADC_H */
@@ -0,0 +1,252 @@
+/*
+ *
+ * Burst capture: The ADC runs free (scanning a few inputs) with DMA into RAM for a short burst at a high samplerate,
+ * started by a command or by a threshold on the regular readings. The burst is transmitted to the remote
+ * client afterwards, a packet at a time between the data packets.
+*/
+
+#include "ctrlBurst.h"
+#include "ctrlRecorder.h"
+
+extern uint8_t iBuffer;               // Buffer index (ctrlADC.cpp)
+extern int iBufferPos;                // Buffer position index (ctrlADC.cpp)
+
+int16_t BURST_buffer[BURST_SIZE];     // Burst samples (the burst inputs after each other)
+DmacDescriptor BURST_descriptor __ALIGNED(16); // DMA descriptor of the burst
+DmacDescriptor BURST_writeback __ALIGNED(16);  // DMA write-back descriptor
+volatile bool BURST_Active = false;   // true: The ADC is used by a burst
+volatile bool BURST_Armed = false;    // true: The burst starts when the threshold is reached
+volatile bool BURST_Done = false;     // true: A burst is recorded and not yet transmitted
+
+// Settings and timing of the armed (or last) burst
+uint8_t BURST_iFirstInput = 0;        // First input of the burst
+uint8_t BURST_nInputs = 0;            // Number of inputs of the burst
+uint16_t BURST_nSamples = 0;          // Number of samples of each input
+int16_t BURST_Threshold = BURST_IMMEDIATE; // Trigger threshold on the regular readings of the first input
+uint8_t BURST_Prescaler = 0;          // ADC prescaler during the burst
+uint8_t BURST_SampleLength = 0;       // ADC sample length during the burst [unit: half ADC clock cycles]
+uint8_t BURST_iBurst = 0;             // Burst number (increased for every burst)
+uint8_t BURST_iBuffer = 0;            // ADC buffer index when the burst started
+uint16_t BURST_iBufferPos = 0;        // ADC buffer position when the burst started
+unsigned long BURST_tStart = 0;       // Start time of the burst [unit: us]
+unsigned long BURST_Duration = 0;     // Duration of the burst [unit: us]
+uint8_t BURST_iSend = 0;              // Next burst packet to transmit
+unsigned long BURST_tSend = 0;        // Time of the last burst packet [unit: ms]
+
+// Number of burst packets
+static uint8_t nPackets() {
+  return((BURST_nInputs*BURST_nSamples + BURST_PACKET_SAMPLES - 1) / BURST_PACKET_SAMPLES);
+}
+
+// Initialize the DMA controller.
+void InitBurst() {
+  PM->AHBMASK.reg |= PM_AHBMASK_DMAC;
+  PM->APBBMASK.reg |= PM_APBBMASK_DMAC;
+  DMAC->BASEADDR.reg = (uint32_t)&BURST_descriptor;
+  DMAC->WRBADDR.reg = (uint32_t)&BURST_writeback;
+  DMAC->CTRL.reg = DMAC_CTRL_DMAENABLE | DMAC_CTRL_LVLEN(0xf);
+  NVIC_EnableIRQ(DMAC_IRQn);
+}
+
+// Arm a burst (see ctrlBurst.h). Returns false if the settings are invalid.
+bool BURST_Arm(uint8_t iFirstInput, uint8_t nInputs, uint16_t SampleRate, uint16_t nSamples, int16_t Threshold) {
+  if (BURST_Active || nInputs == 0 || iFirstInput < 1 || iFirstInput + nInputs - 1 > N_ADC_INPUT) {
+    return(false);
+  }
+
+  // The ADC can only scan inputs with consecutive MUX channels
+  for (int iInput=1; iInput < nInputs; iInput++)
+  {
+    if (g_APinDescription[regInputs[iFirstInput-1+iInput]].ulADCChannelNumber != g_APinDescription[regInputs[iFirstInput-1]].ulADCChannelNumber + iInput) {
+      return(false);
+    }
+  }
+
+  // Find the smallest prescaler (from DIV32, the fastest within the ADC clock specification), where the sample
+  // length gives the samplerate. A conversion takes the sample length plus the propagation delay (BURST_CONVERSION
+  // half ADC clock cycles), and one more ADC clock cycle with a gain above 1x. The host measures the actual
+  // samplerate from the duration of the burst.
+  BURST_Prescaler = ADC_CTRLB_PRESCALER_DIV32_Val;
+  BURST_SampleLength = 0;
+  if (SampleRate > 0)
+  {
+    int32_t nConversion = BURST_CONVERSION + (ADC_Gain > 1 ? 2 : 0);
+    for (uint8_t Prescaler = ADC_CTRLB_PRESCALER_DIV32_Val; Prescaler <= ADC_CTRLB_PRESCALER_DIV32_Val + 4; Prescaler++)
+    {
+      int32_t SampleLength = (int32_t)((2*BURST_ADC_CLOCK / (4 << Prescaler)) / ((uint32_t)SampleRate*nInputs)) - nConversion;
+      if (SampleLength < 0) {
+        break;                        // Faster than possible, use the maximum rate
+      }
+      BURST_Prescaler = Prescaler;
+      BURST_SampleLength = SampleLength < 63 ? SampleLength : 63;
+      if (SampleLength <= 63) {
+        break;
+      }
+    }
+  }
+
+  BURST_iFirstInput = iFirstInput;
+  BURST_nInputs = nInputs;
+  BURST_nSamples = nSamples < BURST_SIZE / nInputs ? nSamples : BURST_SIZE / nInputs;
+  BURST_Threshold = Threshold;
+  BURST_Done = false;
+  BURST_Armed = true;
+  if (Threshold == BURST_IMMEDIATE || !(ADC_EnabledInputs & (0x1 << (iFirstInput-1))))
+  {
+    __disable_irq();
+    BURST_CheckTrigger(iFirstInput-1, BURST_IMMEDIATE);
+    ADC_MarkMissing(0);
+    __enable_irq();
+  }
+  return(true);
+}
+
+// Disarm a burst that has not started.
+void BURST_Disarm() {
+  BURST_Armed = false;
+}
+
+// Start an armed burst if the threshold is reached (called from the ADC interrupt).
+// Returns true if the burst was started (the ADC must not be started for a regular reading).
+bool BURST_CheckTrigger(int iInput, int16_t Sample) {
+  if (!BURST_Armed || iInput != BURST_iFirstInput-1 || Sample < BURST_Threshold) {
+    return(false);
+  }
+  BURST_Armed = false;
+  BURST_Active = true;
+  BURST_iBurst++;
+  BURST_iBuffer = iBuffer;
+  BURST_iBufferPos = iBufferPos;
+
+  // Stop the regular readings, and set up the free running scan of the burst inputs
+  ADC->INTENCLR.bit.RESRDY = 0x1;
+  ADC->CTRLA.bit.ENABLE = 0x0;
+  while (ADC->STATUS.bit.SYNCBUSY) ;  // Wait for clock domain sysch
+  ADC->CTRLB.bit.PRESCALER = BURST_Prescaler;
+  ADC->SAMPCTRL.bit.SAMPLEN = BURST_SampleLength;
+  ADC->INPUTCTRL.bit.MUXPOS = g_APinDescription[regInputs[BURST_iFirstInput-1]].ulADCChannelNumber;
+  ADC->INPUTCTRL.bit.INPUTSCAN = BURST_nInputs - 1;
+  ADC->INPUTCTRL.bit.INPUTOFFSET = 0;
+  ADC->CTRLB.bit.FREERUN = 0x1;
+  while (ADC->STATUS.bit.SYNCBUSY) ;  // Wait for clock domain sysch
+
+  // DMA of every result to the burst buffer (the destination address is the end of the block)
+  BURST_descriptor.BTCTRL.reg = DMAC_BTCTRL_VALID | DMAC_BTCTRL_BEATSIZE_HWORD | DMAC_BTCTRL_DSTINC | DMAC_BTCTRL_BLOCKACT_NOACT;
+  BURST_descriptor.BTCNT.reg = BURST_nInputs*BURST_nSamples;
+  BURST_descriptor.SRCADDR.reg = (uint32_t)&ADC->RESULT.reg;
+  BURST_descriptor.DSTADDR.reg = (uint32_t)&BURST_buffer[BURST_nInputs*BURST_nSamples];
+  BURST_descriptor.DESCADDR.reg = 0;
+  DMAC->CHID.reg = 0;
+  DMAC->CHCTRLA.reg = 0;
+  DMAC->CHCTRLA.reg = DMAC_CHCTRLA_SWRST;
+  DMAC->CHCTRLB.reg = DMAC_CHCTRLB_TRIGSRC(ADC_DMAC_ID_RESRDY) | DMAC_CHCTRLB_TRIGACT_BEAT;
+  DMAC->CHINTENSET.reg = DMAC_CHINTENSET_TCMPL;
+  DMAC->CHCTRLA.reg = DMAC_CHCTRLA_ENABLE;
+
+  // Start the ADC
+  ADC->CTRLA.bit.ENABLE = 0x1;
+  while (ADC->STATUS.bit.SYNCBUSY) ;  // Wait for clock domain sysch
+  ADC->SWTRIG.bit.FLUSH = 0x1;        // Flush ADC memory
+  while (ADC->STATUS.bit.SYNCBUSY) ;  // Wait for clock domain sysch
+  BURST_tStart = micros();
+  ADC->SWTRIG.bit.START = 0x1;
+  return(true);
+}
+
+// DMA interupt handler (the burst is complete)
+void DMAC_Handler() {
+  DMAC->CHID.reg = 0;
+  if (DMAC->CHINTFLAG.reg & DMAC_CHINTFLAG_TCMPL)
+  {
+    BURST_Duration = micros() - BURST_tStart;
+    DMAC->CHINTFLAG.reg = DMAC_CHINTFLAG_TCMPL;
+
+    // Restore the settings of the regular readings
+    ADC->CTRLA.bit.ENABLE = 0x0;
+    while (ADC->STATUS.bit.SYNCBUSY) ;  // Wait for clock domain sysch
+    ADC->CTRLB.bit.FREERUN = 0x0;
+    ADC->CTRLB.bit.PRESCALER = ADC_CTRLB_PRESCALER_DIV64_Val;
+    ADC->SAMPCTRL.bit.SAMPLEN = 0;
+    ADC->INPUTCTRL.bit.INPUTSCAN = 0;
+    ADC->INPUTCTRL.bit.INPUTOFFSET = 0;
+    ADC->CTRLA.bit.ENABLE = 0x1;
+    while (ADC->STATUS.bit.SYNCBUSY) ;  // Wait for clock domain sysch
+    ADC->INTFLAG.bit.RESRDY = 0x1;      // Clear ready flag
+    ADC->INTENSET.bit.RESRDY = 0x1;
+
+    BURST_iSend = 0;
+    BURST_Done = true;
+    BURST_Active = false;
+  }
+}
+
+// Write a burst packet.
+// Burst format: B[iBurst][iPacket][nPackets][FirstInput][nInputs][nSamples_LSB][nSamples_MSB][Duration (4 bytes, LSB first)][iBuffer][iBufferPos_LSB][iBufferPos_MSB][Age_LSB][Age_MSB][Samples]
+static void writePacket(uint8_t iPacket) {
+  uint16_t iFirst = iPacket*BURST_PACKET_SAMPLES;
+  uint16_t nSamples = BURST_nInputs*BURST_nSamples - iFirst;
+  if (nSamples > BURST_PACKET_SAMPLES) {
+    nSamples = BURST_PACKET_SAMPLES;
+  }
+  unsigned long Age = (micros() - BURST_tStart) / 1000; // Time since the burst started, which resolves iBuffer [unit: ms]
+  if (Age > 0xffff) {
+    Age = 0xffff;
+  }
+
+  LINK_Begin();
+  LINK_Write('B');
+  LINK_Write(BURST_iBurst);
+  LINK_Write(iPacket);
+  LINK_Write(nPackets());
+  LINK_Write(BURST_iFirstInput);
+  LINK_Write(BURST_nInputs);
+  LINK_Write((uint8_t)BURST_nSamples);
+  LINK_Write((uint8_t)(BURST_nSamples >> 8));
+  for (int iByte=0; iByte < 4; iByte++)
+  {
+    LINK_Write((uint8_t)(BURST_Duration >> (8*iByte)));
+  }
+  LINK_Write(BURST_iBuffer);
+  LINK_Write((uint8_t)BURST_iBufferPos);
+  LINK_Write((uint8_t)(BURST_iBufferPos >> 8));
+  LINK_Write((uint8_t)Age);
+  LINK_Write((uint8_t)(Age >> 8));
+
+  // Convert from 12 bit to 16 bit 2-complement representation, and write the samples (little endian)
+  for (uint16_t iSample=iFirst; iSample < iFirst + nSamples; iSample++)
+  {
+    if (BURST_buffer[iSample] & 0x0800) {
+      BURST_buffer[iSample] |= 0xf000;
+    }
+  }
+  LINK_Write((const uint8_t*)&BURST_buffer[iFirst], 2*nSamples);
+  LINK_End();
+}
+
+// Transmit the next burst packet (if any).
+void BURST_Transmit() {
+  if (!BURST_Done || millis() - BURST_tSend < BURST_TRICKLE_MS) {
+    return;
+  }
+  if (BURST_iSend == 0)
+  {
+#if FR_DECIMATION > 0
+    FR_Reset();                       // The flight recorder ring was not written during the burst
+#endif
+  }
+  writePacket(BURST_iSend);
+  BURST_tSend = millis();
+  BURST_iSend++;
+  if (BURST_iSend == nPackets()) {
+    BURST_Done = false;
+  }
+}
+
+// Retransmit a packet of the last burst.
+bool BURST_Retransmit(uint8_t iPacket) {
+  if (BURST_Active || iPacket >= nPackets()) {
+    return(false);
+  }
+  writePacket(iPacket);
+  return(true);
+}
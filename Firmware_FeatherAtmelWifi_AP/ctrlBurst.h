@@ -0,0 +1,36 @@
+/*
+ *
+ * Burst capture: The ADC runs free (scanning a few inputs) with DMA into RAM for a short burst at a high samplerate,
+ * started by a command or by a threshold on the regular readings. The burst is transmitted to the remote
+ * client afterwards, a packet at a time between the data packets.
+*/
+
+#ifndef CTRL_BURST_H
+#define CTRL_BURST_H
+
+#include <Arduino.h>
+#include "ctrlADC.h"
+#include "ctrlLink.h"
+
+// Burst defines
+#define BURST_SIZE 4096           // Number of samples in the burst buffer (shared between the burst inputs)
+#define BURST_PACKET_SAMPLES 512  // Number of samples in each burst packet
+#define BURST_TRICKLE_MS 5        // Minimum time between two burst packets [unit: ms]
+#define BURST_ADC_CLOCK 48000000  // Frequency of the ADC clock before the prescaler (GCLK0) [unit: Hz]
+#define BURST_IMMEDIATE 0x7fff    // Threshold value that starts the burst immediately
+#define BURST_CONVERSION 15       // Half ADC clock cycles of a free running conversion besides the sample length: the
+                                  // sampling (SAMPLEN+1) and the propagation delay of 1 + 12/2 clock cycles (12 bit)
+
+// Global variables
+extern volatile bool BURST_Active; // true: The ADC is used by a burst (the regular readings are missing)
+
+void InitBurst();                 // Initialize the DMA controller.
+// Arm a burst of nSamples samples of nInputs consecutive inputs (starting at iFirstInput), at SampleRate Hz on each
+// input (0 = maximum rate). The burst starts when input iFirstInput reaches Threshold (BURST_IMMEDIATE = now).
+bool BURST_Arm(uint8_t iFirstInput, uint8_t nInputs, uint16_t SampleRate, uint16_t nSamples, int16_t Threshold);
+void BURST_Disarm();              // Disarm a burst that has not started.
+bool BURST_CheckTrigger(int iInput, int16_t Sample); // Start an armed burst if the threshold is reached (called from the ADC interrupt).
+void BURST_Transmit();            // Transmit the next burst packet (if any).
+bool BURST_Retransmit(uint8_t iPacket); // Retransmit a packet of the last burst.
+
+#endif /* CTRL_BURST_H */
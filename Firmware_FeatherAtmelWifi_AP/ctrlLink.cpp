@@ -0,0 +1,146 @@
+/*
+ *
+ * Link to the remote client: The packets of the protocol are written and read over WiFi (UDP) or the native USB
+ * port (CDC serial). The link of the last received command is used for all packets, so the link is selected at
+ * runtime by the client. Packets over USB are framed: [LINK_FRAME_START][Length_LSB][Length_MSB][Packet].
+*/
+
+#include "ctrlLink.h"
+
+WiFiUDP LINK_udp;                     // UDP object
+IPAddress LINK_remoteIP;              // Remote UDP client IP
+uint16_t LINK_remotePort = 0;         // Remote UDP client port number
+uint8_t LINK_Active = LINK_UDP;       // Link of the last received command
+
+// Packet being written (the frame header is reserved in front of the packet)
+uint8_t LINK_packet[3 + LINK_PACKET_SIZE];
+uint16_t LINK_nBytes = 0;             // Number of bytes in the packet
+
+// Frame being read from the USB serial port
+char LINK_usbFrame[LINK_COMMAND_SIZE]; // Packet of the frame
+uint8_t LINK_usbState = 0;            // 0: Wait for LINK_FRAME_START, 1-2: Read the length, 3: Read the packet
+uint16_t LINK_usbLength = 0;          // Length of the frame being read
+int LINK_usbPos = 0;                  // Number of bytes of the frame read
+
+// Start listening for UDP packets on Port.
+void LINK_Init(uint16_t Port) {
+  LINK_udp.begin(Port);
+}
+
+// Begin a new packet.
+void LINK_Begin() {
+  LINK_nBytes = 0;
+}
+
+// Append a byte to the packet.
+void LINK_Write(uint8_t Byte) {
+  if (LINK_nBytes < LINK_PACKET_SIZE) {
+    LINK_packet[3 + LINK_nBytes++] = Byte;
+  }
+}
+
+// Append bytes to the packet.
+void LINK_Write(const uint8_t *Bytes, size_t nBytes) {
+  if (nBytes > (size_t)(LINK_PACKET_SIZE - LINK_nBytes)) {
+    nBytes = LINK_PACKET_SIZE - LINK_nBytes;
+  }
+  memcpy(&LINK_packet[3 + LINK_nBytes], Bytes, nBytes);
+  LINK_nBytes += nBytes;
+}
+
+// Write the packet on the active link (in one write).
+void LINK_End() {
+  if (LINK_Active == LINK_USB)
+  {
+    // The packet is dropped if no client has opened the port (the client detects it from the buffer index)
+    if (Serial)
+    {
+      LINK_packet[0] = LINK_FRAME_START;
+      LINK_packet[1] = (uint8_t)LINK_nBytes;
+      LINK_packet[2] = (uint8_t)(LINK_nBytes >> 8);
+      Serial.write(LINK_packet, 3 + LINK_nBytes);
+    }
+  }
+  else
+  {
+    LINK_udp.beginPacket(LINK_remoteIP, LINK_remotePort);
+    LINK_udp.write(&LINK_packet[3], LINK_nBytes);
+    LINK_udp.endPacket();
+  }
+}
+
+// Read a frame from the USB serial port. Returns the packet size when a frame is complete (0 = no packet).
+static int readUsb(char *Buffer, int BufferSize) {
+  while (Serial.available() > 0)
+  {
+    uint8_t Byte = Serial.read();
+    switch (LINK_usbState)
+    {
+      case 0:
+        if (Byte == LINK_FRAME_START) {
+          LINK_usbState = 1;
+        }
+        break;
+
+      case 1:
+        LINK_usbLength = Byte;
+        LINK_usbState = 2;
+        break;
+
+      case 2:
+        LINK_usbLength |= (uint16_t)Byte << 8;
+        LINK_usbPos = 0;
+        LINK_usbState = LINK_usbLength > 0 && LINK_usbLength < BufferSize && LINK_usbLength <= LINK_COMMAND_SIZE ? 3 : 0;
+        break;
+
+      case 3:
+        LINK_usbFrame[LINK_usbPos++] = Byte;
+        if (LINK_usbPos == LINK_usbLength)
+        {
+          LINK_usbState = 0;
+          memcpy(Buffer, LINK_usbFrame, LINK_usbPos);
+          Buffer[LINK_usbPos] = 0;
+          return(LINK_usbPos);
+        }
+        break;
+    }
+  }
+  return(0);
+}
+
+// Read a packet (a command) from either link into Buffer (zero terminated). Returns the packet size (0 = no packet).
+int LINK_Read(char *Buffer, int BufferSize) {
+  // USB frame
+  int packetSize = readUsb(Buffer, BufferSize);
+  if (packetSize > 0)
+  {
+    LINK_Active = LINK_USB;
+    return(packetSize);
+  }
+
+  // UDP packet
+  packetSize = LINK_udp.parsePacket();
+  if (packetSize)
+  {
+    // Store the IP and Port number of the remote UDP client
+    LINK_Active = LINK_UDP;
+    LINK_remoteIP = LINK_udp.remoteIP();
+    LINK_remotePort = LINK_udp.remotePort();
+
+    // Read the packet into the Buffer
+    int len = LINK_udp.read(Buffer, BufferSize - 1);
+    Buffer[len > 0 ? len : 0] = 0; // Terminate the string
+  }
+  return(packetSize);
+}
+
+// Print the sender of the last packet on the serial port (only if the link is UDP).
+void LINK_PrintSender() {
+  if (LINK_Active == LINK_UDP)
+  {
+    Serial.print("port=");
+    Serial.print(LINK_remotePort);
+    Serial.print(", IP=");
+    Serial.println(LINK_remoteIP);
+  }
+}
@@ -0,0 +1,34 @@
+/*
+ *
+ * Link to the remote client: The packets of the protocol are written and read over WiFi (UDP) or the native USB
+ * port (CDC serial). The link of the last received command is used for all packets, so the link is selected at
+ * runtime by the client. Packets over USB are framed: [LINK_FRAME_START][Length_LSB][Length_MSB][Packet].
+*/
+
+#ifndef CTRL_LINK_H
+#define CTRL_LINK_H
+
+#include <Arduino.h>
+#include <WiFi101.h>
+#include <WiFiUdp.h>
+
+// Link defines
+#define LINK_UDP 0                // Packets are written to the remote UDP client
+#define LINK_USB 1                // Packets are written to the USB serial port
+#define LINK_FRAME_START 0xA5     // First byte of each packet frame on the USB serial port
+#define LINK_PACKET_SIZE 1088     // Maximum packet size [unit: bytes]
+#define LINK_COMMAND_SIZE 255     // Maximum command size [unit: bytes]
+
+// Global variables
+extern uint8_t LINK_Active;       // Link of the last received command (LINK_UDP or LINK_USB)
+
+void LINK_Init(uint16_t Port);    // Start listening for UDP packets on Port.
+void LINK_Begin();                // Begin a new packet.
+void LINK_Write(uint8_t Byte);    // Append a byte to the packet.
+void LINK_Write(const uint8_t *Bytes, size_t nBytes); // Append bytes to the packet.
+void LINK_End();                  // Write the packet on the active link (in one write).
+// Read a packet (a command) from either link into Buffer (zero terminated). Returns the packet size (0 = no packet).
+int LINK_Read(char *Buffer, int BufferSize);
+void LINK_PrintSender();          // Print the sender of the last packet on the serial port (only if the link is UDP).
+
+#endif /* CTRL_LINK_H */
@@ -0,0 +1,212 @@
+/*
+ *
+ * Flight recorder: Ring buffer holding the ADC readings at the full samplerate (SAMPLE_RATE*FR_DECIMATION),
+ * while the data packets ('D') are decimated to SAMPLE_RATE. Windows of the ring are transmitted on request
+ * with a windowed bulk transfer (go-back-N flow control).
+*/
+
+#include "ctrlRecorder.h"
+
+#if FR_DECIMATION > 0
+
+int16_t FR_ring[FR_RING_SIZE];        // Full rate samples (frame after frame, enabled inputs only)
+volatile uint32_t FR_iFrame = 0;      // Number of the current full rate frame
+uint32_t FR_bufferFrame[N_ADC_BUFFERS]; // Number of the first full rate frame of each ADC buffer
+volatile uint32_t FR_iFirstValid = 0; // First frame in the ring with valid samples
+uint16_t FR_iRingFrame = 0;           // Position of the current frame in the ring [unit: frames]
+uint8_t FR_iSlot = 0;                 // Index of the next sample in the current frame
+uint8_t FR_nEnabled = 1;              // Number of enabled inputs (samples in each frame)
+uint16_t FR_nRingFrames = FR_RING_SIZE; // Number of frames the ring can hold with the enabled inputs
+volatile bool FR_hold = false;        // true: The ring is not written (a bulk transfer is active)
+uint32_t FR_iHoldFrame = 0;           // Number of the frame, where the ring was held
+
+// Bulk transfer state
+uint16_t FR_TransferRing = 0;         // Position of the first frame of the transfer in the ring [unit: frames]
+uint16_t FR_TransferFrames = 0;       // Number of frames of the transfer
+uint16_t FR_PacketFrames = 0;         // Number of frames in each bulk packet
+uint16_t FR_nPackets = 0;             // Number of bulk packets of the transfer (0 = no transfer)
+uint16_t FR_iAcked = 0;               // All packets before this packet are acknowledged
+uint16_t FR_iSend = 0;                // Next packet to send
+unsigned long FR_tAck = 0;            // Time of the last acknowledge (or of the start of the transfer) [unit: ms]
+uint8_t FR_nTimeouts = 0;             // Number of timeouts since the last acknowledge progress
+
+// Count the enabled inputs
+static uint8_t nEnabledInputs() {
+  uint8_t nEnabled = 0;
+  for (int iInput=0; iInput < N_ADC_INPUT; iInput++)
+  {
+    if (ADC_EnabledInputs & (0x1 << iInput)) {
+      nEnabled++;
+    }
+  }
+  return(nEnabled > 0 ? nEnabled : 1);
+}
+
+// Stop a bulk transfer and continue writing the ring.
+static void releaseHold() {
+  FR_nPackets = 0;
+  __disable_irq();
+  if (FR_hold)
+  {
+    FR_hold = false;
+    FR_iFirstValid = FR_iFrame + 1;   // Frames recorded while the ring was held are missing
+  }
+  __enable_irq();
+}
+
+// Clear the ring (call when the enabled inputs change).
+// The current buffer position is marked missing, as its decimation sums hold samples of the previous inputs.
+void FR_Reset() {
+  __disable_irq();
+  ADC_MarkMissing(0);
+  FR_nEnabled = nEnabledInputs();
+  FR_nRingFrames = FR_RING_SIZE / FR_nEnabled;
+  FR_iRingFrame = 0;
+  FR_iSlot = 0;
+  FR_iFirstValid = FR_iFrame + 1;
+  FR_nPackets = 0;                    // Abort a running transfer
+  FR_hold = false;
+  __enable_irq();
+}
+
+// Number of frames the ring can hold with the enabled inputs.
+uint16_t FR_nFrames() {
+  return(FR_nRingFrames);
+}
+
+// Start a new full rate frame (called from the sample timer).
+void FR_NextFrame() {
+  FR_iFrame++;
+  FR_iSlot = 0;
+  if (!FR_hold)
+  {
+    FR_iRingFrame++;
+    if (FR_iRingFrame >= FR_nRingFrames) {
+      FR_iRingFrame = 0;
+    }
+  }
+}
+
+// Store a sample of the current frame (called from the ADC interrupt).
+void FR_Write(int16_t Sample) {
+  if (!FR_hold && FR_iSlot < FR_nEnabled)
+  {
+    FR_ring[FR_iRingFrame*FR_nEnabled + FR_iSlot] = Sample;
+  }
+  FR_iSlot++;
+}
+
+// Start a bulk transfer of nFrames frames, starting Offset frames after the first frame of ADC buffer iBuffer_in.
+// The ring is held (not written) until the transfer is complete, while the data packets continue. Returns false
+// if the frames are not in the ring.
+bool FR_StartTransfer(uint8_t iBuffer_in, int16_t Offset, uint16_t nFrames) {
+  if (iBuffer_in >= N_ADC_BUFFERS || nFrames == 0)
+  {
+    releaseHold();
+    return(nFrames == 0);             // nFrames = 0 aborts a running transfer
+  }
+
+  // Hold the ring (unless it is held already) and check that the requested frames are recorded and not yet overwritten
+  __disable_irq();
+  if (!FR_hold)
+  {
+    FR_hold = true;
+    FR_iHoldFrame = FR_iFrame;
+  }
+  uint32_t iLast = FR_iHoldFrame - 1; // The frame, where the ring was held, is not complete
+  uint32_t iFirst = FR_iHoldFrame - FR_nRingFrames + 1;
+  if ((int32_t)(iFirst - FR_iFirstValid) < 0) {
+    iFirst = FR_iFirstValid;
+  }
+  uint16_t iRingLast = (FR_iRingFrame + FR_nRingFrames - 1) % FR_nRingFrames;
+  __enable_irq();
+
+  uint32_t iTransferFrame = FR_bufferFrame[iBuffer_in] + Offset;
+  if ((int32_t)(iTransferFrame - iFirst) < 0 || (int32_t)(iLast - (iTransferFrame + nFrames - 1)) < 0)
+  {
+    releaseHold();
+    return(false);
+  }
+
+  // Position of the first frame in the ring (the last complete frame is at iRingLast)
+  FR_TransferRing = (iRingLast + FR_nRingFrames - (iLast - iTransferFrame)) % FR_nRingFrames;
+  FR_TransferFrames = nFrames;
+  FR_PacketFrames = FR_PACKET_BYTES / (2*FR_nEnabled);
+  FR_nPackets = (nFrames + FR_PacketFrames - 1) / FR_PacketFrames;
+  FR_iAcked = 0;
+  FR_iSend = 0;
+  FR_tAck = millis();
+  FR_nTimeouts = 0;
+  return(true);
+}
+
+// All bulk packets before iPacket are received.
+void FR_Acknowledge(uint16_t iPacket) {
+  if (FR_nPackets == 0 || iPacket <= FR_iAcked) {
+    return;
+  }
+  FR_iAcked = iPacket < FR_nPackets ? iPacket : FR_nPackets;
+  if (FR_iSend < FR_iAcked) {
+    FR_iSend = FR_iAcked;
+  }
+  FR_tAck = millis();
+  FR_nTimeouts = 0;
+
+  // Release the ring when the transfer is complete
+  if (FR_iAcked == FR_nPackets) {
+    releaseHold();
+  }
+}
+
+// Transmit the next bulk packet (if any).
+// Bulk format: R[iPacket_LSB][iPacket_MSB][nPackets_LSB][nPackets_MSB][EnabledInputs][Frames]
+void FR_Transmit() {
+  if (FR_nPackets == 0) {
+    return;
+  }
+
+  // Go back to the first unacknowledged packet, if the acknowledge is late, and abort the transfer if the remote
+  // client stopped acknowledging (e.g. it disconnected), so the ring is not held forever
+  if (millis() - FR_tAck > FR_TIMEOUT)
+  {
+    FR_nTimeouts++;
+    if (FR_nTimeouts >= FR_MAX_TIMEOUTS)
+    {
+      releaseHold();
+      return;
+    }
+    FR_iSend = FR_iAcked;
+    FR_tAck = millis();
+  }
+  if (FR_iSend >= FR_nPackets || FR_iSend >= FR_iAcked + FR_WINDOW) {
+    return;
+  }
+
+  uint16_t iFrame = FR_iSend*FR_PacketFrames;
+  uint16_t nFrames = FR_TransferFrames - iFrame;
+  if (nFrames > FR_PacketFrames) {
+    nFrames = FR_PacketFrames;
+  }
+  uint16_t iRing = (FR_TransferRing + iFrame) % FR_nRingFrames;
+
+  LINK_Begin();
+  LINK_Write('R');
+  LINK_Write((uint8_t)FR_iSend);
+  LINK_Write((uint8_t)(FR_iSend >> 8));
+  LINK_Write((uint8_t)FR_nPackets);
+  LINK_Write((uint8_t)(FR_nPackets >> 8));
+  LINK_Write(ADC_EnabledInputs);
+  for (uint16_t iPacketFrame=0; iPacketFrame < nFrames; iPacketFrame++)
+  {
+    // Write the frame in one call (the ring holds the samples in little endian byte order)
+    LINK_Write((const uint8_t*)&FR_ring[iRing*FR_nEnabled], 2*FR_nEnabled);
+    iRing++;
+    if (iRing >= FR_nRingFrames) {
+      iRing = 0;
+    }
+  }
+  LINK_End();
+  FR_iSend++;
+}
+
+#endif /* FR_DECIMATION > 0 */
@@ -0,0 +1,39 @@
+/*
+ *
+ * Flight recorder: Ring buffer holding the ADC readings at the full samplerate (SAMPLE_RATE*FR_DECIMATION),
+ * while the data packets ('D') are decimated to SAMPLE_RATE. Windows of the ring are transmitted on request
+ * with a windowed bulk transfer (go-back-N flow control).
+*/
+
+#ifndef CTRL_RECORDER_H
+#define CTRL_RECORDER_H
+
+#include <Arduino.h>
+#include "ctrlADC.h"
+#include "ctrlLink.h"
+
+#if FR_DECIMATION > 0
+
+// Flight recorder defines
+#define FR_RING_SIZE 4096         // Number of samples in the ring (shared between the enabled inputs)
+#define FR_PACKET_BYTES 1024      // Maximum number of sample bytes in each bulk packet
+#define FR_WINDOW 8               // Number of bulk packets sent before an acknowledge is required
+#define FR_TIMEOUT 50             // Time before unacknowledged bulk packets are retransmitted [unit: ms]
+#define FR_MAX_TIMEOUTS 40        // Number of timeouts without acknowledge progress before the transfer is aborted (and the ring released)
+
+// Global variables
+extern volatile uint32_t FR_iFrame;              // Number of the current full rate frame (one sample of each enabled input)
+extern uint32_t FR_bufferFrame[N_ADC_BUFFERS];   // Number of the first full rate frame of each ADC buffer
+
+void FR_Reset();                  // Clear the ring (call when the enabled inputs change).
+void FR_NextFrame();              // Start a new full rate frame (called from the sample timer).
+void FR_Write(int16_t Sample);    // Store a sample of the current frame (called from the ADC interrupt).
+uint16_t FR_nFrames();            // Number of frames the ring can hold with the enabled inputs.
+// Start a bulk transfer of nFrames frames, starting Offset frames after the first frame of ADC buffer iBuffer_in.
+bool FR_StartTransfer(uint8_t iBuffer_in, int16_t Offset, uint16_t nFrames);
+void FR_Acknowledge(uint16_t iPacket); // All bulk packets before iPacket are received.
+void FR_Transmit();               // Transmit the next bulk packet (if any).
+
+#endif /* FR_DECIMATION > 0 */
+
+#endif /* CTRL_RECORDER_H */
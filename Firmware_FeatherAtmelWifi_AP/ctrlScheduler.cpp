@@ -0,0 +1,172 @@
+/*
+ *
+ * Cooperative run-to-completion task scheduler. Deferred tasks are posted from interrupt handlers and run from the
+ * PendSV interrupt (below all other interrupts, above loop()), while loop tasks run from loop() when they are posted
+ * or their period has elapsed. Ready tasks run in priority order, and the latency, run time and budget overruns of
+ * each task are recorded.
+*/
+
+#include "ctrlScheduler.h"
+
+// Task settings, state and statistics
+struct SCHED_Task {
+  SCHED_TaskFunction Function;        // Task function
+  const char *Name;                   // Task name
+  uint8_t Priority;                   // Priority (0 is the highest)
+  bool Deferred;                      // true: Run from PendSV, false: Run from loop()
+  uint16_t Budget;                    // Expected maximum run time [unit: us]
+  uint16_t Period;                    // Period of the task [unit: ms, SCHED_ON_POST: only run when posted]
+  volatile bool Ready;                // true: The task is posted (or due), and has not run yet
+  volatile unsigned long tPosted;     // Time the task was posted [unit: us]
+  unsigned long tPeriod;              // Time of the last periodic run [unit: ms]
+  uint32_t nRuns;                     // Number of runs
+  uint16_t nOverruns;                 // Number of runs longer than the budget
+  uint16_t MaxLatency;                // Maximum time from post to start [unit: us]
+  uint16_t MaxRunTime;                // Maximum run time [unit: us]
+};
+
+SCHED_Task SCHED_tasks[SCHED_MAX_TASKS]; // Tasks
+uint8_t SCHED_nTasks = 0;             // Number of tasks
+
+// Saturate a time to 16 bit.
+static uint16_t saturate(unsigned long Time) {
+  return(Time < 0xffff ? (uint16_t)Time : 0xffff);
+}
+
+// Run the ready tasks (deferred or loop tasks) in priority order, each at most once.
+static void runReady(bool Deferred) {
+  uint8_t mRun = 0;                   // Tasks, that have run
+  while (true)
+  {
+    // Find the ready task with the highest priority
+    int iRun = -1;
+    for (int iTask=0; iTask < SCHED_nTasks; iTask++)
+    {
+      if (SCHED_tasks[iTask].Ready && SCHED_tasks[iTask].Deferred == Deferred && !(mRun & (0x1 << iTask)) &&
+          (iRun < 0 || SCHED_tasks[iTask].Priority < SCHED_tasks[iRun].Priority)) {
+        iRun = iTask;
+      }
+    }
+    if (iRun < 0) {
+      return;
+    }
+    mRun |= 0x1 << iRun;
+
+    // Run the task (a post while the task runs makes it ready again)
+    SCHED_Task &Task = SCHED_tasks[iRun];
+    __disable_irq();
+    Task.Ready = false;
+    unsigned long tPosted = Task.tPosted;
+    __enable_irq();
+    unsigned long tStart = micros();
+    Task.Function();
+    unsigned long RunTime = micros() - tStart;
+
+    // Update the statistics
+    Task.nRuns++;
+    if (saturate(tStart - tPosted) > Task.MaxLatency) {
+      Task.MaxLatency = saturate(tStart - tPosted);
+    }
+    if (saturate(RunTime) > Task.MaxRunTime) {
+      Task.MaxRunTime = saturate(RunTime);
+    }
+    if (RunTime > Task.Budget && Task.nOverruns < 0xffff) {
+      Task.nOverruns++;
+    }
+  }
+}
+
+// Add a task (see ctrlScheduler.h).
+int SCHED_AddTask(SCHED_TaskFunction Function, const char *Name, uint8_t Priority, bool Deferred, uint16_t Budget, uint16_t Period) {
+  if (SCHED_nTasks >= SCHED_MAX_TASKS) {
+    return(-1);
+  }
+  SCHED_Task &Task = SCHED_tasks[SCHED_nTasks];
+  Task.Function = Function;
+  Task.Name = Name;
+  Task.Priority = Priority;
+  Task.Deferred = Deferred;
+  Task.Budget = Budget;
+  Task.Period = Period;
+  Task.Ready = false;
+  Task.tPeriod = millis();
+  Task.nRuns = 0;
+  Task.nOverruns = 0;
+  Task.MaxLatency = 0;
+  Task.MaxRunTime = 0;
+
+  // PendSV runs the deferred tasks below all other interrupts
+  NVIC_SetPriority(PendSV_IRQn, 0xff);
+  return(SCHED_nTasks++);
+}
+
+// Make a task ready (can be called from interrupt handlers).
+void SCHED_Post(int iTask) {
+  if (iTask < 0 || iTask >= SCHED_nTasks) {
+    return;
+  }
+  __disable_irq();
+  if (!SCHED_tasks[iTask].Ready)
+  {
+    SCHED_tasks[iTask].tPosted = micros();
+    SCHED_tasks[iTask].Ready = true;
+  }
+  __enable_irq();
+  if (SCHED_tasks[iTask].Deferred) {
+    SCB->ICSR = SCB_ICSR_PENDSVSET_Msk;
+  }
+}
+
+// Run the ready loop tasks (called from loop()).
+void SCHED_Run() {
+  // Make the periodic tasks ready, when their period has elapsed
+  unsigned long tNow = millis();
+  for (int iTask=0; iTask < SCHED_nTasks; iTask++)
+  {
+    SCHED_Task &Task = SCHED_tasks[iTask];
+    if (Task.Period != SCHED_ON_POST && tNow - Task.tPeriod >= Task.Period)
+    {
+      Task.tPeriod = tNow;
+      SCHED_Post(iTask);
+    }
+  }
+  runReady(false);
+}
+
+// PendSV interupt handler (runs the deferred tasks)
+void PendSV_Handler() {
+  runReady(true);
+}
+
+// Transmit the task statistics, and restart the maxima.
+// Scheduler format: I[nTasks][Task statistics of each task]
+// Task statistics format: [Name (SCHED_NAME_LENGTH chars)][Priority][Deferred][Budget (2 bytes)][nRuns (4 bytes)][nOverruns (2 bytes)][MaxLatency (2 bytes)][MaxRunTime (2 bytes)]
+void SCHED_TransmitStats() {
+  LINK_Begin();
+  LINK_Write('I');
+  LINK_Write(SCHED_nTasks);
+  for (int iTask=0; iTask < SCHED_nTasks; iTask++)
+  {
+    SCHED_Task &Task = SCHED_tasks[iTask];
+    char Name[SCHED_NAME_LENGTH];
+    strncpy(Name, Task.Name, SCHED_NAME_LENGTH);
+    LINK_Write((const uint8_t*)Name, SCHED_NAME_LENGTH);
+    LINK_Write(Task.Priority);
+    LINK_Write((uint8_t)Task.Deferred);
+    LINK_Write((uint8_t)Task.Budget);
+    LINK_Write((uint8_t)(Task.Budget >> 8));
+    for (int iByte=0; iByte < 4; iByte++)
+    {
+      LINK_Write((uint8_t)(Task.nRuns >> (8*iByte)));
+    }
+    LINK_Write((uint8_t)Task.nOverruns);
+    LINK_Write((uint8_t)(Task.nOverruns >> 8));
+    LINK_Write((uint8_t)Task.MaxLatency);
+    LINK_Write((uint8_t)(Task.MaxLatency >> 8));
+    LINK_Write((uint8_t)Task.MaxRunTime);
+    LINK_Write((uint8_t)(Task.MaxRunTime >> 8));
+    Task.MaxLatency = 0;
+    Task.MaxRunTime = 0;
+  }
+  LINK_End();
+}
@@ -0,0 +1,30 @@
+/*
+ *
+ * Cooperative run-to-completion task scheduler. Deferred tasks are posted from interrupt handlers and run from the
+ * PendSV interrupt (below all other interrupts, above loop()), while loop tasks run from loop() when they are posted
+ * or their period has elapsed. Ready tasks run in priority order, and the latency, run time and budget overruns of
+ * each task are recorded.
+*/
+
+#ifndef CTRL_SCHEDULER_H
+#define CTRL_SCHEDULER_H
+
+#include <Arduino.h>
+#include "ctrlLink.h"
+
+// Scheduler defines
+#define SCHED_MAX_TASKS 8         // Maximum number of tasks
+#define SCHED_NAME_LENGTH 8       // Number of characters of the task names in the status packet
+#define SCHED_ON_POST 0           // Period of tasks, which only run when they are posted
+
+typedef void (*SCHED_TaskFunction)(); // Task function (must run to completion within the budget of the task)
+
+// Add a task (Priority 0 is the highest). Deferred tasks run from PendSV, other tasks from SCHED_Run() in loop().
+// The task runs every Period ms, or only when posted (SCHED_ON_POST). Budget is the expected maximum run time
+// [unit: us]. Returns the task index (used by SCHED_Post), or -1 if there are too many tasks.
+int SCHED_AddTask(SCHED_TaskFunction Function, const char *Name, uint8_t Priority, bool Deferred, uint16_t Budget, uint16_t Period);
+void SCHED_Post(int iTask);       // Make a task ready (can be called from interrupt handlers).
+void SCHED_Run();                 // Run the ready loop tasks (called from loop()).
+void SCHED_TransmitStats();       // Transmit the task statistics, and restart the maxima.
+
+#endif /* CTRL_SCHEDULER_H */
@@ -0,0 +1,129 @@
+/*
+ *
+ * Sync pulse input: The edges of an external sync pulse (e.g. from a treadmill, a force plate or a camera) on
+ * SYNC_PIN are routed from the external interrupt controller (EIC) through the event system (EVSYS) to a capture
+ * channel of the sample timer (TC3). The timer count is captured by hardware (one timer tick, 1.3 us), without an
+ * interrupt of its own: the sample timer interrupt picks up the capture, and the edge is transmitted as an event
+ * record with its position in the sample stream.
+*/
+
+#include "ctrlSync.h"
+#include "wiring_private.h"
+
+extern uint8_t iBuffer;               // Buffer index (ctrlADC.cpp)
+extern int iBufferPos;                // Buffer position index (ctrlADC.cpp)
+#if FR_DECIMATION > 0
+extern uint8_t iDecimation;           // Index of the full rate sample in the current buffer position (ctrlADC.cpp)
+#endif
+
+// Position of an edge in the sample stream
+struct SYNC_Event {
+  uint8_t iBuffer;                    // ADC buffer index
+  uint16_t iBufferPos;                // ADC buffer position
+  uint16_t Fraction;                  // Time from the start of the sample to the edge [unit: 1/65536 sample period]
+};
+
+SYNC_Event SYNC_events[SYNC_N_EVENTS]; // Last events (event iEvent is kept at iEvent % SYNC_N_EVENTS)
+volatile uint8_t SYNC_iNext = 0;      // Number of the next event
+uint8_t SYNC_iSend = 0;               // Number of the next event to transmit
+
+// Route the edges on SYNC_PIN to the capture channel of the sample timer (before startTimer()).
+void InitSync() {
+  // Clock the EIC (edge detection) and the event system
+  REG_GCLK_CLKCTRL = (uint16_t) (GCLK_CLKCTRL_CLKEN | GCLK_CLKCTRL_GEN_GCLK0 | GCLK_CLKCTRL_ID_EIC);
+  while (GCLK->STATUS.bit.SYNCBUSY);  // Wait for clock domain sysch
+  PM->APBCMASK.reg |= PM_APBCMASK_EVSYS;
+
+  // Generate an event (no interrupt) on the edges of the external interrupt line of SYNC_PIN
+  pinPeripheral(SYNC_PIN, PIO_EXTINT);
+  EIC->INTENCLR.reg = EIC_INTENCLR_EXTINT(1 << SYNC_EXTINT);
+  EIC->CONFIG[SYNC_EXTINT/8].reg = (EIC->CONFIG[SYNC_EXTINT/8].reg & ~(EIC_CONFIG_SENSE0_Msk << (4*(SYNC_EXTINT % 8)))) |
+                                   (SYNC_SENSE << (4*(SYNC_EXTINT % 8)));
+  EIC->EVCTRL.reg |= EIC_EVCTRL_EXTINTEO(1 << SYNC_EXTINT);
+  EIC->CTRL.reg |= EIC_CTRL_ENABLE;
+  while (EIC->STATUS.bit.SYNCBUSY);   // Wait for clock domain sysch
+
+  // Route the event to the sample timer (the asynchronous path adds no delay)
+  EVSYS->USER.reg = (uint16_t) (EVSYS_USER_CHANNEL(SYNC_EVSYS_CHANNEL + 1) | EVSYS_USER_USER(EVSYS_ID_USER_TC3_EVU));
+  EVSYS->CHANNEL.reg = EVSYS_CHANNEL_CHANNEL(SYNC_EVSYS_CHANNEL) | EVSYS_CHANNEL_EVGEN(EVSYS_ID_GEN_EIC_EXTINT_0 + SYNC_EXTINT) |
+                       EVSYS_CHANNEL_PATH_ASYNCHRONOUS | EVSYS_CHANNEL_EDGSEL_NO_EVT_OUTPUT;
+}
+
+// Record a captured edge (see ctrlSync.h). The edge is in the timer tick that ended with this interrupt, unless it
+// was captured after the compare match that started the interrupt (Capture <= Count). The interrupt latency is
+// nearly constant, so an edge captured that early in the previous tick was picked up by the previous interrupt.
+void SYNC_Capture(uint16_t Capture, uint16_t Count, uint16_t Top) {
+  if (!ADC_EnabledInputs) {
+    return;                           // The buffer indexes are not updated
+  }
+  uint32_t TickLength = (uint32_t)Top + 1;
+  uint32_t Ticks = Capture;           // Timer ticks from the start of the buffer position
+#if FR_DECIMATION > 0
+  uint32_t SampleTicks = TickLength*FR_DECIMATION;
+  Ticks += iDecimation*TickLength;
+#else
+  uint32_t SampleTicks = TickLength;
+#endif
+  uint8_t Buffer = iBuffer;
+  uint16_t Pos = iBufferPos;
+  if (Capture <= Count) {
+    Ticks += TickLength;
+  }
+  if (Ticks >= SampleTicks)
+  {
+    Ticks -= SampleTicks;
+    if (++Pos == N_ADC_BUFFER_POS)
+    {
+      Pos = 0;
+      Buffer = (Buffer + 1) % N_ADC_BUFFERS;
+    }
+  }
+
+  SYNC_Event &Event = SYNC_events[SYNC_iNext % SYNC_N_EVENTS];
+  Event.iBuffer = Buffer;
+  Event.iBufferPos = Pos;
+  Event.Fraction = (uint16_t)((Ticks << 16) / SampleTicks);
+  SYNC_iNext++;
+}
+
+// Write an event record.
+// Sync format: Y[iEvent][iBuffer][iBufferPos_LSB][iBufferPos_MSB][Fraction_LSB][Fraction_MSB]
+static void transmitEvent(uint8_t iEvent) {
+  SYNC_Event &Event = SYNC_events[iEvent % SYNC_N_EVENTS];
+  LINK_Begin();
+  LINK_Write('Y');
+  LINK_Write(iEvent);
+  LINK_Write(Event.iBuffer);
+  LINK_Write((uint8_t)Event.iBufferPos);
+  LINK_Write((uint8_t)(Event.iBufferPos >> 8));
+  LINK_Write((uint8_t)Event.Fraction);
+  LINK_Write((uint8_t)(Event.Fraction >> 8));
+  LINK_End();
+}
+
+// Transmit the recorded events (scheduler task). An event is transmitted when its buffer is complete, so the data
+// packet of the buffer is written before it.
+void SYNC_Transmit() {
+  __disable_irq();
+  uint8_t iNext = SYNC_iNext;
+  __enable_irq();
+  if ((uint8_t)(iNext - SYNC_iSend) > SYNC_N_EVENTS) {
+    SYNC_iSend = iNext - SYNC_N_EVENTS; // The older events are overwritten
+  }
+  while (SYNC_iSend != iNext && SYNC_events[SYNC_iSend % SYNC_N_EVENTS].iBuffer != iBuffer)
+  {
+    transmitEvent(SYNC_iSend);
+    SYNC_iSend++;
+  }
+}
+
+// Retransmit an event, if it is still kept.
+bool SYNC_Retransmit(uint8_t iEvent) {
+  uint8_t iNext = SYNC_iNext;
+  if ((uint8_t)(SYNC_iSend - iEvent) == 0 || (uint8_t)(SYNC_iSend - iEvent) > SYNC_N_EVENTS ||
+      (uint8_t)(iNext - iEvent) > SYNC_N_EVENTS) {
+    return(false);
+  }
+  transmitEvent(iEvent);
+  return(true);
+}
@@ -0,0 +1,31 @@
+/*
+ *
+ * Sync pulse input: The edges of an external sync pulse (e.g. from a treadmill, a force plate or a camera) on
+ * SYNC_PIN are routed from the external interrupt controller (EIC) through the event system (EVSYS) to a capture
+ * channel of the sample timer (TC3). The timer count is captured by hardware (one timer tick, 1.3 us), without an
+ * interrupt of its own: the sample timer interrupt picks up the capture, and the edge is transmitted as an event
+ * record with its position in the sample stream.
+*/
+
+#ifndef CTRL_SYNC_H
+#define CTRL_SYNC_H
+
+#include <Arduino.h>
+#include "ctrlADC.h"
+#include "ctrlLink.h"
+
+// Sync defines
+#define SYNC_PIN 11               // Pin of the sync pulse input (PA16)
+#define SYNC_EXTINT 0             // External interrupt line of SYNC_PIN (EXTINT[0])
+#define SYNC_EVSYS_CHANNEL 0      // Event system channel from the EIC to the sample timer
+#define SYNC_SENSE EIC_CONFIG_SENSE0_RISE_Val // Timestamped edges (EIC_CONFIG_SENSE0_BOTH_Val: both edges)
+#define SYNC_N_EVENTS 16          // Number of events kept for retransmits
+
+void InitSync();                  // Route the edges on SYNC_PIN to the capture channel of the sample timer (before startTimer()).
+// Record a captured edge (called from the sample timer interrupt, before the buffer indexes are updated). Capture and
+// Count are the captured and the current timer count, and Top the compare value of the timer.
+void SYNC_Capture(uint16_t Capture, uint16_t Count, uint16_t Top);
+void SYNC_Transmit();             // Transmit the recorded events (scheduler task).
+bool SYNC_Retransmit(uint8_t iEvent); // Retransmit an event, if it is still kept.
+
+#endif /* CTRL_SYNC_H */
@@ -5,8 +5,17 @@
 
 #include "ctrlTimer.h" 
 #include "ctrlADC.h"
+#include "ctrlSync.h"
 
 TcCount16* TC = (TcCount16*) TC3;   // Timer object (e.g. TC3)
+uint16_t TIMER_Top = 0;             // Compare value of the timer (the count restarts after it)
+
+// Read a read-synchronized 16 bit register of the timer (COUNT or CCx).
+static uint16_t readSynced(volatile uint16_t *Register) {
+  TC->READREQ.reg = TC_READREQ_RREQ | TC_READREQ_ADDR((uint32_t)Register - (uint32_t)TC);
+  while (TC->STATUS.bit.SYNCBUSY);    // Wait for clock domain sysch
+  return(*Register);
+}
 
 // Timer interupt handler
 void TC3_Handler() {
@@ -16,6 +25,14 @@ void TC3_Handler() {
     // Clear interupt flag
     TC->INTFLAG.bit.MC0 = 1;
 
+    // Pick up a captured sync pulse edge (before the buffer indexes move on)
+    if (TC->INTFLAG.bit.MC1 == 1)
+    {
+      uint16_t Capture = readSynced(&TC->CC[1].reg);
+      TC->INTFLAG.reg = TC_INTFLAG_MC1;
+      SYNC_Capture(Capture, readSynced(&TC->COUNT.reg), TIMER_Top);
+    }
+
     // Start a new ADC read
     ADC_UpdateBufferIdx();
     ADC_StartRead();
@@ -33,6 +50,7 @@ void setTimerFrequency(int frequencyHz) {
   
   // Set counter compare register
   TC->CC[0].reg = compareValue;
+  TIMER_Top = compareValue;
   while (TC->STATUS.bit.SYNCBUSY == 1); // Wait for clock domain sysch
 }
 
@@ -53,8 +71,17 @@ void startTimer(int frequencyHz) {
   TC->CTRLA.reg |= TC_CTRLA_WAVEGEN_MFRQ;
   while (TC->STATUS.bit.SYNCBUSY);    // Wait for clock domain sysch
 
-  // Set prescaler to 1024
+  // Set prescaler to TIMER_PRESCALER_DIV
+#if TIMER_PRESCALER_DIV == 64
+  TC->CTRLA.reg |= TC_CTRLA_PRESCALER_DIV64;
+#else
   TC->CTRLA.reg |= TC_CTRLA_PRESCALER_DIV1024;
+#endif
+  while (TC->STATUS.bit.SYNCBUSY);    // Wait for clock domain sysch
+
+  // Capture the count on channel 1 at the sync pulse events (channel 0 holds the compare value of the match mode)
+  TC->EVCTRL.reg |= TC_EVCTRL_TCEI | TC_EVCTRL_EVACT_OFF;
+  TC->CTRLC.reg |= TC_CTRLC_CPTEN1;
   while (TC->STATUS.bit.SYNCBUSY);    // Wait for clock domain sysch
 
   // Set timer frequency
@@ -8,8 +8,13 @@
 #define CTRL_TIMER_H
 
 #include <Arduino.h>
+#include "ctrlADC.h"
 
-#define TIMER_PRESCALER_DIV 1024          // Timer clock scaler.
+#if FR_DECIMATION > 0
+#define TIMER_PRESCALER_DIV 64            // Timer clock scaler (resolution of the kHz samplerates of the flight recorder).
+#else
+#define TIMER_PRESCALER_DIV 1024          // Timer clock scaler
+#endif
 #define CPU_HZ 48000000                   // CPU clock frequency
 
 void setTimerFrequency(int frequencyHz);  // Change the timer frequency
@@ -0,0 +1,1159 @@
+
+%
+% >>Description<<
+% Benchmarks of the WiFiUDPlogger class, using the FeatherEmulator class instead of the Arduino Feather board.
+% Each section can be run on its own (Ctrl+Enter).
+%
+
+%% Gap imputation on loss-injected recordings
+rng(0);
+Emu = FeatherEmulator;
+obj = WiFiUDPlogger;
+obj.ADCsamplerate = Emu.SampleRate;
+Truth = generateSignal(Emu, 600*Emu.SampleRate);
+StepsTruth = detectSteps(obj, 1, Truth);
+
+for LossRate = [0.01 0.05 0.1 0.2]
+    DataLost = injectLoss(Emu, Truth, LossRate);
+
+    % Previous behaviour: zero the missing samples
+    DataZero = DataLost;
+    DataZero(isnan(DataZero)) = 0;
+    StepsZero = detectSteps(obj, 1, DataZero);
+
+    tic;
+    [DataImputed, mValid] = imputeGaps(obj, DataLost);
+    tImpute = toc;
+    StepsImputed = detectSteps(obj, 1, DataImputed);
+
+    mFilled = ~mValid & ~isnan(DataImputed);
+    RMSE = sqrt(mean((DataImputed(mFilled) - Truth(mFilled)).^2));
+    fprintf('Loss %4.1f%%: filled %5.1f%% of lost samples, RMSE %0.3f V, %0.2f us/sample, steps detected %i/%i (zero fill: %i)\n', ...
+        LossRate*100, 100*nnz(mFilled)/nnz(~mValid), RMSE, tImpute/nnz(mFilled)*1e6, ...
+        length(StepsImputed.iOnset), length(StepsTruth.iOnset), length(StepsZero.iOnset));
+end
+
+% The steps are detected once per input, so the cost per filled sample does not depend on the length of the recording
+for Duration = [60 600]
+    DataLost = injectLoss(Emu, Truth(:,1:Duration*Emu.SampleRate), 0.1);
+    tic;
+    [DataImputed, mValid] = imputeGaps(obj, DataLost);
+    fprintf('%i s recording: %0.2f us/filled sample\n', Duration, toc/nnz(~mValid & ~isnan(DataImputed))*1e6);
+end
+
+%% Ingest rate on a replayed session (packets/s)
+rng(0);
+Emu = FeatherEmulator;
+Packets = generatePackets(Emu, generateSignal(Emu, 300*Emu.SampleRate), 0.02);
+
+obj = decodePacket(WiFiUDPlogger, Packets{1});
+obj = clearData(obj);
+tic;
+for iPacket = 2:length(Packets)
+    obj = decodePacket(obj, Packets{iPacket});
+end
+tDecode = toc;
+
+tic;
+[DataLegacy, TimeAxisLegacy] = legacyDecode(Packets);
+tLegacy = toc;
+
+mCompare = ~isnan(obj.Data(:,1:size(DataLegacy,2)));
+fprintf('Vectorised: %0.0f packets/s, legacy: %0.0f packets/s, max. difference %g V\n', ...
+    (length(Packets)-1)/tDecode, (length(Packets)-1)/tLegacy, max(abs(obj.Data(mCompare) - DataLegacy(mCompare))));
+
+% The block summaries are kept by the imputation at the end of recordData
+obj = imputeData(obj);
+if isempty(obj.BlockSummary.Min) || all(isnan(obj.BlockSummary.Min(:)))
+    error('Benchmark: The block summaries were lost by imputeData.');
+end
+fprintf('Block summaries after imputation: %i blocks\n', size(obj.BlockSummary.Min,2));
+
+%% Live plot load at 1 kHz x 8 channels (fraction of real time spent on decoding, filtering and drawing)
+rng(0);
+Emu = FeatherEmulator;
+Emu.SampleRate = 1000;
+Emu.nADCinput = 8;
+Emu.EnabledInputs = 255;
+Duration = 60;
+Packets = generatePackets(Emu, generateSignal(Emu, Duration*Emu.SampleRate), 0.02);
+
+obj = decodePacket(WiFiUDPlogger, Packets{1});
+obj = clearData(obj);
+[b_Notch, a_Notch] = iirnotch(50/obj.ADCsamplerate*2, obj.bandwidthNotch/obj.ADCsamplerate*2);
+Live = initLive(obj, b_Notch, a_Notch);
+[Live.b_BandPass, Live.a_BandPass] = butter(4, obj.freqBandpass/obj.ADCsamplerate*2);
+Live.Notch = true;
+Live.Bandpass = true;
+Live = resetLive(obj, Live);
+
+hFig = figure;
+hAxis = gca;
+hLines = line(nan(2,Emu.nADCinput), nan(2,Emu.nADCinput));
+ylim(hAxis, obj.LiveYlims);
+
+tAppend = 0;
+tDraw = 0;
+nFrames = 0;
+nPacketsPerFrame = round(Emu.SampleRate/Emu.nADCbufferPos/obj.LiveFrameRate);
+for iPacket = 2:length(Packets)
+    tStart = tic;
+    obj = decodePacket(obj, Packets{iPacket});
+    Live = appendLive(obj, Live);
+    tAppend = tAppend + toc(tStart);
+    if mod(iPacket, nPacketsPerFrame) == 0
+        tStart = tic;
+        drawLive(obj, Live, hAxis, hLines);
+        drawnow;
+        tDraw = tDraw + toc(tStart);
+        nFrames = nFrames + 1;
+    end
+end
+close(hFig);
+fprintf('Decode+filter: %0.1f%% of real time, draw: %0.1f ms/frame at %i frames/s = %0.1f%% of real time\n', ...
+    100*tAppend/Duration, 1e3*tDraw/nFrames, obj.LiveFrameRate, 100*tDraw/nFrames*obj.LiveFrameRate);
+
+%% Derived-data cache on a repeated analysis workload (hit rate and speedup)
+rng(0);
+Emu = FeatherEmulator;
+obj = WiFiUDPlogger;
+obj.ADCsamplerate = Emu.SampleRate;
+obj.Data = generateSignal(Emu, 20*60*Emu.SampleRate);
+Cache = DerivedCache(fullfile(tempdir, 'WiFiUDPlogger_benchmark_cache'));
+clear(Cache);
+
+% Typical notebook: a few filter settings, rerun after each edit of the notebook, and once after a short part of
+% the recording was changed (e.g. a patched gap).
+Configs = {struct('freqBandpass', [0.1 45]), struct('freqBandpass', [1 20]), struct('freqBandpass', [0.1 45], 'freqNotch', [])};
+tUncached = zeros(1, length(Configs));
+for iConfig = 1:length(Configs)
+    [~, Stats] = processData(obj, Configs{iConfig});
+    tUncached(iConfig) = Stats.tElapsed;
+end
+for iRun = 1:4
+    if iRun == 4
+        iChanged = 5*60*Emu.SampleRate + (1:10*Emu.SampleRate);
+        Data = obj.Data;
+        Data(:,iChanged) = Data(:,iChanged) * 1.01;
+        obj.Data = Data;
+    end
+    nHits = 0;
+    nLookups = 0;
+    tRun = 0;
+    for iConfig = 1:length(Configs)
+        [~, Stats] = processData(obj, Configs{iConfig}, Cache);
+        nHits = nHits + Stats.nHits;
+        nLookups = nLookups + Stats.nLookups;
+        tRun = tRun + Stats.tElapsed;
+    end
+    fprintf('Run %i: hit rate %5.1f%%, %0.2f s (uncached %0.2f s, speedup %0.1fx)\n', ...
+        iRun, 100*nHits/nLookups, tRun, sum(tUncached), sum(tUncached)/tRun);
+end
+
+%% Chunked processing versus filtering the whole signal (warm-up of the 0.1 Hz high-pass in each chunk)
+rng(0);
+Emu = FeatherEmulator;
+obj = WiFiUDPlogger;
+obj.ADCsamplerate = Emu.SampleRate;
+obj.Data = generateSignal(Emu, 5*60*Emu.SampleRate) + 0.5;
+Chunked = processData(obj, struct('ChunkSize', 30));
+Whole = processData(obj, struct('ChunkSize', 10*60));
+Error = max(abs(Chunked.Filtered(:) - Whole.Filtered(:)));
+fprintf('Chunked versus whole signal: max. error %0.2g V (signal max. %0.2g V)\n', Error, max(abs(Whole.Filtered(:))));
+if Error > 1e-3*max(abs(Whole.Filtered(:)))
+    error('Benchmark: The chunks of processData are not settled (warm-up too short).');
+end
+
+%% Lazy chunked queries versus reading the whole recording (1 hour at 256 Hz)
+rng(0);
+Emu = FeatherEmulator;
+Store = RecordingStore(fullfile(tempdir, 'WiFiUDPlogger_benchmark_store'));
+write(Store, 'Benchmark', generateSignal(Emu, 3600*Emu.SampleRate), Emu.SampleRate, {'Heel', 'Forefoot', 'A3', 'A4', 'A5'});
+[b, a] = butter(4, 20/Emu.SampleRate*2);
+
+% Materialise the recording, then compute
+tic;
+Data = read(Store, 'Benchmark');
+iMinute = 1800*Emu.SampleRate + (1:60*Emu.SampleRate);
+MeanMaterialised = mean(Data(1,iMinute) - Data(2,iMinute));
+tMaterialised = toc;
+tic;
+HeelFiltered = filter(b, a, Data(1,:));
+PeakMaterialised = max(reshape(HeelFiltered(1:floor(end/Emu.SampleRate)*Emu.SampleRate), Emu.SampleRate, []), [], 1);
+tMaterialisedFilter = tMaterialised + toc;
+
+% Lazy queries
+Q = query(Store, 'Benchmark');
+tic;
+MeanQuery = mean(between(channel(Q, 'Heel') - channel(Q, 'Forefoot'), 1800, 1860));
+tQuery = toc;
+tic;
+PeakQuery = aggregate(filter(channel(Q, 'Heel'), b, a), 1, 'max');
+tQueryFilter = toc;
+
+fprintf('mean(heel - forefoot) over 1 minute: %0.1f ms lazy, %0.1f ms materialised (difference %g V)\n', ...
+    1e3*tQuery, 1e3*tMaterialised, abs(MeanQuery - MeanMaterialised));
+fprintf('1 s peaks of the filtered heel over 1 hour: %0.1f ms lazy, %0.1f ms materialised (max. difference %g V)\n', ...
+    1e3*tQueryFilter, 1e3*tMaterialisedFilter, max(abs(PeakQuery - PeakMaterialised)));
+if license('test', 'Distrib_Computing_Toolbox')
+    Q.UseParallel = true;
+    tic;
+    aggregate(filter(channel(Q, 'Heel'), b, a), 1, 'max');
+    fprintf('1 s peaks with parallel chunks: %0.1f ms\n', 1e3*toc);
+end
+remove(Store, 'Benchmark');
+
+%% Flight recorder bulk transfer: reassembly under loss (go-back-N with the firmware window of 8 packets)
+rng(0);
+Emu = FeatherEmulator;
+Emu.FRdecimation = 8;
+Emu.EnabledInputs = 3;
+EmuFull = Emu;
+EmuFull.SampleRate = Emu.SampleRate*Emu.FRdecimation;
+Frames = generateSignal(EmuFull, floor(Emu.FRringSize/2));
+Packets = bulkPackets(Emu, Frames);
+nWindowPackets = 8;
+
+StatusPacket = generatePackets(Emu, zeros(Emu.nADCinput, 0));
+obj = decodePacket(WiFiUDPlogger, StatusPacket{1});
+for LossRate = [0 0.01 0.05 0.1 0.2]
+    obj = resetBulk(obj);
+    iAcked = 0;
+    iAckReceived = 0;
+    nSent = 0;
+    tic;
+    while iAcked < length(Packets)
+        for iPacket = iAcked:min(iAcked+nWindowPackets, length(Packets))-1
+            nSent = nSent + 1;
+            if rand >= LossRate
+                [obj, iAck] = decodeBulkPacket(obj, Packets{iPacket+1});
+                if rand >= LossRate     % The acknowledge may be lost as well
+                    iAckReceived = max(iAckReceived, iAck);
+                end
+            end
+        end
+        iAcked = iAckReceived;  % Go back to the first unacknowledged packet after the timeout
+    end
+    [Window, ~] = assembleBulk(obj, 0);
+    tReassembly = toc;
+    nBytes = sum(cellfun(@length, Packets));
+    fprintf('Loss %4.1f%%: %i packets sent for %i (efficiency %5.1f%%), reassembly %0.1f MB/s, max. error %g V\n', ...
+        100*LossRate, nSent, length(Packets), 100*length(Packets)/nSent, nBytes/tReassembly/1e6, ...
+        max(max(abs(Window(1:2,:) - Frames(1:2,:)))));
+end
+
+%% Flight recorder bulk throughput on the Feather board (the board must run the firmware with FR_DECIMATION > 0)
+obj = open(WiFiUDPlogger);
+if obj.Connected
+    obj = clearData(obj);
+    fprintf(obj.hUDP,'A11');
+    fprintf(obj.hUDP,'A21');
+    pause(1);
+    obj = readData(obj);
+    tWindow = [-0.2 0.4];
+    nBytes = 0;
+    tTransfer = 0;
+    nFetched = 0;
+    for iFetch = 1:20
+        obj = readData(obj);
+        tEvent = obj.nDataSamples/obj.ADCsamplerate - 0.5;
+        tic;
+        [obj, Window] = fetchWindow(obj, tEvent, tWindow);
+        if ~isempty(Window)
+            tTransfer = tTransfer + toc;
+            nBytes = nBytes + 2*nnz(~isnan(Window));
+            nFetched = nFetched + 1;
+        end
+    end
+    fprintf(obj.hUDP,'A0');
+    fprintf('%i of 20 windows fetched, bulk throughput %0.1f kB/s (%0.0f ms per %0.1f s window)\n', ...
+        nFetched, nBytes/tTransfer/1e3, 1e3*tTransfer/nFetched, diff(tWindow));
+end
+obj = close(obj);
+
+%% Burst capture on the Feather board: maximum samplerate for 1 to 4 consecutive inputs
+obj = open(WiFiUDPlogger);
+if obj.Connected
+    obj = clearData(obj);
+    fprintf(obj.hUDP,'A11');
+    pause(1);
+    for nInputs = 1:4
+        nBursts = length(obj.Bursts);
+        obj = startBurst(obj, 1:nInputs);
+        tStart = tic;
+        while length(obj.Bursts) == nBursts && toc(tStart) < 5
+            obj = readData(obj);
+            pause(0.001);
+        end
+        if length(obj.Bursts) > nBursts
+            Burst = obj.Bursts(end);
+            fprintf('%i inputs: %0.1f kHz per input (%0.1f kHz in total), %i samples per input in %0.0f ms, received after %0.0f ms\n', ...
+                nInputs, Burst.SampleRate/1e3, nInputs*Burst.SampleRate/1e3, size(Burst.Data,2), ...
+                1e3*size(Burst.Data,2)/Burst.SampleRate, 1e3*toc(tStart));
+        else
+            fprintf('%i inputs: no burst received (the inputs may not have consecutive ADC channels)\n', nInputs);
+        end
+    end
+    fprintf(obj.hUDP,'A0');
+end
+obj = close(obj);
+
+%% Firmware scheduler on the Feather board: task latency, run time and overruns while streaming 5 inputs
+obj = open(WiFiUDPlogger);
+if obj.Connected
+    obj = clearData(obj);
+    for iInput = 1:5
+        fprintf(obj.hUDP,'A%i1',iInput);
+    end
+    [obj, Stats] = readSchedulerStats(obj);    % Restart the maxima
+    tStart = tic;
+    while toc(tStart) < 10
+        obj = readData(obj);
+        pause(0.001);
+    end
+    [obj, Stats] = readSchedulerStats(obj);
+    fprintf(obj.hUDP,'A0');
+    fprintf('%-10s %8s %8s %8s %10s %10s %10s\n', 'Task', 'Priority', 'Budget', 'Runs', 'Overruns', 'Latency', 'Run time');
+    for iTask = 1:length(Stats)
+        fprintf('%-10s %8i %6i us %8i %10i %7i us %7i us\n', Stats(iTask).Name, Stats(iTask).Priority, Stats(iTask).Budget, ...
+            Stats(iTask).nRuns, Stats(iTask).nOverruns, Stats(iTask).MaxLatency, Stats(iTask).MaxRunTime);
+    end
+end
+obj = close(obj);
+
+%% USB transport through a pseudo terminal pair (Linux with socat): 8 kHz x 5 inputs from the emulator, loss and throughput
+[NoSocat, ~] = system('which socat');
+if ~NoSocat
+    LogFile = [tempname '.log'];
+    system(sprintf('socat -d -d pty,raw,echo=0 pty,raw,echo=0 2> %s &', LogFile));
+    pause(1);
+    Ptys = regexp(fileread(LogFile), '/dev/pts/\d+', 'match');
+    Emu = FeatherEmulator;
+    Emu.SampleRate = 8000;
+    Emu.EnabledInputs = 0;
+    Server = parfeval(gcp, @servePty, 0, Emu, Ptys{1}, 30);
+    obj = WiFiUDPlogger;
+    obj.Transport = 'serial';
+    obj.SerialPort = Ptys{2};
+    obj = open(obj);
+    if obj.Connected
+        obj = clearData(obj);
+        for iInput = 1:5
+            sendCommand(obj, sprintf('A%i1',iInput));
+        end
+        tStart = tic;
+        while toc(tStart) < 10
+            obj = readData(obj);
+            pause(0.001);
+        end
+        tElapsed = toc(tStart);
+        sendCommand(obj, 'A0');
+        Data = obj.Data(:,1:end-obj.nADCbufferPos);
+        fprintf('%0.0f samples/s x 5 inputs received (%0.0f kB/s framed), %0.3f%% of the samples lost\n', ...
+            size(Data,2)/tElapsed, ...
+            size(Data,2)/obj.nADCbufferPos*(6 + 5*(10 + 2*obj.nADCbufferPos))/tElapsed/1e3, 100*mean(isnan(Data(:))));
+    end
+    obj = close(obj);
+    cancel(Server);
+    system('pkill -f "socat -d -d pty"');
+end
+
+%% Receive latency and CPU cost of the receive modes (emulator at 1 kHz x 5 inputs over localhost UDP)
+% The lag of each data packet is its receive time minus its sample time (relative to the smallest lag).
+Emu = FeatherEmulator;
+Emu.SampleRate = 1000;
+Emu.EnabledInputs = 0;
+Emu.BusyPoll = true;
+Server = parfeval(gcp, @serveUdp, 0, Emu, 62301, 60);
+obj = WiFiUDPlogger;
+obj.RemoteHostIP = '127.0.0.1';
+obj = open(obj);
+if obj.Connected
+    for Mode = {'sleep', 'latency'}
+        obj.ReceiveMode = Mode{1};
+        obj = clearData(obj);
+        for iInput = 1:5
+            sendCommand(obj, sprintf('A%i1',iInput));
+        end
+        tRecv = zeros(1, 0);
+        iBlock = zeros(1, 0);
+        tCPU = cputime;
+        tStart = tic;
+        while toc(tStart) < 10
+            [obj, nRecvDataPackets] = readData(obj);
+            if nRecvDataPackets > 0
+                tRecv(end+1) = toc(tStart); %#ok<SAGROW>
+                iBlock(end+1) = obj.iData; %#ok<SAGROW>
+            else
+                waitForData(obj);
+            end
+        end
+        CPU = (cputime - tCPU)/toc(tStart);
+        sendCommand(obj, 'A0');
+        Lag = tRecv - (iBlock-1)*obj.nADCbufferPos/obj.ADCsamplerate;
+        Lag = sort(Lag - min(Lag));
+        fprintf('%-8s lag: median %6.0f us, 99%% %6.0f us, max %6.0f us, CPU %3.0f%% of a core\n', Mode{1}, ...
+            1e6*median(Lag), 1e6*Lag(ceil(0.99*end)), 1e6*Lag(end), 100*CPU);
+        pause(0.5);
+    end
+end
+obj = close(obj);
+cancel(Server);
+
+%% Worst-case receive jitter with the real-time profile (emulator at 1 kHz x 5 inputs over localhost UDP, 1 hour)
+% Run MATLAB with CAP_SYS_NICE (and ideally isolated cores in RealtimeCPUs). Page faults and context switches are
+% counted after the first minute (steady state).
+tRun = 3600;
+Emu = FeatherEmulator;
+Emu.SampleRate = 1000;
+Emu.EnabledInputs = 0;
+Emu.BusyPoll = true;
+Server = parfeval(gcp, @serveUdp, 0, Emu, 62301, tRun + 60);
+obj = WiFiUDPlogger;
+obj.RemoteHostIP = '127.0.0.1';
+obj.ReceiveMode = 'latency';
+obj = open(obj);
+if obj.Connected
+    obj = clearData(obj);
+    obj = preallocate(obj, tRun + 10);
+    obj = startRealtimeProfile(obj);
+    for iInput = 1:5
+        sendCommand(obj, sprintf('A%i1',iInput));
+    end
+    nPackets = ceil(tRun*obj.ADCsamplerate/obj.nADCbufferPos) + 100;
+    tRecv = zeros(1, nPackets);
+    iBlock = zeros(1, nPackets);
+    nRecv = 0;
+    StatsStart = [];
+    tStart = tic;
+    while toc(tStart) < tRun
+        [obj, nRecvDataPackets] = readData(obj);
+        if nRecvDataPackets > 0 && nRecv < nPackets
+            nRecv = nRecv + 1;
+            tRecv(nRecv) = toc(tStart);
+            iBlock(nRecv) = obj.iData;
+        else
+            waitForData(obj);
+        end
+        if isempty(StatsStart) && toc(tStart) > 60
+            StatsStart = WiFiUDPlogger.processStats();
+        end
+    end
+    StatsEnd = WiFiUDPlogger.processStats();
+    sendCommand(obj, 'A0');
+    obj = stopRealtimeProfile(obj);
+    Lag = tRecv(1:nRecv) - (iBlock(1:nRecv)-1)*obj.nADCbufferPos/obj.ADCsamplerate;
+    Lag = sort(Lag - min(Lag));
+    fprintf('Lag over %0.0f s: median %0.0f us, 99.99%% %0.0f us, worst case %0.0f us\n', tRun, ...
+        1e6*median(Lag), 1e6*Lag(ceil(0.9999*end)), 1e6*Lag(end));
+    if ~isempty(StatsStart)
+        fprintf('Steady state: %i minor and %i major page faults, %i voluntary and %i involuntary context switches\n', ...
+            StatsEnd.MinorFaults - StatsStart.MinorFaults, StatsEnd.MajorFaults - StatsStart.MajorFaults, ...
+            StatsEnd.VoluntarySwitches - StatsStart.VoluntarySwitches, StatsEnd.InvoluntarySwitches - StatsStart.InvoluntarySwitches);
+    end
+end
+obj = close(obj);
+cancel(Server);
+
+%% Step similarity index: build throughput and query latency for 10^7 steps (1000 recordings of 3 hours at 100 Hz)
+% The archive takes about 9 GB on disk, and is kept for later runs.
+rng(0);
+Emu = FeatherEmulator;
+Emu.SampleRate = 100;
+Emu.nADCinput = 2;
+Store = RecordingStore(fullfile(tempdir, 'WiFiUDPlogger_benchmark_archive'));
+Names = arrayfun(@(iRecording) sprintf('Patient%04i', iRecording), 1:1000, 'UniformOutput', false);
+for Name = setdiff(Names, list(Store))
+    Emu.StepPeriod = 0.9 + 0.4*rand;
+    Emu.StanceFraction = 0.5 + 0.2*rand;
+    Emu.Amplitude = [0.6 0.5] + 0.6*rand(1,2);
+    write(Store, Name{1}, generateSignal(Emu, 3*3600*Emu.SampleRate), Emu.SampleRate, {'Heel', 'Forefoot'});
+end
+
+Index = StepIndex(fullfile(tempdir, 'WiFiUDPlogger_benchmark_stepindex'));
+Index.UseParallel = license('test', 'Distrib_Computing_Toolbox');
+tic;
+build(Index, Store, Names);
+tBuild = toc;
+fprintf('Build: %i steps in %0.0f s (%0.0f steps/s), %i leaves\n', Index.nSteps, tBuild, Index.nSteps/tBuild, ...
+    length(Index.LeafCount));
+
+% Queries: indexed steps with added noise
+nQueries = 100;
+k = 10;
+tExact = zeros(1, nQueries);
+tApproximate = zeros(1, nQueries);
+nDistances = zeros(1, nQueries);
+Recall = zeros(1, nQueries);
+for iQuery = 1:nQueries
+    iStep = randi(Index.nSteps);
+    Step = read(Store, Index.Names{Index.StepRecording(iStep)}, 1, [Index.StepOnset(iStep) Index.StepOffset(iStep)]);
+    Step = Step + 0.02*randn(size(Step));
+    tic;
+    [Exact, Stats] = search(Index, Step, k);
+    tExact(iQuery) = toc;
+    tic;
+    Approximate = search(Index, Step, k, false);
+    tApproximate(iQuery) = toc;
+    nDistances(iQuery) = Stats.nDistances;
+    Recall(iQuery) = mean(ismember(Exact.Distance, Approximate.Distance));
+end
+fprintf('Exact %i-NN: median %0.0f ms, max. %0.0f ms, %0.2f%% of the steps compared\n', k, 1e3*median(tExact), ...
+    1e3*max(tExact), 100*mean(nDistances)/Index.nSteps);
+fprintf('Approximate %i-NN: median %0.1f ms, max. %0.1f ms, recall %0.0f%%\n', k, 1e3*median(tApproximate), ...
+    1e3*max(tApproximate), 100*mean(Recall));
+
+% A query is a single step, so it must be one curve
+Query = StepIndex.normalise(Step(:)', 1, length(Step), Index.nPoints);
+if ~isequal(size(Query), [Index.nPoints 1])
+    error('Benchmark: A single step query is resampled to %ix%i instead of %ix1.', size(Query,1), size(Query,2), Index.nPoints);
+end
+
+%% Matrix profile of a 1 hour session at 256 Hz (heel and forefoot, one stumble at 1800 s): anytime refinement
+rng(0);
+Emu = FeatherEmulator;
+Data = generateSignal(Emu, 3600*Emu.SampleRate);
+iStumble = 1800*Emu.SampleRate + (1:round(0.7*Emu.SampleRate));
+Data(1,iStumble) = 1.8*Data(1,iStumble);
+Data(2,iStumble) = 0.2*Data(2,iStumble);
+Store = RecordingStore(fullfile(tempdir, 'WiFiUDPlogger_benchmark_store'));
+write(Store, 'Benchmark', Data, Emu.SampleRate, {'Heel', 'Forefoot', 'A3', 'A4', 'A5'});
+Q = channel(query(Store, 'Benchmark'), [1 2]);
+
+MP = MatrixProfile(Q, 1.1);
+MP.UseParallel = license('test', 'Distrib_Computing_Toolbox');
+tRefine = 0;
+while MP.Progress < 0.05
+    tic;
+    refine(MP, 0.005);
+    tRefine = tRefine + toc;
+    [tDiscord, dDiscord] = discords(MP, 1);
+    [tMotif, tNeighbour, dMotif] = motifs(MP, 1);
+    fprintf('%4.1f%% of the diagonals after %5.0f s: discord at %6.1f s (distance %0.2f), motif at %6.1f s / %6.1f s (distance %0.2f)\n', ...
+        100*MP.Progress, tRefine, tDiscord, dDiscord, tMotif, tNeighbour, dMotif);
+end
+nCells = MP.Progress*length(MP.JointProfile)^2/2;
+fprintf('%0.2g distance matrix cells/s, %0.1f h estimated for the exact profile\n', nCells/tRefine, tRefine/MP.Progress/3600);
+
+% Accuracy of the anytime profile on 10 minutes around the stumble (exact profile for reference)
+MP = MatrixProfile(between(Q, 1500, 2100), 1.1);
+MP.UseParallel = license('test', 'Distrib_Computing_Toolbox');
+Fractions = [0.01 0.05 0.1];
+Approximate = zeros(length(Fractions), length(MP.JointProfile));
+for iFraction = 1:length(Fractions)
+    refine(MP, Fractions(iFraction) - MP.Progress);
+    Approximate(iFraction,:) = MP.JointProfile;
+end
+refine(MP);
+for iFraction = 1:length(Fractions)
+    fprintf('%2.0f%% of the diagonals: %5.1f%% of the subsequences within 5%% of the exact distance\n', ...
+        100*Fractions(iFraction), 100*mean(Approximate(iFraction,:) <= 1.05*MP.JointProfile));
+end
+fprintf('Exact: discord at %0.1f s\n', discords(MP, 1));
+remove(Store, 'Benchmark');
+
+%% Step ensemble averaging: steps/s for one session (vectorised versus one interp1 per step) and for an archive
+rng(0);
+Emu = FeatherEmulator;
+Data = generateSignal(Emu, 3600*Emu.SampleRate);
+obj = WiFiUDPlogger;
+Steps = detectSteps(obj, 1, Data);
+nSteps = length(Steps.iOnset);
+
+tic;
+Curves = zeros(101, nSteps);
+for iStep = 1:nSteps
+    Curves(:,iStep) = interp1(Steps.iOnset(iStep):Steps.iOffset(iStep), Data(1,Steps.iOnset(iStep):Steps.iOffset(iStep)), ...
+        linspace(Steps.iOnset(iStep), Steps.iOffset(iStep), 101));
+end
+MeanLoop = mean(Curves, 2)';
+tLoop = toc;
+
+Ensemble = StepEnsemble;
+tic;
+add(Ensemble, Data(1:2,:), {'Heel', 'Forefoot'}, 'Benchmark', Steps);
+tEnsemble = toc;
+fprintf('1 session (%i steps, 2 inputs): %0.0f steps/s, one interp1 per step (1 input): %0.0f steps/s, max. difference %g V\n', ...
+    nSteps, 2*nSteps/tEnsemble, nSteps/tLoop, max(abs(curve(Ensemble, 'Heel', 'Benchmark') - MeanLoop)));
+
+% A chunk with a single step adds one curve
+Ensemble = StepEnsemble;
+add(Ensemble, Data(1:2,:), {'Heel', 'Forefoot'}, 'Benchmark', struct('iOnset', Steps.iOnset(1), 'iOffset', Steps.iOffset(1)));
+[Mean, ~, nHeel] = curve(Ensemble, 'Heel', 'Benchmark');
+if nHeel ~= 1 || ~isequal(size(Mean), [1 101]) || max(abs(Mean - Curves(:,1)')) > 1e-9
+    error('Benchmark: A single step is not added as one curve.');
+end
+
+% Archive of 20 sessions of 1 hour, added with the parallel pool
+Store = RecordingStore(fullfile(tempdir, 'WiFiUDPlogger_benchmark_store'));
+Names = arrayfun(@(iSession) sprintf('Ensemble%02i', iSession), 1:20, 'UniformOutput', false);
+for iSession = 1:length(Names)
+    write(Store, Names{iSession}, generateSignal(Emu, 3600*Emu.SampleRate), Emu.SampleRate, {'Heel', 'Forefoot', 'A3', 'A4', 'A5'});
+end
+Ensemble = StepEnsemble;
+Ensemble.UseParallel = license('test', 'Distrib_Computing_Toolbox');
+tic;
+addRecordings(Ensemble, Store, Names, 'Benchmark');
+tArchive = toc;
+[~, ~, nHeel] = curve(Ensemble, 'Heel', 'Benchmark');
+fprintf('Archive (%i sessions, %i steps, 5 inputs): %0.0f steps/s including reading\n', length(Names), nHeel, ...
+    sum(Ensemble.nSteps)/tArchive);
+for iSession = 1:length(Names)
+    remove(Store, Names{iSession});
+end
+
+%% Export of a 1 hour session at 256 Hz to CSV and C3D (MB/s of written file)
+rng(0);
+Emu = FeatherEmulator;
+Data = generateSignal(Emu, 3600*Emu.SampleRate);
+Store = RecordingStore(fullfile(tempdir, 'WiFiUDPlogger_benchmark_store'));
+write(Store, 'Benchmark', Data, Emu.SampleRate, {'Heel', 'Forefoot', 'A3', 'A4', 'A5'});
+fileExport = fullfile(tempdir, 'WiFiUDPlogger_benchmark_export');
+
+tic;
+writematrix([(0:size(Data,2)-1)'/Emu.SampleRate single(Data')], [fileExport '_writematrix.csv']);
+tWritematrix = toc;
+File = dir([fileExport '_writematrix.csv']);
+fprintf('writematrix: %0.1f MB/s (%0.0f MB)\n', File.bytes/tWritematrix/1e6, File.bytes/1e6);
+
+for UseParallel = unique([false license('test', 'Distrib_Computing_Toolbox')])
+    Store.UseParallel = UseParallel;
+    tic;
+    exportCSV(Store, 'Benchmark', [fileExport '.csv']);
+    tCSV = toc;
+    File = dir([fileExport '.csv']);
+    fprintf('exportCSV (UseParallel = %i): %0.1f MB/s (%0.0f MB)\n', UseParallel, File.bytes/tCSV/1e6, File.bytes/1e6);
+end
+
+tic;
+exportC3D(Store, 'Benchmark', [fileExport '.c3d']);
+tC3D = toc;
+File = dir([fileExport '.c3d']);
+fprintf('exportC3D: %0.1f MB/s (%0.0f MB)\n', File.bytes/tC3D/1e6, File.bytes/1e6);
+delete([fileExport '*']);
+remove(Store, 'Benchmark');
+
+%% Editing a 2 GB recording (2 hours at 8 kHz x 5 inputs): trim, split, concatenate and relabel versus a copy
+rng(0);
+Emu = FeatherEmulator;
+Emu.SampleRate = 8000;
+Store = RecordingStore(fullfile(tempdir, 'WiFiUDPlogger_benchmark_store'));
+Labels = {'Heel', 'Forefoot', 'A3', 'A4', 'A5'};
+Parts = arrayfun(@(iPart) sprintf('Part%02i', iPart), 1:12, 'UniformOutput', false);
+for iPart = 1:length(Parts)
+    write(Store, Parts{iPart}, generateSignal(Emu, 600*Emu.SampleRate), Emu.SampleRate, Labels);
+end
+tic;
+Index = concat(Store, Parts, 'Long');
+tConcat = toc;
+fprintf('Recording of %0.2f GB\n', Index.nInputs*sum(Index.ChunkSamples)*4/1e9);
+fprintf('concat: %0.0f ms\n', 1e3*tConcat);
+
+tic;
+trim(Store, 'Long', [31.5 7100.25]);
+fprintf('trim: %0.0f ms\n', 1e3*toc);
+tic;
+relabel(Store, 'Long', {'LeftHeel', 'LeftForefoot', 'A3', 'A4', 'A5'});
+fprintf('relabel: %0.0f ms\n', 1e3*toc);
+tic;
+split(Store, 'Long', [1800.1 3600.7 5400.3], {'Trial1', 'Trial2', 'Trial3', 'Trial4'});
+fprintf('split into 4 trials: %0.0f ms\n', 1e3*toc);
+
+% Previous approach for one trial: load the data, and save a new copy
+tic;
+[Data, TimeAxis] = read(Store, 'Trial2');
+write(Store, 'Trial2Copy', Data(:, TimeAxis >= 60), Emu.SampleRate, Labels);
+fprintf('read and write a 30 minute trial: %0.0f ms\n', 1e3*toc);
+
+for Name = [Parts {'Trial1', 'Trial2', 'Trial3', 'Trial4', 'Trial2Copy'}]
+    delete(fullfile(Store.StoreDir, 'recordings', [Name{1} '.mat']));
+end
+collectGarbage(Store);
+
+%% Tiered storage of a 1 hour live recording at 1 kHz x 5 inputs: write amplification and read speed per tier
+rng(0);
+Emu = FeatherEmulator;
+Emu.SampleRate = 1000;
+Quantum = Emu.ADCscale/Emu.ADCgain;
+Data = min(max(round(generateSignal(Emu, 3600*Emu.SampleRate)/Quantum), -2^11), 2^11-1)*Quantum;
+Store = RecordingStore(fullfile(tempdir, 'WiFiUDPlogger_benchmark_store'));
+Live = HotRecording(Store, 'Benchmark', Emu.SampleRate, {'Heel', 'Forefoot', 'A3', 'A4', 'A5'}, Quantum, false);
+
+% Blocks of 16 samples, 1% retransmitted 1-100 blocks late (patches of the hot and cold tier)
+nBlock = 16;
+nBlocks = floor(size(Data,2)/nBlock);
+tWrite = zeros(nBlocks, 1);
+tCompact = 0;
+for iBlock = 1:nBlocks
+    tic;
+    write(Live, (iBlock-1)*nBlock + 1, Data(:,(iBlock-1)*nBlock + (1:nBlock)));
+    if rand < 0.01
+        iLate = max(iBlock - randi(100), 1);
+        write(Live, (iLate-1)*nBlock + 1, Data(:,(iLate-1)*nBlock + (1:nBlock)));
+    end
+    tWrite(iBlock) = toc;
+    if mod(iBlock, round(Live.CompactionPeriod*Emu.SampleRate/nBlock)) == 0
+        tic;
+        compactStep(Live);
+        tCompact = tCompact + toc;
+    end
+end
+fprintf('write: %0.1f us/block (max. %0.1f ms), compaction: %0.1f%% of real time\n', ...
+    1e6*mean(tWrite), 1e3*max(tWrite), 100*tCompact/3600);
+
+tic;
+Hot = read(Live, Live.nCompacted + 1, Live.nSamples);
+tHot = toc;
+fprintf('hot tier read: %0.1f MB/s (%i samples)\n', 4*numel(Hot)/tHot/1e6, size(Hot,2));
+close(Live);
+compact(Live);
+tic;
+Cold = read(Store, 'Benchmark');
+tCold = toc;
+fprintf('cold tier read: %0.1f MB/s, max. difference %g V\n', 4*numel(Cold)/tCold/1e6, max(abs(Cold(:) - Data(:))));
+fprintf('ingested %0.0f MB, hot tier %0.0f MB, cold tier %0.0f MB, write amplification %0.2f\n', ...
+    Live.Bytes.Ingested/1e6, Live.Bytes.Hot/1e6, Live.Bytes.Cold/1e6, (Live.Bytes.Hot + Live.Bytes.Cold)/Live.Bytes.Ingested);
+remove(Store, 'Benchmark');
+
+%% Sync pulse alignment with an external system (force plate clock 3.2 s behind with 50 ppm drift, 5% packet loss)
+rng(0);
+Emu = FeatherEmulator;
+Data = generateSignal(Emu, 300*Emu.SampleRate);
+tPulses = cumsum(0.5 + rand(1, 250));   % Sync pulses at random intervals (as sent by the force plate)
+tPulses = tPulses(tPulses < 295);
+Packets = generatePackets(Emu, Data, 0.05, 0, tPulses);
+obj = decodePacket(WiFiUDPlogger, Packets{1});
+obj = clearData(obj);
+for iPacket = 2:length(Packets)
+    obj = decodePacket(obj, Packets{iPacket});
+end
+
+% The force plate timestamps the pulses on its own clock, and starts recording after the first 3 pulses
+tEdges = (tPulses(4:end) - 3.2)*(1 - 50e-6) + 1e-6*randn(1, length(tPulses)-3);
+tic;
+[Align, Fit] = alignExternal(obj, tEdges);
+tAlign = toc;
+tTruth = tPulses(4:end) + Emu.nADCbufferPos/Emu.SampleRate;   % The first block is at sample nADCbufferPos+1 of obj.Data
+fprintf('%i of %i edges received, %i pairs, offset %0.4f s, drift %0.1f ppm, %0.2f ms\n', ...
+    length(obj.SyncTimes), length(tPulses), Fit.nPairs, Fit.Offset, Fit.Drift, 1e3*tAlign);
+fprintf('Alignment error: max. %0.1f us (sample period %0.0f us)\n', 1e6*max(abs(Align(tEdges) - tTruth)), 1e6/Emu.SampleRate);
+
+% An edge missed by the force plate in the middle must not change the pairing, and pulses at a constant interval
+% must be rejected as ambiguous
+AlignGap = alignExternal(obj, tEdges([1:100 102:end]));
+if max(abs(AlignGap(tEdges) - Align(tEdges))) > 0.1/Emu.SampleRate
+    error('Benchmark: An edge missing in the middle changed the sync alignment.');
+end
+isAmbiguous = false;
+try
+    alignExternal(obj, 0:0.5:100, 10 + (0:0.5:100));
+catch
+    isAmbiguous = true;
+end
+if ~isAmbiguous
+    error('Benchmark: Sync pulses at a constant interval were not rejected as ambiguous.');
+end
+
+%% Step anomaly detection on 5000 concurrent streams (200 steps each, 1% anomalies, a lasting change in half the streams)
+rng(0);
+Emu = FeatherEmulator;
+Data = generateSignal(Emu, 600*Emu.SampleRate);
+obj = WiFiUDPlogger;
+[Features, Names] = StepAnomalyDetector.features(Data(1:2,:), detectSteps(obj, 1, Data), Emu.SampleRate);
+fprintf('%i steps of the emulator, features: %s\n', size(Features,1), strjoin(Names, ', '));
+
+% Steps of each stream resampled from the emulator steps with a scale per stream, 1% anomalies (a feature off by
+% 6 standard deviations), and a 10% change after step 100 in the streams with even index
+nStreams = 5000;
+nSteps = 200;
+Scale = 0.8 + 0.4*rand(nStreams, size(Features,2));
+StepFeatures = zeros(nStreams, nSteps, size(Features,2));
+for iStep = 1:nSteps
+    StepFeatures(:,iStep,:) = reshape(Features(randi(size(Features,1), nStreams, 1),:).*Scale, nStreams, 1, []);
+end
+StepFeatures(2:2:end,101:end,:) = 1.1*StepFeatures(2:2:end,101:end,:);
+mAnomaly = rand(nStreams, nSteps) < 0.01;
+mAnomaly(:,1:50) = false;
+[iAnomalyStream, iAnomalyStep] = find(mAnomaly);
+iFeature = randi(size(Features,2), length(iAnomalyStream), 1);
+Deviation = std(Features, 0, 1);
+for iAnomaly = 1:length(iAnomalyStream)
+    StepFeatures(iAnomalyStream(iAnomaly),iAnomalyStep(iAnomaly),iFeature(iAnomaly)) = StepFeatures(iAnomalyStream(iAnomaly),iAnomalyStep(iAnomaly),iFeature(iAnomaly)) + ...
+        6*Deviation(iFeature(iAnomaly))*Scale(iAnomalyStream(iAnomaly),iFeature(iAnomaly));
+end
+
+% One step of every stream per batch
+Detector = StepAnomalyDetector(size(Features,2), nStreams);
+isAnomaly = false(nStreams, nSteps);
+tic;
+for iStep = 1:nSteps
+    [~, isAnomaly(:,iStep)] = score(Detector, (1:nStreams)', reshape(StepFeatures(:,iStep,:), nStreams, []));
+end
+tBatch = toc;
+
+% One step at a time (first 20 streams)
+Single = StepAnomalyDetector(size(Features,2));
+tic;
+for iStream = 1:20
+    for iStep = 1:nSteps
+        score(Single, iStream, reshape(StepFeatures(iStream,iStep,:), 1, []));
+    end
+end
+tSingle = toc;
+
+mScored = false(nStreams, nSteps);
+mScored(:,Detector.WarmupSteps+1:end) = true;
+fprintf('Per step: %0.2f us in batches of %i streams, %0.1f us one at a time\n', 1e6*tBatch/(nStreams*nSteps), nStreams, 1e6*tSingle/(20*nSteps));
+fprintf('Anomalies detected: %0.1f%%, false alarms: %0.2f%% (%0.2f%% in the 50 steps after the change)\n', ...
+    100*nnz(isAnomaly & mAnomaly)/nnz(mAnomaly), 100*nnz(isAnomaly & ~mAnomaly & mScored)/nnz(~mAnomaly & mScored), ...
+    100*nnz(isAnomaly(2:2:end,101:150) & ~mAnomaly(2:2:end,101:150))/nnz(~mAnomaly(2:2:end,101:150)));
+
+%% Wavelet denoising versus the live filter chain (10 minutes at 256 Hz x 5 inputs): cost and heel strike timing
+rng(0);
+Emu = FeatherEmulator;
+Emu.NoiseLevel = 0;
+Clean = generateSignal(Emu, 600*Emu.SampleRate);
+Data = Clean + 0.005*randn(size(Clean));
+fs = Emu.SampleRate;
+nChunk = Emu.nADCbufferPos;         % One data packet per chunk
+
+% True heel strikes, extrapolated back to zero from the first two loaded samples of the clean heel signal
+iFirst = find(diff(Clean(1,:) > 0) == 1) + 1;
+tTrue = (iFirst - 1 - Clean(1,iFirst)./(Clean(1,iFirst+1) - Clean(1,iFirst)))/fs;
+tTrue = tTrue(tTrue > 2 & tTrue < 598);
+
+% Wavelet denoiser: heel strikes from its edges
+Denoiser = WaveletDenoiser(fs);
+tEdges = [];
+tic;
+for iSample = 1:nChunk:size(Data,2)
+    [~, Edges] = process(Denoiser, Data(:,iSample:min(iSample+nChunk-1, end)));
+    tEdges = [tEdges; Edges.Time(Edges.iInput == 1)]; %#ok<AGROW>
+end
+tWavelet = toc;
+
+% Live filter chain (50 Hz notch and band-pass): heel strikes at the steepest slope in the first 150 ms of each step
+obj = WiFiUDPlogger;
+[b_Notch, a_Notch] = iirnotch(50/fs*2, obj.bandwidthNotch/fs*2);
+[b_BandPass, a_BandPass] = butter(4, obj.freqBandpass/fs*2);
+z_Notch = zeros(2, size(Data,1));
+z_BandPass = zeros(length(a_BandPass)-1, size(Data,1));
+Filtered = zeros(size(Data));
+tic;
+for iSample = 1:nChunk:size(Data,2)
+    iRange = iSample:min(iSample+nChunk-1, size(Data,2));
+    [X, z_Notch] = filter(b_Notch, a_Notch, Data(:,iRange), z_Notch, 2);
+    [Filtered(:,iRange), z_BandPass] = filter(b_BandPass, a_BandPass, X, z_BandPass, 2);
+end
+tIIR = toc;
+Slope = diff(Filtered(1,:));
+tSlope = zeros(size(tTrue));
+for iStep = 1:length(tTrue)
+    iWindow = round(tTrue(iStep)*fs) + (-5:round(0.15*fs));
+    [~, iMax] = max(Slope(iWindow));
+    tSlope(iStep) = (iWindow(iMax) - 0.5)/fs;
+end
+
+ErrorWavelet = zeros(size(tTrue));
+for iStep = 1:length(tTrue)
+    [~, iNearest] = min(abs(tEdges - tTrue(iStep)));
+    ErrorWavelet(iStep) = tEdges(iNearest) - tTrue(iStep);
+end
+ErrorSlope = tSlope - tTrue;
+fprintf('Per sample and input: wavelet %0.3f us (delay %0.1f ms), filter chain %0.3f us\n', 1e6*tWavelet/numel(Data), ...
+    1e3*Denoiser.Delay/fs, 1e6*tIIR/numel(Data));
+fprintf('Heel strikes: %i, wavelet edges: %i (noise estimate %0.4f V)\n', length(tTrue), nnz(tEdges > 2 & tEdges < 598), Denoiser.Noise(1));
+fprintf('Timing error (mean +- std): wavelet %0.1f +- %0.1f ms, filter chain %0.1f +- %0.1f ms\n', ...
+    1e3*mean(ErrorWavelet), 1e3*std(ErrorWavelet), 1e3*mean(ErrorSlope), 1e3*std(ErrorSlope));
+
+%% Automatic tare on the board versus the 0.1 Hz high-pass: posture trial (30 s standing) with baseline drift
+rng(0);
+Emu = FeatherEmulator;
+fs = Emu.SampleRate;
+Data = generateSignal(Emu, 300*fs);
+t = (0:size(Data,2)-1)/fs;
+mStanding = t >= 60 & t < 90;
+Data(1,mStanding) = 0.5 + Emu.NoiseLevel*randn(1, nnz(mStanding));
+Truth = Data(1,:);
+Drift = 0.05*sin(2*pi*t/200) + 0.02*t/300;
+Codes = round((Data(1,:) + Drift)/Emu.ADCscale);
+
+% Firmware tare (ADC_CompleteBlocks with TARE_* of ctrlADC.h) versus the live band-pass filter
+[Tared, Offsets] = tareBlocks(Codes, Emu.nADCbufferPos);
+Tared = Tared*Emu.ADCscale;
+obj = WiFiUDPlogger;
+[b_BandPass, a_BandPass] = butter(4, obj.freqBandpass/fs*2);
+Filtered = filter(b_BandPass, a_BandPass, (Codes - Codes(1))*Emu.ADCscale);
+mSettled = t > 5;
+fprintf('Standing (0.5 V): mean error %0.1f mV tared, %0.1f mV band-pass\n', ...
+    1e3*mean(abs(Tared(mStanding) - Truth(mStanding))), 1e3*mean(abs(Filtered(mStanding) - Truth(mStanding))));
+fprintf('Walking: rms error %0.1f mV tared (baseline drift %0.0f mV, offset error max. %0.1f mV)\n', ...
+    1e3*sqrt(mean((Tared(mSettled & ~mStanding) - Truth(mSettled & ~mStanding)).^2)), 1e3*(max(Drift) - min(Drift)), ...
+    1e3*max(abs(Offsets(mSettled)*Emu.ADCscale - Drift(mSettled))));
+
+%% Session catalog of 2000 sessions (10 s at 256 Hz x 5 inputs): ingest overhead, query latency and rebuild
+rng(0);
+Emu = FeatherEmulator;
+fs = Emu.SampleRate;
+Store = RecordingStore(fullfile(tempdir, 'WiFiUDPlogger_benchmark_catalog'));
+Catalog = SessionCatalog(fullfile(tempdir, 'WiFiUDPlogger_benchmark_catalog', 'catalog'));
+Sides = {'left', 'right'};
+Conditions = {'walking', 'running', 'stairs', 'posture'};
+Gains = [1 2 4 8];
+nSessions = 2000;
+Names = arrayfun(@(iSession) sprintf('S%04i', iSession), 1:nSessions, 'UniformOutput', false);
+tWrite = zeros(nSessions, 1);
+for iSession = 1:nSessions
+    Data = generateSignal(Emu, 10*fs);
+    Data(:, rand(1, size(Data,2)) < 0.03*rand^2) = NaN;     % Packet loss of 0-3%
+    Data(randi(4)+1:end,:) = NaN;                           % Disabled inputs (A3-A5 in most sessions)
+    Metadata = struct('Patient', sprintf('P%03i', randi(100)), 'Side', Sides{randi(2)}, ...
+        'Condition', Conditions{randi(4)}, 'ADCgain', Gains(randi(4)), 'Quality', rand);
+    Store.Catalog = [];
+    if iSession > nSessions/10
+        Store.Catalog = Catalog;                            % The first 10% are written without the catalog
+    end
+    tic;
+    write(Store, Names{iSession}, Data, fs, {'Heel', 'Forefoot', 'A3', 'A4', 'A5'}, Metadata);
+    tWrite(iSession) = toc;
+end
+add(Catalog, Store, Names(1:nSessions/10));
+fprintf('write: %0.1f ms/session without, %0.1f ms/session with the catalog\n', ...
+    1e3*mean(tWrite(1:nSessions/10)), 1e3*mean(tWrite(nSessions/10+1:end)));
+
+Query = 'Side == left & ADCgain == 4 & LossRate < 1%';
+search(Catalog, Query);                                     % Builds the indexes
+tic;
+[Found, Sessions, Stats] = search(Catalog, Query);
+nMatches = length(Found);
+fprintf('"%s": %i sessions in %0.2f ms (%i rows from the indexes, %i checked)\n', ...
+    Query, length(Found), 1e3*toc, Stats.nIndexed, Stats.nScanned);
+for Query = {'Patient == P042', 'Condition == stairs & Quality >= 0.9 | Condition == posture & Duration > 5', 'LossRate > 2.5%'}
+    tic;
+    Found = search(Catalog, Query{1});
+    fprintf('"%s": %i sessions in %0.2f ms\n', Query{1}, length(Found), 1e3*toc);
+end
+
+% Previous approach: open each recording, and compute its loss rate from the data
+tic;
+nFound = 0;
+for iSession = 1:nSessions
+    Index = info(Store, Names{iSession});
+    if strcmp(Index.Metadata.Side, 'left') && Index.Metadata.ADCgain == 4
+        Data = read(Store, Names{iSession});
+        Data = Data(any(~isnan(Data), 2),:);                % Without the disabled inputs
+        nFound = nFound + (mean(isnan(Data(:))) < 0.01);
+    end
+end
+fprintf('scan of the recordings: %i sessions in %0.0f ms\n', nFound, 1e3*toc);
+if nFound ~= nMatches
+    error('Benchmark: The loss rates of the catalog do not match the recordings.');
+end
+
+tic;
+rebuild(Catalog, Store);
+fprintf('rebuild: %0.1f s\n', toc);
+if license('test', 'Distrib_Computing_Toolbox')
+    Catalog.UseParallel = true;
+    tic;
+    rebuild(Catalog, Store);
+    fprintf('rebuild on the parallel pool: %0.1f s\n', toc);
+end
+
+% The store written with a trailing separator has the same sessions, and a string in the number field ADCgain turns it
+% into a string field (the numbers are kept as strings)
+remove(Catalog, [Store.StoreDir filesep], Names(1));
+if ~isempty(search(Catalog, 'Name == S0001'))
+    error('Benchmark: The catalog keys depend on the trailing separator of the store directory.');
+end
+nGain4 = length(search(Catalog, 'ADCgain == 4'));
+Store.Catalog = Catalog;
+write(Store, 'Text', generateSignal(Emu, fs), fs, {'Heel', 'Forefoot', 'A3', 'A4', 'A5'}, struct('ADCgain', 'high'));
+if length(search(Catalog, 'ADCgain == high')) ~= 1 || length(search(Catalog, 'ADCgain == 4')) ~= nGain4
+    error('Benchmark: A string in a number field of the catalog was not kept.');
+end
+delete(Catalog);
+rmdir(Store.StoreDir, 's');
+
+%% Receiver hand-off in a 10 minute recording (256 Hz x 5 inputs, 2% packet loss): state size, hand-off time and lost samples
+% Replay of the packet stream: the old receiver decodes the first half and hands over its state, and the new receiver
+% decodes the rest (the packets passed on by the old receiver are the first of them). Live test with the emulator:
+% serve(Emu, hUDP, 600) in one MATLAB session, recordData in a second, and takeOver in a third during the recording.
+rng(0);
+Emu = FeatherEmulator;
+Packets = generatePackets(Emu, generateSignal(Emu, 600*Emu.SampleRate), 0.02);
+Reference = decodePacket(WiFiUDPlogger, Packets{1});
+Reference = clearData(Reference);
+for iPacket = 2:length(Packets)
+    Reference = decodePacket(Reference, Packets{iPacket});
+end
+
+iHandoff = round(length(Packets)/2);
+Old = decodePacket(WiFiUDPlogger, Packets{1});
+Old = clearData(Old);
+for iPacket = 2:iHandoff
+    Old = decodePacket(Old, Packets{iPacket});
+end
+fileState = [tempname '.mat'];
+tic;
+State = handoffState(Old);
+save(fileState, 'State');
+tSave = toc;
+tic;
+Saved = load(fileState);
+New = restoreState(WiFiUDPlogger, Saved.State);
+tLoad = toc;
+File = dir(fileState);
+delete(fileState);
+for iPacket = iHandoff+1:length(Packets)
+    New = decodePacket(New, Packets{iPacket});
+end
+fprintf('state of %0.1f MB after %0.0f s: save %0.0f ms, load %0.0f ms\n', File.bytes/1e6, Old.nDataSamples/Emu.SampleRate, 1e3*tSave, 1e3*tLoad);
+fprintf('samples differing from a single receiver: %i of %i\n', ...
+    nnz(~(New.Data == Reference.Data | (isnan(New.Data) & isnan(Reference.Data)))), numel(Reference.Data));
+
+%% Pipeline tracing: cost per event, overhead on the decoding of a replayed session (packets/s) and export
+rng(0);
+Emu = FeatherEmulator;
+Packets = generatePackets(Emu, generateSignal(Emu, 300*Emu.SampleRate), 0.02);
+Trace = TraceRecorder;
+tic;
+for iEvent = 1:1e5
+    record(Trace, 'Decode', tick(Trace));
+end
+fprintf('tick and record: %0.2f us/event\n', 1e6*toc/1e5);
+
+% Decoding as in readData, without and with the trace
+tDecode = zeros(1, 2);
+for isTraced = [false true]
+    obj = decodePacket(WiFiUDPlogger, Packets{1});
+    obj = clearData(obj);
+    if isTraced
+        obj.Trace = TraceRecorder;
+    end
+    tic;
+    for iPacket = 2:length(Packets)
+        if ~isempty(obj.Trace)
+            tEvent = tick(obj.Trace);
+        end
+        obj = decodePacket(obj, Packets{iPacket});
+        if ~isempty(obj.Trace)
+            record(obj.Trace, 'Decode', tEvent);
+        end
+    end
+    tDecode(isTraced+1) = toc;
+end
+fprintf('decode: %0.0f packets/s untraced, %0.0f packets/s traced (overhead %0.1f%%)\n', ...
+    (length(Packets)-1)./tDecode, 100*(tDecode(2)/tDecode(1) - 1));
+
+fileTrace = [tempname '.json'];
+tic;
+exportChrome(obj.Trace, fileTrace);
+tExport = toc;
+File = dir(fileTrace);
+fprintf('export of %i events: %0.0f ms, %0.1f MB\n', min(obj.Trace.nEvents, obj.Trace.Capacity), 1e3*tExport, File.bytes/1e6);
+delete(fileTrace);
+Stats = summary(obj.Trace);
+fprintf('%s: %i events, mean %0.1f us, 99th percentile %0.1f us, max. %0.1f us\n', ...
+    Stats(1).Stage, Stats(1).nEvents, 1e6*[Stats(1).Mean Stats(1).P99 Stats(1).Max]);
+
+%% Local functions
+
+% The per-sample decoder of readData() before it was vectorised (used as reference by the ingest benchmark).
+function [Data, TimeAxis] = legacyDecode(Packets)
+    Status = Packets{1};
+    ADCsamplerate = Status(2) + 256*Status(3);
+    ADCgain = Status(4);
+    nADCinput = Status(5);
+    nADCbuffers = Status(6);
+    nADCbufferPos = Status(7) + 256*Status(8);
+    ADCscale = 3.3/2^12;
+    Data = nan(nADCinput, 1);
+    iData = 1;
+    iBufferLast = [];
+    for iPacket = 2:length(Packets)
+        RecvData = Packets{iPacket};
+        iBuffer = RecvData(2);
+        mEnabledInputs = bitget(RecvData(3),1:nADCinput) == 1;
+        iEnabledInputs = find(mEnabledInputs);
+        if RecvData(1) == 'D'
+            if isempty(iBufferLast)
+                iBufferLast = iBuffer - 1;
+            end
+            if iBuffer > iBufferLast
+                iMissing = iBufferLast+1:iBuffer-1;
+            else
+                iMissing = [iBufferLast+1:nADCbuffers-1 0:iBuffer-1];
+            end
+            iData = iData + 1 + length(iMissing);
+            iBufferLast = iBuffer;
+            iDataWrite = iData;
+        elseif iBuffer < iBufferLast
+            iDataWrite = iData - (iBufferLast - iBuffer);
+        else
+            iDataWrite = iData - (iBufferLast + (nADCbuffers-iBuffer));
+        end
+        if iDataWrite > 0
+            iRecvData = 4 + 10*length(iEnabledInputs);  % Skip the buffer summaries
+            iRange = (1:nADCbufferPos)+(iDataWrite-1)*nADCbufferPos;
+            for iInput = 1:length(iEnabledInputs)
+                for iBufferPos = 1:nADCbufferPos
+                    Sample = RecvData(iRecvData) + RecvData(iRecvData+1)*2^8;
+                    if Sample > 2^15
+                        Sample = Sample - 2^16;
+                    end
+                    Data(iEnabledInputs(iInput),iRange(iBufferPos)) = Sample * ADCscale / ADCgain;
+                    iRecvData = iRecvData + 2;
+                end
+            end
+            Data(~mEnabledInputs,iRange) = NaN;
+            TimeAxis = (0:size(Data,2)-1)/ADCsamplerate;
+        end
+    end
+end
+
+% Serve the emulator on a serial port (one end of a pseudo terminal pair) for Duration seconds (run on a pool worker).
+function servePty(Emu, Port, Duration)
+    hPty = serial(Port);
+    fopen(hPty);
+    serve(Emu, hPty, Duration);
+    fclose(hPty);
+    delete(hPty);
+end
+
+% Serve the emulator on a local UDP port for Duration seconds (run on a pool worker).
+function serveUdp(Emu, Port, Duration)
+    hUdp = udp('127.0.0.1', Port+1, 'LocalPort', Port);
+    fopen(hUdp);
+    serve(Emu, hUdp, Duration);
+    fclose(hUdp);
+    delete(hUdp);
+end
+
+% The automatic tare of the firmware (ADC_CompleteBlocks) on the readings of one input [unit: ADC codes], in the same
+% fixed point arithmetic. Offsets is the offset subtracted from each sample [unit: ADC codes].
+function [Tared, Offsets] = tareBlocks(Codes, nBufferPos)
+    TARE_MAX_RANGE = 32;
+    TARE_MAX_LOAD = 64;
+    TARE_SHIFT = 3;
+    TARE_FRACTION_BITS = 8;
+    TARE_WINDOW = 16;
+    Offset = 0;
+    isValid = false;
+    Offsets = zeros(size(Codes));
+    for iBlock = 1:floor(length(Codes)/nBufferPos)
+        iRange = (iBlock-1)*nBufferPos + (1:nBufferPos);
+        Block = Codes(iRange);
+        if max(Block) - min(Block) <= TARE_MAX_RANGE
+            Mean = sum(Block)*2^TARE_FRACTION_BITS/nBufferPos;
+            if iBlock <= TARE_WINDOW && (~isValid || Mean < Offset)
+                Offset = Mean;
+                isValid = true;
+            elseif isValid && Mean < Offset + TARE_MAX_LOAD*2^TARE_FRACTION_BITS
+                Offset = Offset + floor((Mean - Offset)/2^TARE_SHIFT);
+            end
+        end
+        Offsets(iRange) = floor((Offset + 2^(TARE_FRACTION_BITS-1))/2^TARE_FRACTION_BITS);
+    end
+    Tared = Codes - Offsets;
+end
@@ -0,0 +1,215 @@
+% >>Description<<
+% Class which stores derived data (e.g. filtered channels, step tables and spectra) on the local disk, so analyses
+% that are repeated with the same data and settings can reuse the previous results.
+% Entries are addressed by a key, which is normally the hash of the input data and the hash of the settings
+% (DerivedCache.hash). The least recently used entries are deleted when the cache exceeds MaxBytes.
+%
+% >>Properties<<
+%   CacheDir:           Directory holding the cached entries
+%   MaxBytes:           Maximum size of the cache on disk [unit: bytes]
+%   nHits:              Number of lookups that were found in the cache
+%   nMisses:            Number of lookups that were not found in the cache
+%
+% >>Functions<<
+%   obj = DerivedCache(CacheDir, MaxBytes)  ......  Open (or create) a cache (parameters are optional).
+%   [Value, isHit] = get(obj, Key)  ..............  Read an entry (Value is empty if it is not cached).
+%   put(obj, Key, Value)  ........................  Store an entry, and delete the least recently used entries if the cache is full.
+%   clear(obj)  ..................................  Delete all entries.
+%   Hash = DerivedCache.hash(Value, ...)  ........  Canonical SHA-1 hash of one or more values (struct fields are hashed in sorted order).
+%
+% >>Example<<
+%   Cache = DerivedCache;
+%   Key = [DerivedCache.hash(Data) '-' DerivedCache.hash(Config)];
+%   [Filtered, isHit] = get(Cache, Key);
+%   if ~isHit
+%       Filtered = filter(b, a, Data, [], 2);
+%       put(Cache, Key, Filtered);
+%   end
+
+classdef DerivedCache < handle
+    properties
+        CacheDir = fullfile(tempdir, 'WiFiUDPlogger_cache');
+        MaxBytes = 2^30;
+    end
+
+    properties (SetAccess = private)
+        nHits = 0;
+        nMisses = 0;
+    end
+
+    properties (SetAccess = private, Hidden = true)
+        Keys = {};                  % Key of each entry
+        Bytes = [];                 % Size of each entry on disk [unit: bytes]
+        LastAccess = [];            % Access counter value of the last lookup of each entry (LRU order)
+        AccessCounter = 0;          % Incremented on every lookup
+    end
+
+    methods
+
+        %% Open (or create) a cache (parameters are optional).
+        function obj = DerivedCache(CacheDir, MaxBytes)
+            if nargin >= 1 && ~isempty(CacheDir)
+                obj.CacheDir = CacheDir;
+            end
+            if nargin >= 2
+                obj.MaxBytes = MaxBytes;
+            end
+            if ~exist(obj.CacheDir, 'dir')
+                mkdir(obj.CacheDir);
+            end
+
+            % Load the index of the entries from a previous session
+            fileIndex = fullfile(obj.CacheDir, 'index.mat');
+            if exist(fileIndex, 'file')
+                Index = load(fileIndex);
+                obj.Keys = Index.Keys;
+                obj.Bytes = Index.Bytes;
+                obj.LastAccess = Index.LastAccess;
+                obj.AccessCounter = max([0 Index.LastAccess]);
+            end
+        end
+
+        %% Save the index when the object is deleted (the LRU order changes on every lookup).
+        function delete(obj)
+            saveIndex(obj);
+        end
+
+        %% Read an entry (Value is empty if it is not cached).
+        function [Value, isHit] = get(obj, Key)
+            Value = [];
+            [isHit, iEntry] = ismember(Key, obj.Keys);
+            if isHit
+                try
+                    Entry = load(entryFile(obj, Key));
+                    Value = Entry.Value;
+                catch
+                    removeEntries(obj, iEntry);
+                    isHit = false;
+                end
+            end
+
+            if isHit
+                obj.nHits = obj.nHits + 1;
+                obj.AccessCounter = obj.AccessCounter + 1;
+                obj.LastAccess(iEntry) = obj.AccessCounter;
+            else
+                obj.nMisses = obj.nMisses + 1;
+            end
+        end
+
+        %% Store an entry, and delete the least recently used entries if the cache is full.
+        function put(obj, Key, Value)
+            fileEntry = entryFile(obj, Key);
+            save(fileEntry, 'Value');
+            EntryInfo = dir(fileEntry);
+
+            [isCached, iEntry] = ismember(Key, obj.Keys);
+            if ~isCached
+                iEntry = length(obj.Keys) + 1;
+                obj.Keys{iEntry} = Key;
+            end
+            obj.AccessCounter = obj.AccessCounter + 1;
+            obj.Bytes(iEntry) = EntryInfo.bytes;
+            obj.LastAccess(iEntry) = obj.AccessCounter;
+
+            % Evict the least recently used entries (but never the new entry)
+            [~, iOrder] = sort(obj.LastAccess);
+            nEvict = find(sum(obj.Bytes) - [0 cumsum(obj.Bytes(iOrder))] <= obj.MaxBytes, 1) - 1;
+            if isempty(nEvict)
+                nEvict = length(iOrder);
+            end
+            removeEntries(obj, setdiff(iOrder(1:nEvict), iEntry));
+            saveIndex(obj);
+        end
+
+        %% Delete all entries.
+        function clear(obj)
+            removeEntries(obj, 1:length(obj.Keys));
+            obj.nHits = 0;
+            obj.nMisses = 0;
+            saveIndex(obj);
+        end
+
+    end
+
+    methods (Static)
+
+        %% Canonical SHA-1 hash of one or more values (struct fields are hashed in sorted order).
+        function Hash = hash(varargin)
+            md = java.security.MessageDigest.getInstance('SHA-1');
+            DerivedCache.hashUpdate(md, varargin);
+            Hash = sprintf('%02x', typecast(md.digest(), 'uint8'));
+        end
+
+    end
+
+    methods (Access = private)
+
+        function fileEntry = entryFile(obj, Key)
+            fileEntry = fullfile(obj.CacheDir, [Key '.mat']);
+        end
+
+        function removeEntries(obj, iEntries)
+            for iEntry = iEntries(:)'
+                fileEntry = entryFile(obj, obj.Keys{iEntry});
+                if exist(fileEntry, 'file')
+                    delete(fileEntry);
+                end
+            end
+            obj.Keys(iEntries) = [];
+            obj.Bytes(iEntries) = [];
+            obj.LastAccess(iEntries) = [];
+        end
+
+        function saveIndex(obj)
+            if exist(obj.CacheDir, 'dir')
+                Keys = obj.Keys;
+                Bytes = obj.Bytes;
+                LastAccess = obj.LastAccess;
+                save(fullfile(obj.CacheDir, 'index.mat'), 'Keys', 'Bytes', 'LastAccess');
+            end
+        end
+
+    end
+
+    methods (Static, Access = private)
+
+        %% Add a value to the hash: its class and size, followed by its content. Numbers are hashed as doubles.
+        function hashUpdate(md, Value)
+            if isnumeric(Value)
+                Value = double(Value);
+            end
+            md.update(int8(sprintf('<%s%s>', class(Value), sprintf(' %i', size(Value)))));
+
+            if isstruct(Value)
+                Fields = sort(fieldnames(Value));
+                for iElement = 1:numel(Value)
+                    for iField = 1:length(Fields)
+                        md.update(int8(Fields{iField}));
+                        DerivedCache.hashUpdate(md, Value(iElement).(Fields{iField}));
+                    end
+                end
+            elseif iscell(Value)
+                for iElement = 1:numel(Value)
+                    DerivedCache.hashUpdate(md, Value{iElement});
+                end
+            elseif isempty(Value)
+                return;
+            elseif ischar(Value)
+                md.update(typecast(uint16(Value(:)), 'int8'));
+            elseif islogical(Value)
+                md.update(int8(Value(:)));
+            elseif isnumeric(Value)
+                if ~isreal(Value)
+                    Value = [real(Value(:)); imag(Value(:))];
+                end
+                md.update(typecast(Value(:), 'int8'));
+            elseif isa(Value, 'function_handle')
+                md.update(int8(func2str(Value)));
+            else
+                error('DerivedCache.hash(): Values of class ''%s'' can not be hashed.', class(Value));
+            end
+        end
+
+    end
+end
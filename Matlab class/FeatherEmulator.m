@@ -0,0 +1,312 @@
+% >>Description<<
+% Class which emulates the Arduino Feather board, to allow the WiFiUDPlogger class to be tested and benchmarked without hardware.
+% The emulated signals resemble the force recorded under the heel and the forefoot during walking.
+%
+% >>Properties<<
+%   SampleRate:         Samplerate of the emulated ADC [unit: Hz]
+%   nADCinput:          Number of ADC inputs
+%   nADCbuffers:        Number of ADC buffers
+%   nADCbufferPos:      Number of positions in each buffer
+%   ADCgain:            Gain setting the PGA before to the ADC.
+%   EnabledInputs:      Enabled ADC inputs [type: bit mask]
+%   StepPeriod:         Mean time between two steps of the same foot [unit: seconds]
+%   StepVariability:    Relative standard deviation of the step period
+%   StanceFraction:     Fraction of the step period where the foot is loaded
+%   Amplitude:          Peak amplitude of the heel and forefoot signals [unit: Volt, size: 1x2]
+%   NoiseLevel:         Standard deviation of the additive noise [unit: Volt]
+%   LossBurstLength:    Mean number of consecutive lost UDP packets
+%   FRdecimation:       Flight recorder decimation (the ring is sampled at SampleRate*FRdecimation, 0: no flight recorder)
+%   BusyPoll:           true: serve() busy-polls (packets are written on time), false: serve() pauses 1 ms between polls
+%
+% >>Functions<<
+%   Data = generateSignal(obj, nSamples)  ........  Generate emulated ADC readings [size: nADCinput x nSamples, unit: Volt].
+%   [Data, mLost] = injectLoss(obj, Data, LossRate)  Replace the samples of lost UDP packets with NaN.
+%   Packets = generatePackets(obj, Data, LossRate, RetransmitLoss, SyncTimes)  UDP packets as transmitted by the firmware (parameters 'LossRate', 'RetransmitLoss' and 'SyncTimes' are optional).
+%   Packets = bulkPackets(obj, Frames)  ..........  Flight recorder bulk packets holding full rate readings [size: nADCinput x nFrames, unit: Volt].
+%   obj = serve(obj, hLink, Duration)  ...........  Answer commands and stream data in real time on an opened serial port or UDP object.
+%
+% >>Example<<
+%   Emu = FeatherEmulator;
+%   Data = generateSignal(Emu, 60*Emu.SampleRate);
+%   [DataLost, mLost] = injectLoss(Emu, Data, 0.05);
+%
+%   % USB transport with a pseudo terminal pair as stand-in for the board (Linux: socat -d -d pty,raw,echo=0 pty,raw,echo=0)
+%   hPty = serial('/dev/pts/3'); fopen(hPty);
+%   serve(Emu, hPty, 60);           % Run the logger in another MATLAB session with Transport='serial', SerialPort='/dev/pts/4'
+
+classdef FeatherEmulator
+    properties
+        SampleRate = 256;
+        nADCinput = 5;
+        nADCbuffers = 64;
+        nADCbufferPos = 16;
+        ADCgain = 1;
+        EnabledInputs = 31;
+
+        % Gait settings
+        StepPeriod = 1.1;
+        StepVariability = 0.03;
+        StanceFraction = 0.6;
+        Amplitude = [1.0 0.8];
+        NoiseLevel = 0.005;
+
+        % UDP loss settings
+        LossBurstLength = 3;
+
+        % Flight recorder settings
+        FRdecimation = 0;
+
+        % Serve settings
+        BusyPoll = false;
+    end
+
+    properties (SetAccess = private, Hidden = true)
+        ADCscale = 3.3/2^12;        % ADC scaling factor
+        RetransmitDelay = 1;        % Number of data packets sent before a requested retransmit arrives
+        FRringSize = 4096;          % Number of samples in the flight recorder ring (FR_RING_SIZE)
+        FRpacketBytes = 1024;       % Maximum number of sample bytes in each bulk packet (FR_PACKET_BYTES)
+        TimerTick = 64/48e6;        % Tick of the sample timer, which captures the sync pulse edges [unit: seconds]
+    end
+
+    methods
+
+        %% Generate emulated ADC readings [size: nADCinput x nSamples, unit: Volt].
+        % Input 1 is the heel, input 2 is the forefoot and the remaining inputs are unloaded.
+        function Data = generateSignal(obj, nSamples)
+            t = (0:nSamples-1)/obj.SampleRate;
+
+            % Step onsets with stride-to-stride variability
+            nSteps = ceil(t(end)/obj.StepPeriod/(1-3*obj.StepVariability)) + 1;
+            tOnset = 0.5 + [0; cumsum(obj.StepPeriod*(1 + obj.StepVariability*randn(nSteps,1)))];
+
+            % Progress through the stance phase (0 at heel strike, 1 at toe off)
+            Phase = interp1(tOnset, 0:nSteps, t);
+            Phase(isnan(Phase)) = -1;
+            iStep = max(floor(Phase), 0) + 1;
+            Stance = (t - tOnset(iStep)') ./ (obj.StanceFraction*diff(tOnset(min(iStep,nSteps) + [0; 1])));
+            Stance(Phase < 0) = -1;
+
+            Data = obj.NoiseLevel*randn(obj.nADCinput, nSamples);
+            mHeel = Stance >= 0 & Stance < 0.7;
+            mForefoot = Stance >= 0.3 & Stance < 1;
+            Data(1,mHeel) = Data(1,mHeel) + obj.Amplitude(1)*sin(pi*Stance(mHeel)/0.7);
+            Data(2,mForefoot) = Data(2,mForefoot) + obj.Amplitude(2)*sin(pi*(Stance(mForefoot)-0.3)/0.7).^2;
+        end
+
+        %% Replace the samples of lost UDP packets with NaN.
+        % Packets are lost in bursts (Gilbert model) with an overall loss rate of LossRate. mLost is true for
+        % every lost sample [size: 1 x nSamples].
+        function [Data, mLost] = injectLoss(obj, Data, LossRate)
+            nBlocks = floor(size(Data,2)/obj.nADCbufferPos);
+            BlockLost = lostBlocks(obj, nBlocks, LossRate);
+
+            mLost = false(1, size(Data,2));
+            mLost(1:nBlocks*obj.nADCbufferPos) = kron(BlockLost, true(1,obj.nADCbufferPos));
+            Data(:,mLost) = NaN;
+        end
+
+        %% UDP packets as transmitted by the firmware (parameters 'LossRate' and 'RetransmitLoss' are optional).
+        % Packets is a cell array of received packets (as returned by fread), starting with a status packet.
+        % Lost data packets are replaced by a retransmitted packet ('T') after RetransmitDelay data packets,
+        % unless the retransmit is lost as well (probability RetransmitLoss). A sync event ('Y') is written after the
+        % data packet of the block of each edge in SyncTimes [unit: seconds, captured at the timer tick], and is not lost.
+        function Packets = generatePackets(obj, Data, LossRate, RetransmitLoss, SyncTimes)
+            if nargin < 3
+                LossRate = 0;
+            end
+            if nargin < 4
+                RetransmitLoss = 0;
+            end
+            if nargin < 5
+                SyncTimes = [];
+            end
+            iEnabledInputs = find(bitget(obj.EnabledInputs, 1:obj.nADCinput));
+            nBlocks = floor(size(Data,2)/obj.nADCbufferPos);
+            BlockLost = lostBlocks(obj, nBlocks, LossRate);
+            RetransmitLost = rand(1, nBlocks) < RetransmitLoss;
+
+            % 12 bit ADC readings in 2-complement format
+            Samples = round(Data(iEnabledInputs,1:nBlocks*obj.nADCbufferPos) * obj.ADCgain / obj.ADCscale);
+            Samples = int16(min(max(Samples, -2^11), 2^11-1));
+
+            % Sample (0-based) and fraction of a sample period of the sync edges
+            SyncTimes = sort(SyncTimes(:)');
+            SyncSamples = floor(SyncTimes/obj.TimerTick)*obj.TimerTick*obj.SampleRate;
+            iSyncBlock = floor(SyncSamples/obj.nADCbufferPos) + 1;
+
+            Packets = cell(1, 1 + nBlocks + length(SyncTimes));
+            Packets{1} = statusPacket(obj);
+            nPackets = 1;
+            Pending = zeros(0,2);   % Lost blocks waiting for retransmit [iBlock, data packets left before it arrives]
+            for iBlock = 1:nBlocks
+                if BlockLost(iBlock)
+                    if ~RetransmitLost(iBlock)
+                        Pending(end+1,:) = [iBlock obj.RetransmitDelay];
+                    end
+                else
+                    nPackets = nPackets + 1;
+                    Packets{nPackets} = dataPacket(obj, 'D', iBlock, Samples);
+
+                    Pending(:,2) = Pending(:,2) - 1;
+                    for iLost = Pending(Pending(:,2) <= 0, 1)'
+                        nPackets = nPackets + 1;
+                        Packets{nPackets} = dataPacket(obj, 'T', iLost, Samples);
+                    end
+                    Pending(Pending(:,2) <= 0, :) = [];
+                end
+                for iEvent = find(iSyncBlock == iBlock)
+                    nPackets = nPackets + 1;
+                    Packets{nPackets} = syncPacket(obj, iEvent-1, SyncSamples(iEvent));
+                end
+            end
+            Packets = Packets(1:nPackets);
+        end
+
+        %% Flight recorder bulk packets holding full rate readings [size: nADCinput x nFrames, unit: Volt].
+        % Packets is a cell array with the packets in transmit order (see 'R' in the firmware protocol).
+        function Packets = bulkPackets(obj, Frames)
+            iEnabledInputs = find(bitget(obj.EnabledInputs, 1:obj.nADCinput));
+            Samples = round(Frames(iEnabledInputs,:) * obj.ADCgain / obj.ADCscale);
+            Samples = int16(min(max(Samples, -2^11), 2^11-1));
+
+            nPacketFrames = floor(obj.FRpacketBytes/(2*length(iEnabledInputs)));
+            nPackets = ceil(size(Samples,2)/nPacketFrames);
+            Packets = cell(1, nPackets);
+            for iPacket = 1:nPackets
+                iFrames = (iPacket-1)*nPacketFrames+1:min(iPacket*nPacketFrames, size(Samples,2));
+                Packets{iPacket} = [double('R'); mod(iPacket-1,256); floor((iPacket-1)/256); mod(nPackets,256); floor(nPackets/256); ...
+                    obj.EnabledInputs; double(typecast(reshape(Samples(:,iFrames), 1, []), 'uint8'))'];
+            end
+        end
+
+        %% Answer commands and stream data in real time on an opened serial port or UDP object, for Duration seconds.
+        % Packets on a serial port are framed as on the USB link of the firmware, and a UDP object answers the sender of
+        % the last command. 'S', 'A', 'G' and 'T' are answered as by the firmware, and other commands are ignored.
+        function obj = serve(obj, hLink, Duration)
+            Framed = isa(hLink, 'serial');
+            nBlocks = ceil(Duration*obj.SampleRate/obj.nADCbufferPos) + 1;
+            Data = generateSignal(obj, nBlocks*obj.nADCbufferPos);
+            Samples = round(Data * obj.ADCgain / obj.ADCscale);
+            Samples = int16(min(max(Samples, -2^11), 2^11-1));
+            Rest = [];
+            iBlock = 0;
+            tStart = tic;
+            while toc(tStart) < Duration
+                % Answer the received commands
+                Commands = {};
+                while hLink.BytesAvailable > 0
+                    RecvData = fread(hLink, hLink.BytesAvailable);
+                    if Framed
+                        [Packets, Rest] = WiFiUDPlogger.deframe([Rest; RecvData]);
+                        Commands = [Commands Packets]; %#ok<AGROW>
+                    else
+                        hLink.RemoteHost = hLink.DatagramAddress;
+                        hLink.RemotePort = hLink.DatagramPort;
+                        Commands{end+1} = RecvData; %#ok<AGROW>
+                    end
+                end
+                for iCommand = 1:length(Commands)
+                    Command = Commands{iCommand};
+                    Reply = [];
+                    switch Command(1)
+                        case 'S'
+                            Reply = statusPacket(obj);
+                        case 'A'
+                            if length(Command) >= 2 && Command(2) == '0'
+                                obj.EnabledInputs = 0;
+                                Reply = statusPacket(obj);
+                            elseif length(Command) >= 2 && Command(2) >= '1' && Command(2) < '1' + obj.nADCinput
+                                obj.EnabledInputs = bitset(obj.EnabledInputs, Command(2)-'0', length(Command) < 3 || Command(3) == '1');
+                            end
+                        case 'G'
+                            if length(Command) >= 2 && any(Command(2) == [1 2 4 8 16])
+                                obj.ADCgain = Command(2);
+                                Reply = statusPacket(obj);
+                            end
+                        case 'T'
+                            iLost = iBlock - mod(mod(iBlock-1, obj.nADCbuffers) - Command(2), obj.nADCbuffers);
+                            if iLost >= 1 && obj.EnabledInputs > 0
+                                Reply = dataPacket(obj, 'T', iLost, Samples(bitget(obj.EnabledInputs, 1:obj.nADCinput) == 1,:));
+                            end
+                    end
+                    if ~isempty(Reply)
+                        FeatherEmulator.writePacket(hLink, Reply, Framed);
+                    end
+                end
+                
+                % Write the data packets of the blocks sampled since the last write
+                while iBlock < min(floor(toc(tStart)*obj.SampleRate/obj.nADCbufferPos), nBlocks)
+                    iBlock = iBlock + 1;
+                    if obj.EnabledInputs > 0
+                        FeatherEmulator.writePacket(hLink, dataPacket(obj, 'D', iBlock, Samples(bitget(obj.EnabledInputs, 1:obj.nADCinput) == 1,:)), Framed);
+                    end
+                end
+                if ~obj.BusyPoll
+                    pause(0.001);
+                end
+            end
+        end
+
+    end
+
+    methods (Access = private)
+
+        %% Status packet ('S') of the emulated board.
+        function Packet = statusPacket(obj)
+            nEnabled = sum(bitget(obj.EnabledInputs, 1:obj.nADCinput));
+            nRingFrames = (obj.FRdecimation > 0) * floor(obj.FRringSize/max(nEnabled,1));
+            Packet = [double('S'); mod(obj.SampleRate,256); floor(obj.SampleRate/256); obj.ADCgain; obj.nADCinput; ...
+                obj.nADCbuffers; mod(obj.nADCbufferPos,256); floor(obj.nADCbufferPos/256); obj.EnabledInputs; ...
+                obj.FRdecimation; mod(nRingFrames,256); floor(nRingFrames/256)];
+        end
+
+        %% Data packet ('D' or 'T') holding block 'iBlock' of the ADC readings in Samples.
+        function Packet = dataPacket(obj, DataType, iBlock, Samples)
+            Block = Samples(:,(iBlock-1)*obj.nADCbufferPos + (1:obj.nADCbufferPos))';
+            Summary = [reshape(typecast(min(Block,[],1), 'uint8'), 2, [])
+                reshape(typecast(max(Block,[],1), 'uint8'), 2, [])
+                reshape(typecast(sum(int32(Block),1), 'uint8'), 4, [])
+                zeros(2, size(Block,2), 'uint8')];     % Tare offset (the emulated baselines do not drift)
+            Packet = [double(DataType); mod(iBlock-1, obj.nADCbuffers); obj.EnabledInputs; double(Summary(:)); double(typecast(Block(:), 'uint8'))];
+        end
+
+        %% Sync event packet ('Y') of an edge 'Sample' sample periods after the first sample (0-based).
+        function Packet = syncPacket(obj, iEvent, Sample)
+            iSample = floor(Sample);
+            iBlock = floor(iSample/obj.nADCbufferPos) + 1;
+            iBufferPos = iSample - (iBlock-1)*obj.nADCbufferPos;
+            Fraction = min(floor((Sample - iSample)*65536), 65535);
+            Packet = [double('Y'); mod(iEvent, 256); mod(iBlock-1, obj.nADCbuffers); mod(iBufferPos,256); floor(iBufferPos/256); ...
+                mod(Fraction,256); floor(Fraction/256)];
+        end
+
+        %% Lost UDP packets, in bursts (Gilbert model) with an overall loss rate of LossRate [size: 1 x nBlocks].
+        function BlockLost = lostBlocks(obj, nBlocks, LossRate)
+            pExit = 1/obj.LossBurstLength;
+            pEnter = LossRate*pExit/(1-LossRate);
+
+            BlockLost = false(1, nBlocks);
+            Draw = rand(1, nBlocks);
+            for iBlock = 2:nBlocks
+                if BlockLost(iBlock-1)
+                    BlockLost(iBlock) = Draw(iBlock) >= pExit;
+                else
+                    BlockLost(iBlock) = Draw(iBlock) < pEnter;
+                end
+            end
+        end
+
+    end
+
+    methods (Static, Access = private)
+
+        %% Write a packet on a serial port (framed) or UDP object.
+        function writePacket(hLink, Packet, Framed)
+            if Framed
+                Packet = WiFiUDPlogger.frame(Packet);
+            end
+            fwrite(hLink, uint8(Packet));
+        end
+
+    end
+end
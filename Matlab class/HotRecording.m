@@ -0,0 +1,427 @@
+% >>Description<<
+% Class which writes a live recording to the hot tier of a RecordingStore, and compacts it in the background into the
+% cold tier (the chunked recordings of the store).
+% The hot tier is append-only: the samples are buffered in memory and appended to raw segment files (SegmentLength
+% seconds each, samples of all inputs interleaved), and samples written again later (retransmitted packets) are
+% appended to a patch log, unless they are still buffered. The patches are also kept in memory with the sample range
+% of each, until they are folded into the cold tier, so a read only applies the patches overlapping it. A timer
+% compacts the hot tier one chunk at a time, once the samples are older than CompactionDelay: the chunk is read from
+% the segments with the patches folded in, and stored as a chunk of the recording in the store (as 16 bit ADC codes,
+% see RecordingStore.writeChunk), so the recording can be read with RecordingStore.read and RecordingQuery while it is
+% recorded. Patches that arrive for chunks which are already compacted rewrite those chunks. The compaction is
+% throttled to CompactionRate (token bucket), and each timer callback compacts at most the chunks its tokens allow, so
+% the receive loop is only delayed briefly.
+% When the recording is closed and fully compacted, the hot tier files are deleted.
+% A recording can be suspended and resumed in another MATLAB process (e.g. when the receiver is restarted while
+% recording): all samples are kept in the hot tier files, so the state is only the position in them.
+%
+% >>Properties<<
+%   Store:              RecordingStore holding the recording
+%   Name:               Name of the recording
+%   SampleRate:         Samplerate of the recording [unit: Hz]
+%   Labels:             Input labels [type: cell array of strings]
+%   Quantum:            Step of the ADC codes (ADCscale/ADCgain) [unit: Volt, empty: store the chunks as floats]
+%   SegmentLength:      Length of the hot tier segment files [unit: seconds]
+%   FlushLength:        Samples are appended to the segment files when this much is buffered [unit: seconds]
+%   CompactionDelay:    Samples are compacted when they are this much older than the last sample [unit: seconds]
+%   CompactionPeriod:   Period of the compaction timer [unit: seconds]
+%   CompactionRate:     Maximum rate of data read from the hot tier by the compaction [unit: bytes/s]
+%   Metadata:           Metadata of the recording in the store (see RecordingStore.write)
+%   Trace:              TraceRecorder of the writes and the compaction (see TraceRecorder, empty: disabled)
+%   nSamples:           Number of samples written
+%   nCompacted:         Number of samples in the cold tier
+%   isClosed:           true: No more samples are written
+%   isCompacted:        true: The recording is closed and the hot tier is compacted (and deleted)
+%   Bytes:              Bytes written [fields: Ingested (samples passed to write), Hot (segments and patch log), Cold (chunks and index)]
+%
+% >>Functions<<
+%   obj = HotRecording(Store, Name, SampleRate, Labels, Quantum, Background)  Start a recording (parameters 'Quantum' and 'Background' are optional).
+%   write(obj, iFirst, Data)  ....................  Write samples iFirst:iFirst+nSamples-1 [size: nInputs x nSamples, unit: Volt].
+%   Data = read(obj, iFirst, iLast)  .............  Read samples from the hot and cold tier, with the patches applied [size: nInputs x nSamples].
+%   close(obj)  ..................................  End the recording (the compaction continues in the background).
+%   compact(obj)  ................................  Compact the whole recording now (the recording must be closed).
+%   State = suspend(obj)  ........................  Stop the recording here, and return its state to resume it in another process.
+%   obj = HotRecording.resume(State, Store, Background)  Resume a suspended recording (parameters 'Store' and 'Background' are optional).
+%
+% >>Example<<
+%   Hot = HotRecording(RecordingStore, 'Session1', 1000, {'Heel', 'Forefoot'}, 3.3/2^12);
+%   write(Hot, 1, Block);           % Called for each received block
+%   close(Hot);
+
+classdef HotRecording < handle
+    properties (SetAccess = private)
+        Store = [];
+        Name = '';
+        SampleRate = [];
+        Labels = {};
+        Quantum = [];
+        nSamples = 0;
+        nCompacted = 0;
+        isClosed = false;
+        isCompacted = false;
+        Bytes = struct('Ingested', 0, 'Hot', 0, 'Cold', 0);
+    end
+
+    properties
+        SegmentLength = 60;
+        FlushLength = 0.25;
+        CompactionDelay = 5;
+        CompactionPeriod = 0.5;
+        CompactionRate = 20e6;
+        Metadata = struct();
+        Trace = [];
+    end
+
+    properties (SetAccess = private, Hidden = true)
+        HotDir = '';                % Directory of the hot tier files
+        Pending = [];               % Samples not yet appended to the segment files [size: nInputs x nPending]
+        nFlushed = 0;               % Number of samples in the segment files
+        nPatches = 0;               % Number of records in the patch log
+        nPatchesFolded = 0;         % Number of patch log records folded into the cold tier
+        Patches = struct('iFirst', {}, 'Data', {}, 'iRecord', {}); % Patch log records not yet folded into the cold tier (see readPatches)
+        PatchRange = zeros(0, 2);   % First and last sample of each record in Patches [size: nPatches x 2]
+        ColdIndex = [];             % Index of the recording in the store (see RecordingStore.info)
+        Tokens = 0;                 % Compaction budget [unit: bytes]
+        Timer = [];                 % Compaction timer
+    end
+
+    methods
+
+        %% Start a recording (parameters 'Quantum' and 'Background' are optional).
+        % Background (default: true) starts the compaction timer.
+        function obj = HotRecording(Store, Name, SampleRate, Labels, Quantum, Background)
+            if nargin == 0
+                return;                     % Recording restored by resume()
+            end
+            obj.Store = Store;
+            obj.Name = Name;
+            obj.SampleRate = SampleRate;
+            obj.Labels = Labels(:)';
+            if nargin >= 5
+                obj.Quantum = Quantum;
+            end
+            obj.HotDir = fullfile(Store.StoreDir, 'hot', Name);
+            if exist(obj.HotDir, 'dir')
+                rmdir(obj.HotDir, 's');
+            end
+            mkdir(obj.HotDir);
+            obj.Pending = zeros(length(obj.Labels), 0, 'single');
+            obj.ColdIndex = struct('Name', Name, 'SampleRate', SampleRate, 'Labels', {obj.Labels}, ...
+                'nInputs', length(obj.Labels), 'Metadata', struct(), 'ChunkHash', {{}}, 'ChunkSamples', []);
+
+            if nargin < 6 || Background
+                startTimer(obj);
+            end
+        end
+
+        function delete(obj)
+            stopTimer(obj);
+        end
+
+        %% Write samples iFirst:iFirst+nSamples-1 [size: nInputs x nSamples, unit: Volt].
+        % Samples after the last written sample are appended (a gap is filled with NaN), earlier samples are patched.
+        function write(obj, iFirst, Data)
+            if obj.isClosed
+                error('HotRecording.write(): The recording ''%s'' is closed.', obj.Name);
+            end
+            if ~isempty(obj.Trace)
+                tStore = tick(obj.Trace);
+            end
+            Data = single(Data);
+            obj.Bytes.Ingested = obj.Bytes.Ingested + 4*numel(Data);
+            nOld = min(max(obj.nSamples - iFirst + 1, 0), size(Data,2));
+            if nOld > 0
+                patch(obj, iFirst, Data(:,1:nOld));
+            end
+            if nOld < size(Data,2)
+                nGap = iFirst + nOld - obj.nSamples - 1;
+                obj.Pending = [obj.Pending nan(size(Data,1), nGap, 'single') Data(:,nOld+1:end)];
+                obj.nSamples = obj.nSamples + nGap + size(Data,2) - nOld;
+            end
+            if size(obj.Pending,2) >= obj.FlushLength*obj.SampleRate
+                flush(obj);
+            end
+            if ~isempty(obj.Trace)
+                record(obj.Trace, 'Store', tStore, size(Data,2));
+            end
+        end
+
+        %% Read samples from the hot and cold tier, with the patches applied [size: nInputs x nSamples].
+        function Data = read(obj, iFirst, iLast)
+            iFirst = max(iFirst, 1);
+            iLast = min(iLast, obj.nSamples);
+            Data = nan(length(obj.Labels), max(iLast-iFirst+1, 0));
+            if iFirst <= obj.nCompacted
+                iColdLast = min(iLast, obj.nCompacted);
+                Data(:,1:iColdLast-iFirst+1) = readBlock(obj.Store, obj.ColdIndex, 1:length(obj.Labels), iFirst, iColdLast)';
+            end
+            iHotFirst = max(iFirst, obj.nCompacted + 1);
+            if iHotFirst <= iLast
+                Data(:,iHotFirst-iFirst+1:end) = readHot(obj, iHotFirst, iLast);
+            end
+        end
+
+        %% End the recording (the compaction continues in the background).
+        function close(obj)
+            flush(obj);
+            obj.isClosed = true;
+        end
+
+        %% Compact the whole recording now (the recording must be closed).
+        function compact(obj)
+            if ~obj.isClosed
+                error('HotRecording.compact(): The recording ''%s'' must be closed first.', obj.Name);
+            end
+            stopTimer(obj);
+            compactStep(obj, true);
+        end
+
+        %% Stop the recording here, and return its state to resume it in another process.
+        % The buffered samples are appended to the segment files and the compaction is stopped, so the hot tier files
+        % hold the whole recording. The recording is closed here, but not compacted.
+        function State = suspend(obj)
+            flush(obj);
+            stopTimer(obj);
+            State.StoreDir = obj.Store.StoreDir;
+            for Property = {'Name', 'SampleRate', 'Labels', 'Quantum', 'Metadata', 'SegmentLength', 'FlushLength', ...
+                    'CompactionDelay', 'CompactionPeriod', 'CompactionRate', 'nSamples', 'nCompacted', 'Bytes', ...
+                    'HotDir', 'nFlushed', 'nPatches', 'nPatchesFolded', 'ColdIndex', 'Tokens'}
+                State.(Property{1}) = obj.(Property{1});
+            end
+            obj.isClosed = true;
+        end
+
+    end
+
+    methods (Static)
+
+        %% Resume a suspended recording (parameters 'Store' and 'Background' are optional).
+        % Store is the RecordingStore of the recording (default: opened from the directory in State), and Background
+        % (default: true) starts the compaction timer.
+        function obj = resume(State, Store, Background)
+            if nargin < 2 || isempty(Store)
+                Store = RecordingStore(State.StoreDir);
+            end
+            obj = HotRecording();
+            obj.Store = Store;
+            for Property = setdiff(fieldnames(State)', {'StoreDir'})
+                obj.(Property{1}) = State.(Property{1});
+            end
+            obj.Pending = zeros(length(obj.Labels), 0, 'single');
+            keepPatches(obj, readPatches(obj, 1));
+            prunePatches(obj);
+            if nargin < 3 || Background
+                startTimer(obj);
+            end
+        end
+
+    end
+
+    methods (Hidden = true)
+
+        %% Compaction timer callback: compact the sealed chunks the tokens allow, and fold late patches
+        % (parameter 'Unthrottled' is optional, true: compact all sealed chunks).
+        function compactStep(obj, Unthrottled)
+            if ~isempty(obj.Trace)
+                tCompaction = tick(obj.Trace);
+            end
+            flush(obj);
+            nInputs = length(obj.Labels);
+            nChunk = max(round(obj.Store.ChunkSize*obj.SampleRate), 1);
+            nSealed = obj.nSamples - round(obj.CompactionDelay*obj.SampleRate);
+            if obj.isClosed
+                nSealed = obj.nSamples;
+            end
+            ChunkBytes = 4*nInputs*nChunk;
+            if nargin >= 2 && Unthrottled
+                obj.Tokens = Inf;
+            else
+                obj.Tokens = min(obj.Tokens + obj.CompactionRate*obj.CompactionPeriod, max(ChunkBytes, obj.CompactionRate*obj.CompactionPeriod));
+            end
+            nChanged = 0;
+
+            % Patches of compacted samples: rewrite the chunks (the patches from the first new record). The other new
+            % patches are applied by readHot when their samples are compacted.
+            Patches = obj.Patches([obj.Patches.iRecord] > obj.nPatchesFolded);
+            iRecords = [Patches.iRecord];
+            mLate = [Patches.iFirst] <= obj.nCompacted;
+            for Patch = Patches(mLate)
+                iChunkStart = [0 cumsum(obj.ColdIndex.ChunkSamples)];
+                for iChunk = find(iChunkStart(2:end) >= Patch.iFirst & iChunkStart(1:end-1) < Patch.iFirst + size(Patch.Data,2) - 1)
+                    Chunk = readBlock(obj.Store, obj.ColdIndex, 1:nInputs, iChunkStart(iChunk) + 1, iChunkStart(iChunk+1))';
+                    Chunk = applyPatches(Chunk, iChunkStart(iChunk) + 1, Patch);
+                    [obj.ColdIndex.ChunkHash{iChunk}, obj.ColdIndex.ChunkSamples(iChunk)] = writeColdChunk(obj, Chunk);
+                    nChanged = nChanged + 1;
+                end
+            end
+            if ~isempty(iRecords)
+                obj.nPatchesFolded = iRecords(end);
+            end
+
+            % New chunks of sealed samples
+            while obj.nCompacted < nSealed && (obj.nCompacted + nChunk <= nSealed || obj.isClosed) && obj.Tokens >= ChunkBytes
+                iLast = min(obj.nCompacted + nChunk, nSealed);
+                Chunk = readHot(obj, obj.nCompacted + 1, iLast);
+                [obj.ColdIndex.ChunkHash{end+1}, obj.ColdIndex.ChunkSamples(end+1)] = writeColdChunk(obj, Chunk);
+                obj.Tokens = obj.Tokens - 4*numel(Chunk);
+                obj.nCompacted = iLast;
+                nChanged = nChanged + 1;
+            end
+            prunePatches(obj);
+            if nChanged > 0
+                obj.ColdIndex.Metadata = obj.Metadata;
+                saveIndex(obj.Store, obj.ColdIndex);
+                File = dir(fullfile(obj.Store.StoreDir, 'recordings', [obj.Name '.mat']));
+                obj.Bytes.Cold = obj.Bytes.Cold + File.bytes;
+            end
+
+            % Delete the hot tier when the closed recording is compacted
+            if obj.isClosed && obj.nCompacted == obj.nSamples && obj.nPatchesFolded == obj.nPatches
+                stopTimer(obj);
+                rmdir(obj.HotDir, 's');
+                obj.isCompacted = true;
+            end
+            if ~isempty(obj.Trace) && nChanged > 0
+                record(obj.Trace, 'Compaction', tCompaction, nChanged);
+            end
+        end
+
+    end
+
+    methods (Access = private)
+
+        %% Append the pending samples to the segment files.
+        function flush(obj)
+            nSegment = max(round(obj.SegmentLength*obj.SampleRate), 1);
+            while ~isempty(obj.Pending)
+                iSegment = floor(obj.nFlushed/nSegment) + 1;
+                n = min(size(obj.Pending,2), iSegment*nSegment - obj.nFlushed);
+                fid = fopen(segmentFile(obj, iSegment), 'a', 'ieee-le');
+                fwrite(fid, obj.Pending(:,1:n), 'single');
+                fclose(fid);
+                obj.Bytes.Hot = obj.Bytes.Hot + 4*numel(obj.Pending(:,1:n));
+                obj.Pending(:,1:n) = [];
+                obj.nFlushed = obj.nFlushed + n;
+            end
+        end
+
+        %% Patch samples written before: buffered samples are replaced, the others are appended to the patch log.
+        % Patch log record: [iFirst (double)][nSamples (double)][Data (single, nInputs x nSamples)]
+        function patch(obj, iFirst, Data)
+            nPending = obj.nSamples - obj.nFlushed;
+            iPending = iFirst - obj.nFlushed + (0:size(Data,2)-1);
+            mPending = iPending >= 1 & iPending <= nPending;
+            obj.Pending(:,iPending(mPending)) = Data(:,mPending);
+            if ~all(mPending)
+                iFlushed = find(~mPending);
+                fid = fopen(fullfile(obj.HotDir, 'patches.log'), 'a', 'ieee-le');
+                fwrite(fid, [iFirst + iFlushed(1) - 1, length(iFlushed)], 'double');
+                fwrite(fid, Data(:,iFlushed), 'single');
+                fclose(fid);
+                obj.nPatches = obj.nPatches + 1;
+                keepPatches(obj, struct('iFirst', iFirst + iFlushed(1) - 1, 'Data', Data(:,iFlushed), 'iRecord', obj.nPatches));
+                obj.Bytes.Hot = obj.Bytes.Hot + 16 + 4*numel(Data(:,iFlushed));
+            end
+        end
+
+        %% Samples iFirst to iLast from the segment files and the pending samples, with the patches overlapping them applied.
+        function Data = readHot(obj, iFirst, iLast)
+            nInputs = length(obj.Labels);
+            nSegment = max(round(obj.SegmentLength*obj.SampleRate), 1);
+            Data = nan(nInputs, iLast-iFirst+1);
+            for iSegment = floor((iFirst-1)/nSegment)+1:floor((min(iLast, obj.nFlushed)-1)/nSegment)+1
+                iStart = max(iFirst, (iSegment-1)*nSegment + 1);
+                iEnd = min([iLast, iSegment*nSegment, obj.nFlushed]);
+                if iEnd < iStart
+                    continue;
+                end
+                fid = fopen(segmentFile(obj, iSegment), 'r', 'ieee-le');
+                fseek(fid, 4*nInputs*(iStart - (iSegment-1)*nSegment - 1), 'bof');
+                Data(:,iStart-iFirst+1:iEnd-iFirst+1) = fread(fid, [nInputs iEnd-iStart+1], 'single');
+                fclose(fid);
+            end
+            iPendingFirst = max(iFirst, obj.nFlushed + 1);
+            if iPendingFirst <= iLast
+                Data(:,iPendingFirst-iFirst+1:end) = obj.Pending(:,iPendingFirst-obj.nFlushed:iLast-obj.nFlushed);
+            end
+            mOverlap = obj.PatchRange(:,1) <= iLast & obj.PatchRange(:,2) >= iFirst;
+            Data = applyPatches(Data, iFirst, obj.Patches(mOverlap));
+        end
+
+        %% Keep patch log records in memory [fields: iFirst, Data, iRecord].
+        function keepPatches(obj, Patches)
+            for Patch = Patches(:)'
+                obj.Patches(end+1) = Patch;
+                obj.PatchRange(end+1,:) = [Patch.iFirst, Patch.iFirst + size(Patch.Data,2) - 1];
+            end
+        end
+
+        %% Drop the patches from memory that are folded into the cold tier, and whose samples are all compacted.
+        function prunePatches(obj)
+            if isempty(obj.Patches)
+                return;
+            end
+            mDone = [obj.Patches.iRecord]' <= obj.nPatchesFolded & obj.PatchRange(:,2) <= obj.nCompacted;
+            obj.Patches(mDone) = [];
+            obj.PatchRange(mDone,:) = [];
+        end
+
+        %% Records of the patch log from record iStart on [fields: iFirst, Data, iRecord], and their record numbers.
+        function [Patches, iRecords] = readPatches(obj, iStart)
+            Patches = struct('iFirst', {}, 'Data', {}, 'iRecord', {});
+            iRecords = [];
+            if obj.nPatches < iStart
+                return;
+            end
+            nInputs = length(obj.Labels);
+            fid = fopen(fullfile(obj.HotDir, 'patches.log'), 'r', 'ieee-le');
+            for iRecord = 1:obj.nPatches
+                Header = fread(fid, 2, 'double');
+                if iRecord < iStart
+                    fseek(fid, 4*nInputs*Header(2), 'cof');
+                else
+                    Patches(end+1).iFirst = Header(1); %#ok<AGROW>
+                    Patches(end).Data = fread(fid, [nInputs Header(2)], 'single');
+                    Patches(end).iRecord = iRecord;
+                    iRecords(end+1) = iRecord; %#ok<AGROW>
+                end
+            end
+            fclose(fid);
+        end
+
+        %% Store a chunk in the cold tier [size: nInputs x nSamples].
+        function [Hash, nSamples] = writeColdChunk(obj, Chunk)
+            [Hash, nSamples] = writeChunk(obj.Store, Chunk, obj.Quantum);
+            File = dir(fullfile(obj.Store.StoreDir, 'chunks', [regexprep(Hash, '\.i16$', '') '.*']));
+            obj.Bytes.Cold = obj.Bytes.Cold + sum([File.bytes]);
+        end
+
+        function startTimer(obj)
+            obj.Timer = timer('ExecutionMode', 'fixedSpacing', 'Period', obj.CompactionPeriod, 'BusyMode', 'drop', ...
+                'TimerFcn', @(~,~) compactStep(obj), 'Name', ['HotRecording ' obj.Name]);
+            start(obj.Timer);
+        end
+
+        function stopTimer(obj)
+            if ~isempty(obj.Timer) && isvalid(obj.Timer)
+                stop(obj.Timer);
+                delete(obj.Timer);
+            end
+            obj.Timer = [];
+        end
+
+        function fileSegment = segmentFile(obj, iSegment)
+            fileSegment = fullfile(obj.HotDir, sprintf('segment%06i.f32', iSegment));
+        end
+
+    end
+end
+
+%% Apply patches [fields: iFirst, Data] to samples starting at sample iFirst [size: nInputs x nSamples].
+function Data = applyPatches(Data, iFirst, Patches)
+    for Patch = Patches(:)'
+        iTarget = Patch.iFirst - iFirst + (1:size(Patch.Data,2));
+        mInside = iTarget >= 1 & iTarget <= size(Data,2);
+        Data(:,iTarget(mInside)) = Patch.Data(:,mInside);
+    end
+end
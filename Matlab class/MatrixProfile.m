@@ -0,0 +1,267 @@
+% >>Description<<
+% Class which computes the matrix profile of one or more channels, to find motifs (the most similar pair of
+% subsequences, e.g. a recurring gait pattern) and discords (the subsequence least similar to all others, e.g. a
+% stumble) in long recordings.
+% The profile holds, for each subsequence of Window seconds, the z-normalised Euclidean distance to its nearest
+% neighbour (outside an exclusion zone of a quarter window). It is computed diagonal by diagonal of the distance
+% matrix (SCRIMP): the dot products along a diagonal follow from a cumulative sum of the products of the samples, so
+% each diagonal costs a few vector operations over the recording. The diagonals are processed in random order, so the
+% profile is a useful approximation after a fraction of the diagonals (anytime), and refine() can be called until
+% Progress reaches 1. The diagonals of each refine() call are split between the workers of the parallel pool
+% (UseParallel). Besides the profile of each channel, JointProfile uses the root mean square of the distances of all
+% channels, to find patterns that appear on all channels together.
+%
+% >>Properties<<
+%   Window:             Length of the subsequences [unit: seconds]
+%   SampleRate:         Samplerate of the data [unit: Hz]
+%   tStart:             Time of the first sample [unit: seconds]
+%   Profile:            Distance of each subsequence to its nearest neighbour [size: nColumns x nSubsequences]
+%   ProfileIndex:       Index of the nearest neighbour of each subsequence [size: nColumns x nSubsequences]
+%   JointProfile:       Profile of the RMS distance of all channels [size: 1 x nSubsequences]
+%   JointIndex:         Index of the nearest neighbour in JointProfile [size: 1 x nSubsequences]
+%   Progress:           Fraction of the diagonals of the distance matrix that have been processed
+%   UseParallel:        true: Process the diagonals on the workers of the parallel pool (Parallel Computing Toolbox)
+%
+% >>Functions<<
+%   obj = MatrixProfile(Source, Window, SampleRate)  Profile of a RecordingQuery or of data [size: nColumns x nSamples] (parameter 'SampleRate' is only used for data).
+%   obj = refine(obj, Fraction)  .................  Process a further fraction of the diagonals (parameter 'Fraction' is optional, default: all remaining).
+%   [tMotifs, tNeighbours, Distance] = motifs(obj, k, iColumn)  The k best motif pairs [unit: seconds] (parameters are optional, iColumn 0: joint profile).
+%   [tDiscords, Distance] = discords(obj, k, iColumn)  The k top discords [unit: seconds] (parameters are optional, iColumn 0: joint profile).
+%
+% >>Example<<
+%   Q = channel(query(RecordingStore, 'Session1'), [1 2]);
+%   MP = MatrixProfile(Q, 1.1);
+%   while MP.Progress < 1
+%       refine(MP, 0.01);
+%       tDiscords = discords(MP, 3)
+%   end
+
+classdef MatrixProfile < handle
+    properties (SetAccess = private)
+        Window = [];
+        SampleRate = [];
+        tStart = 0;
+        Profile = [];
+        ProfileIndex = [];
+        JointProfile = [];
+        JointIndex = [];
+        Progress = 0;
+    end
+
+    properties
+        UseParallel = false;
+    end
+
+    properties (SetAccess = private, Hidden = true)
+        Data = [];                  % Samples of each channel, less the mean of the channel (NaN replaced with 0) [size: nSamples x nColumns]
+        Mean = [];                  % Mean of each subsequence [size: nSubsequences x nColumns]
+        Deviation = [];             % Standard deviation of each subsequence (NaN if it has missing samples or no variation) [size: nSubsequences x nColumns]
+        Diagonals = [];             % Diagonals (offsets between the subsequences) in processing order
+        nDone = 0;                  % Number of diagonals processed
+    end
+
+    methods
+
+        %% Profile of a RecordingQuery or of data [size: nColumns x nSamples] (parameter 'SampleRate' is only used for data).
+        % The profile is empty until refine() is called. A query is evaluated chunk by chunk (see RecordingQuery.collect).
+        function obj = MatrixProfile(Source, Window, SampleRate)
+            if isa(Source, 'RecordingQuery')
+                SampleRate = Source.SampleRate;
+                [Source, TimeAxis] = collect(Source);
+                if ~isempty(TimeAxis)
+                    obj.tStart = TimeAxis(1);
+                end
+            end
+            obj.Window = Window;
+            obj.SampleRate = SampleRate;
+            m = round(Window*SampleRate);
+            nSubsequences = size(Source,2) - m + 1;
+            if m < 4 || nSubsequences < 2
+                error('MatrixProfile(): The window must hold at least 4 samples, and the data at least one window more.');
+            end
+
+            % Mean and deviation of the subsequences (over the samples less the mean of the channel, for precision)
+            X = Source' - mean(Source', 1, 'omitnan');
+            obj.Mean = movmean(X, [0 m-1], 1, 'Endpoints', 'discard');
+            obj.Deviation = movstd(X, [0 m-1], 1, 1, 'Endpoints', 'discard');
+            obj.Deviation(obj.Deviation < 1e-8*max(obj.Deviation(:))) = NaN;
+            X(isnan(X)) = 0;
+            obj.Data = X;
+
+            obj.Diagonals = ceil(m/4) + randperm(nSubsequences - 1 - ceil(m/4));
+            obj.Profile = inf(size(Source,1), nSubsequences);
+            obj.ProfileIndex = zeros(size(Source,1), nSubsequences);
+            obj.JointProfile = inf(1, nSubsequences);
+            obj.JointIndex = zeros(1, nSubsequences);
+        end
+
+        %% Process a further fraction of the diagonals (parameter 'Fraction' is optional, default: all remaining).
+        function obj = refine(obj, Fraction)
+            nDiagonals = length(obj.Diagonals);
+            if nargin < 2
+                Fraction = 1;
+            end
+            iNext = obj.nDone + 1:min(obj.nDone + ceil(Fraction*nDiagonals), nDiagonals);
+            if isempty(iNext)
+                return;
+            end
+
+            % Batches of diagonals, one per task of the parallel pool
+            nBatches = 1;
+            if obj.UseParallel && license('test', 'Distrib_Computing_Toolbox')
+                Pool = gcp;
+                nBatches = min(4*Pool.NumWorkers, length(iNext));
+            end
+            Batches = cell(nBatches, 1);
+            for iBatch = 1:nBatches
+                Batches{iBatch} = obj.Diagonals(iNext(iBatch:nBatches:end));
+            end
+            X = obj.Data;
+            Mu = obj.Mean;
+            Sigma = obj.Deviation;
+            m = round(obj.Window*obj.SampleRate);
+            Partials = cell(nBatches, 1);
+            parfor (iBatch = 1:nBatches, MatrixProfile.nWorkers(nBatches))
+                [P, I] = MatrixProfile.diagonals(X, Mu, Sigma, m, Batches{iBatch});
+                Partials{iBatch} = {P, I};
+            end
+
+            % Merge the profiles of the batches
+            P = [obj.Profile; obj.JointProfile];
+            I = [obj.ProfileIndex; obj.JointIndex];
+            for iBatch = 1:nBatches
+                mUpdate = Partials{iBatch}{1} < P;
+                P(mUpdate) = Partials{iBatch}{1}(mUpdate);
+                I(mUpdate) = Partials{iBatch}{2}(mUpdate);
+            end
+            obj.Profile = P(1:end-1,:);
+            obj.ProfileIndex = I(1:end-1,:);
+            obj.JointProfile = P(end,:);
+            obj.JointIndex = I(end,:);
+            obj.nDone = iNext(end);
+            obj.Progress = obj.nDone/nDiagonals;
+        end
+
+        %% The k best motif pairs [unit: seconds] (parameters are optional, iColumn 0: joint profile).
+        % Each motif is the subsequence with the lowest distance to its neighbour, after excluding one window around
+        % the previous motifs and their neighbours. tMotifs and tNeighbours are the start times of the subsequences.
+        function [tMotifs, tNeighbours, Distance] = motifs(obj, k, iColumn)
+            if nargin < 2
+                k = 1;
+            end
+            if nargin < 3
+                iColumn = 0;
+            end
+            [P, I] = selectProfile(obj, iColumn);
+            m = round(obj.Window*obj.SampleRate);
+            tMotifs = zeros(0,1);
+            tNeighbours = zeros(0,1);
+            Distance = zeros(0,1);
+            while length(Distance) < k
+                [dMin, iMin] = min(P);
+                if isinf(dMin) || isnan(dMin)
+                    break;
+                end
+                tMotifs(end+1,1) = obj.tStart + (iMin-1)/obj.SampleRate; %#ok<AGROW>
+                tNeighbours(end+1,1) = obj.tStart + (I(iMin)-1)/obj.SampleRate; %#ok<AGROW>
+                Distance(end+1,1) = dMin; %#ok<AGROW>
+                P(max(iMin-m+1,1):min(iMin+m-1,end)) = Inf;
+                P(max(I(iMin)-m+1,1):min(I(iMin)+m-1,end)) = Inf;
+            end
+        end
+
+        %% The k top discords [unit: seconds] (parameters are optional, iColumn 0: joint profile).
+        % Each discord is the subsequence with the highest distance to its neighbour, after excluding one window
+        % around the previous discords. tDiscords are the start times of the subsequences.
+        function [tDiscords, Distance] = discords(obj, k, iColumn)
+            if nargin < 2
+                k = 1;
+            end
+            if nargin < 3
+                iColumn = 0;
+            end
+            P = selectProfile(obj, iColumn);
+            P(isinf(P)) = NaN;
+            m = round(obj.Window*obj.SampleRate);
+            tDiscords = zeros(0,1);
+            Distance = zeros(0,1);
+            while length(Distance) < k
+                [dMax, iMax] = max(P);
+                if isnan(dMax)
+                    break;
+                end
+                tDiscords(end+1,1) = obj.tStart + (iMax-1)/obj.SampleRate; %#ok<AGROW>
+                Distance(end+1,1) = dMax; %#ok<AGROW>
+                P(max(iMax-m+1,1):min(iMax+m-1,end)) = NaN;
+            end
+        end
+
+    end
+
+    methods (Access = private)
+
+        function [P, I] = selectProfile(obj, iColumn)
+            if iColumn == 0
+                P = obj.JointProfile;
+                I = obj.JointIndex;
+            else
+                P = obj.Profile(iColumn,:);
+                I = obj.ProfileIndex(iColumn,:);
+            end
+        end
+
+    end
+
+    methods (Static, Hidden = true)
+
+        %% Profile (and joint profile in the last row) of the diagonals 'Offsets' of the distance matrix
+        % [size: nColumns+1 x nSubsequences]. The dot products QT of the subsequences i and i+Offset are the
+        % differences of the cumulative sum of the sample products along the diagonal.
+        function [P, I] = diagonals(X, Mu, Sigma, m, Offsets)
+            [nSubsequences, nColumns] = size(Mu);
+            P = inf(nColumns+1, nSubsequences);
+            I = zeros(nColumns+1, nSubsequences);
+            for Offset = Offsets(:)'
+                n = nSubsequences - Offset;
+                iA = 1:n;
+                iB = Offset + (1:n);
+                D = zeros(nColumns+1, n);
+                for iColumn = 1:nColumns
+                    QT = [0; cumsum(X(1:end-Offset,iColumn).*X(1+Offset:end,iColumn))];
+                    QT = QT(m+1:m+n) - QT(1:n);
+                    Correlation = (QT - m*Mu(iA,iColumn).*Mu(iB,iColumn)) ./ (m*Sigma(iA,iColumn).*Sigma(iB,iColumn));
+                    D(iColumn,:) = sqrt(max(2*m*(1 - Correlation), 0));
+                end
+                D(end,:) = sqrt(mean(D(1:nColumns,:).^2, 1));
+
+                % Both subsequences of each pair are updated
+                for iSide = 1:2
+                    if iSide == 1
+                        iSelf = iA;
+                        iPartner = iB;
+                    else
+                        iSelf = iB;
+                        iPartner = iA;
+                    end
+                    Ps = P(:,iSelf);
+                    Is = I(:,iSelf);
+                    mUpdate = D < Ps;
+                    Ps(mUpdate) = D(mUpdate);
+                    Partner = repmat(iPartner, nColumns+1, 1);
+                    Is(mUpdate) = Partner(mUpdate);
+                    P(:,iSelf) = Ps;
+                    I(:,iSelf) = Is;
+                end
+            end
+        end
+
+        %% Number of parallel workers (0 runs the parfor loop in this MATLAB session).
+        function n = nWorkers(nBatches)
+            n = 0;
+            if nBatches > 1
+                n = Inf;
+            end
+        end
+
+    end
+end
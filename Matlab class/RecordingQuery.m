@@ -0,0 +1,449 @@
+% >>Description<<
+% Class which describes a lazy query of a recording in a RecordingStore. Expressions over the inputs (arithmetic,
+% filters and moving windows) are only built when they are written, and are evaluated chunk by chunk when a result is
+% requested (mean, aggregate, atEvents, ...). Only the inputs used by the expression and the chunks overlapping the
+% time range are read, and the whole expression is evaluated on one chunk at a time, so intermediate results never
+% grow beyond the size of a chunk. Filters and moving windows read the samples they need before each chunk, so the
+% chunks are independent and can be evaluated by parallel workers (UseParallel).
+%
+% >>Properties<<
+%   Name:               Name of the queried recording
+%   SampleRate:         Samplerate of the recording [unit: Hz]
+%   tRange:             Time range of the query [unit: seconds, size: 1x2]
+%   UseParallel:        true: Evaluate the chunks on the workers of the parallel pool (Parallel Computing Toolbox)
+%
+% >>Functions<<
+%   Q = channel(Q, Input)  .......................  Select one or more inputs [type: index or label].
+%   Q = between(Q, tStart, tEnd)  ................  Restrict the query to a time range [unit: seconds].
+%   Q = A + B, A - B, A .* B, A ./ B, -A, abs(A)  .  Elementwise arithmetic of queries and numbers.
+%   Q = filter(Q, b, a, Warmup)  .................  Filter with coefficients b and a, settled over 'Warmup' seconds before each chunk (parameter 'Warmup' is optional).
+%   Q = movmean(Q, Window), movsum, movmin, movmax, movstd  Trailing moving window statistics [unit: seconds].
+%   [Data, TimeAxis] = collect(Q)  ...............  Evaluate the query [size: nColumns x nSamples].
+%   Value = mean(Q), sum(Q), min(Q), max(Q), std(Q)  Statistics of the query over the time range (NaN samples are ignored) [size: nColumns x 1].
+%   [Values, TimeAxis] = aggregate(Q, Window, Fun)  Statistic 'Fun' (mean, sum, min or max) of non-overlapping windows [unit: seconds].
+%   tEvents = crossings(Q, Threshold)  ...........  Times where the query rises above 'Threshold' [unit: seconds].
+%   [Segments, tSegment] = atEvents(Q, tEvents, Window)  Segments of the query around events, 'Window' relative to each event [unit: seconds, size: nEvents x nWindow x nColumns].
+%
+% >>Example<<
+%   Store = RecordingStore;
+%   Q = query(Store, 'Session1');
+%   Heel = channel(Q, 1);
+%   Forefoot = channel(Q, 2);
+%   Difference = mean(between(Heel - Forefoot, 60, 120));
+%   Steps = atEvents(Heel, crossings(movmean(Heel, 0.02), 0.3), [-0.1 0.6]);
+
+classdef RecordingQuery
+    properties (SetAccess = private)
+        Name = '';
+        SampleRate = [];
+        tRange = [];
+    end
+
+    properties
+        UseParallel = false;
+    end
+
+    properties (SetAccess = private, Hidden = true)
+        Store = [];                 % RecordingStore holding the recording
+        Index = [];                 % Index of the recording (see RecordingStore.info)
+        Node = [];                  % Expression tree [fields: Type, Fun, Args, Value, Lookback]
+    end
+
+    methods
+
+        %% Query of all inputs of recording 'Name' in RecordingStore 'Store' (normally created with query(Store, Name)).
+        function Q = RecordingQuery(Store, Name)
+            Q.Store = Store;
+            Q.Name = Name;
+            Q.Index = info(Store, Name);
+            Q.SampleRate = Q.Index.SampleRate;
+            Q.tRange = [0 Q.Index.Duration];
+            Q.Node = RecordingQuery.newNode('input', [], {}, 1:Q.Index.nInputs, 0);
+        end
+
+        %% Select one or more inputs [type: index or label].
+        function Q = channel(Q, Input)
+            if ischar(Input) || iscell(Input)
+                [isLabel, Input] = ismember(Input, Q.Index.Labels);
+                if ~all(isLabel)
+                    error('RecordingQuery.channel(): The recording ''%s'' has no input with this label.', Q.Name);
+                end
+            end
+            Q.Node = RecordingQuery.newNode('input', [], {}, Input(:)', 0);
+        end
+
+        %% Restrict the query to a time range [unit: seconds].
+        function Q = between(Q, tStart, tEnd)
+            Q.tRange = [max(tStart, Q.tRange(1)) min(tEnd, Q.tRange(2))];
+        end
+
+        %% Elementwise arithmetic of queries and numbers.
+        function Q = plus(A, B)
+            Q = RecordingQuery.combine(@plus, A, B);
+        end
+
+        function Q = minus(A, B)
+            Q = RecordingQuery.combine(@minus, A, B);
+        end
+
+        function Q = times(A, B)
+            Q = RecordingQuery.combine(@times, A, B);
+        end
+
+        function Q = mtimes(A, B)
+            Q = RecordingQuery.combine(@times, A, B);
+        end
+
+        function Q = rdivide(A, B)
+            Q = RecordingQuery.combine(@rdivide, A, B);
+        end
+
+        function Q = uminus(A)
+            A.Node = RecordingQuery.newNode('op', @uminus, {A.Node}, [], A.Node.Lookback);
+            Q = A;
+        end
+
+        function Q = abs(A)
+            A.Node = RecordingQuery.newNode('op', @abs, {A.Node}, [], A.Node.Lookback);
+            Q = A;
+        end
+
+        %% Filter with coefficients b and a, settled over 'Warmup' seconds before each chunk (parameter 'Warmup' is optional).
+        % The default warm-up matches the buffer added to the live plot windows (WiFiUDPlogger.AddLiveBuffer).
+        function Q = filter(Q, b, a, Warmup)
+            if nargin < 4
+                Warmup = 2;
+            end
+            Q.Node = RecordingQuery.newNode('filter', [], {Q.Node}, {b, a}, Q.Node.Lookback + round(Warmup*Q.SampleRate));
+        end
+
+        %% Trailing moving window statistics [unit: seconds].
+        function Q = movmean(Q, Window)
+            Q = movingWindow(Q, @movmean, Window);
+        end
+
+        function Q = movsum(Q, Window)
+            Q = movingWindow(Q, @movsum, Window);
+        end
+
+        function Q = movmin(Q, Window)
+            Q = movingWindow(Q, @movmin, Window);
+        end
+
+        function Q = movmax(Q, Window)
+            Q = movingWindow(Q, @movmax, Window);
+        end
+
+        function Q = movstd(Q, Window)
+            Q = movingWindow(Q, @movstd, Window);
+        end
+
+        %% Evaluate the query [size: nColumns x nSamples].
+        function [Data, TimeAxis] = collect(Q)
+            [Partials, iStarts] = execute(Q, @(Y, iStart) Y);
+            Data = vertcat(Partials{:})';
+            if isempty(iStarts)
+                Data = zeros(RecordingQuery.nColumns(Q.Node), 0);
+            end
+            [iFirst, iLast] = sampleRange(Q);
+            TimeAxis = (iFirst-1:iLast-1)/Q.SampleRate;
+        end
+
+        %% Statistics of the query over the time range (NaN samples are ignored) [size: nColumns x 1].
+        function Value = mean(Q)
+            Stats = reduce(Q);
+            Value = Stats.Mean;
+        end
+
+        function Value = sum(Q)
+            Stats = reduce(Q);
+            Value = Stats.Mean .* Stats.n;
+        end
+
+        function Value = min(Q)
+            Stats = reduce(Q);
+            Value = Stats.Min;
+        end
+
+        function Value = max(Q)
+            Stats = reduce(Q);
+            Value = Stats.Max;
+        end
+
+        function Value = std(Q)
+            Stats = reduce(Q);
+            Value = sqrt(Stats.M2 ./ (Stats.n - 1));
+        end
+
+        %% Statistic 'Fun' (mean, sum, min or max) of non-overlapping windows [unit: seconds].
+        % Values has a column for each window [size: nColumns x nWindows], and TimeAxis is the start of each window.
+        function [Values, TimeAxis] = aggregate(Q, Window, Fun)
+            [iFirst, iLast] = sampleRange(Q);
+            nWindow = max(round(Window*Q.SampleRate), 1);
+            nWindows = ceil((iLast-iFirst+1)/nWindow);
+            Partials = execute(Q, @(Y, iStart) RecordingQuery.windowPartial(Y, floor((iStart-iFirst+(0:size(Y,1)-1)')/nWindow) + 1));
+
+            % Combine the windows which were split between two chunks
+            Partials = vertcat(Partials{:});
+            nColumns = (size(Partials,2)-1)/4;
+            Values = zeros(nColumns, nWindows);
+            for iColumn = 1:nColumns
+                Part = Partials(:,1 + (iColumn-1)*4 + (1:4));
+                n = accumarray(Partials(:,1), Part(:,1), [nWindows 1]);
+                switch lower(Fun)
+                    case 'mean'
+                        Values(iColumn,:) = accumarray(Partials(:,1), Part(:,2), [nWindows 1]) ./ n;
+                    case 'sum'
+                        Values(iColumn,:) = accumarray(Partials(:,1), Part(:,2), [nWindows 1]);
+                    case 'min'
+                        Values(iColumn,:) = accumarray(Partials(:,1), Part(:,3), [nWindows 1], @min);
+                    case 'max'
+                        Values(iColumn,:) = accumarray(Partials(:,1), Part(:,4), [nWindows 1], @max);
+                    otherwise
+                        error('RecordingQuery.aggregate(): Unknown statistic ''%s''.', Fun);
+                end
+                Values(iColumn,n == 0) = NaN;
+            end
+            TimeAxis = (iFirst-1 + (0:nWindows-1)*nWindow)/Q.SampleRate;
+        end
+
+        %% Times where the query rises above 'Threshold' [unit: seconds].
+        % Only the first column of the query is used. The crossings at chunk boundaries are found from the last
+        % sample of the previous chunk.
+        function tEvents = crossings(Q, Threshold)
+            [Partials, iStarts] = execute(Q, @(Y, iStart) {iStart - 1 + find(Y(2:end,1) >= Threshold & Y(1:end-1,1) < Threshold) + 1, ...
+                Y([1 end],1) >= Threshold});
+            iEvents = zeros(0,1);
+            for iChunk = 1:length(Partials)
+                if iChunk > 1 && ~Partials{iChunk-1}{2}(2) && Partials{iChunk}{2}(1)
+                    iEvents(end+1,1) = iStarts(iChunk); %#ok<AGROW>
+                end
+                iEvents = [iEvents; Partials{iChunk}{1}]; %#ok<AGROW>
+            end
+            tEvents = (iEvents-1)/Q.SampleRate;
+        end
+
+        %% Segments of the query around events, 'Window' relative to each event [unit: seconds, size: nEvents x nWindow x nColumns].
+        % Only the samples of the segments (and the samples needed before them by filters and moving windows) are read.
+        function [Segments, tSegment] = atEvents(Q, tEvents, Window)
+            iOffsets = round(Window(1)*Q.SampleRate):round(Window(2)*Q.SampleRate);
+            iEvents = round(tEvents(:)*Q.SampleRate) + 1;
+            [iInputs, Node] = prepare(Q);
+            Store = Q.Store;
+            Index = Q.Index;
+            Lookback = Node.Lookback;
+
+            SegmentList = cell(length(iEvents), 1);
+            parfor (iEvent = 1:length(iEvents), RecordingQuery.nWorkers(Q))
+                Block = readBlock(Store, Index, iInputs, iEvents(iEvent) + iOffsets(1) - Lookback, iEvents(iEvent) + iOffsets(end));
+                Y = RecordingQuery.evaluate(Node, double(Block)) + zeros(size(Block,1), 1);
+                SegmentList{iEvent} = Y(Lookback+1:end,:);
+            end
+            Segments = permute(cat(3, zeros(length(iOffsets), RecordingQuery.nColumns(Node), 0), SegmentList{:}), [3 1 2]);
+            tSegment = iOffsets/Q.SampleRate;
+        end
+
+    end
+
+    methods (Access = private)
+
+        function Q = movingWindow(Q, Fun, Window)
+            nWindow = max(round(Window*Q.SampleRate), 1);
+            Q.Node = RecordingQuery.newNode('moving', Fun, {Q.Node}, nWindow, Q.Node.Lookback + nWindow - 1);
+        end
+
+        %% First and last sample of the time range.
+        function [iFirst, iLast] = sampleRange(Q)
+            iFirst = max(floor(Q.tRange(1)*Q.SampleRate) + 1, 1);
+            iLast = min(ceil(Q.tRange(2)*Q.SampleRate), Q.Index.nSamples);
+        end
+
+        %% Inputs read by the query, and the expression tree with the inputs renumbered to the columns of the read blocks.
+        function [iInputs, Node] = prepare(Q)
+            iInputs = unique(RecordingQuery.inputs(Q.Node));
+            Node = RecordingQuery.renumber(Q.Node, iInputs);
+        end
+
+        %% Evaluate the query on the chunks of the time range, and apply ChunkFun(Y, iStart) to the result of each
+        % chunk [size: nSamples x nColumns], where iStart is the sample number of the first row of Y.
+        function [Partials, iStarts] = execute(Q, ChunkFun)
+            [iFirst, iLast] = sampleRange(Q);
+            [iInputs, Node] = prepare(Q);
+            Store = Q.Store;
+            Index = Q.Index;
+            Lookback = Node.Lookback;
+
+            % Evaluate the chunks of the store, so each chunk file is mapped once
+            iBounds = unique([iFirst cumsum(Index.ChunkSamples)+1 iLast+1]);
+            iBounds = iBounds(iBounds >= iFirst & iBounds <= iLast+1);
+            iStarts = iBounds(1:end-1);
+            iEnds = iBounds(2:end) - 1;
+
+            Partials = cell(length(iStarts), 1);
+            parfor (iChunk = 1:length(iStarts), RecordingQuery.nWorkers(Q))
+                Block = readBlock(Store, Index, iInputs, iStarts(iChunk) - Lookback, iEnds(iChunk));
+                Y = RecordingQuery.evaluate(Node, double(Block)) + zeros(size(Block,1), 1);
+                Partials{iChunk} = ChunkFun(Y(Lookback+1:end,:), iStarts(iChunk));
+            end
+        end
+
+        %% Number of samples, mean, sum of squared deviations, min and max of each column (NaN samples are ignored).
+        function Stats = reduce(Q)
+            Partials = execute(Q, @RecordingQuery.statsPartial);
+            nColumns = RecordingQuery.nColumns(Q.Node);
+            Stats = struct('n', zeros(nColumns,1), 'Mean', nan(nColumns,1), 'M2', zeros(nColumns,1), ...
+                'Min', nan(nColumns,1), 'Max', nan(nColumns,1));
+            for iChunk = 1:length(Partials)
+                % Combine the means and squared deviations of two parts (Chan et al.)
+                P = Partials{iChunk};
+                n = Stats.n + P.n;
+                Delta = P.Mean - Stats.Mean;
+                Delta(Stats.n == 0 | P.n == 0) = 0;
+                Stats.Mean = (Stats.n.*fillNaN(Stats.Mean) + P.n.*fillNaN(P.Mean)) ./ n;
+                Stats.M2 = Stats.M2 + fillNaN(P.M2) + Delta.^2 .* Stats.n .* P.n ./ max(n, 1);
+                Stats.Min = min(Stats.Min, P.Min);
+                Stats.Max = max(Stats.Max, P.Max);
+                Stats.n = n;
+            end
+        end
+
+    end
+
+    methods (Static, Hidden = true)
+
+        %% Evaluate an expression tree on a block of samples [size: nSamples x nInputs].
+        function Y = evaluate(Node, Block)
+            switch Node.Type
+                case 'input'
+                    Y = Block(:,Node.Value);
+                case 'const'
+                    Y = Node.Value;
+                case 'op'
+                    Args = cell(1, length(Node.Args));
+                    for iArg = 1:length(Node.Args)
+                        Args{iArg} = RecordingQuery.evaluate(Node.Args{iArg}, Block);
+                    end
+                    Y = Node.Fun(Args{:});
+                case 'filter'
+                    Y = RecordingQuery.filterSegments(Node.Value{1}, Node.Value{2}, RecordingQuery.evaluate(Node.Args{1}, Block));
+                case 'moving'
+                    X = RecordingQuery.evaluate(Node.Args{1}, Block);
+                    if isequal(Node.Fun, @movstd)
+                        Y = movstd(X, [Node.Value-1 0], 0, 1, 'omitnan');
+                    else
+                        Y = Node.Fun(X, [Node.Value-1 0], 1, 'omitnan');
+                    end
+            end
+        end
+
+        %% Number of parallel workers (0 runs the parfor loops in this MATLAB session).
+        function n = nWorkers(Q)
+            n = 0;
+            if Q.UseParallel && license('test', 'Distrib_Computing_Toolbox')
+                n = Inf;
+            end
+        end
+
+    end
+
+    methods (Static, Access = private)
+
+        function Node = newNode(Type, Fun, Args, Value, Lookback)
+            Node = struct('Type', Type, 'Fun', Fun, 'Args', {Args}, 'Value', {Value}, 'Lookback', Lookback);
+        end
+
+        %% Elementwise operation of two queries or a query and a number.
+        function Q = combine(Fun, A, B)
+            Args = {A, B};
+            for iArg = 1:2
+                if isa(Args{iArg}, 'RecordingQuery')
+                    Q = Args{iArg};
+                    Args{iArg} = Args{iArg}.Node;
+                else
+                    Args{iArg} = RecordingQuery.newNode('const', [], {}, double(Args{iArg}), 0);
+                end
+            end
+            if isa(A, 'RecordingQuery') && isa(B, 'RecordingQuery')
+                if ~strcmp(A.Name, B.Name) || A.Store ~= B.Store
+                    error('RecordingQuery: Queries of different recordings can not be combined.');
+                end
+                Q = between(A, B.tRange(1), B.tRange(2));
+            end
+            Q.Node = RecordingQuery.newNode('op', Fun, Args, [], max(Args{1}.Lookback, Args{2}.Lookback));
+        end
+
+        %% Inputs used by an expression tree.
+        function iInputs = inputs(Node)
+            iInputs = [];
+            if strcmp(Node.Type, 'input')
+                iInputs = Node.Value;
+            end
+            for iArg = 1:length(Node.Args)
+                iInputs = [iInputs RecordingQuery.inputs(Node.Args{iArg})]; %#ok<AGROW>
+            end
+        end
+
+        %% Number of columns of the result of an expression tree.
+        function n = nColumns(Node)
+            n = 1;
+            if strcmp(Node.Type, 'input')
+                n = length(Node.Value);
+            end
+            for iArg = 1:length(Node.Args)
+                n = max(n, RecordingQuery.nColumns(Node.Args{iArg}));
+            end
+        end
+
+        %% Renumber the inputs of an expression tree to their positions in iInputs.
+        function Node = renumber(Node, iInputs)
+            if strcmp(Node.Type, 'input')
+                [~, Node.Value] = ismember(Node.Value, iInputs);
+            end
+            for iArg = 1:length(Node.Args)
+                Node.Args{iArg} = RecordingQuery.renumber(Node.Args{iArg}, iInputs);
+            end
+        end
+
+        %% Filter each column of X, resetting the filter state after every NaN gap.
+        function X = filterSegments(b, a, X)
+            for iColumn = 1:size(X,2)
+                dValid = diff([false; ~isnan(X(:,iColumn)); false]);
+                iStart = find(dValid == 1);
+                iEnd = find(dValid == -1) - 1;
+                for iSeg = 1:length(iStart)
+                    X(iStart(iSeg):iEnd(iSeg),iColumn) = filter(b, a, X(iStart(iSeg):iEnd(iSeg),iColumn));
+                end
+            end
+        end
+
+        %% Number of valid samples, mean, sum of squared deviations, min and max of each column of Y.
+        function P = statsPartial(Y, ~)
+            mValid = ~isnan(Y);
+            P.n = sum(mValid,1)';
+            Y(~mValid) = 0;
+            P.Mean = sum(Y,1)' ./ P.n;
+            P.M2 = sum(((Y - fillNaN(P.Mean)') .* mValid).^2, 1)';
+            Y(~mValid) = NaN;
+            P.Min = min(Y, [], 1)';
+            P.Max = max(Y, [], 1)';
+        end
+
+        %% Window number followed by the number of valid samples, sum, min and max of each column in each window.
+        function Partial = windowPartial(Y, iWindow)
+            mValid = ~isnan(Y);
+            [iWindows, ~, iGroup] = unique(iWindow);
+            Partial = iWindows;
+            for iColumn = 1:size(Y,2)
+                y = Y(:,iColumn);
+                Partial = [Partial, accumarray(iGroup, mValid(:,iColumn)), accumarray(iGroup(mValid(:,iColumn)), y(mValid(:,iColumn)), size(iWindows)), ...
+                    accumarray(iGroup, y, size(iWindows), @min), accumarray(iGroup, y, size(iWindows), @max)]; %#ok<AGROW>
+            end
+        end
+
+    end
+end
+
+%% Replace NaN with zero (the mean of a part without valid samples).
+function x = fillNaN(x)
+    x(isnan(x)) = 0;
+end
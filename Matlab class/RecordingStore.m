@@ -0,0 +1,477 @@
+% >>Description<<
+% Class which stores recordings on the local disk in chunks, so parts of long recordings can be read (or queried with
+% RecordingQuery) without loading the whole recording into memory.
+% Each chunk holds ChunkSize seconds of all inputs as single precision floats, with the samples of each input stored
+% contiguously, and is named by the hash of its content (identical chunks are stored once). Chunks of raw ADC
+% readings can be stored as 16 bit ADC codes instead (half the size, see writeChunk). Each recording has an
+% index listing its chunks, samplerate, input labels and metadata.
+% Live recordings are written to a hot tier, and compacted into chunks while they are recorded (see HotRecording).
+% Recordings are edited (trimmed, split, concatenated and relabelled) by rewriting their indexes: the chunks within
+% the kept range are shared with the original, and only the chunks at the boundaries of the range are rewritten.
+% Recordings can be exported to CSV and C3D files. The exporters read, format and write ExportBlockSize samples at a
+% time, so the recording is never held in memory as a whole, and each block is written with one fwrite.
+%
+% >>Properties<<
+%   StoreDir:           Directory holding the chunks and the recording indexes
+%   ChunkSize:          Length of the chunks of new recordings [unit: seconds]
+%   ExportBlockSize:    Number of samples read, formatted and written at a time by the exporters
+%   UseParallel:        true: Format the CSV blocks on the workers of the parallel pool (Parallel Computing Toolbox)
+%   Catalog:            Catalog kept up to date with the recordings of the store (see SessionCatalog, [] for none)
+%
+% >>Functions<<
+%   obj = RecordingStore(StoreDir)  ..............  Open (or create) a store (parameter 'StoreDir' is optional).
+%   Names = list(obj)  ...........................  Names of the stored recordings [type: cell array of strings].
+%   Index = write(obj, Name, Data, SampleRate, Labels, Metadata)  Store a recording [size: nInputs x nSamples] (parameters 'Labels' and 'Metadata' are optional).
+%   Index = info(obj, Name)  .....................  Index of a recording (samplerate, labels, metadata and chunks).
+%   [Data, TimeAxis] = read(obj, Name, iInputs, tRange)  Read inputs 'iInputs' in the time range 'tRange' [unit: seconds] (parameters 'iInputs' and 'tRange' are optional).
+%   Q = query(obj, Name)  ........................  Lazy query of a recording (see RecordingQuery).
+%   remove(obj, Name)  ...........................  Delete a recording (chunks shared with other recordings are kept).
+%   nDeleted = collectGarbage(obj)  ..............  Delete chunks which are not used by any recording.
+%   Index = trim(obj, Name, tRange)  .............  Keep only the time range 'tRange' of a recording [unit: seconds].
+%   split(obj, Name, tSplit, NewNames)  ..........  Split a recording at the times 'tSplit' into recordings 'NewNames' [unit: seconds].
+%   Index = concat(obj, Names, NewName)  .........  Concatenate recordings (same samplerate and inputs) into a new recording.
+%   Index = relabel(obj, Name, Labels)  ..........  Change the input labels of a recording.
+%   exportCSV(obj, Name, fileName, iInputs, tRange)  Export a recording to a CSV file (parameters 'iInputs' and 'tRange' are optional).
+%   exportC3D(obj, Name, fileName, iInputs, tRange)  Export a recording to the analog data of a C3D file (parameters 'iInputs' and 'tRange' are optional).
+%
+% >>Example<<
+%   Store = RecordingStore;
+%   write(Store, 'Session1', obj.Data, obj.ADCsamplerate, obj.labelADCinput);
+%   [Data, TimeAxis] = read(Store, 'Session1', [1 2], [60 120]);
+%   trim(Store, 'Session1', [30 Inf]);
+%   split(Store, 'Session1', [600 1200], {'Trial1', 'Trial2', 'Trial3'});
+%   exportC3D(Store, 'Trial1', 'Trial1.c3d');
+
+classdef RecordingStore < handle
+    properties
+        StoreDir = fullfile(tempdir, 'WiFiUDPlogger_recordings');
+        ChunkSize = 10;
+        ExportBlockSize = 2^16;
+        UseParallel = false;
+        Catalog = [];
+    end
+
+    methods
+
+        %% Open (or create) a store (parameter 'StoreDir' is optional).
+        function obj = RecordingStore(StoreDir)
+            if nargin >= 1 && ~isempty(StoreDir)
+                obj.StoreDir = StoreDir;
+            end
+            for Dir = {obj.StoreDir, fullfile(obj.StoreDir, 'chunks'), fullfile(obj.StoreDir, 'recordings')}
+                if ~exist(Dir{1}, 'dir')
+                    mkdir(Dir{1});
+                end
+            end
+        end
+
+        %% Names of the stored recordings [type: cell array of strings].
+        function Names = list(obj)
+            Files = dir(fullfile(obj.StoreDir, 'recordings', '*.mat'));
+            Names = sort(regexprep({Files.name}, '\.mat$', ''));
+        end
+
+        %% Store a recording [size: nInputs x nSamples] (parameters 'Labels' and 'Metadata' are optional).
+        function Index = write(obj, Name, Data, SampleRate, Labels, Metadata)
+            if nargin < 5 || isempty(Labels)
+                Labels = arrayfun(@(iInput) sprintf('A%i', iInput), 1:size(Data,1), 'UniformOutput', false);
+            end
+            if nargin < 6
+                Metadata = struct();
+            end
+            nChunk = max(round(obj.ChunkSize*SampleRate), 1);
+            nChunks = ceil(size(Data,2)/nChunk);
+
+            Index.Name = Name;
+            Index.SampleRate = SampleRate;
+            Index.Labels = Labels(1:size(Data,1));
+            Index.nInputs = size(Data,1);
+            Index.Metadata = Metadata;
+            Index.ChunkHash = cell(1, nChunks);
+            Index.ChunkSamples = zeros(1, nChunks);
+            for iChunk = 1:nChunks
+                iRange = (iChunk-1)*nChunk+1:min(iChunk*nChunk, size(Data,2));
+                [Index.ChunkHash{iChunk}, Index.ChunkSamples(iChunk)] = writeChunk(obj, Data(:,iRange));
+            end
+            saveIndex(obj, Index);
+        end
+
+        %% Index of a recording (samplerate, labels, metadata and chunks).
+        function Index = info(obj, Name)
+            fileIndex = indexFile(obj, Name);
+            if ~exist(fileIndex, 'file')
+                error('RecordingStore.info(): The recording ''%s'' does not exist.', Name);
+            end
+            Index = load(fileIndex);
+            Index.nSamples = sum(Index.ChunkSamples);
+            Index.Duration = Index.nSamples/Index.SampleRate;
+        end
+
+        %% Read inputs 'iInputs' in the time range 'tRange' [unit: seconds] (parameters 'iInputs' and 'tRange' are optional).
+        % Only the chunks overlapping the time range are read. Data has the same layout as WiFiUDPlogger.Data.
+        function [Data, TimeAxis] = read(obj, Name, iInputs, tRange)
+            if nargin < 3
+                iInputs = [];
+            end
+            if nargin < 4
+                tRange = [];
+            end
+            [Index, iInputs, iFirst, iLast] = selectRange(obj, Name, iInputs, tRange);
+            Data = double(readBlock(obj, Index, iInputs, iFirst, iLast)');
+            TimeAxis = (iFirst-1:iLast-1)/Index.SampleRate;
+        end
+
+        %% Lazy query of a recording (see RecordingQuery).
+        function Q = query(obj, Name)
+            Q = RecordingQuery(obj, Name);
+        end
+
+        %% Delete a recording (chunks shared with other recordings are kept).
+        function remove(obj, Name)
+            delete(indexFile(obj, Name));
+            if ~isempty(obj.Catalog)
+                remove(obj.Catalog, obj, Name);
+            end
+            collectGarbage(obj);
+        end
+
+        %% Delete chunks which are not used by any recording.
+        function nDeleted = collectGarbage(obj)
+            Used = {};
+            for Name = list(obj)
+                Index = info(obj, Name{1});
+                Used = [Used Index.ChunkHash]; %#ok<AGROW>
+            end
+            Files = [dir(fullfile(obj.StoreDir, 'chunks', '*.f32')); dir(fullfile(obj.StoreDir, 'chunks', '*.i16'))];
+            mUnused = ~ismember(regexprep({Files.name}, '\.f32$', ''), Used);
+            for File = Files(mUnused)'
+                delete(fullfile(obj.StoreDir, 'chunks', File.name));
+            end
+            nDeleted = nnz(mUnused);
+        end
+
+        %% Keep only the time range 'tRange' of a recording [unit: seconds].
+        % The replaced boundary chunks are deleted by collectGarbage.
+        function Index = trim(obj, Name, tRange)
+            [Index, ~, iFirst, iLast] = selectRange(obj, Name, [], tRange);
+            Index = sliceIndex(obj, Index, iFirst, iLast);
+            saveIndex(obj, Index);
+        end
+
+        %% Split a recording at the times 'tSplit' into recordings 'NewNames' [unit: seconds].
+        % NewNames has one name more than tSplit. The original recording is deleted, unless it is one of the new names.
+        function split(obj, Name, tSplit, NewNames)
+            if length(NewNames) ~= length(tSplit) + 1
+                error('RecordingStore.split(): One name more than split times is needed.');
+            end
+            Index = info(obj, Name);
+            iBounds = [0 round(sort(tSplit(:)')*Index.SampleRate) Index.nSamples];
+            for iPart = 1:length(NewNames)
+                Part = sliceIndex(obj, Index, max(iBounds(iPart)+1, 1), min(iBounds(iPart+1), Index.nSamples));
+                Part.Name = NewNames{iPart};
+                saveIndex(obj, Part);
+            end
+            if ~ismember(Name, NewNames)
+                delete(indexFile(obj, Name));
+                if ~isempty(obj.Catalog)
+                    remove(obj.Catalog, obj, Name);
+                end
+            end
+        end
+
+        %% Concatenate recordings (same samplerate and inputs) into a new recording.
+        % The new recording references the chunks of the recordings, and has the labels and metadata of the first.
+        function Index = concat(obj, Names, NewName)
+            Index = info(obj, Names{1});
+            for iName = 2:length(Names)
+                Next = info(obj, Names{iName});
+                if Next.SampleRate ~= Index.SampleRate || Next.nInputs ~= Index.nInputs
+                    error('RecordingStore.concat(): The recording ''%s'' differs in samplerate or number of inputs.', Names{iName});
+                end
+                Index.ChunkHash = [Index.ChunkHash Next.ChunkHash];
+                Index.ChunkSamples = [Index.ChunkSamples Next.ChunkSamples];
+            end
+            Index.Name = NewName;
+            saveIndex(obj, Index);
+        end
+
+        %% Change the input labels of a recording.
+        function Index = relabel(obj, Name, Labels)
+            Index = info(obj, Name);
+            if length(Labels) ~= Index.nInputs
+                error('RecordingStore.relabel(): The recording ''%s'' has %i inputs.', Name, Index.nInputs);
+            end
+            Index.Labels = Labels(:)';
+            saveIndex(obj, Index);
+        end
+
+        %% Export a recording to a CSV file (parameters 'iInputs' and 'tRange' are optional).
+        % The file has a header line (Time and the input labels) and a line for each sample [unit: seconds, Volt].
+        % Missing samples are written as NaN.
+        function exportCSV(obj, Name, fileName, iInputs, tRange)
+            if nargin < 4
+                iInputs = [];
+            end
+            if nargin < 5
+                tRange = [];
+            end
+            [Index, iInputs, iFirst, iLast] = selectRange(obj, Name, iInputs, tRange);
+            fid = fopen(fileName, 'w');
+            if fid < 0
+                error('RecordingStore.exportCSV(): The file ''%s'' cannot be opened.', fileName);
+            end
+            fprintf(fid, '%s\n', strjoin([{'Time'} Index.Labels(iInputs)], ','));
+            Format = ['%.6f' repmat(',%.7g', 1, length(iInputs)) '\n'];
+
+            % The blocks are formatted in groups of one block per task of the parallel pool, and written in order
+            nWorkers = 0;
+            nGroup = 1;
+            if obj.UseParallel && license('test', 'Distrib_Computing_Toolbox')
+                Pool = gcp;
+                nWorkers = Inf;
+                nGroup = 2*Pool.NumWorkers;
+            end
+            iStarts = iFirst:obj.ExportBlockSize:iLast;
+            nBlock = obj.ExportBlockSize;
+            for iGroup = 1:nGroup:length(iStarts)
+                iGroupStarts = iStarts(iGroup:min(iGroup+nGroup-1, end));
+                Text = cell(size(iGroupStarts));
+                parfor (iBlock = 1:length(iGroupStarts), nWorkers)
+                    iEnd = min(iGroupStarts(iBlock) + nBlock - 1, iLast);
+                    Block = readBlock(obj, Index, iInputs, iGroupStarts(iBlock), iEnd);
+                    Text{iBlock} = sprintf(Format, [(iGroupStarts(iBlock)-1:iEnd-1)/Index.SampleRate; double(Block')]);
+                end
+                for iBlock = 1:length(Text)
+                    fwrite(fid, Text{iBlock}, 'char');
+                end
+            end
+            fclose(fid);
+        end
+
+        %% Export a recording to the analog data of a C3D file (parameters 'iInputs' and 'tRange' are optional).
+        % The file holds no 3D points, and the inputs are stored as analog channels in floating point format (Intel
+        % byte order) [unit: Volt]. The frame rate is the samplerate divided by the number of analog samples per
+        % frame, which is chosen so the number of frames fits the 16 bit fields of the format (the last frame is
+        % padded with zeros). Missing samples are written as NaN.
+        function exportC3D(obj, Name, fileName, iInputs, tRange)
+            if nargin < 4
+                iInputs = [];
+            end
+            if nargin < 5
+                tRange = [];
+            end
+            [Index, iInputs, iFirst, iLast] = selectRange(obj, Name, iInputs, tRange);
+            nInputs = length(iInputs);
+            nPerFrame = max(ceil((iLast-iFirst+1)/32767), 1);
+            nFrames = ceil((iLast-iFirst+1)/nPerFrame);
+            FrameRate = Index.SampleRate/nPerFrame;
+
+            % Parameter section (its size does not depend on the start of the data section)
+            Parameters = c3dParameters(Index.Labels(iInputs), Index.SampleRate, FrameRate, nFrames, 0);
+            DataStart = 2 + length(Parameters)/512;
+            Parameters = c3dParameters(Index.Labels(iInputs), Index.SampleRate, FrameRate, nFrames, DataStart);
+
+            % Header section
+            Header = zeros(1, 512, 'uint8');
+            Header(1:2) = [2 80];
+            Header(3:24) = [typecast(uint16([0 nInputs*nPerFrame 1 nFrames 10]), 'uint8') typecast(single(-1), 'uint8') ...
+                typecast(uint16([DataStart nPerFrame]), 'uint8') typecast(single(FrameRate), 'uint8')];
+
+            fid = fopen(fileName, 'w', 'ieee-le');
+            if fid < 0
+                error('RecordingStore.exportC3D(): The file ''%s'' cannot be opened.', fileName);
+            end
+            fwrite(fid, [Header Parameters], 'uint8');
+
+            % Data section: the samples of all channels of each analog sample, frame by frame
+            nBlock = nPerFrame*ceil(obj.ExportBlockSize/nPerFrame);
+            for iStart = iFirst:nBlock:iLast
+                iEnd = min(iStart + nBlock - 1, iLast);
+                Block = readBlock(obj, Index, iInputs, iStart, iEnd)';
+                if iEnd == iLast
+                    Block(:,end+1:nPerFrame*ceil(size(Block,2)/nPerFrame)) = 0;
+                end
+                fwrite(fid, Block, 'single');
+            end
+            fwrite(fid, zeros(1, mod(-4*nInputs*nPerFrame*nFrames, 512), 'uint8'), 'uint8');
+            fclose(fid);
+        end
+
+    end
+
+    methods (Hidden = true)
+
+        %% Samples iFirst to iLast of inputs iInputs of a recording [size: nSamples x nInputs, type: single].
+        % Samples outside the recording are NaN.
+        function Block = readBlock(obj, Index, iInputs, iFirst, iLast)
+            Block = nan(max(iLast-iFirst+1, 0), length(iInputs), 'single');
+            iChunkStart = [0 cumsum(Index.ChunkSamples)];
+            for iChunk = find(iChunkStart(2:end) >= iFirst & iChunkStart(1:end-1) < iLast)
+                iStart = max(iFirst - iChunkStart(iChunk), 1);
+                iEnd = min(iLast - iChunkStart(iChunk), Index.ChunkSamples(iChunk));
+                fileChunk = chunkFile(obj, Index.ChunkHash{iChunk});
+                if endsWith(fileChunk, '.i16')
+                    % Quantum (double) followed by the ADC codes (-32768: missing)
+                    fid = fopen(fileChunk, 'r', 'ieee-le');
+                    Quantum = fread(fid, 1, 'double');
+                    fclose(fid);
+                    Map = memmapfile(fileChunk, 'Offset', 8, 'Format', {'int16', [Index.ChunkSamples(iChunk) Index.nInputs], 'x'});
+                    Codes = Map.Data.x(iStart:iEnd, iInputs);
+                    Values = single(Codes)*Quantum;
+                    Values(Codes == -32768) = NaN;
+                else
+                    Map = memmapfile(fileChunk, 'Format', {'single', [Index.ChunkSamples(iChunk) Index.nInputs], 'x'});
+                    Values = Map.Data.x(iStart:iEnd, iInputs);
+                end
+                Block(iChunkStart(iChunk) + (iStart:iEnd) - iFirst + 1, :) = Values;
+            end
+        end
+
+        %% Store a chunk [size: nInputs x nSamples] under the hash of its content (unless it is stored already).
+        % If the step 'Quantum' of the ADC codes is given (parameter is optional), and all samples are multiples of
+        % it, the chunk is stored as 16 bit codes (the hash ends with '.i16'), otherwise as single precision floats.
+        function [Hash, nSamples] = writeChunk(obj, Data, Quantum)
+            Chunk = single(Data');
+            nSamples = size(Chunk,1);
+            isCoded = false;
+            if nargin >= 3 && ~isempty(Quantum)
+                Codes = double(Data')/Quantum;
+                mValid = ~isnan(Codes);
+                isCoded = all(abs(Codes(mValid) - round(Codes(mValid))) < 1e-2) && all(abs(Codes(mValid)) <= 32767);
+                Codes(~mValid) = -32768;
+            end
+            if isCoded
+                Chunk = int16(Codes);
+                Hash = [DerivedCache.hash(Chunk, Quantum) '.i16'];
+            else
+                Hash = DerivedCache.hash(Chunk);
+            end
+            fileChunk = chunkFile(obj, Hash);
+            if ~exist(fileChunk, 'file')
+                fid = fopen([fileChunk '.tmp'], 'w', 'ieee-le');
+                if isCoded
+                    fwrite(fid, Quantum, 'double');
+                    fwrite(fid, Chunk, 'int16');
+                else
+                    fwrite(fid, Chunk, 'single');
+                end
+                fclose(fid);
+                movefile([fileChunk '.tmp'], fileChunk);
+            end
+            if ~isempty(obj.Catalog)
+                noteChunk(obj.Catalog, Hash, Data);
+            end
+        end
+
+        %% Index of samples iFirst to iLast of a recording. The chunks within the range are shared, and the parts of
+        % the chunks at the boundaries are stored as new chunks.
+        function Index = sliceIndex(obj, Index, iFirst, iLast)
+            iChunkStart = [0 cumsum(Index.ChunkSamples)];
+            ChunkHash = {};
+            ChunkSamples = [];
+            for iChunk = find(iChunkStart(2:end) >= iFirst & iChunkStart(1:end-1) < iLast)
+                iStart = max(iFirst - iChunkStart(iChunk), 1);
+                iEnd = min(iLast - iChunkStart(iChunk), Index.ChunkSamples(iChunk));
+                if iStart == 1 && iEnd == Index.ChunkSamples(iChunk)
+                    ChunkHash{end+1} = Index.ChunkHash{iChunk}; %#ok<AGROW>
+                    ChunkSamples(end+1) = Index.ChunkSamples(iChunk); %#ok<AGROW>
+                else
+                    Block = readBlock(obj, Index, 1:Index.nInputs, iChunkStart(iChunk) + iStart, iChunkStart(iChunk) + iEnd);
+                    [ChunkHash{end+1}, ChunkSamples(end+1)] = writeChunk(obj, Block'); %#ok<AGROW>
+                end
+            end
+            Index.ChunkHash = ChunkHash;
+            Index.ChunkSamples = ChunkSamples;
+        end
+
+        %% Save the index of a recording (the fields added by info() are not stored), and catalog it.
+        function saveIndex(obj, Index)
+            Index = rmfield(Index, intersect(fieldnames(Index), {'nSamples', 'Duration'}));
+            save(indexFile(obj, Index.Name), '-struct', 'Index');
+            if ~isempty(obj.Catalog)
+                addIndex(obj.Catalog, obj, Index);
+            end
+        end
+
+    end
+
+    methods (Access = private)
+
+        %% Index, inputs and sample range of a recording for inputs 'iInputs' in the time range 'tRange' [unit: seconds]
+        % (all inputs and the whole recording if empty).
+        function [Index, iInputs, iFirst, iLast] = selectRange(obj, Name, iInputs, tRange)
+            Index = info(obj, Name);
+            if isempty(iInputs)
+                iInputs = 1:Index.nInputs;
+            end
+            if isempty(tRange)
+                tRange = [0 Index.Duration];
+            end
+            iFirst = max(floor(tRange(1)*Index.SampleRate) + 1, 1);
+            iLast = min(ceil(tRange(2)*Index.SampleRate), Index.nSamples);
+        end
+
+        function fileIndex = indexFile(obj, Name)
+            fileIndex = fullfile(obj.StoreDir, 'recordings', [Name '.mat']);
+        end
+
+        function fileChunk = chunkFile(obj, Hash)
+            if endsWith(Hash, '.i16')
+                fileChunk = fullfile(obj.StoreDir, 'chunks', Hash);
+            else
+                fileChunk = fullfile(obj.StoreDir, 'chunks', [Hash '.f32']);
+            end
+        end
+
+    end
+end
+
+%% Parameter section of a C3D file with analog channels only (padded to 512 byte blocks).
+function Section = c3dParameters(Labels, SampleRate, FrameRate, nFrames, DataStart)
+    nInputs = length(Labels);
+    Records = {
+        c3dGroup(1, 'POINT', '3-D point parameters')
+        c3dParameter(1, 'USED', 2, [], 0)
+        c3dParameter(1, 'SCALE', 4, [], -1)
+        c3dParameter(1, 'RATE', 4, [], FrameRate)
+        c3dParameter(1, 'DATA_START', 2, [], DataStart)
+        c3dParameter(1, 'FRAMES', 2, [], nFrames)
+        c3dGroup(2, 'ANALOG', 'Analog data parameters')
+        c3dParameter(2, 'USED', 2, [], nInputs)
+        c3dParameter(2, 'LABELS', -1, [], char(Labels)')
+        c3dParameter(2, 'DESCRIPTIONS', -1, [], char(Labels)')
+        c3dParameter(2, 'GEN_SCALE', 4, [], 1)
+        c3dParameter(2, 'SCALE', 4, nInputs, ones(1, nInputs))
+        c3dParameter(2, 'OFFSET', 2, nInputs, zeros(1, nInputs))
+        c3dParameter(2, 'UNITS', -1, [], repmat('V', 1, nInputs))
+        c3dParameter(2, 'RATE', 4, [], SampleRate)};
+
+    % The offset of the last record is zero (end of the parameters)
+    Records{end}{2} = uint8([0 0]);
+    Records = cellfun(@(Record) [Record{:}], Records, 'UniformOutput', false);
+    Section = [uint8([1 80 0 84]) Records{:}];
+    Section(3) = ceil(length(Section)/512);
+    Section(end+1:512*Section(3)) = 0;
+end
+
+%% Group record of a C3D parameter section {Name part, Offset and description part}.
+function Record = c3dGroup(Id, Name, Description)
+    Record = {[uint8(length(Name)) typecast(int8(-Id), 'uint8') uint8(Name)], ...
+        typecast(int16(3 + length(Description)), 'uint8'), [uint8(length(Description)) uint8(Description)]};
+end
+
+%% Parameter record of a C3D parameter section {Name part, Offset and data part}. Type is -1 (char), 2 (int16) or 4
+% (float). Dims are the dimensions of numeric arrays (empty for scalars), char arrays have one column per string.
+function Record = c3dParameter(Id, Name, Type, Dims, Value)
+    switch Type
+        case -1
+            Dims = size(Value);
+            Bytes = uint8(Value(:)');
+        case 2
+            Bytes = typecast(int16(Value(:)'), 'uint8');
+        case 4
+            Bytes = typecast(single(Value(:)'), 'uint8');
+    end
+    Data = [typecast(int8(Type), 'uint8') uint8(length(Dims)) uint8(Dims) Bytes uint8(0)];
+    Record = {[uint8(length(Name)) uint8(Id) uint8(Name)], typecast(int16(2 + length(Data)), 'uint8'), Data};
+end
@@ -0,0 +1,623 @@
+% >>Description<<
+% Class which catalogs the recordings of one or more RecordingStores (patient, side, condition, board settings,
+% quality scores and summary statistics), so sessions are found by their metadata without opening the recordings.
+% Each session is a row, and each field a column (numbers as doubles, strings as codes into a dictionary per field).
+% A row holds the header of the recording (Store, Name, SampleRate, nInputs, nSamples, Duration and Labels), the scalar
+% fields of its metadata (see RecordingStore.write), and its summary statistics (LossRate: fraction of missing
+% samples of the inputs with data, so disabled inputs do not count as lost, Min and Max). The statistics are kept per
+% chunk and input under the chunk hash, so a recording edited in the store
+% (see RecordingStore.trim) only reads its new chunks. A store with this catalog as its Catalog keeps it up to date
+% on ingest (the chunks are summarised when they are written), and the catalog is saved at most every SaveInterval
+% seconds (and when it is deleted). The IndexedFields have secondary indexes (sorted values of number fields, lists
+% of rows of each string of string fields), which are rebuilt on the first search after a change.
+% Queries are conditions 'Field Op Value' combined with & (and) and | (or, of the & terms), e.g.
+% "Side == left & ADCgain == 4 & LossRate < 1%". Op is ==, ~=, <, <=, > or >=, and Value is a number (a percentage
+% with %), or a string (in quotes, if it is not a single word). Each & term is answered from its most selective
+% indexed condition, and the other conditions are only checked on those rows.
+%
+% >>Properties<<
+%   CatalogDir:         Directory holding the catalog
+%   IndexedFields:      Fields with secondary indexes [type: cell array of strings]
+%   SaveInterval:       Minimum time between two saves of the catalog after changes [unit: seconds]
+%   UseParallel:        true: Rebuild the catalog on the workers of the parallel pool (Parallel Computing Toolbox)
+%   Fields:             Names of the fields (columns) [type: cell array of strings]
+%   nSessions:          Number of sessions (rows)
+%
+% >>Functions<<
+%   obj = SessionCatalog(CatalogDir)  ............  Open a catalog (parameter 'CatalogDir' is optional).
+%   obj = add(obj, Store, Names)  ................  Catalog (or update) recordings 'Names' of RecordingStore 'Store' (parameter 'Names' is optional).
+%   obj = remove(obj, Store, Names)  .............  Remove recordings 'Names' of RecordingStore 'Store' from the catalog.
+%   [Names, Sessions, Stats] = search(obj, Query)  Sessions matching the query [Sessions: fields of the catalog, size: nMatches x 1].
+%   obj = rebuild(obj, Stores)  ..................  Catalog all recordings of the stores from scratch [type: RecordingStore, directory or a cell array of these].
+%   flush(obj)  ..................................  Save the catalog now.
+%
+% >>Example<<
+%   Catalog = SessionCatalog;
+%   Store = RecordingStore;
+%   Store.Catalog = Catalog;
+%   write(Store, 'Session1', obj.Data, obj.ADCsamplerate, obj.labelADCinput, struct('Patient', 'P012', 'Side', 'left', 'ADCgain', 4));
+%   [Names, Sessions] = search(Catalog, 'Side == left & ADCgain == 4 & LossRate < 1%');
+
+classdef SessionCatalog < handle
+    properties
+        CatalogDir = fullfile(tempdir, 'WiFiUDPlogger_catalog');
+        IndexedFields = {'Store', 'Name', 'Patient', 'Side', 'Condition', 'ADCgain', 'SampleRate', 'Duration', 'LossRate'};
+        SaveInterval = 10;
+        UseParallel = false;
+    end
+
+    properties (SetAccess = private)
+        Fields = {};
+        nSessions = 0;
+    end
+
+    properties (SetAccess = private, Hidden = true)
+        Columns = struct();         % Column of each field [size: nSessions x 1, type: double, or uint32 codes of string fields]
+        Dictionaries = struct();    % Strings of each string field (code i: Dictionaries.(Field){i}, 0: missing)
+        Rows = [];                  % Row of each session, by store directory and name [type: containers.Map]
+        ChunkHashes = {};           % Hashes of the chunks with statistics
+        ChunkStats = {};            % Number of values, number of missing values, min and max of each input of each chunk [size: nInputs x 4]
+        ChunkRows = [];             % Row in ChunkStats of each chunk hash [type: containers.Map]
+        Indexes = struct();         % Secondary index of each indexed field [fields: Values and Rows (number fields), Postings (string fields)]
+        isIndexed = false;          % true: Indexes are up to date
+        isSaved = true;             % true: The catalog on disk is up to date
+        tSaved = [];                % Time of the last save [type: tic]
+    end
+
+    methods
+
+        %% Open a catalog (parameter 'CatalogDir' is optional).
+        function obj = SessionCatalog(CatalogDir)
+            if nargin >= 1 && ~isempty(CatalogDir)
+                obj.CatalogDir = CatalogDir;
+            end
+            if ~exist(obj.CatalogDir, 'dir')
+                mkdir(obj.CatalogDir);
+            end
+            fileCatalog = fullfile(obj.CatalogDir, 'catalog.mat');
+            if exist(fileCatalog, 'file')
+                Saved = load(fileCatalog);
+                for Field = fieldnames(Saved)'
+                    obj.(Field{1}) = Saved.(Field{1});
+                end
+            end
+            obj.Rows = containers.Map('KeyType', 'char', 'ValueType', 'double');
+            for iRow = 1:obj.nSessions
+                obj.Rows(sessionKey(obj, iRow)) = iRow;
+            end
+            if ~iscell(obj.ChunkStats)
+                % Catalogs of older versions only hold the statistics of whole chunks (read again when needed)
+                obj.ChunkHashes = {};
+                obj.ChunkStats = {};
+            end
+            obj.ChunkRows = containers.Map('KeyType', 'char', 'ValueType', 'double');
+            for iChunk = 1:length(obj.ChunkHashes)
+                obj.ChunkRows(obj.ChunkHashes{iChunk}) = iChunk;
+            end
+            obj.tSaved = tic;
+        end
+
+        function delete(obj)
+            if ~obj.isSaved
+                flush(obj);
+            end
+        end
+
+        %% Catalog (or update) recordings 'Names' of RecordingStore 'Store' (parameter 'Names' is optional).
+        function obj = add(obj, Store, Names)
+            if nargin < 3 || isempty(Names)
+                Names = list(Store);
+            end
+            if ischar(Names)
+                Names = {Names};
+            end
+            for iName = 1:length(Names)
+                addIndex(obj, Store, info(Store, Names{iName}));
+            end
+        end
+
+        %% Remove recordings 'Names' of RecordingStore 'Store' from the catalog.
+        function obj = remove(obj, Store, Names)
+            if ischar(Names)
+                Names = {Names};
+            end
+            Keys = strcat(SessionCatalog.storeDir(Store), filesep, Names);
+            Keys = Keys(isKey(obj.Rows, Keys));
+            if isempty(Keys)
+                return;
+            end
+            mKeep = true(obj.nSessions, 1);
+            mKeep(cell2mat(values(obj.Rows, Keys))) = false;
+            for Field = obj.Fields
+                obj.Columns.(Field{1}) = obj.Columns.(Field{1})(mKeep);
+            end
+            obj.nSessions = nnz(mKeep);
+            remove(obj.Rows, Keys);
+            iNew = cumsum(mKeep);
+            for Key = keys(obj.Rows)
+                obj.Rows(Key{1}) = iNew(obj.Rows(Key{1}));
+            end
+            changed(obj);
+        end
+
+        %% Sessions matching the query [Sessions: fields of the catalog, size: nMatches x 1].
+        % Names are the names of the matching recordings (in the order of the catalog). Stats holds the number of
+        % rows answered from the indexes (nIndexed) and checked in the columns (nScanned), and the time of the search
+        % (tElapsed) [unit: seconds].
+        function [Names, Sessions, Stats] = search(obj, Query)
+            tStart = tic;
+            if ~obj.isIndexed
+                buildIndexes(obj);
+            end
+            Stats.nIndexed = 0;
+            Stats.nScanned = 0;
+            if obj.nSessions == 0
+                Names = cell(0, 1);
+                Sessions = struct([]);
+                Stats.tElapsed = toc(tStart);
+                return;
+            end
+            Match = zeros(0, 1);
+            for Group = SessionCatalog.parse(Query)
+                % Start from the most selective indexed condition
+                Terms = Group{1};
+                Candidates = [];
+                iStart = 0;
+                for iTerm = 1:length(Terms)
+                    [TermRows, isIndexed] = lookup(obj, Terms(iTerm));
+                    if isIndexed && (iStart == 0 || length(TermRows) < length(Candidates))
+                        Candidates = TermRows;
+                        iStart = iTerm;
+                    end
+                end
+                if iStart == 0
+                    Candidates = (1:obj.nSessions)';
+                else
+                    Stats.nIndexed = Stats.nIndexed + length(Candidates);
+                end
+                for iTerm = [1:iStart-1 iStart+1:length(Terms)]
+                    Stats.nScanned = Stats.nScanned + length(Candidates);
+                    Candidates = Candidates(evaluate(obj, Terms(iTerm), Candidates));
+                end
+                Match = [Match; Candidates]; %#ok<AGROW>
+            end
+            Match = unique(Match);
+            Sessions = cell(length(Match), length(obj.Fields));
+            for iField = 1:length(obj.Fields)
+                Values = column(obj, obj.Fields{iField}, Match);
+                if ~iscell(Values)
+                    Values = num2cell(Values);
+                end
+                Sessions(:,iField) = Values;
+            end
+            Sessions = cell2struct(Sessions, obj.Fields, 2);
+            Names = column(obj, 'Name', Match);
+            Stats.tElapsed = toc(tStart);
+        end
+
+        %% Catalog all recordings of the stores from scratch [type: RecordingStore, directory or a cell array of these].
+        % The recordings are read on the workers of the parallel pool (UseParallel).
+        function obj = rebuild(obj, Stores)
+            if ~iscell(Stores)
+                Stores = {Stores};
+            end
+            StoreDirs = cellfun(@SessionCatalog.storeDir, Stores, 'UniformOutput', false);
+            DirOf = {};
+            NameOf = {};
+            for iStore = 1:length(StoreDirs)
+                Names = list(RecordingStore(StoreDirs{iStore}));
+                DirOf = [DirOf repmat(StoreDirs(iStore), 1, length(Names))]; %#ok<AGROW>
+                NameOf = [NameOf Names]; %#ok<AGROW>
+            end
+
+            nJobs = length(NameOf);
+            Indexes = cell(nJobs, 1);
+            Stats = cell(nJobs, 1);
+            nWorkers = 0;
+            if obj.UseParallel && license('test', 'Distrib_Computing_Toolbox')
+                nWorkers = Inf;
+            end
+            parfor (iJob = 1:nJobs, nWorkers)
+                Store = RecordingStore(DirOf{iJob});
+                Index = info(Store, NameOf{iJob});
+                ChunkStats = cell(length(Index.ChunkHash), 1);
+                for iChunk = 1:length(Index.ChunkHash)
+                    ChunkStats{iChunk} = SessionCatalog.chunkStats(Store, Index, iChunk);
+                end
+                Indexes{iJob} = Index;
+                Stats{iJob} = ChunkStats;
+            end
+
+            obj.Fields = {};
+            obj.nSessions = 0;
+            obj.Columns = struct();
+            obj.Dictionaries = struct();
+            obj.Rows = containers.Map('KeyType', 'char', 'ValueType', 'double');
+            obj.ChunkHashes = {};
+            obj.ChunkStats = {};
+            obj.ChunkRows = containers.Map('KeyType', 'char', 'ValueType', 'double');
+            for iJob = 1:nJobs
+                for iChunk = 1:length(Indexes{iJob}.ChunkHash)
+                    noteStats(obj, Indexes{iJob}.ChunkHash{iChunk}, Stats{iJob}{iChunk});
+                end
+                setRow(obj, SessionCatalog.header(DirOf{iJob}, Indexes{iJob}, Stats{iJob}));
+            end
+            changed(obj);
+            flush(obj);
+        end
+
+        %% Save the catalog now.
+        function flush(obj)
+            Saved.Fields = obj.Fields;
+            Saved.nSessions = obj.nSessions;
+            Saved.Columns = obj.Columns;
+            Saved.Dictionaries = obj.Dictionaries;
+            Saved.ChunkHashes = obj.ChunkHashes;
+            Saved.ChunkStats = obj.ChunkStats;
+            fileCatalog = fullfile(obj.CatalogDir, 'catalog.mat');
+            save([fileCatalog '.tmp.mat'], '-struct', 'Saved');
+            movefile([fileCatalog '.tmp.mat'], fileCatalog);
+            obj.isSaved = true;
+            obj.tSaved = tic;
+        end
+
+    end
+
+    methods (Hidden = true)
+
+        %% Catalog (or update) the recording with index 'Index' of RecordingStore 'Store' (called when the store saves an index).
+        function addIndex(obj, Store, Index)
+            Stats = cell(length(Index.ChunkHash), 1);
+            for iChunk = 1:length(Index.ChunkHash)
+                if isKey(obj.ChunkRows, Index.ChunkHash{iChunk})
+                    Stats{iChunk} = obj.ChunkStats{obj.ChunkRows(Index.ChunkHash{iChunk})};
+                else
+                    Stats{iChunk} = SessionCatalog.chunkStats(Store, Index, iChunk);
+                    noteStats(obj, Index.ChunkHash{iChunk}, Stats{iChunk});
+                end
+            end
+            setRow(obj, SessionCatalog.header(SessionCatalog.storeDir(Store), Index, Stats));
+            changed(obj);
+        end
+
+        %% Keep the statistics of a chunk [size: nInputs x nSamples] (called when the store writes a chunk).
+        function noteChunk(obj, Hash, Data)
+            if ~isKey(obj.ChunkRows, Hash)
+                noteStats(obj, Hash, SessionCatalog.summarise(Data));
+            end
+        end
+
+    end
+
+    methods (Access = private)
+
+        %% Keep the statistics of a chunk.
+        function noteStats(obj, Hash, Stats)
+            obj.ChunkHashes{end+1} = Hash;
+            obj.ChunkStats{end+1} = Stats;
+            obj.ChunkRows(Hash) = length(obj.ChunkHashes);
+        end
+
+        %% Write the fields of a session to its row (a new row for a new session). Fields of the catalog, that the
+        % session does not have, are missing (NaN, or code 0). A string, that is not a number, in a number field
+        % turns the field into a string field.
+        function setRow(obj, Row)
+            Key = [Row.Store filesep Row.Name];
+            if isKey(obj.Rows, Key)
+                iRow = obj.Rows(Key);
+            else
+                iRow = obj.nSessions + 1;
+                obj.nSessions = iRow;
+                obj.Rows(Key) = iRow;
+                for Field = obj.Fields
+                    obj.Columns.(Field{1})(iRow,1) = missingValue(obj, Field{1});
+                end
+            end
+            for Field = setdiff(obj.Fields, fieldnames(Row)')
+                obj.Columns.(Field{1})(iRow) = missingValue(obj, Field{1});
+            end
+            for Field = fieldnames(Row)'
+                Value = Row.(Field{1});
+                if isfield(obj.Columns, Field{1}) && ischar(Value) && ~isa(obj.Columns.(Field{1}), 'uint32') && ...
+                        isnan(str2double(Value)) && ~any(strcmpi(strtrim(Value), {'', 'NaN'}))
+                    promote(obj, Field{1});
+                end
+                if ~isfield(obj.Columns, Field{1})
+                    obj.Fields{end+1} = Field{1};
+                    if ischar(Value)
+                        obj.Columns.(Field{1}) = zeros(obj.nSessions, 1, 'uint32');
+                        obj.Dictionaries.(Field{1}) = {};
+                    else
+                        obj.Columns.(Field{1}) = nan(obj.nSessions, 1);
+                    end
+                end
+                if isa(obj.Columns.(Field{1}), 'uint32')
+                    if ~ischar(Value)
+                        Value = num2str(Value);
+                    end
+                    Code = find(strcmp(obj.Dictionaries.(Field{1}), Value), 1);
+                    if isempty(Code)
+                        obj.Dictionaries.(Field{1}){end+1,1} = Value;
+                        Code = length(obj.Dictionaries.(Field{1}));
+                    end
+                    obj.Columns.(Field{1})(iRow) = Code;
+                elseif ischar(Value)
+                    obj.Columns.(Field{1})(iRow) = str2double(Value);
+                else
+                    obj.Columns.(Field{1})(iRow) = Value;
+                end
+            end
+        end
+
+        %% Turn a number field into a string field (the numbers become their strings, NaN becomes missing).
+        function promote(obj, Field)
+            Values = obj.Columns.(Field);
+            mValid = ~isnan(Values);
+            [Strings, ~, Codes] = unique(arrayfun(@num2str, Values(mValid), 'UniformOutput', false));
+            obj.Dictionaries.(Field) = Strings(:);
+            obj.Columns.(Field) = zeros(size(Values), 'uint32');
+            obj.Columns.(Field)(mValid) = Codes;
+        end
+
+        function Value = missingValue(obj, Field)
+            Value = NaN;
+            if isa(obj.Columns.(Field), 'uint32')
+                Value = 0;
+            end
+        end
+
+        %% Values of a field in rows iRows [type: double, or cell array of strings].
+        function Values = column(obj, Field, iRows)
+            Values = obj.Columns.(Field)(iRows);
+            if isa(Values, 'uint32')
+                Dictionary = [{''}; obj.Dictionaries.(Field)(:)];
+                Values = Dictionary(Values + 1);
+            end
+        end
+
+        function Key = sessionKey(obj, iRow)
+            Key = [obj.Dictionaries.Store{obj.Columns.Store(iRow)} filesep obj.Dictionaries.Name{obj.Columns.Name(iRow)}];
+        end
+
+        %% Mark the indexes as outdated, and save the catalog if the last save is older than SaveInterval.
+        function changed(obj)
+            obj.isIndexed = false;
+            obj.isSaved = false;
+            if toc(obj.tSaved) > obj.SaveInterval
+                flush(obj);
+            end
+        end
+
+        %% Build the secondary indexes of the IndexedFields.
+        function buildIndexes(obj)
+            obj.Indexes = struct();
+            for Field = intersect(obj.IndexedFields, obj.Fields)
+                Values = obj.Columns.(Field{1});
+                if isa(Values, 'uint32')
+                    iRows = find(Values > 0);
+                    Postings = accumarray(double(Values(iRows)), iRows, [length(obj.Dictionaries.(Field{1})) 1], @(r) {sort(r)});
+                    obj.Indexes.(Field{1}) = struct('Postings', {Postings});
+                else
+                    [Sorted, Order] = sort(Values);
+                    nValid = nnz(~isnan(Sorted));
+                    obj.Indexes.(Field{1}) = struct('Values', Sorted(1:nValid), 'Rows', Order(1:nValid));
+                end
+            end
+            obj.isIndexed = true;
+        end
+
+        %% Rows matching a condition from the secondary index of its field (sorted). isIndexed is false, if the
+        % field has no index for the condition.
+        function [iRows, isIndexed] = lookup(obj, Term)
+            iRows = [];
+            isIndexed = false;
+            if ~isfield(obj.Indexes, Term.Field)
+                return;
+            end
+            Index = obj.Indexes.(Term.Field);
+            if isfield(Index, 'Postings')
+                if ~strcmp(Term.Op, '==')
+                    return;
+                end
+                Code = find(strcmp(obj.Dictionaries.(Term.Field), SessionCatalog.asString(Term.Value)), 1);
+                iRows = zeros(0, 1);
+                if ~isempty(Code)
+                    iRows = Index.Postings{Code};
+                end
+                isIndexed = true;
+            else
+                if ~isnumeric(Term.Value) || strcmp(Term.Op, '~=')
+                    return;
+                end
+                n = length(Index.Values);
+                iBelow = SessionCatalog.bound(Index.Values, Term.Value, true);    % First value >= Value
+                iAbove = SessionCatalog.bound(Index.Values, Term.Value, false);   % First value > Value
+                switch Term.Op
+                    case '=='
+                        iRange = iBelow:iAbove-1;
+                    case '<'
+                        iRange = 1:iBelow-1;
+                    case '<='
+                        iRange = 1:iAbove-1;
+                    case '>'
+                        iRange = iAbove:n;
+                    case '>='
+                        iRange = iBelow:n;
+                end
+                iRows = sort(Index.Rows(iRange));
+                isIndexed = true;
+            end
+        end
+
+        %% Mask of the rows iRows matching a condition (from the column of its field).
+        function mMatch = evaluate(obj, Term, iRows)
+            if ~isfield(obj.Columns, Term.Field)
+                error('SessionCatalog.search(): Unknown field ''%s''.', Term.Field);
+            end
+            Values = obj.Columns.(Term.Field)(iRows);
+            if isa(Values, 'uint32')
+                Code = find(strcmp(obj.Dictionaries.(Term.Field), SessionCatalog.asString(Term.Value)), 1);
+                if isempty(Code)
+                    Code = -1;
+                end
+                switch Term.Op
+                    case '=='
+                        mMatch = Values == Code;
+                    case '~='
+                        mMatch = Values ~= Code & Values > 0;
+                    otherwise
+                        error('SessionCatalog.search(): The string field ''%s'' only supports == and ~=.', Term.Field);
+                end
+            else
+                if ~isnumeric(Term.Value)
+                    error('SessionCatalog.search(): The field ''%s'' holds numbers.', Term.Field);
+                end
+                switch Term.Op
+                    case '=='
+                        mMatch = Values == Term.Value;
+                    case '~='
+                        mMatch = Values ~= Term.Value & ~isnan(Values);
+                    case '<'
+                        mMatch = Values < Term.Value;
+                    case '<='
+                        mMatch = Values <= Term.Value;
+                    case '>'
+                        mMatch = Values > Term.Value;
+                    case '>='
+                        mMatch = Values >= Term.Value;
+                end
+            end
+        end
+
+    end
+
+    methods (Static, Hidden = true)
+
+        %% Conditions of a query, as a cell array of the & terms [fields of each condition: Field, Op, Value].
+        function Groups = parse(Query)
+            Groups = {};
+            for Group = regexp(Query, '\|', 'split')
+                Terms = struct('Field', {}, 'Op', {}, 'Value', {});
+                for Term = regexp(Group{1}, '&', 'split')
+                    if isempty(strtrim(Term{1}))
+                        continue;
+                    end
+                    Tokens = regexp(Term{1}, '^\s*(\w+)\s*(==|~=|!=|<=|>=|<|>|=)\s*(.*?)\s*$', 'tokens', 'once');
+                    if isempty(Tokens) || isempty(Tokens{3})
+                        error('SessionCatalog.search(): The condition ''%s'' is not ''Field Op Value''.', strtrim(Term{1}));
+                    end
+                    Op = Tokens{2};
+                    if strcmp(Op, '=')
+                        Op = '==';
+                    elseif strcmp(Op, '!=')
+                        Op = '~=';
+                    end
+                    Value = Tokens{3};
+                    if any(Value(1) == '''"') && Value(end) == Value(1) && length(Value) >= 2
+                        Value = Value(2:end-1);
+                    elseif Value(end) == '%' && ~isnan(str2double(Value(1:end-1)))
+                        Value = str2double(Value(1:end-1))/100;
+                    elseif ~isnan(str2double(Value))
+                        Value = str2double(Value);
+                    end
+                    Terms(end+1) = struct('Field', Tokens{1}, 'Op', Op, 'Value', Value); %#ok<AGROW>
+                end
+                if ~isempty(Terms) || isempty(Groups)
+                    Groups{end+1} = Terms; %#ok<AGROW>
+                end
+            end
+        end
+
+        %% Fields of the row of a recording: header, scalar metadata fields and summary statistics (from the
+        % statistics of its chunks [size: nChunks x 1 cell array of nInputs x 4]). The loss rate only counts the inputs
+        % with at least one valid sample (all inputs, if none has one).
+        function Row = header(StoreDir, Index, Stats)
+            Row = struct();
+            for Field = fieldnames(Index.Metadata)'
+                Value = Index.Metadata.(Field{1});
+                if isstring(Value) && isscalar(Value)
+                    Value = char(Value);
+                end
+                if (ischar(Value) && size(Value,1) <= 1) || ((isnumeric(Value) || islogical(Value)) && isscalar(Value))
+                    Row.(Field{1}) = Value;
+                    if ~ischar(Value)
+                        Row.(Field{1}) = double(Value);
+                    end
+                end
+            end
+            Row.Store = StoreDir;
+            Row.Name = Index.Name;
+            Row.SampleRate = Index.SampleRate;
+            Row.nInputs = Index.nInputs;
+            Row.nSamples = sum(Index.ChunkSamples);
+            Row.Duration = Row.nSamples/Index.SampleRate;
+            Row.Labels = strjoin(Index.Labels, ',');
+            Stats = cat(3, repmat([0 0 NaN NaN], Index.nInputs, 1), Stats{:});
+            Counts = sum(Stats(:,1:2,:), 3);
+            mData = Counts(:,2) < Counts(:,1);
+            if ~any(mData)
+                mData(:) = true;
+            end
+            Row.LossRate = sum(Counts(mData,2))/max(sum(Counts(mData,1)), 1);
+            Row.Min = min(reshape(Stats(:,3,:), [], 1));
+            Row.Max = max(reshape(Stats(:,4,:), [], 1));
+        end
+
+        %% Statistics of chunk iChunk of a recording, read from the store.
+        function Stats = chunkStats(Store, Index, iChunk)
+            iChunkStart = sum(Index.ChunkSamples(1:iChunk-1));
+            Block = readBlock(Store, Index, 1:Index.nInputs, iChunkStart + 1, iChunkStart + Index.ChunkSamples(iChunk));
+            Stats = SessionCatalog.summarise(Block');
+        end
+
+        %% Number of values, number of missing values, min and max of each input of a chunk [Data size: nInputs x
+        % nSamples, Stats size: nInputs x 4].
+        function Stats = summarise(Data)
+            nInputs = size(Data,1);
+            if isempty(Data)
+                Stats = repmat([0 0 NaN NaN], nInputs, 1);
+                return;
+            end
+            Stats = [repmat(size(Data,2), nInputs, 1) sum(isnan(Data), 2) double(min(Data, [], 2)) double(max(Data, [], 2))];
+        end
+
+        %% First position in the sorted values with a value >= Value (isInclusive), or > Value (length+1 if none), by
+        % binary search.
+        function iFirst = bound(Values, Value, isInclusive)
+            iLow = 1;
+            iHigh = length(Values) + 1;
+            while iLow < iHigh
+                iMid = floor((iLow + iHigh)/2);
+                if Values(iMid) < Value || (~isInclusive && Values(iMid) == Value)
+                    iLow = iMid + 1;
+                else
+                    iHigh = iMid;
+                end
+            end
+            iFirst = iLow;
+        end
+
+        function Value = asString(Value)
+            if ~ischar(Value)
+                Value = num2str(Value);
+            end
+        end
+
+        %% Directory of a store (a RecordingStore or a directory) as an absolute path without a trailing separator, so
+        % the keys of its sessions match however the directory is written.
+        function StoreDir = storeDir(Store)
+            StoreDir = Store;
+            if isa(Store, 'RecordingStore')
+                StoreDir = Store.StoreDir;
+            end
+            if isempty(regexp(StoreDir, '^([/\\]|[A-Za-z]:)', 'once'))
+                StoreDir = fullfile(pwd, StoreDir);
+            end
+            StoreDir = regexprep(StoreDir, '(?<=.)[/\\]+$', '');
+            if ~isempty(regexp(StoreDir, '^[A-Za-z]:$', 'once'))
+                StoreDir = [StoreDir filesep];    % Root of a drive
+            end
+        end
+
+    end
+end
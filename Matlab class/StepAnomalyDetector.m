@@ -0,0 +1,227 @@
+% >>Description<<
+% Class which scores the feature vector of each step (stance time, peak, impulse and loading rate, see features)
+% against the recent baseline of the same patient, for many patients (streams) at once with constant memory per stream.
+% The baseline of each stream is an exponentially weighted mean and covariance, where the covariance is kept as its
+% inverse (precision matrix, updated by the Sherman-Morrison formula), so the score of a step is the squared
+% Mahalanobis distance without a matrix inversion. The update is robust: steps far from the baseline are down-weighted
+% (Huber weights), so an anomaly does not shift the baseline. When the level of the scores stays high (a lasting
+% change, e.g. new shoes or a rehabilitation step), the stream forgets faster (DriftForgettingFactor) until the
+% baseline has adapted. The first WarmupSteps steps of a stream build the initial baseline, and are not scored.
+% All streams of a batch are updated with array operations over the streams (steps of the same stream in order).
+%
+% >>Properties<<
+%   nFeatures:          Number of features of each step
+%   nStreams:           Number of streams (patients)
+%   nSteps:             Number of steps of each stream [size: 1 x nStreams]
+%   WarmupSteps:        Number of steps of a stream, which build the initial baseline
+%   ForgettingFactor:   Weight of the baseline at each step (0.99: the last ~100 steps)
+%   DriftForgettingFactor: Forgetting factor while the scores of the stream are high (drift)
+%   DriftLimit:         Drift, when the running mean of Score/nFeatures exceeds this level (1: as expected)
+%   AnomalyProbability: Steps with a score above this quantile of the chi-square distribution are anomalies
+%   HuberProbability:   Steps with a score above this quantile are down-weighted in the baseline update
+%
+% >>Functions<<
+%   obj = StepAnomalyDetector(nFeatures, nStreams)  Detector without baselines (parameter 'nStreams' is optional, more streams are added when scored).
+%   [Score, isAnomaly] = score(obj, iStreams, Features)  Score steps [size: nSteps x nFeatures] of streams iStreams [size: nSteps x 1], and update the baselines.
+%   obj = reset(obj, iStreams)  ..................  Discard the baselines of streams iStreams.
+%   [Features, Names] = StepAnomalyDetector.features(Data, Steps, SampleRate)  Feature vectors of the steps in data [size: nSteps x nFeatures].
+%
+% >>Example<<
+%   Steps = detectSteps(obj, 1);
+%   Features = StepAnomalyDetector.features(obj.Data(1:2,:), Steps, obj.ADCsamplerate);
+%   Detector = StepAnomalyDetector(size(Features,2));
+%   [Score, isAnomaly] = score(Detector, ones(size(Features,1),1), Features);
+
+classdef StepAnomalyDetector < handle
+    properties (SetAccess = private)
+        nFeatures = [];
+        nStreams = 0;
+        nSteps = [];
+    end
+
+    properties
+        WarmupSteps = 30;
+        ForgettingFactor = 0.99;
+        DriftForgettingFactor = 0.9;
+        DriftLimit = 3;
+        AnomalyProbability = 0.999;
+        HuberProbability = 0.95;
+    end
+
+    properties (SetAccess = private, Hidden = true)
+        Mean = [];                  % Baseline mean of each stream [size: nFeatures x nStreams]
+        Precision = [];             % Inverse of the baseline covariance of each stream [size: nFeatures x nFeatures x nStreams]
+        Sum = [];                   % Sum of the warm-up steps of each stream [size: nFeatures x nStreams]
+        SumSquares = [];            % Sum of the outer products of the warm-up steps [size: nFeatures x nFeatures x nStreams]
+        ScoreLevel = [];            % Running mean of Score/nFeatures of each stream (drift detection) [size: 1 x nStreams]
+        ScoreSmoothing = 0.1;       % Weight of the last step in ScoreLevel
+        Ridge = 1e-6;               % Regularisation of the initial covariance, relative to its diagonal
+    end
+
+    methods
+
+        %% Detector without baselines (parameter 'nStreams' is optional, more streams are added when scored).
+        function obj = StepAnomalyDetector(nFeatures, nStreams)
+            obj.nFeatures = nFeatures;
+            obj.Mean = zeros(nFeatures, 0);
+            obj.Precision = zeros(nFeatures, nFeatures, 0);
+            obj.Sum = zeros(nFeatures, 0);
+            obj.SumSquares = zeros(nFeatures, nFeatures, 0);
+            if nargin >= 2
+                addStreams(obj, nStreams);
+            end
+        end
+
+        %% Score steps [size: nSteps x nFeatures] of streams iStreams [size: nSteps x 1], and update the baselines.
+        % Score is the squared Mahalanobis distance of each step to the baseline of its stream (NaN during the
+        % warm-up, or if the step has missing features, which are not used for the baseline either).
+        function [Score, isAnomaly] = score(obj, iStreams, Features)
+            iStreams = iStreams(:);
+            if size(Features,2) ~= obj.nFeatures || size(Features,1) ~= length(iStreams)
+                error('StepAnomalyDetector.score(): Features must have a row of %i features for each stream index.', obj.nFeatures);
+            end
+            addStreams(obj, max([iStreams; 0]));
+            Score = nan(length(iStreams), 1);
+            mValid = all(~isnan(Features), 2);
+
+            % Rank of each step among the steps of its stream: the steps of each rank are processed together
+            [iSorted, iOrder] = sort(iStreams);
+            isFirst = [true; diff(iSorted) ~= 0];
+            iFirst = find(isFirst);
+            Rank = zeros(size(iStreams));
+            Rank(iOrder) = (1:length(iStreams))' - iFirst(cumsum(isFirst)) + 1;
+            for iRank = 1:max([Rank; 0])
+                iRows = find(Rank == iRank & mValid);
+                Score(iRows) = update(obj, iStreams(iRows)', Features(iRows,:)');
+            end
+            isAnomaly = Score > StepAnomalyDetector.chi2Quantile(obj.AnomalyProbability, obj.nFeatures);
+        end
+
+        %% Discard the baselines of streams iStreams.
+        function obj = reset(obj, iStreams)
+            obj.nSteps(iStreams) = 0;
+            obj.Mean(:,iStreams) = 0;
+            obj.Precision(:,:,iStreams) = 0;
+            obj.Sum(:,iStreams) = 0;
+            obj.SumSquares(:,:,iStreams) = 0;
+            obj.ScoreLevel(iStreams) = 1;
+        end
+
+    end
+
+    methods (Static)
+
+        %% Feature vectors of the steps in data [size: nSteps x nFeatures].
+        % Data holds the inputs of one foot [size: nInputs x nSamples, e.g. heel and forefoot], and Steps the onset
+        % and offset of each step (see WiFiUDPlogger.detectSteps). The features are the stance time [unit: seconds],
+        % the peak [unit: Volt] and the impulse [unit: Volt*seconds] of each input, and the loading rate of the first
+        % input (the steepest rise in the first half of the stance) [unit: Volt/second]. Names are the feature names.
+        function [Features, Names] = features(Data, Steps, SampleRate)
+            nInputs = size(Data,1);
+            nSteps = length(Steps.iOnset);
+            iOnset = Steps.iOnset(:);
+            iOffset = Steps.iOffset(:);
+
+            % Step of each sample (0: outside the steps)
+            Marks = zeros(1, size(Data,2)+1);
+            Marks(iOnset) = Marks(iOnset) + 1;
+            Marks(iOffset+1) = Marks(iOffset+1) - 1;
+            mStance = cumsum(Marks(1:end-1)) > 0;
+            StepOf = zeros(1, size(Data,2));
+            StepOf(iOnset) = 1:nSteps;
+            StepOf = cummax(StepOf);
+            StepOf(~mStance) = 0;
+            iSamples = find(StepOf > 0);
+            iStep = StepOf(iSamples)';
+
+            Features = zeros(nSteps, 2 + 2*nInputs);
+            Features(:,1) = (iOffset - iOnset + 1)/SampleRate;
+            for iInput = 1:nInputs
+                x = Data(iInput, iSamples)';
+                Features(:,1+iInput) = accumarray(iStep, x, [nSteps 1], @max, NaN);
+                Features(:,1+nInputs+iInput) = accumarray(iStep, x, [nSteps 1])/SampleRate;
+            end
+            Slope = [diff(Data(1,:)) 0]*SampleRate;
+            mLoading = iSamples - iOnset(iStep)' < (iOffset(iStep) - iOnset(iStep))'/2;
+            Features(:,end) = accumarray(iStep(mLoading), Slope(iSamples(mLoading))', [nSteps 1], @max, NaN);
+
+            Names = [{'Stance'} strcat('Peak', arrayfun(@(i) sprintf('%i', i), 1:nInputs, 'UniformOutput', false)) ...
+                strcat('Impulse', arrayfun(@(i) sprintf('%i', i), 1:nInputs, 'UniformOutput', false)) {'LoadingRate'}];
+        end
+
+    end
+
+    methods (Hidden = true)
+
+        %% Score one step of each of the (distinct) streams k [size: 1 x m] with features X [size: nFeatures x m], and
+        % update their baselines.
+        function Score = update(obj, k, X)
+            d = obj.nFeatures;
+            Score = nan(length(k), 1);
+
+            % Warm-up: sums of the steps, and the initial baseline after the last warm-up step
+            mWarmup = obj.nSteps(k) < obj.WarmupSteps;
+            kWarmup = k(mWarmup);
+            Xw = X(:,mWarmup);
+            obj.Sum(:,kWarmup) = obj.Sum(:,kWarmup) + Xw;
+            obj.SumSquares(:,:,kWarmup) = obj.SumSquares(:,:,kWarmup) + reshape(Xw, d, 1, []).*reshape(Xw, 1, d, []);
+            obj.nSteps(kWarmup) = obj.nSteps(kWarmup) + 1;
+            for kDone = kWarmup(obj.nSteps(kWarmup) == obj.WarmupSteps)
+                n = obj.WarmupSteps;
+                obj.Mean(:,kDone) = obj.Sum(:,kDone)/n;
+                Covariance = obj.SumSquares(:,:,kDone)/n - obj.Mean(:,kDone)*obj.Mean(:,kDone)';
+                Covariance = Covariance + obj.Ridge*diag(diag(Covariance)) + eps*eye(d);
+                obj.Precision(:,:,kDone) = inv(Covariance);
+            end
+
+            % Score the other steps, and update the baselines with Huber weights
+            k = k(~mWarmup);
+            if isempty(k)
+                return;
+            end
+            m = length(k);
+            Delta = X(:,~mWarmup) - obj.Mean(:,k);
+            P = obj.Precision(:,:,k);
+            PDelta = reshape(sum(P.*reshape(Delta, 1, d, m), 2), d, m);
+            D2 = sum(Delta.*PDelta, 1);
+            Score(~mWarmup) = D2;
+
+            obj.ScoreLevel(k) = (1 - obj.ScoreSmoothing)*obj.ScoreLevel(k) + obj.ScoreSmoothing*D2/d;
+            Lambda = repmat(obj.ForgettingFactor, 1, m);
+            Lambda(obj.ScoreLevel(k) > obj.DriftLimit) = obj.DriftForgettingFactor;
+            Weight = min(1, StepAnomalyDetector.chi2Quantile(obj.HuberProbability, d)./max(D2, eps));
+            a = (1 - Lambda).*Weight;
+
+            % Exponentially weighted mean and covariance C = (1-a)*(C + a*Delta*Delta'), with the inverse updated by
+            % the Sherman-Morrison formula
+            obj.Mean(:,k) = obj.Mean(:,k) + a.*Delta;
+            P = (P - reshape(a./(1 + a.*D2), 1, 1, m).*reshape(PDelta, d, 1, m).*reshape(PDelta, 1, d, m)) ./ reshape(1 - a, 1, 1, m);
+            obj.Precision(:,:,k) = (P + permute(P, [2 1 3]))/2;
+            obj.nSteps(k) = obj.nSteps(k) + 1;
+        end
+
+        %% Add streams up to stream n.
+        function addStreams(obj, n)
+            if n <= obj.nStreams
+                return;
+            end
+            obj.nSteps(1,end+1:n) = 0;
+            obj.Mean(:,end+1:n) = 0;
+            obj.Precision(:,:,end+1:n) = 0;
+            obj.Sum(:,end+1:n) = 0;
+            obj.SumSquares(:,:,end+1:n) = 0;
+            obj.ScoreLevel(1,end+1:n) = 1;
+            obj.nStreams = n;
+        end
+
+    end
+
+    methods (Static, Hidden = true)
+
+        %% Quantile of the chi-square distribution with d degrees of freedom (without the Statistics Toolbox).
+        function q = chi2Quantile(p, d)
+            q = 2*gammaincinv(p, d/2);
+        end
+
+    end
+end
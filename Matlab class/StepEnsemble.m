@@ -0,0 +1,203 @@
+% >>Description<<
+% Class which computes the ensemble average of the force curves of the steps, time-normalised to 0-100% stance, with
+% the standard deviation as variability band. The average is kept per group (input label and condition, e.g. 'Heel'
+% and 'Barefoot') as running mean and sum of squared deviations (Welford, batches combined as by Chan et al.), so
+% steps can be added while recording (add) or from the recordings of a RecordingStore (addRecordings), without
+% keeping the steps. The steps are resampled by linear interpolation of all steps at once (resample), and the
+% recordings of addRecordings are processed on the workers of the parallel pool (UseParallel).
+%
+% >>Properties<<
+%   nPoints:            Number of points of the curves (101: steps of 1% stance)
+%   StepInput:          Input the steps are detected on [type: index or label]
+%   StepThreshold:      Step detection threshold, relative to the range of the signal (see WiFiUDPlogger.StepThreshold)
+%   UseParallel:        true: Process the recordings of addRecordings on the workers of the parallel pool (Parallel Computing Toolbox)
+%   Groups:             Names of the groups ('Label/Condition') [type: cell array of strings]
+%   nSteps:             Number of steps in each group
+%   Stance:             Stance axis of the curves [unit: %, size: 1 x nPoints]
+%
+% >>Functions<<
+%   obj = StepEnsemble(nPoints)  .................  Empty ensemble (parameter 'nPoints' is optional).
+%   obj = add(obj, Data, Labels, Condition, Steps)  Add the steps of data [size: nInputs x nSamples] to the groups of each input (parameter 'Steps' is optional, see WiFiUDPlogger.detectSteps).
+%   obj = addRecordings(obj, Store, Names, Condition)  Add the steps of recordings 'Names' in RecordingStore 'Store'.
+%   [Mean, Deviation, n] = curve(obj, Label, Condition)  Mean and standard deviation curve of a group [size: 1 x nPoints].
+%   plotCurves(obj)  .............................  Plot the mean curve and variability band of each group.
+%   Curves = StepEnsemble.resample(x, iOnset, iOffset, nPoints)  Steps of signal 'x' resampled from onset to offset [size: nPoints x nSteps].
+%
+% >>Example<<
+%   Ensemble = StepEnsemble;
+%   add(Ensemble, obj.Data(1:2,:), {'Heel', 'Forefoot'}, 'Barefoot');
+%   [Mean, Deviation] = curve(Ensemble, 'Heel', 'Barefoot');
+
+classdef StepEnsemble < handle
+    properties
+        nPoints = 101;
+        StepInput = 1;
+        StepThreshold = 0.2;
+        UseParallel = false;
+    end
+
+    properties (SetAccess = private)
+        Groups = {};
+        nSteps = [];
+    end
+
+    properties (Dependent, SetAccess = private)
+        Stance
+    end
+
+    properties (SetAccess = private, Hidden = true)
+        MeanCurves = [];            % Mean curve of each group [size: nGroups x nPoints]
+        M2Curves = [];              % Sum of squared deviations from the mean curve of each group [size: nGroups x nPoints]
+    end
+
+    methods
+
+        function Stance = get.Stance(obj)
+            Stance = linspace(0, 100, obj.nPoints);
+        end
+
+        %% Empty ensemble (parameter 'nPoints' is optional).
+        function obj = StepEnsemble(nPoints)
+            if nargin >= 1 && ~isempty(nPoints)
+                obj.nPoints = nPoints;
+            end
+        end
+
+        %% Add the steps of data [size: nInputs x nSamples] to the groups of each input (parameter 'Steps' is optional, see WiFiUDPlogger.detectSteps).
+        % Steps with missing samples are left out of the group of that input.
+        function obj = add(obj, Data, Labels, Condition, Steps)
+            if nargin < 5
+                Steps = detect(obj, Data, Labels);
+            end
+            Partial = StepEnsemble.summarise(Data, Steps, obj.nPoints);
+            for iInput = 1:size(Data,1)
+                merge(obj, [Labels{iInput} '/' Condition], Partial.n(iInput), Partial.Mean(iInput,:), Partial.M2(iInput,:));
+            end
+        end
+
+        %% Add the steps of recordings 'Names' in RecordingStore 'Store'.
+        % All inputs of the recordings are added, to the groups of their labels.
+        function obj = addRecordings(obj, Store, Names, Condition)
+            if ischar(Names)
+                Names = {Names};
+            end
+            Partials = cell(length(Names), 1);
+            Labels = cell(length(Names), 1);
+            nWorkers = 0;
+            if obj.UseParallel && license('test', 'Distrib_Computing_Toolbox')
+                nWorkers = Inf;
+            end
+            parfor (iRecording = 1:length(Names), nWorkers)
+                Index = info(Store, Names{iRecording});
+                Data = read(Store, Names{iRecording});
+                Labels{iRecording} = Index.Labels;
+                Partials{iRecording} = StepEnsemble.summarise(Data, detect(obj, Data, Index.Labels), obj.nPoints);
+            end
+            for iRecording = 1:length(Names)
+                for iInput = 1:length(Labels{iRecording})
+                    merge(obj, [Labels{iRecording}{iInput} '/' Condition], Partials{iRecording}.n(iInput), ...
+                        Partials{iRecording}.Mean(iInput,:), Partials{iRecording}.M2(iInput,:));
+                end
+            end
+        end
+
+        %% Mean and standard deviation curve of a group [size: 1 x nPoints].
+        function [Mean, Deviation, n] = curve(obj, Label, Condition)
+            iGroup = find(strcmp(obj.Groups, [Label '/' Condition]));
+            if isempty(iGroup)
+                error('StepEnsemble.curve(): The group ''%s/%s'' holds no steps.', Label, Condition);
+            end
+            n = obj.nSteps(iGroup);
+            Mean = obj.MeanCurves(iGroup,:);
+            Deviation = sqrt(obj.M2Curves(iGroup,:)/max(n-1, 1));
+        end
+
+        %% Plot the mean curve and variability band of each group.
+        function plotCurves(obj)
+            figure;
+            hold on;
+            Colors = lines(length(obj.Groups));
+            for iGroup = 1:length(obj.Groups)
+                Mean = obj.MeanCurves(iGroup,:);
+                Deviation = sqrt(obj.M2Curves(iGroup,:)/max(obj.nSteps(iGroup)-1, 1));
+                fill([obj.Stance fliplr(obj.Stance)], [Mean+Deviation fliplr(Mean-Deviation)], Colors(iGroup,:), ...
+                    'FaceAlpha', 0.2, 'EdgeColor', 'none', 'HandleVisibility', 'off');
+                plot(obj.Stance, Mean, 'Color', Colors(iGroup,:), 'DisplayName', sprintf('%s (%i steps)', obj.Groups{iGroup}, obj.nSteps(iGroup)));
+            end
+            xlabel('Stance [%]');
+            ylabel('Voltage [V]');
+            legend('show', 'Interpreter', 'none');
+        end
+
+    end
+
+    methods (Static)
+
+        %% Steps of signal 'x' resampled from onset to offset [size: nPoints x nSteps].
+        % The samples are interpolated linearly (for all steps at once). Steps with missing samples have NaN points.
+        function Curves = resample(x, iOnset, iOffset, nPoints)
+            x = x(:);               % x(iBelow) has the shape of iBelow (also for a single step)
+            Pos = iOnset(:)' + (0:nPoints-1)'/(nPoints-1).*(iOffset(:)' - iOnset(:)');
+            iBelow = min(floor(Pos), length(x)-1);
+            xBelow = reshape(x(iBelow), size(iBelow));
+            Curves = xBelow + (Pos - iBelow).*(reshape(x(iBelow+1), size(iBelow)) - xBelow);
+        end
+
+    end
+
+    methods (Hidden = true)
+
+        %% Detect the steps of data [size: nInputs x nSamples] on input StepInput.
+        function Steps = detect(obj, Data, Labels)
+            iStepInput = obj.StepInput;
+            if ischar(iStepInput)
+                iStepInput = find(strcmp(Labels, iStepInput));
+            end
+            Logger = WiFiUDPlogger;
+            Logger.StepThreshold = obj.StepThreshold;
+            Steps = detectSteps(Logger, iStepInput, Data);
+        end
+
+        %% Add a batch of steps [n, mean and sum of squared deviations] to a group.
+        function merge(obj, Group, n, Mean, M2)
+            if n == 0
+                return;
+            end
+            iGroup = find(strcmp(obj.Groups, Group));
+            if isempty(iGroup)
+                obj.Groups{end+1} = Group;
+                obj.nSteps(end+1) = 0;
+                obj.MeanCurves(end+1,:) = zeros(1, obj.nPoints);
+                obj.M2Curves(end+1,:) = zeros(1, obj.nPoints);
+                iGroup = length(obj.Groups);
+            end
+            nTotal = obj.nSteps(iGroup) + n;
+            Delta = Mean - obj.MeanCurves(iGroup,:);
+            obj.MeanCurves(iGroup,:) = obj.MeanCurves(iGroup,:) + Delta*n/nTotal;
+            obj.M2Curves(iGroup,:) = obj.M2Curves(iGroup,:) + M2 + Delta.^2*obj.nSteps(iGroup)*n/nTotal;
+            obj.nSteps(iGroup) = nTotal;
+        end
+
+    end
+
+    methods (Static, Access = private)
+
+        %% Number of steps, mean curve and sum of squared deviations of the steps of each input
+        % [fields: n (nInputs x 1), Mean and M2 (nInputs x nPoints)].
+        function Partial = summarise(Data, Steps, nPoints)
+            nInputs = size(Data,1);
+            Partial = struct('n', zeros(nInputs,1), 'Mean', zeros(nInputs,nPoints), 'M2', zeros(nInputs,nPoints));
+            mValid = Steps.iOffset(:)' > Steps.iOnset(:)';
+            for iInput = 1:nInputs
+                Curves = StepEnsemble.resample(Data(iInput,:), Steps.iOnset(mValid), Steps.iOffset(mValid), nPoints);
+                Curves = Curves(:,~any(isnan(Curves), 1));
+                Partial.n(iInput) = size(Curves,2);
+                if Partial.n(iInput) > 0
+                    Partial.Mean(iInput,:) = mean(Curves, 2)';
+                    Partial.M2(iInput,:) = sum((Curves - Partial.Mean(iInput,:)').^2, 2)';
+                end
+            end
+        end
+
+    end
+end
@@ -0,0 +1,334 @@
+% >>Description<<
+% Class which indexes the steps of the recordings in a RecordingStore, so the steps that look like a given step can be
+% found across the whole archive without loading the sessions.
+% Each step (see WiFiUDPlogger.detectSteps) is resampled to nPoints samples from onset to offset and z-normalised, so
+% the index compares the shape of the force curves. The curves are summarised by iSAX words (mean of WordLength
+% segments, quantised with breakpoints of the standard normal distribution) and sorted into an iSAX tree: a leaf is
+% split on the segment whose next bit divides it most evenly, until it holds at most LeafSize steps. The curves are
+% stored in leaf order in one file on disk, and only the leaves that are searched are read (memory mapped).
+% Exact searches visit the leaves in the order of the lower bound of their iSAX word (MINDIST), and stop when the
+% lower bound exceeds the distance of the k-th match.
+%
+% >>Properties<<
+%   IndexDir:           Directory holding the index
+%   Input:              Input the steps are detected on [type: index or label]
+%   StepThreshold:      Step detection threshold, relative to the range of the signal (see WiFiUDPlogger.StepThreshold)
+%   nPoints:            Number of samples of the resampled steps (multiple of WordLength)
+%   WordLength:         Number of segments of the iSAX words
+%   MaxBits:            Maximum number of bits of each segment symbol
+%   LeafSize:           Maximum number of steps in a leaf (unless the leaf cannot be split any more)
+%   UseParallel:        true: Detect the steps of the recordings on the workers of the parallel pool (Parallel Computing Toolbox)
+%   Names:              Names of the indexed recordings
+%   nSteps:             Number of indexed steps
+%
+% >>Functions<<
+%   obj = StepIndex(IndexDir)  ...................  Open an index (parameter 'IndexDir' is optional).
+%   obj = build(obj, Store, Names)  ..............  Index the steps of recordings 'Names' in RecordingStore 'Store' (parameter 'Names' is optional).
+%   [Matches, Stats] = search(obj, Step, k, Exact)  The k steps nearest to 'Step' [fields: Name, tOnset, tOffset, Distance] (parameters 'k' and 'Exact' are optional).
+%   Curves = StepIndex.normalise(x, iOnset, iOffset, nPoints)  Resampled and z-normalised steps of signal 'x' [size: nPoints x nSteps].
+%
+% >>Example<<
+%   Index = build(StepIndex, RecordingStore);
+%   [Data, TimeAxis] = read(RecordingStore, 'Session1', 1, [60 62]);
+%   Matches = search(Index, Data(1, TimeAxis >= 60.45 & TimeAxis < 61.1), 20);
+
+classdef StepIndex < handle
+    properties
+        IndexDir = fullfile(tempdir, 'WiFiUDPlogger_stepindex');
+        Input = 1;
+        StepThreshold = 0.2;
+        nPoints = 64;
+        WordLength = 8;
+        MaxBits = 8;
+        LeafSize = 2000;
+        UseParallel = false;
+    end
+
+    properties (SetAccess = private)
+        Names = {};
+        nSteps = 0;
+    end
+
+    properties (SetAccess = private, Hidden = true)
+        LeafWords = zeros(0, 0, 'uint8'); % iSAX word of each leaf [size: nLeaves x WordLength]
+        LeafBits = zeros(0, 0, 'uint8');  % Number of bits of each segment symbol of each leaf [size: nLeaves x WordLength]
+        LeafStart = [];             % Number of steps in the leaves before each leaf
+        LeafCount = [];             % Number of steps in each leaf
+        StepRecording = zeros(0, 1, 'uint32'); % Recording of each step (index in obj.Names), in leaf order
+        StepOnset = zeros(0, 1, 'single'); % Onset of each step [unit: seconds], in leaf order
+        StepOffset = zeros(0, 1, 'single'); % Offset of each step [unit: seconds], in leaf order
+    end
+
+    methods
+
+        %% Open an index (parameter 'IndexDir' is optional).
+        function obj = StepIndex(IndexDir)
+            if nargin >= 1 && ~isempty(IndexDir)
+                obj.IndexDir = IndexDir;
+            end
+            if ~exist(obj.IndexDir, 'dir')
+                mkdir(obj.IndexDir);
+            end
+            if exist(fullfile(obj.IndexDir, 'index.mat'), 'file')
+                Saved = load(fullfile(obj.IndexDir, 'index.mat'));
+                for Field = fieldnames(Saved)'
+                    obj.(Field{1}) = Saved.(Field{1});
+                end
+            end
+        end
+
+        %% Index the steps of recordings 'Names' in RecordingStore 'Store' (parameter 'Names' is optional).
+        % The index is rebuilt from scratch. The steps of each recording are detected and resampled in parallel
+        % (UseParallel) and written to a temporary file, the tree is built from the iSAX words of all steps, and the
+        % curves are then copied into the leaf order of the tree.
+        function obj = build(obj, Store, Names)
+            if nargin < 3 || isempty(Names)
+                Names = list(Store);
+            end
+            if ischar(Names)
+                Names = {Names};
+            end
+            if mod(obj.nPoints, obj.WordLength) ~= 0
+                error('StepIndex.build(): nPoints must be a multiple of WordLength.');
+            end
+
+            % Detect, resample and summarise the steps of each recording
+            Breakpoints = StepIndex.breakpoints(obj.MaxBits);
+            Settings = struct('Input', obj.Input, 'StepThreshold', obj.StepThreshold, 'nPoints', obj.nPoints, ...
+                'WordLength', obj.WordLength, 'Breakpoints', Breakpoints);
+            TmpDir = tempname(obj.IndexDir);
+            mkdir(TmpDir);
+            nRecordings = length(Names);
+            Words = cell(nRecordings, 1);
+            Onsets = cell(nRecordings, 1);
+            Offsets = cell(nRecordings, 1);
+            parfor (iRecording = 1:nRecordings, StepIndex.nWorkers(obj))
+                [Words{iRecording}, Onsets{iRecording}, Offsets{iRecording}] = StepIndex.extract(Store, ...
+                    Names{iRecording}, Settings, fullfile(TmpDir, sprintf('%i.f32', iRecording)));
+            end
+            nStepsRecording = cellfun(@length, Onsets);
+            Words = [Words{:}];
+            Recording = uint32(repelem(1:nRecordings, nStepsRecording))';
+            iStepRecording = cell2mat(arrayfun(@(n) (1:n)', nStepsRecording, 'UniformOutput', false));
+
+            % Build the tree, and sort the steps into leaf order (by recording within each leaf)
+            [Leaf, obj.LeafWords, obj.LeafBits] = StepIndex.partition(Words, obj.MaxBits, obj.LeafSize);
+            [~, iOrder] = sortrows([Leaf Recording iStepRecording]);
+            obj.LeafCount = accumarray(Leaf, 1, [size(obj.LeafWords,1) 1]);
+            obj.LeafStart = [0; cumsum(obj.LeafCount(1:end-1))];
+            Onsets = vertcat(Onsets{:});
+            Offsets = vertcat(Offsets{:});
+            obj.StepRecording = Recording(iOrder);
+            obj.StepOnset = single(Onsets(iOrder));
+            obj.StepOffset = single(Offsets(iOrder));
+            obj.Names = Names(:)';
+            obj.nSteps = length(iOrder);
+
+            % Copy the curves of each recording to their positions in leaf order (runs of consecutive positions are
+            % written at once)
+            Position(iOrder) = (0:obj.nSteps-1)';
+            fileCurves = fullfile(obj.IndexDir, 'curves.f32');
+            fid = fopen([fileCurves '.tmp'], 'w', 'ieee-le');
+            nBlock = 2^20;
+            for iBlock = 1:ceil(obj.nSteps*obj.nPoints/nBlock)
+                fwrite(fid, zeros(min(nBlock, obj.nSteps*obj.nPoints - (iBlock-1)*nBlock), 1, 'single'), 'single');
+            end
+            iFirstStep = [0; cumsum(nStepsRecording)];
+            for iRecording = 1:nRecordings
+                fileTmp = fullfile(TmpDir, sprintf('%i.f32', iRecording));
+                fidTmp = fopen(fileTmp, 'r', 'ieee-le');
+                Curves = fread(fidTmp, [obj.nPoints nStepsRecording(iRecording)], '*single');
+                fclose(fidTmp);
+                delete(fileTmp);
+                Pos = Position(iFirstStep(iRecording)+1:iFirstStep(iRecording+1));
+                iRuns = [0; find(diff(Pos(:)) ~= 1); length(Pos)];
+                for iRun = 1:length(iRuns)-1
+                    fseek(fid, 4*obj.nPoints*Pos(iRuns(iRun)+1), 'bof');
+                    fwrite(fid, Curves(:,iRuns(iRun)+1:iRuns(iRun+1)), 'single');
+                end
+            end
+            fclose(fid);
+            rmdir(TmpDir);
+            movefile([fileCurves '.tmp'], fileCurves);
+            saveIndex(obj);
+        end
+
+        %% The k steps nearest to 'Step' [fields: Name, tOnset, tOffset, Distance] (parameters 'k' and 'Exact' are optional).
+        % Step holds the samples of one step from onset to offset (any length). The fields of Matches have one row per
+        % match [size: k x 1], sorted by the Euclidean distance of the resampled, z-normalised curves. Approximate
+        % searches (Exact = false) only read the leaves with the lowest lower bounds until k steps are found, which is
+        % normally the leaf the step falls into. Stats.nLeaves is the number of leaves read, and Stats.nDistances the
+        % number of distances computed.
+        function [Matches, Stats] = search(obj, Step, k, Exact)
+            if nargin < 3 || isempty(k)
+                k = 10;
+            end
+            if nargin < 4
+                Exact = true;
+            end
+            Stats = struct('nLeaves', 0, 'nDistances', 0);
+            Query = [];
+            if length(Step) >= 2
+                Query = StepIndex.normalise(Step(:)', 1, length(Step), obj.nPoints);
+            end
+            if isempty(Query)
+                error('StepIndex.search(): The step must hold at least two valid samples, and must not be constant.');
+            end
+            Bound = lowerBound(obj, Query);
+            [Bound, iLeaves] = sort(Bound);
+            Map = memmapfile(fullfile(obj.IndexDir, 'curves.f32'), 'Format', {'single', [obj.nPoints obj.nSteps], 'x'});
+
+            Best = zeros(0, 2);     % Nearest steps found [Distance, step number in leaf order]
+            for iSorted = 1:length(iLeaves)
+                if size(Best,1) >= k && (~Exact || Bound(iSorted) >= Best(k,1))
+                    break;
+                end
+                iLeaf = iLeaves(iSorted);
+                iSteps = obj.LeafStart(iLeaf) + (1:obj.LeafCount(iLeaf));
+                Distance = sqrt(sum((double(Map.Data.x(:,iSteps)) - Query).^2, 1));
+                Best = sortrows([Best; Distance' iSteps']);
+                Best = Best(1:min(k, end),:);
+                Stats.nLeaves = Stats.nLeaves + 1;
+                Stats.nDistances = Stats.nDistances + length(iSteps);
+            end
+
+            iSteps = Best(:,2);
+            Matches = struct('Name', {obj.Names(obj.StepRecording(iSteps))'}, 'tOnset', double(obj.StepOnset(iSteps)), ...
+                'tOffset', double(obj.StepOffset(iSteps)), 'Distance', Best(:,1));
+        end
+
+    end
+
+    methods (Static)
+
+        %% Resampled and z-normalised steps of signal 'x' [size: nPoints x nSteps].
+        % Steps with missing samples (NaN) or without variation are left out; iValid are the indexes of the steps
+        % that are kept.
+        function [Curves, iValid] = normalise(x, iOnset, iOffset, nPoints)
+            iOnset = iOnset(:)';
+            iOffset = iOffset(:)';
+            Curves = StepEnsemble.resample(x, iOnset, iOffset, nPoints);
+            Curves = Curves - mean(Curves, 1);
+            Deviation = std(Curves, 0, 1);
+            iValid = find(~any(isnan(Curves), 1) & Deviation > 1e-6 & iOffset > iOnset);
+            Curves = Curves(:,iValid)./Deviation(iValid);
+        end
+
+    end
+
+    methods (Hidden = true)
+
+        %% Lower bound of the distance of the normalised step 'Query' to the steps of each leaf (MINDIST).
+        function Bound = lowerBound(obj, Query)
+            Breakpoints = [-Inf StepIndex.breakpoints(obj.MaxBits) Inf];
+            Segments = mean(reshape(Query, [], obj.WordLength), 1);
+            Scale = 2.^(obj.MaxBits - double(obj.LeafBits));
+            Low = Breakpoints(double(obj.LeafWords).*Scale + 1);
+            High = Breakpoints((double(obj.LeafWords) + 1).*Scale + 1);
+            Gap = max(Low - Segments, 0) + max(Segments - High, 0);
+            Bound = sqrt(obj.nPoints/obj.WordLength*sum(Gap.^2, 2));
+        end
+
+        %% Save the index (the curves are saved by build).
+        function saveIndex(obj)
+            Index = struct();
+            for Field = {'Input', 'StepThreshold', 'nPoints', 'WordLength', 'MaxBits', 'LeafSize', 'Names', 'nSteps', ...
+                    'LeafWords', 'LeafBits', 'LeafStart', 'LeafCount', 'StepRecording', 'StepOnset', 'StepOffset'}
+                Index.(Field{1}) = obj.(Field{1});
+            end
+            save(fullfile(obj.IndexDir, 'index.mat'), '-struct', 'Index', '-v7.3');
+        end
+
+    end
+
+    methods (Static, Access = private)
+
+        %% Breakpoints dividing the standard normal distribution into 2^nBits equiprobable symbols [size: 1 x 2^nBits-1].
+        function Breakpoints = breakpoints(nBits)
+            Breakpoints = -sqrt(2)*erfcinv(2*(1:2^nBits-1)/2^nBits);
+        end
+
+        %% Detect, resample and summarise the steps of one recording. The curves are written to fileCurves, and Words
+        % holds the iSAX word of each step at full cardinality [size: WordLength x nSteps].
+        function [Words, tOnset, tOffset] = extract(Store, Name, Settings, fileCurves)
+            Index = info(Store, Name);
+            iInput = Settings.Input;
+            if ischar(iInput)
+                iInput = find(strcmp(Index.Labels, iInput));
+            end
+            x = read(Store, Name, iInput);
+            Logger = WiFiUDPlogger;
+            Logger.StepThreshold = Settings.StepThreshold;
+            Steps = detectSteps(Logger, 1, x);
+            [Curves, iValid] = StepIndex.normalise(x, Steps.iOnset, Steps.iOffset, Settings.nPoints);
+            tOnset = (Steps.iOnset(iValid)-1)/Index.SampleRate;
+            tOffset = (Steps.iOffset(iValid)-1)/Index.SampleRate;
+
+            Segments = reshape(mean(reshape(Curves, Settings.nPoints/Settings.WordLength, []), 1), Settings.WordLength, []);
+            Words = uint8(discretize(Segments, [-Inf Settings.Breakpoints Inf]) - 1);
+
+            fid = fopen(fileCurves, 'w', 'ieee-le');
+            fwrite(fid, Curves, 'single');
+            fclose(fid);
+        end
+
+        %% Sort the steps into the leaves of an iSAX tree. The root has a child for each combination of the first bit
+        % of the segments, and a node with more than LeafSize steps is split into two on the next bit of the segment
+        % that divides it most evenly (segments whose next bit is the same for all steps are refined first). Leaf is
+        % the leaf of each step [size: nSteps x 1].
+        function [Leaf, LeafWords, LeafBits] = partition(Words, MaxBits, LeafSize)
+            [WordLength, nSteps] = size(Words);
+            Leaf = zeros(nSteps, 1);
+            LeafWords = zeros(0, WordLength, 'uint8');
+            LeafBits = zeros(0, WordLength, 'uint8');
+            if nSteps == 0
+                return;
+            end
+            [~, ~, iRoot] = unique(bitshift(Words, 1 - MaxBits)', 'rows');
+            Stack = arrayfun(@(iChild) struct('iSteps', find(iRoot == iChild), 'Bits', ones(1, WordLength)), ...
+                1:max(iRoot), 'UniformOutput', false);
+            while ~isempty(Stack)
+                Node = Stack{end};
+                Stack(end) = [];
+                iSplit = 0;
+                if length(Node.iSteps) > LeafSize
+                    % Fraction of the steps with the next bit set, for each segment that can be split
+                    NextBit = bitand(bitshift(Words(:,Node.iSteps), repmat((Node.Bits + 1 - MaxBits)', 1, length(Node.iSteps))), 1);
+                    Balance = abs(mean(NextBit, 2)' - 0.5);
+                    mConstant = Balance == 0.5 & Node.Bits < MaxBits;
+                    Balance(Node.Bits >= MaxBits | Balance == 0.5) = Inf;
+                    [MinBalance, iSplit] = min(Balance);
+                    if isinf(MinBalance)
+                        iSplit = 0;
+                        if any(mConstant)
+                            % The next bit is the same for all steps: refine the segments, and try again
+                            Node.Bits(mConstant) = Node.Bits(mConstant) + 1;
+                            Stack{end+1} = Node; %#ok<AGROW>
+                            continue;
+                        end
+                    end
+                end
+                if iSplit == 0
+                    LeafWords(end+1,:) = bitshift(Words(:,Node.iSteps(1)), (Node.Bits - MaxBits)')'; %#ok<AGROW>
+                    LeafBits(end+1,:) = Node.Bits; %#ok<AGROW>
+                    Leaf(Node.iSteps) = size(LeafWords,1);
+                else
+                    Bits = Node.Bits;
+                    Bits(iSplit) = Bits(iSplit) + 1;
+                    mSet = NextBit(iSplit,:) == 1;
+                    Stack(end+(1:2)) = {struct('iSteps', Node.iSteps(~mSet), 'Bits', Bits), ...
+                        struct('iSteps', Node.iSteps(mSet), 'Bits', Bits)};
+                end
+            end
+        end
+
+        %% Number of parallel workers (0 runs the parfor loops in this MATLAB session).
+        function n = nWorkers(obj)
+            n = 0;
+            if obj.UseParallel && license('test', 'Distrib_Computing_Toolbox')
+                n = Inf;
+            end
+        end
+
+    end
+end
@@ -0,0 +1,152 @@
+% >>Description<<
+% Class which records the timing of the stages of the receive pipeline (receive batches, decoding, reassembly of
+% bursts and bulk transfers, live filters, drawing, writes to the live recording and its compaction, analytics), so a
+% stalled stage can be found when a live session stutters. An event is the stage name, its start and duration, and an
+% optional value (e.g. the number of packets of a receive batch). The events are kept in a preallocated ring of
+% Capacity events (the oldest are overwritten), so recording costs a few array writes per event and no allocation. The
+% timestamps are taken with tic/toc (monotonic clock) from the creation or the last reset of the recorder.
+% The events are exported as Chrome trace JSON, which is opened by the Perfetto UI (ui.perfetto.dev) or
+% chrome://tracing. Stages listed in Threads are shown on their own track (e.g. the compaction timer), the others on
+% the track of the receive loop. The classes check for an empty recorder before each event, so tracing costs nothing
+% when it is disabled.
+%
+% >>Properties<<
+%   Capacity:           Number of events kept (the last events)
+%   Threads:            Track of the stages which do not run in the receive loop [fields: stage names, values: track names]
+%   nEvents:            Number of events recorded since the last reset
+%   Stages:             Names of the recorded stages [type: cell array of strings]
+%
+% >>Functions<<
+%   obj = TraceRecorder(Capacity)  ...............  Trace recorder (parameter 'Capacity' is optional).
+%   t = tick(obj)  ...............................  Current time for the start of an event [unit: seconds].
+%   record(obj, Stage, tBegin, Value)  ...........  Record an event of stage 'Stage' from tBegin (see tick) until now (parameter 'Value' is optional).
+%   exportChrome(obj, fileName)  .................  Write the events as Chrome trace JSON (Perfetto UI, chrome://tracing).
+%   Stats = summary(obj)  ........................  Number of events, and total, mean, 99th percentile and maximum duration of each stage.
+%   obj = reset(obj)  ............................  Discard the events, and restart the time.
+%
+% >>Example<<
+%   obj.Trace = TraceRecorder;
+%   obj = recordData(obj, [], 60);
+%   exportChrome(obj.Trace, 'session.json');
+%   Stats = summary(obj.Trace);
+
+classdef TraceRecorder < handle
+    properties
+        Threads = struct('Compaction', 'Compaction timer');
+    end
+
+    properties (SetAccess = private)
+        Capacity = 2^16;
+        nEvents = 0;
+        Stages = {};
+    end
+
+    properties (SetAccess = private, Hidden = true)
+        Codes = struct();           % Index in Stages of each stage name
+        Stage = [];                 % Stage of each event [size: Capacity x 1, type: uint16]
+        tBegin = [];                % Start of each event [size: Capacity x 1, unit: seconds]
+        Duration = [];              % Duration of each event [size: Capacity x 1, unit: seconds]
+        Value = [];                 % Value of each event (NaN: none) [size: Capacity x 1]
+        tOrigin = [];               % Origin of the event times (from tic)
+    end
+
+    methods
+
+        %% Trace recorder (parameter 'Capacity' is optional).
+        function obj = TraceRecorder(Capacity)
+            if nargin >= 1 && ~isempty(Capacity)
+                obj.Capacity = Capacity;
+            end
+            reset(obj);
+        end
+
+        %% Current time for the start of an event [unit: seconds].
+        function t = tick(obj)
+            t = toc(obj.tOrigin);
+        end
+
+        %% Record an event of stage 'Stage' from tBegin (see tick) until now (parameter 'Value' is optional).
+        function record(obj, Stage, tBegin, Value)
+            if ~isfield(obj.Codes, Stage)
+                obj.Stages{end+1} = Stage;
+                obj.Codes.(Stage) = length(obj.Stages);
+            end
+            iEvent = mod(obj.nEvents, obj.Capacity) + 1;
+            obj.Stage(iEvent) = obj.Codes.(Stage);
+            obj.tBegin(iEvent) = tBegin;
+            obj.Duration(iEvent) = toc(obj.tOrigin) - tBegin;
+            if nargin >= 4
+                obj.Value(iEvent) = Value;
+            else
+                obj.Value(iEvent) = NaN;
+            end
+            obj.nEvents = obj.nEvents + 1;
+        end
+
+        %% Write the events as Chrome trace JSON (Perfetto UI, chrome://tracing).
+        % Each event is a complete event ('X') with its start and duration in microseconds, and its value in args.
+        function exportChrome(obj, fileName)
+            nKept = min(obj.nEvents, obj.Capacity);
+            ThreadNames = [{'Receive loop'} unique(struct2cell(obj.Threads))'];
+            Text = {sprintf('{"name":"process_name","ph":"M","pid":1,"tid":1,"args":{"name":"WiFiUDPlogger"}},\n')};
+            for iThread = 1:length(ThreadNames)
+                Text{end+1} = sprintf('{"name":"thread_name","ph":"M","pid":1,"tid":%i,"args":{"name":"%s"}},\n', iThread, ThreadNames{iThread}); %#ok<AGROW>
+            end
+            for iStage = 1:length(obj.Stages)
+                iThread = 1;
+                if isfield(obj.Threads, obj.Stages{iStage})
+                    iThread = find(strcmp(ThreadNames, obj.Threads.(obj.Stages{iStage})), 1);
+                end
+                iEvents = find(obj.Stage(1:nKept) == iStage);
+                mValue = ~isnan(obj.Value(iEvents));
+                Format = ['{"name":"' obj.Stages{iStage} '","cat":"pipeline","ph":"X","pid":1,"tid":' sprintf('%i', iThread) ...
+                    ',"ts":%.3f,"dur":%.3f'];
+                if any(mValue)
+                    Text{end+1} = sprintf([Format ',"args":{"value":%.15g}},\n'], ...
+                        [1e6*obj.tBegin(iEvents(mValue)) 1e6*obj.Duration(iEvents(mValue)) obj.Value(iEvents(mValue))]'); %#ok<AGROW>
+                end
+                if any(~mValue)
+                    Text{end+1} = sprintf([Format '},\n'], [1e6*obj.tBegin(iEvents(~mValue)) 1e6*obj.Duration(iEvents(~mValue))]'); %#ok<AGROW>
+                end
+            end
+            Text = [Text{:}];
+
+            fid = fopen(fileName, 'w');
+            if fid < 0
+                error('TraceRecorder.exportChrome(): Could not open ''%s''.', fileName);
+            end
+            fprintf(fid, '{"traceEvents":[\n%s\n],"displayTimeUnit":"ms"}\n', Text(1:end-2));
+            fclose(fid);
+        end
+
+        %% Number of events, and total, mean, 99th percentile and maximum duration of each stage.
+        % Stats is a struct array with the fields Stage, nEvents, Total, Mean, P99 and Max [unit: seconds], of the kept
+        % events.
+        function Stats = summary(obj)
+            nKept = min(obj.nEvents, obj.Capacity);
+            Stats = struct('Stage', obj.Stages, 'nEvents', 0, 'Total', 0, 'Mean', NaN, 'P99', NaN, 'Max', NaN);
+            for iStage = 1:length(obj.Stages)
+                Durations = sort(obj.Duration(obj.Stage(1:nKept) == iStage));
+                if isempty(Durations)
+                    continue;
+                end
+                Stats(iStage).nEvents = length(Durations);
+                Stats(iStage).Total = sum(Durations);
+                Stats(iStage).Mean = mean(Durations);
+                Stats(iStage).P99 = Durations(ceil(0.99*length(Durations)));
+                Stats(iStage).Max = Durations(end);
+            end
+        end
+
+        %% Discard the events, and restart the time.
+        function obj = reset(obj)
+            obj.Stage = zeros(obj.Capacity, 1, 'uint16');
+            obj.tBegin = zeros(obj.Capacity, 1);
+            obj.Duration = zeros(obj.Capacity, 1);
+            obj.Value = nan(obj.Capacity, 1);
+            obj.nEvents = 0;
+            obj.tOrigin = tic;
+        end
+
+    end
+end
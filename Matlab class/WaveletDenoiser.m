@@ -0,0 +1,208 @@
+% >>Description<<
+% Class which denoises the data while recording with the stationary (undecimated) Haar wavelet transform, and times
+% the heel strikes (rising edges) at the finest scales. The transform is computed by lifting (a difference and an
+% update per level), and the detail coefficients are soft-thresholded relative to the noise of each input, so the
+% edges of the steps stay sharp where a low-pass filter would smear them. The chunks are processed for all inputs at
+% once with array operations, and the output is delayed by a fixed lookahead of 2^Levels-1 samples (Delay), so for
+% the same noise the streamed output is the same as the output of the whole recording (denoise). The noise is
+% estimated from the second differences of the inputs (median absolute deviation, not affected by the slopes of the
+% steps).
+% Edges are the maxima of the product of the (normalised, positive) details over the levels: noise is not
+% correlated over the scales, but an edge is, so the product locates the edge at the finest scale.
+%
+% >>Properties<<
+%   SampleRate:         Samplerate of the data [unit: Hz]
+%   Levels:             Number of levels of the transform (2 or more, the lookahead is 2^Levels-1 samples)
+%   Threshold:          Threshold of the details, relative to the noise of each level
+%   EdgeThreshold:      Edge threshold of the normalised details (the product over the levels must exceed EdgeThreshold^Levels)
+%   RefractoryTime:     Minimum time between two edges of an input [unit: seconds]
+%   NoiseTime:          Time constant of the noise estimate while streaming [unit: seconds]
+%   Noise:              Noise estimate of each input [size: nInputs x 1, unit: Volt]
+%   Delay:              Delay of the output of process [unit: samples]
+%   nSamples:           Number of samples processed since the last reset
+%
+% >>Functions<<
+%   obj = WaveletDenoiser(SampleRate, Levels)  ...  Denoiser (parameter 'Levels' is optional).
+%   [Y, Edges] = process(obj, X)  ...............  Denoise the next chunk X [size: nInputs x nSamples] and find the edges in it (the output is delayed by Delay samples).
+%   obj = reset(obj)  ...........................  Discard the history of the stream.
+%   Y = WaveletDenoiser.denoise(X, Levels, Threshold, Noise)  Denoise a whole recording X [size: nInputs x nSamples] (parameter 'Noise' is optional).
+%
+% >>Example<<
+%   Denoiser = WaveletDenoiser(obj.ADCsamplerate);
+%   [Y, Edges] = process(Denoiser, Chunk);
+%   tHeelStrikes = Edges.Time(Edges.iInput == 1);
+
+classdef WaveletDenoiser < handle
+    properties
+        SampleRate = 256;
+        Levels = 3;
+        Threshold = 3;
+        EdgeThreshold = 4;
+        RefractoryTime = 0.2;
+        NoiseTime = 10;
+    end
+
+    properties (SetAccess = private)
+        Noise = [];
+        nSamples = 0;
+    end
+
+    properties (Dependent, SetAccess = private)
+        Delay
+    end
+
+    properties (SetAccess = private, Hidden = true)
+        History = [];               % Last input samples [size: nInputs x 2*Delay]
+        tLastEdge = [];             % Time of the last edge of each input [size: nInputs x 1, unit: seconds]
+    end
+
+    methods
+
+        function Delay = get.Delay(obj)
+            Delay = 2^obj.Levels - 1;
+        end
+
+        %% Denoiser (parameter 'Levels' is optional).
+        function obj = WaveletDenoiser(SampleRate, Levels)
+            obj.SampleRate = SampleRate;
+            if nargin >= 2 && ~isempty(Levels)
+                obj.Levels = Levels;
+            end
+        end
+
+        %% Denoise the next chunk X [size: nInputs x nSamples] and find the edges in it (the output is delayed by Delay samples).
+        % Sample i of the output is input sample i-Delay (the first Delay output samples repeat the first input
+        % sample). Edges holds the rising edges, found within the samples of the output:
+        % Edges.iInput:         Input of each edge
+        % Edges.Time:           Time of each edge since the first input sample after reset [unit: seconds]
+        % Edges.Strength:       Product of the normalised details at the edge
+        function [Y, Edges] = process(obj, X)
+            if obj.Levels < 2
+                error('WaveletDenoiser.process(): Levels must be 2 or more.');
+            end
+            nInputs = size(X,1);
+            n = size(X,2);
+            L = obj.Delay;
+            if isempty(obj.History)
+                obj.History = repmat(X(:,1), 1, 2*L);
+                obj.tLastEdge = -inf(nInputs, 1);
+            elseif size(obj.History,1) ~= nInputs
+                error('WaveletDenoiser.process(): The number of inputs changed from %i to %i (call reset).', size(obj.History,1), nInputs);
+            end
+            Window = [obj.History X];
+
+            % Noise of each input from the new samples, smoothed over NoiseTime
+            NoiseChunk = median(abs(diff(Window(:,end-n-1:end), 2, 2)), 2, 'omitnan')/0.6745/sqrt(6);
+            if isempty(obj.Noise)
+                obj.Noise = NoiseChunk;
+            else
+                w = 1 - exp(-n/(obj.NoiseTime*obj.SampleRate));
+                obj.Noise = obj.Noise + w*(NoiseChunk - obj.Noise);
+            end
+            Sigma = max(obj.Noise, eps);
+
+            [a, D] = WaveletDenoiser.analyse(Window, obj.Levels);
+            Y = WaveletDenoiser.synthesise(a, D, obj.Threshold*Sigma);
+            Y = Y(:,L+1:end-L);
+
+            % Edges: maxima of the product of the details (at the centre between sample m and m+1)
+            P = ones(size(Window));
+            for j = 1:obj.Levels
+                s = 2^(j-1);
+                d = zeros(size(Window));
+                d(:,1:end-s) = D{j}(:,s+1:end);
+                P = P .* max(d, 0) ./ (Sigma*sqrt(2/s));
+            end
+            iColumns = L+1:L+n;
+            Peak = P(:,iColumns);
+            [iInput, iPeak] = find(Peak > obj.EdgeThreshold^obj.Levels & Peak > P(:,iColumns-1) & Peak >= P(:,iColumns+1));
+            [iPeak, iOrder] = sort(iPeak);
+            iInput = iInput(iOrder);
+            iCentre = sub2ind(size(P), iInput, iPeak + L);
+            y0 = P(iCentre - nInputs);
+            y1 = P(iCentre);
+            y2 = P(iCentre + nInputs);
+            Offset = 0.5*(y0 - y2)./(y0 - 2*y1 + y2);
+            Time = (obj.nSamples - L + iPeak - 0.5 + Offset)/obj.SampleRate;
+
+            mKeep = true(size(Time));
+            for iEdge = 1:length(Time)
+                if Time(iEdge) - obj.tLastEdge(iInput(iEdge)) < obj.RefractoryTime
+                    mKeep(iEdge) = false;
+                else
+                    obj.tLastEdge(iInput(iEdge)) = Time(iEdge);
+                end
+            end
+            Edges.iInput = iInput(mKeep);
+            Edges.Time = Time(mKeep);
+            Edges.Strength = y1(mKeep);
+
+            obj.History = Window(:,end-2*L+1:end);
+            obj.nSamples = obj.nSamples + n;
+        end
+
+        %% Discard the history of the stream.
+        function obj = reset(obj)
+            obj.History = [];
+            obj.tLastEdge = [];
+            obj.Noise = [];
+            obj.nSamples = 0;
+        end
+
+    end
+
+    methods (Static)
+
+        %% Denoise a whole recording X [size: nInputs x nSamples] (parameter 'Noise' is optional).
+        % Noise is the noise of each input [size: nInputs x 1, unit: Volt], estimated from X if it is not given. The
+        % recording is extended by its first and last sample, so the output has no delay. Missing samples (NaN)
+        % leave the output missing within 2^Levels-1 samples around them.
+        function Y = denoise(X, Levels, Threshold, Noise)
+            if nargin < 4 || isempty(Noise)
+                Noise = median(abs(diff(X, 2, 2)), 2, 'omitnan')/0.6745/sqrt(6);
+            end
+            L = 2^Levels - 1;
+            Window = [repmat(X(:,1), 1, L) X repmat(X(:,end), 1, L)];
+            [a, D] = WaveletDenoiser.analyse(Window, Levels);
+            Y = WaveletDenoiser.synthesise(a, D, Threshold*max(Noise, eps));
+            Y = Y(:,L+1:end-L);
+        end
+
+    end
+
+    methods (Static, Hidden = true)
+
+        %% Stationary Haar transform of X [size: nInputs x nSamples] by lifting: approximation 'a' and the details
+        % of each level D{j}. Level j compares samples 2^(j-1) apart, and the first 2^j-1 samples are NaN.
+        function [a, D] = analyse(X, Levels)
+            a = X;
+            D = cell(1, Levels);
+            for j = 1:Levels
+                s = 2^(j-1);
+                d = nan(size(a));
+                d(:,s+1:end) = a(:,s+1:end) - a(:,1:end-s);
+                aNext = nan(size(a));
+                aNext(:,s+1:end) = a(:,1:end-s) + d(:,s+1:end)/2;
+                D{j} = d;
+                a = aNext;
+            end
+        end
+
+        %% Inverse of analyse, with the details soft-thresholded at Threshold*sqrt(2/2^(j-1)) for level j (the noise
+        % of the level for unit noise) [Threshold size: nInputs x 1]. Each level is inverted from both of its samples
+        % (centred), so sample i of the output depends on the input up to sample i+2^Levels-1.
+        function X = synthesise(a, D, Threshold)
+            for j = length(D):-1:1
+                s = 2^(j-1);
+                T = Threshold*sqrt(2/s);
+                d = sign(D{j}) .* max(abs(D{j}) - T, 0);
+                Up = a + d/2;
+                Down = nan(size(a));
+                Down(:,1:end-s) = a(:,s+1:end) - d(:,s+1:end)/2;
+                a = (Up + Down)/2;
+            end
+            X = a;
+        end
+
+    end
+end
@@ -3,7 +3,11 @@
 %
 % >>Properties<<
 %   Data:               ADC readings [size: nInputs x nSamples, unit: Volt, type: double]
+%   BlockSummary:       Min, max, mean and tare offset of each input in each UDP packet [fields: Min, Max, Mean, Offset, size: nInputs x nBlocks, unit: Volt]
+%   DataValid:          Validity mask of obj.Data, false for lost/imputed samples [size: nInputs x nSamples, type: logical]
 %   Recordings:         Struct containing previous recordings performed with the same class object.
+%   Bursts:             Bursts received during the recording [fields: iBurst, Data (nInputs x nSamples, unit: Volt), iInputs, SampleRate, tStart (unit: seconds)]
+%   SyncTimes:          Time of the edges on the sync pulse input of the board [unit: seconds, on the time axis of obj.Data]
 %   labelADCinput:      ADC input labels [size: nInputs x 1, type: cell array of strings]
 %
 %  >UDP connection settings
@@ -12,9 +16,16 @@
 %   InputBufferSize:    Buffer size for the UDP object.
 %   Connected:          true: Connected to the Arduino Feather board.
 %
+%  >USB connection settings
+%   Transport:          'udp': Connect over WiFi, 'serial': Connect over the native USB port (framed packets)
+%   SerialPort:         Serial port of the board (or a pseudo terminal of an emulator), e.g. '/dev/ttyACM0' or 'COM3'
+%
 %  >ADC settings
 %   ADCsamplerate:      Samplerate of the ADC
 %   ADCgain:            Gain setting the PGA before to the ADC.
+%   TareInputs:         Inputs with automatic tare on the board (see setTare, sent again by open). If the board confirms the tare of all
+%                       recorded inputs at the start of a recording (see isTared), the live plot and processData low-pass filter the
+%                       recording (freqBandpass(end)) instead of the band-pass filter, without warm-up (AddLiveBuffer).
 %
 %  >Live plot settings
 %   LivePlotEnabled:    true: Plot live data during recording
@@ -22,16 +33,62 @@
 %   freqBandpass:       Corner frequencies for the bandpass filter [unit: Hz, size:1x2]
 %   freqNotch:          Notch filter frequencies [Unit:Hz]
 %   bandwidthNotch:     Width of notch filter [unit:Hz]
+%   LiveIncremental:    true: Append only new samples to circular live buffers, false: Refilter and redraw the whole live window
+%   LiveFrameRate:      Maximum redraw rate of the live plot [unit: Hz]
+%
+%  >Gap imputation settings
+%   ImputeEnabled:      true: Fill gaps left by lost UDP packets (live plot and end of recording)
+%   ImputeShortGap:     Gaps up to this length are filled with a cubic Hermite spline [unit: seconds]
+%   ImputeLongGap:      Gaps up to this length are filled from the previous step (longer gaps are left as NaN) [unit: seconds]
+%   StepThreshold:      Step detection threshold, relative to the range of the signal [range: 0-1]
+%
+%  >Receive settings
+%   ReceiveMode:        'sleep': Pause obj.IdlePollPeriod between reads, 'latency': Busy-poll while packets arrive (low latency, one CPU core)
+%   IdlePollPeriod:     Pause between reads, when no packets arrive (or in the 'sleep' mode) [unit: seconds]
+%   BusyPollWindow:     Packets are arriving, if a packet was received within this time [unit: seconds]
+%   BusyPollBudget:     Maximum busy-poll time before the GUI is updated [unit: seconds]
+%   RealtimeProfile:    true: Run recordData() with real-time scheduling and CPU affinity, and preallocate the whole recording (Linux)
+%                       All threads of MATLAB (including the JVM and the graphics) are real-time threads during the recording, so a
+%                       busy-polling MATLAB ('latency' mode) may starve other processes and kernel threads on its cores. Use RealtimeCPUs
+%                       to keep at least one core free, and keep RealtimePriority below the kernel interrupt threads (50).
+%   RealtimeCPUs:       CPU cores for the MATLAB process during the recording, e.g. cores isolated with isolcpus (empty: no affinity)
+%   RealtimePriority:   Real-time priority of the MATLAB threads during the recording [range: 1-99]
+%   RealtimeSessionLength: Length preallocated by the real-time profile, if the recording has no RecordTime (until stopped) [unit: seconds]
+%
+%  >Live storage settings
+%   LiveStore:          RecordingStore the recordings are written to while they are recorded (see HotRecording, empty: disabled)
+%   LiveName:           Name of the recording in LiveStore (empty: date and time of the start of the recording)
+%   LiveMetadata:       Metadata of the recording in LiveStore, e.g. Patient, Side and Condition (ADCgain and Tared are added, see SessionCatalog)
+%
+%  >Hand-off settings
+%   HandoffFile:        Base name of the files through which another MATLAB process takes over the recording (see takeOver, empty: disabled)
+%   HandoffTimeout:     Maximum wait for the other process during a hand-off [unit: seconds]
+%
+%  >Trace settings
+%   Trace:              TraceRecorder of the stages of the receive pipeline (receive, decode, filter, draw, store, analytics, see TraceRecorder, empty: disabled)
 %
 % >>Functions<<
 %   obj = open(obj)  .............................  Open UDP connection.
 %   obj = close(obj) .............................  Close UDP connection.
 %   obj = setADCgain(obj, gain)  .................  Set the gain of the PGA before to the ADC.
+%   obj = setTare(obj, iInputs)  .................  Enable the automatic tare of inputs iInputs on the board (send with the feet off).
 %   obj = clearData(obj)  ........................  Clear the obj.Data to initialize a new recording.
 %   obj = recordData(obj, iInputs, RecordTime)  ..  Record data from the ADCs (parameters 'iInputs' and 'RecordTime' are optional).
+%   obj = takeOver(obj, RecordTime)  .............  Take over the recording of another MATLAB process, and continue it (parameter 'RecordTime' is optional).
 %   handle = plot(obj)  ..........................  Plot data.
 %   [obj, nRecvDataPackets] = readData(obj)  .....  Read availible data from the UDP object.
+%   waitForData(obj)  ............................  Wait for received data (as set by obj.ReceiveMode).
+%   Stats = WiFiUDPlogger.processStats()  ........  Page faults and context switches of the MATLAB process (Linux).
+%   [obj, isData] = decodePacket(obj, RecvData)  .  Decode a single UDP packet (e.g. from a replayed session).
 %   [obj, hFig] = plotLive(obj, RecordTime)  .....  Create a GUI for live plotting (parameter 'RecordTime' is optional).
+%   obj = imputeData(obj)  .......................  Fill gaps in obj.Data and update obj.DataValid.
+%   [Data, mValid] = imputeGaps(obj, Data)  ......  Fill gaps (NaN) in a data array [size: nInputs x nSamples].
+%   Steps = detectSteps(obj, iInput, Data)  ......  Detect steps on ADC input 'iInput' (parameter 'Data' is optional).
+%   [Result, CacheStats] = processData(obj, Config, Cache)  Filter obj.Data, detect steps and estimate the spectra (parameters 'Config' and 'Cache' are optional).
+%   [obj, Window, TimeAxis] = fetchWindow(obj, tEvent, tWindow)  Fetch the full rate readings around time 'tEvent' in obj.Data from the flight recorder.
+%   obj = startBurst(obj, iInputs, SampleRate, Duration, Threshold)  Arm a high samplerate burst on consecutive inputs (parameters 'SampleRate', 'Duration' and 'Threshold' are optional).
+%   [obj, Stats] = readSchedulerStats(obj)  ......  Read the latency, run time and overruns of the firmware tasks (since the last call).
+%   [Align, Fit] = alignExternal(obj, tEdges, SyncTimes)  Map times of an external system to the time axis of obj.Data from the sync pulse edges (parameter 'SyncTimes' is optional).
 %
 % >>Example<<
 %   obj = WiFiUDPlogger;
@@ -43,9 +100,16 @@
 %   obj = close(obj);
 
 classdef WiFiUDPlogger
+    properties (Dependent)
+        Data;
+        BlockSummary;
+    end
+    
     properties
-        Data = [];
+        DataValid = [];
         Recordings = [];
+        Bursts = [];
+        SyncTimes = [];
         labelADCinput = {};
         
         % UDP connection settings.
@@ -54,9 +118,14 @@ classdef WiFiUDPlogger
         InputBufferSize = 1e6;
         Connected = false;
         
+        % USB connection settings
+        Transport = 'udp';
+        SerialPort = '/dev/ttyACM0';
+        
         % ADC settings
         ADCsamplerate = [];
         ADCgain = [];
+        TareInputs = [];
         
         % Live plot settings
         LivePlotEnabled = true;
@@ -64,13 +133,51 @@ classdef WiFiUDPlogger
         freqBandpass = [0.1 45];
         freqNotch = [50 100];
         bandwidthNotch = 0.5;
+        LiveIncremental = true;
+        LiveFrameRate = 25;
+        
+        % Gap imputation settings
+        ImputeEnabled = true;
+        ImputeShortGap = 0.05;
+        ImputeLongGap = 1;
+        StepThreshold = 0.2;
+        
+        % Receive settings
+        ReceiveMode = 'sleep';
+        IdlePollPeriod = 0.01;
+        BusyPollWindow = 0.1;
+        BusyPollBudget = 0.005;
+        RealtimeProfile = false;
+        RealtimeCPUs = [];
+        RealtimePriority = 49;
+        RealtimeSessionLength = 3600;
+        
+        % Live storage settings
+        LiveStore = [];
+        LiveName = '';
+        LiveMetadata = struct();
+        
+        % Hand-off settings
+        HandoffFile = fullfile(tempdir, 'WiFiUDPlogger_handoff');
+        HandoffTimeout = 10;
+        
+        % Trace settings
+        Trace = [];
     end
     
     properties (SetAccess = private, Hidden = true)
-        hUDP = [];                  % UDP object
+        hUDP = [];                  % UDP object (or serial port object, if obj.Transport is 'serial')
+        SerialBuffer = [];          % Received bytes of an incomplete frame on the serial port
+        tLastPacket = [];           % Time of the last received packet (from tic)
+        RealtimeRestore = {};       % Shell commands restoring the scheduling and affinity after the real-time profile
+        LiveRecording = [];         % HotRecording in obj.LiveStore of the recording in progress
         
         iData = 1;                  % Data struct index
         iBufferLast = [];           % Last received ADC buffer index
+        DataBuffer = [];            % Preallocated ADC readings (obj.Data is the first nDataSamples columns)
+        nDataSamples = 0;           % Number of samples in obj.Data
+        SummaryBuffer = [];         % Preallocated min, max, mean and tare offset of each block in obj.DataBuffer [size: nInputs x nBlocks x 4]
+        DataPrealloc = 60;          % Seconds of data to preallocate when a new recording is initialized
         
         % ADC settings
         ADCscale = 3.3/2^12;        % ADC scaling factor        
@@ -78,10 +185,24 @@ classdef WiFiUDPlogger
         nADCbuffers = [];           % Number of ADC buffers
         nADCbufferPos = [];         % Number of positions in each buffer
         mEnabledInputs= [];         % Enabled ADC inputs
+        FRdecimation = 0;           % Flight recorder decimation (the ring is sampled at ADCsamplerate*FRdecimation, 0: no flight recorder)
+        FRnFrames = 0;              % Number of full rate frames in the flight recorder ring
+        BoardTareInputs = [];       % Inputs with automatic tare, reported by the status of the board (see isTared)
+        DataTared = [];             % true: The board confirmed the tare of all inputs at the start of the recording ([]: not started)
+        FRtimeout = 2;              % Time to wait for a flight recorder window [unit: seconds]
+        Bulk = [];                  % Flight recorder bulk transfer in progress [fields: Packets, nPackets, Failed]
+        BurstPackets = [];          % Burst being received [fields: iBurst, Packets, iLast, tLast, nRetries]
+        iSyncNext = [];             % Number of the next sync event (uint8 counter of the firmware)
+        SyncMissing = [];           % Numbers of the sync events requested again
+        BurstSize = 4096;           % Number of samples in the burst buffer of the device (shared between the burst inputs)
+        BurstTimeout = 0.5;         % Time without burst packets before the missing packets are requested again [unit: seconds]
+        BurstRetries = 10;          % Requests of the missing packets without a burst packet, before the burst is dropped
+        nPatched = 0;               % Blocks written behind the last received block (retransmissions and burst fills, see appendLive)
+        SchedulerStats = [];        % Last received task statistics of the firmware scheduler
         
         % Live plot settings
-        TimeAxis = [];        
         AddLiveBuffer = 2;          % Seconds to add to live windows (this is relavant to avoid e.g. filter transient effects)
+        SettleCycles = 5;           % Warm-up of each chunk in processData [unit: periods of the high-pass corner freqBandpass(1)]
         LiveYlims = [-0.5 0.5]*3.3; % Ylimits of the Live plot
         GridLines = true;           % Activate grid lines
         thdSaturation = [];         % Saturation threshold [unit: Volt]
@@ -90,32 +211,91 @@ classdef WiFiUDPlogger
         heightUserInputs = 0.035;   % The height of the UI elements to the right of the live plot
         distUserInputs = 0.01;      % The distance between the UI elements to the right of the live plot
         dispRetransmit = false;     % true: Display retransmit commands in the command window.
+        
+        % Gap imputation settings
+        ImputeTemplateWindow = 5;   % Seconds of data before a long gap used to estimate the step period
+        
+        % Sync settings
+        SyncTolerance = 1e-3;       % Maximum RMS residual of paired sync edges in alignExternal() [unit: seconds]
+        
+        % Hand-off settings
+        HandoffQuiet = 0.2;         % Time without packets after the takeover, before the last packets are passed on [unit: seconds]
+        HandoffState = {'DataValid', 'Recordings', 'Bursts', 'SyncTimes', 'labelADCinput', 'ADCsamplerate', 'ADCgain', ...
+            'TareInputs', 'BoardTareInputs', 'DataTared', 'iData', 'iBufferLast', 'DataBuffer', 'nDataSamples', 'SummaryBuffer', 'nADCinput', 'nADCbuffers', ...
+            'nADCbufferPos', 'mEnabledInputs', 'FRdecimation', 'FRnFrames', 'Bulk', 'BurstPackets', 'iSyncNext', ...
+            'SyncMissing', 'SchedulerStats', 'LiveYlims', 'thdSaturation'}; % Properties handed over to another process
+        tHandoffCheck = [];         % Time of the last check for a hand-off request (from tic)
+        isTakenOver = false;        % true: recordData() continues the recording taken over (see takeOver)
+        tHandoffSnapshot = [];      % Time of the state of a hand-off, whose last packets were not passed on (see takeOver) [type: datenum]
+    end
+    
+    properties (Dependent, SetAccess = private, Hidden = true)
+        TimeAxis;                   % Time of each sample in obj.Data [unit: seconds]
     end
     
     methods
         
-        %% Open UDP connection
+        %% Get/set methods of the dependent properties
+        function Data = get.Data(obj)
+            Data = obj.DataBuffer(:,1:obj.nDataSamples);
+        end
+        
+        function obj = set.Data(obj, Data)
+            % The block summaries only belong to data with the same samples
+            if size(Data,2) ~= obj.nDataSamples
+                obj.SummaryBuffer = [];
+            end
+            obj.DataBuffer = Data;
+            obj.nDataSamples = size(Data,2);
+        end
+        
+        function BlockSummary = get.BlockSummary(obj)
+            nBlocks = min(floor(obj.nDataSamples/obj.nADCbufferPos), size(obj.SummaryBuffer,2));
+            BlockSummary.Min = obj.SummaryBuffer(:,1:nBlocks,1);
+            BlockSummary.Max = obj.SummaryBuffer(:,1:nBlocks,2);
+            BlockSummary.Mean = obj.SummaryBuffer(:,1:nBlocks,3);
+            BlockSummary.Offset = obj.SummaryBuffer(:,1:nBlocks,4);
+        end
+        
+        function TimeAxis = get.TimeAxis(obj)
+            TimeAxis = (0:obj.nDataSamples-1)/obj.ADCsamplerate;
+        end
+        
+        %% Open UDP connection (or the serial port, if obj.Transport is 'serial')
         function obj = open(obj)
-            obj.hUDP = udp(obj.RemoteHostIP, obj.RemoteHostPort, 'InputBufferSize',obj.InputBufferSize);
+            if strcmp(obj.Transport, 'serial')
+                obj.hUDP = serial(obj.SerialPort, 'InputBufferSize',obj.InputBufferSize, 'OutputBufferSize',1024);
+                obj.SerialBuffer = [];
+            else
+                obj.hUDP = udp(obj.RemoteHostIP, obj.RemoteHostPort, 'InputBufferSize',obj.InputBufferSize);
+            end
             fopen(obj.hUDP);
             
             % Try to connect to the host 5 times and display an error if it fails.
             for idx=1:20
-                fprintf(obj.hUDP,'S');
+                sendCommand(obj, 'S');
                 
                 % Wait for response
                 pause(0.1);
                 obj = readData(obj);
                 if obj.Connected
                     obj.Data = nan(obj.nADCinput, 1);
-                    obj.TimeAxis = 0;
                     obj.iBufferLast = [];
                     break;
                 end
             end
+            
+            % Enable the tare again (a board restarted since the last connection has forgotten it)
+            if obj.Connected && ~isempty(obj.TareInputs)
+                obj = setTare(obj, obj.TareInputs);
+            end
             if ~obj.Connected
                 obj = close(obj);
-                errordlg(sprintf('Could not connect to remote host\n IP:%s, Port:%i', obj.RemoteHostIP, obj.RemoteHostPort));
+                if strcmp(obj.Transport, 'serial')
+                    errordlg(sprintf('Could not connect to the board\n Serial port:%s', obj.SerialPort));
+                else
+                    errordlg(sprintf('Could not connect to remote host\n IP:%s, Port:%i', obj.RemoteHostIP, obj.RemoteHostPort));
+                end
             end
             
         end
@@ -124,7 +304,7 @@ classdef WiFiUDPlogger
         function obj = close(obj)
             if obj.Connected
                 % Send command to stop transmitting of ADC readings.
-                fprintf(obj.hUDP,'A0');
+                sendCommand(obj, 'A0');
             end
             pause(0.01);
             try
@@ -138,7 +318,22 @@ classdef WiFiUDPlogger
         %% Set the gain of the PGA before to the ADC.
         function obj = setADCgain(obj, gain)
             if obj.Connected
-                fprintf(obj.hUDP,'G%s',gain);
+                sendCommand(obj, ['G' gain]);
+                pause(0.02);
+                obj = readData(obj);
+            end
+        end
+        
+        %% Enable the automatic tare of inputs iInputs on the board (the feet must be off in the first second recorded after it).
+        % The board restarts the offsets of the inputs: the lowest unloaded block of the first blocks recorded (feet off)
+        % sets the offset of an input, and the following unloaded blocks (swing phases) track the drift of its baseline.
+        % The offsets are subtracted on the board, and received in obj.BlockSummary.Offset. iInputs = [] disables the
+        % tare. Without a connection, the tare is enabled by open().
+        function obj = setTare(obj, iInputs)
+            obj.TareInputs = iInputs;
+            if obj.Connected
+                % The board confirms the tare by its status (see isTared)
+                sendCommand(obj, ['Z' sum(bitset(0, iInputs))]);
                 pause(0.02);
                 obj = readData(obj);
             end
@@ -147,10 +342,18 @@ classdef WiFiUDPlogger
         %% Clear the obj.Data to initialize a new recording.
         function obj = clearData(obj)
             obj = readData(obj);
-            obj.Data = nan(obj.nADCinput, 1);
-            obj.TimeAxis = 0;
+            obj.DataBuffer = nan(obj.nADCinput, max(round(obj.DataPrealloc*obj.ADCsamplerate), 1));
+            obj.SummaryBuffer = nan(obj.nADCinput, ceil(size(obj.DataBuffer,2)/obj.nADCbufferPos), 4);
+            obj.nDataSamples = 1;
+            obj.DataValid = [];
             obj.iBufferLast = [];
             obj.iData = 1;
+            obj.DataTared = [];
+            obj.Bursts = [];
+            obj.BurstPackets = [];
+            obj.SyncTimes = [];
+            obj.iSyncNext = [];
+            obj.SyncMissing = [];
         end
         
         %% Record data from the ADCs (parameters 'iInputs' and 'RecordTime' are optional)
@@ -163,17 +366,36 @@ classdef WiFiUDPlogger
             end
             
             if obj.Connected   
-                % Clear the data array to before starting af new recording
-                obj = clearData(obj);                                
+                % Clear the data array to before starting af new recording (a recording taken over is continued)
+                if obj.isTakenOver
+                    obj.isTakenOver = false;
+                else
+                    obj = clearData(obj);
+                    obj.LiveRecording = [];
+                end
+                
+                % Preallocate the whole recording and switch to real-time scheduling
+                if obj.RealtimeProfile
+                    if RecordTime > 0
+                        obj = preallocate(obj, RecordTime + obj.AddLiveBuffer);
+                    else
+                        obj = preallocate(obj, obj.RealtimeSessionLength);
+                    end
+                    obj = startRealtimeProfile(obj);
+                    Cleanup = onCleanup(@() stopRealtimeProfile(obj)); % Restores the scheduling after an error, Ctrl-C or a closed figure
+                end
                 
                 % Send commands to start transmitting of ADC readings.
                 for idx = iInputs
-                    fprintf(obj.hUDP,'A%i1',idx);
+                    sendCommand(obj, sprintf('A%i1',idx));
                 end
                 
-                % If no input indexes are given, ask for a status from the board
-                if isempty(iInputs)
-                    fprintf(obj.hUDP,'S');
+                % Ask for a status from the board, which confirms the enabled and the tared inputs of the recording
+                sendCommand(obj, 'S');
+                if isempty(obj.DataTared)
+                    pause(0.02);
+                    obj = readData(obj);
+                    obj.DataTared = isTared(obj);
                 end
                 
                 if obj.LivePlotEnabled
@@ -187,30 +409,126 @@ classdef WiFiUDPlogger
                     % Start the recording
                     tic
                     iSec = 1;
-                    while ishandle(hRec) && (isempty(RecordTime) || RecordTime <= 0  || toc < RecordTime)
+                    while ishandle(hRec) && obj.Connected && (isempty(RecordTime) || RecordTime <= 0  || toc < RecordTime)
                         obj = readData(obj);
                         if toc >= iSec
                             fprintf('Recording %i of %i seconds\n', iSec, RecordTime);
                             iSec = iSec + 1;
                         end
-                        pause(0.01);
+                        waitForData(obj);
                     end
                 end
                 
                 % Send command to stop transmitting of ADC readings.
-                fprintf(obj.hUDP,'A0');
+                sendCommand(obj, 'A0');
                 obj.mEnabledInputs(:) = 0;
+                clear Cleanup;          % Restore the scheduling (see startRealtimeProfile)
+                obj.RealtimeRestore = {};
+                
+                % Close the live recording (it is compacted in the background)
+                if ~isempty(obj.LiveRecording)
+                    close(obj.LiveRecording);
+                end
+                
+                % Fill the gaps left by lost UDP packets
+                if obj.ImputeEnabled
+                    obj = imputeData(obj);
+                end
                 
                 % Store the recorded data in the obj.Data array to obj.Recordings
-                if size(obj.Data,2) > 1
+                if obj.nDataSamples > 1
                     obj.Recordings(end+1).Data = obj.Data;
+                    obj.Recordings(end).DataValid = obj.DataValid;
                     obj.Recordings(end).TimeAxis = obj.TimeAxis;
+                    obj.Recordings(end).Bursts = obj.Bursts;
+                    obj.Recordings(end).SyncTimes = obj.SyncTimes;
+                    obj.Recordings(end).Tared = obj.DataTared;
                 end
             else
                 errordlg('You must open the UDP connection before recording data');
             end
         end
         
+        %% Take over the recording of another MATLAB process, and continue it (parameter 'RecordTime' is optional).
+        % Used to restart the receiver (e.g. with a new version of this class) without stopping the recording. The
+        % other process checks for the request while it receives, saves its receive state (data, pending retransmits,
+        % bursts, sync events and the live recording), and keeps receiving until this process has sent its first
+        % command: the board then streams to this process (the sender of the last command). The packets the other
+        % process received in between are passed on and decoded first, so no packet is lost. If they are not passed on
+        % within HandoffTimeout, the blocks still in the history of the board are requested again, and the older blocks
+        % are a gap (NaN, and false in DataValid after imputeData): the number of blocks since the state was saved is
+        % estimated from the clock, so the buffer index can wrap around in between. The live plot filters start again
+        % from the received data (AddLiveBuffer). Only UDP recordings can be handed over.
+        function obj = takeOver(obj, RecordTime)
+            if nargin < 2
+                RecordTime = 0;
+            end
+            if ~strcmp(obj.Transport, 'udp')
+                error('WiFiUDPlogger.takeOver(): Only UDP recordings can be handed over.');
+            end
+            Files = handoffFiles(obj);
+            for File = {Files.State, Files.Taken, Files.Tail}
+                if exist(File{1}, 'file')
+                    delete(File{1});
+                end
+            end
+            fclose(fopen(Files.Request, 'w'));
+            
+            % Receive state of the other process
+            tStart = tic;
+            while ~exist(Files.State, 'file') && toc(tStart) < obj.HandoffTimeout
+                pause(0.01);
+            end
+            if ~exist(Files.State, 'file')
+                delete(Files.Request);
+                errordlg(sprintf('No recording was handed over within %g seconds', obj.HandoffTimeout));
+                return;
+            end
+            Saved = load(Files.State);
+            obj = restoreState(obj, Saved.State);
+            
+            % Continue the live recording in its store (before any packet is decoded, so the blocks are written to it)
+            if ~isempty(Saved.LiveState)
+                if isempty(obj.LiveStore) || ~strcmp(obj.LiveStore.StoreDir, Saved.LiveState.StoreDir)
+                    obj.LiveStore = RecordingStore(Saved.LiveState.StoreDir);
+                end
+                obj.LiveRecording = HotRecording.resume(Saved.LiveState, obj.LiveStore);
+                obj.LiveRecording.Trace = obj.Trace;
+            end
+            
+            % Redirect the stream to this process
+            obj.hUDP = udp(obj.RemoteHostIP, obj.RemoteHostPort, 'InputBufferSize',obj.InputBufferSize);
+            fopen(obj.hUDP);
+            sendCommand(obj, 'S');
+            obj.Connected = true;
+            fclose(fopen(Files.Taken, 'w'));
+            
+            % Decode the packets the other process received after its snapshot, before the new packets
+            tStart = tic;
+            while ~exist(Files.Tail, 'file') && toc(tStart) < obj.HandoffTimeout
+                pause(0.01);
+            end
+            if exist(Files.Tail, 'file')
+                Tail = load(Files.Tail);
+                for iPacket = 1:length(Tail.Packets)
+                    obj = decodePacket(obj, Tail.Packets{iPacket});
+                end
+            else
+                if isfield(Saved, 'tSnapshot')
+                    obj.tHandoffSnapshot = Saved.tSnapshot;
+                end
+                warning('WiFiUDPlogger.takeOver(): The last packets of the other process were not passed on (the blocks no longer on the board are a gap).');
+            end
+            for File = struct2cell(Files)'
+                if exist(File{1}, 'file')
+                    delete(File{1});
+                end
+            end
+            
+            obj.isTakenOver = true;
+            obj = recordData(obj, [], RecordTime);
+        end
+        
         %% Plot data (obj.Data)
         function handle = plot(obj)
             handle = plot(obj.TimeAxis,obj.Data');
@@ -222,108 +540,270 @@ classdef WiFiUDPlogger
         %% Read availible data from the UDP object.
         function [obj, nRecvDataPackets] = readData(obj)
             nRecvDataPackets = 0;
-            while obj.hUDP.BytesAvailable > 0
+            nPackets = 0;
+            if ~isempty(obj.Trace)
+                tReceive = tick(obj.Trace);
+            end
+            while ~isempty(obj.hUDP) && obj.hUDP.BytesAvailable > 0
                 RecvData = fread(obj.hUDP, obj.hUDP.BytesAvailable);
+                if strcmp(obj.Transport, 'serial')
+                    % Split the byte stream into packets (a frame may continue in the next read)
+                    [Packets, obj.SerialBuffer] = WiFiUDPlogger.deframe([obj.SerialBuffer; RecvData]);
+                else
+                    Packets = {RecvData};
+                end
+                for iPacket = 1:length(Packets)
+                    if ~isempty(obj.Trace)
+                        tDecode = tick(obj.Trace);
+                    end
+                    [obj, isData] = decodePacket(obj, Packets{iPacket});
+                    nRecvDataPackets = nRecvDataPackets + isData;
+                    if ~isempty(obj.Trace)
+                        % Burst and bulk packets are reassembled, the others are decoded
+                        if any(Packets{iPacket}(1) == 'BR')
+                            record(obj.Trace, 'Reassembly', tDecode);
+                        else
+                            record(obj.Trace, 'Decode', tDecode);
+                        end
+                    end
+                end
+                nPackets = nPackets + length(Packets);
+                obj.tLastPacket = tic;
+            end
+            if ~isempty(obj.Trace) && nPackets > 0
+                record(obj.Trace, 'Receive', tReceive, nPackets);
+            end
+            
+            % Request the missing packets of a burst again, if the last packets are lost (and drop the burst after
+            % obj.BurstRetries requests without a packet, e.g. if the device armed a new burst)
+            if ~isempty(obj.BurstPackets) && toc(obj.BurstPackets.tLast) > obj.BurstTimeout
+                if obj.BurstPackets.nRetries >= obj.BurstRetries
+                    warning('WiFiUDPlogger(): Burst %i is incomplete after %i requests, and dropped.', ...
+                        obj.BurstPackets.iBurst, obj.BurstPackets.nRetries);
+                    obj.BurstPackets = [];
+                else
+                    obj.BurstPackets.nRetries = obj.BurstPackets.nRetries + 1;
+                    obj = requestBurstPackets(obj, 1:length(obj.BurstPackets.Packets));
+                end
+            end
+            
+            % Hand the recording over, if another process asks for it (checked once per second, see takeOver)
+            if ~isempty(obj.HandoffFile) && obj.Connected && any(obj.mEnabledInputs) && strcmp(obj.Transport, 'udp') && ...
+                    (isempty(obj.tHandoffCheck) || toc(obj.tHandoffCheck) >= 1)
+                obj.tHandoffCheck = tic;
+                if exist([obj.HandoffFile '.request'], 'file')
+                    obj = handOver(obj);
+                end
+            end
+        end
+        
+        %% Wait for received data (as set by obj.ReceiveMode).
+        % In the 'latency' mode, the UDP object is busy-polled for up to obj.BusyPollBudget while packets arrive, so a
+        % packet is read right after it arrives. Without recent packets (and in the 'sleep' mode), it pauses instead.
+        function waitForData(obj)
+            if strcmp(obj.ReceiveMode, 'latency') && ~isempty(obj.hUDP) && ~isempty(obj.tLastPacket) && toc(obj.tLastPacket) < obj.BusyPollWindow
+                tStart = tic;
+                while obj.hUDP.BytesAvailable == 0 && toc(tStart) < obj.BusyPollBudget
+                end
+            else
+                pause(obj.IdlePollPeriod);
+            end
+        end
+        
+        %% Decode a single UDP packet (e.g. from a replayed session).
+        function [obj, isData] = decodePacket(obj, RecvData)
+            isData = false;
+            switch RecvData(1)
                 
-                switch RecvData(1)
+                    % Status received
+                case 'S'
+                    obj.ADCsamplerate = RecvData(2) + 256*RecvData(3);
+                    obj.ADCgain = RecvData(4);
+                    obj.nADCinput = RecvData(5);
+                    obj.nADCbuffers = RecvData(6);
+                    obj.nADCbufferPos = RecvData(7) + 256*RecvData(8);
+                    obj.mEnabledInputs = bitget(RecvData(9),1:obj.nADCinput) == 1;
+                    obj.Connected = true;
+                    if length(RecvData) >= 12
+                        obj.FRdecimation = RecvData(10);
+                        obj.FRnFrames = RecvData(11) + 256*RecvData(12);
+                    end
+                    if length(RecvData) >= 13
+                        obj.BoardTareInputs = find(bitget(RecvData(13),1:obj.nADCinput));
+                    else
+                        obj.BoardTareInputs = [];
+                    end
                     
-                        % Status received
-                    case 'S'
-                        obj.ADCsamplerate = RecvData(2) + 256*RecvData(3);
-                        obj.ADCgain = RecvData(4);
-                        obj.nADCinput = RecvData(5);
-                        obj.nADCbuffers = RecvData(6);
-                        obj.nADCbufferPos = RecvData(7) + 256*RecvData(8);
-                        obj.mEnabledInputs = bitget(RecvData(9),1:obj.nADCinput) == 1;
-                        obj.Connected = true;
-                        
-                        % update active inputs
-                        if length(obj.mEnabledInputs) ~= obj.nADCinput
-                            fprintf(obj.hUDP,'A0');
-                            obj.mEnabledInputs= zeros(1,obj.nADCinput);
+                    % update active inputs
+                    if length(obj.mEnabledInputs) ~= obj.nADCinput
+                        sendCommand(obj, 'A0');
+                        obj.mEnabledInputs= zeros(1,obj.nADCinput);
+                    end
+                    
+                    % Update yLimits of the Live plot
+                    obj.LiveYlims = [-0.5 0.5]*3.3/obj.ADCgain;
+                    obj.thdSaturation = obj.LiveYlims(2)*0.99;
+                    
+                    % Update channel labels
+                    if isempty(obj.labelADCinput) || length(obj.labelADCinput) < obj.nADCinput
+                        for iLabel =  length(obj.labelADCinput)+1 :obj.nADCinput
+                            obj.labelADCinput{iLabel} = sprintf('A%i',iLabel);
+                        end
+                    end
+                    
+                    % Data received
+                case {'D','T'}
+                    iBuffer = RecvData(2);
+                    obj.mEnabledInputs = bitget(RecvData(3),1:obj.nADCinput) == 1;
+                    iEnabledInputs= find(obj.mEnabledInputs);
+                    nEnabledInputs = length(iEnabledInputs);
+                    if length(RecvData) == 3 + (10 + 2*obj.nADCbufferPos)*nEnabledInputs
+                        nSummary = 10*nEnabledInputs;
+                    elseif length(RecvData) == 3 + (8 + 2*obj.nADCbufferPos)*nEnabledInputs
+                        nSummary = 8*nEnabledInputs;    % Firmware without tare offsets
+                    elseif length(RecvData) == 3 + 2*obj.nADCbufferPos*nEnabledInputs
+                        nSummary = 0;   % Firmware without buffer summaries
+                    else
+                        warning('Data packet with unexpected length (%i bytes) - ignoring the UDP packet.', length(RecvData));
+                        return;
+                    end
+                    
+                    if RecvData(1) == 'D' % Received 'ordinary' data
+                        if isempty(obj.iBufferLast)
+                            obj.iBufferLast = iBuffer - 1;
                         end
                         
-                        % Update yLimits of the Live plot
-                        obj.LiveYlims = [-0.5 0.5]*3.3/obj.ADCgain;
-                        obj.thdSaturation = obj.LiveYlims(2)*0.99;
-                        
-                        % Update channel labels
-                        if isempty(obj.labelADCinput) || length(obj.labelADCinput) < obj.nADCinput
-                            for iLabel =  length(obj.labelADCinput)+1 :obj.nADCinput
-                                obj.labelADCinput{iLabel} = sprintf('A%i',iLabel);
-                            end
+                        % Locate missing UDP packets
+                        if iBuffer > obj.iBufferLast
+                            iMissing = obj.iBufferLast+1:iBuffer-1;
+                        else
+                            iMissing = obj.iBufferLast+1:obj.nADCbuffers-1;
+                            iMissing = [iMissing 0:iBuffer-1];
                         end
                         
-                        % Data received
-                    case {'D','T'}
-                        iBuffer = RecvData(2);
-                        obj.mEnabledInputs = bitget(RecvData(3),1:obj.nADCinput) == 1;
-                        iEnabledInputs= find(obj.mEnabledInputs);
+                        % After a hand-off without the last packets of the other process, whole cycles of the buffer
+                        % index may have passed: they are skipped (a gap), estimated from the time since the state
+                        if ~isempty(obj.tHandoffSnapshot)
+                            nBlocks = (now - obj.tHandoffSnapshot)*86400*obj.ADCsamplerate/obj.nADCbufferPos;
+                            obj.iData = obj.iData + obj.nADCbuffers*max(round((nBlocks - length(iMissing) - 1)/obj.nADCbuffers), 0);
+                            obj.tHandoffSnapshot = [];
+                        end
                         
-                        if RecvData(1) == 'D' % Received 'ordinary' data
-                            if isempty(obj.iBufferLast)
-                                obj.iBufferLast = iBuffer - 1;
-                            end
-                            
-                            % Locate missing UDP packets
-                            if iBuffer > obj.iBufferLast
-                                iMissing = obj.iBufferLast+1:iBuffer-1;
-                            else
-                                iMissing = obj.iBufferLast+1:obj.nADCbuffers-1;
-                                iMissing = [iMissing 0:iBuffer-1];
-                            end
-                            
-                            % Ask for retransmit of missing UDP packets
-                            for iBuf = iMissing
-                                fprintf(obj.hUDP,'T%s', iBuf);
-                                if obj.dispRetransmit
-                                    fprintf('Send retransmit, iBuffer=%i\n',iBuf);
-                                end
-                            end
-                            
-                            % Update indexes
-                            obj.iData = obj.iData + 1 + length(iMissing);
-                            obj.iBufferLast = iBuffer;
-                            iDataWrite = obj.iData;
-                        else % Received retransmitted data
-                            if iBuffer < obj.iBufferLast
-                                iDataWrite = obj.iData - (obj.iBufferLast - iBuffer);
-                            else
-                                iDataWrite = obj.iData - (obj.iBufferLast + (obj.nADCbuffers-iBuffer) );
-                            end
+                        % Ask for retransmit of missing UDP packets
+                        for iBuf = iMissing
+                            sendCommand(obj, ['T' iBuf]);
                             if obj.dispRetransmit
-                                fprintf('Recv retransmit, iBuffer=%i\n', iBuffer);
+                                fprintf('Send retransmit, iBuffer=%i\n',iBuf);
                             end
                         end
                         
-                        % Store the received data in the obj.Data array and obj.TimeAxis.
-                        if iDataWrite > 0
-                            iRecvData = 4;
-                            iRange = (1:obj.nADCbufferPos)+(iDataWrite-1)*obj.nADCbufferPos;
-                            for iInput = 1:length(iEnabledInputs)
-                                for iBufferPos = 1:obj.nADCbufferPos
-                                    Sample = RecvData(iRecvData) + RecvData(iRecvData+1)*2^8;
-                                    if Sample > 2^15 % data with negative sign (2-complement format)
-                                        Sample = Sample - 2^16;
-                                    end
-                                    Sample = Sample * obj.ADCscale / obj.ADCgain;
-                                    obj.Data(iEnabledInputs(iInput),iRange(iBufferPos)) = Sample;
-                                    iRecvData = iRecvData + 2;
-                                end
-                            end
-                            obj.Data(~obj.mEnabledInputs,iRange) = NaN;
-                            obj.TimeAxis = (0:size(obj.Data,2)-1)/obj.ADCsamplerate;
+                        % Update indexes
+                        obj.iData = obj.iData + 1 + length(iMissing);
+                        obj.iBufferLast = iBuffer;
+                        iDataWrite = obj.iData;
+                    else % Received retransmitted data
+                        if iBuffer < obj.iBufferLast
+                            iDataWrite = obj.iData - (obj.iBufferLast - iBuffer);
+                        else
+                            iDataWrite = obj.iData - (obj.iBufferLast + (obj.nADCbuffers-iBuffer) );
+                        end
+                        if obj.dispRetransmit
+                            fprintf('Recv retransmit, iBuffer=%i\n', iBuffer);
+                        end
+                        obj.nPatched = obj.nPatched + 1;
+                    end
+                    
+                    % Store the received data in the obj.Data array (the block is written at its block index).
+                    if iDataWrite > 0
+                        iRange = (1:obj.nADCbufferPos)+(iDataWrite-1)*obj.nADCbufferPos;
+                        
+                        % Grow the preallocated buffers if they are full
+                        nCapacity = size(obj.DataBuffer,2);
+                        if iRange(end) > nCapacity
+                            obj.DataBuffer(:,nCapacity+1:max(2*nCapacity,iRange(end))) = NaN;
+                            obj.SummaryBuffer(:,end+1:ceil(size(obj.DataBuffer,2)/obj.nADCbufferPos),:) = NaN;
                         end
-                        nRecvDataPackets = nRecvDataPackets + 1;
                         
-                        % Error received
-                    case 'E'
-                        warning('Error: %s',RecvData);                        
+                        % Samples are little-endian int16, one buffer per enabled input (-32768: missing, e.g. during a burst).
+                        Samples = double(typecast(uint8(RecvData(4+nSummary:end)), 'int16'));
+                        Samples = reshape(Samples, obj.nADCbufferPos, nEnabledInputs)';
+                        mMissing = Samples == -32768;
+                        Samples(mMissing) = NaN;
+                        obj.DataBuffer(iEnabledInputs,iRange) = Samples * (obj.ADCscale / obj.ADCgain);
+                        obj.DataBuffer(~obj.mEnabledInputs,iRange) = NaN;
+                        obj.nDataSamples = max(obj.nDataSamples, iRange(end));
                         
-                    otherwise
-                        warning('Command ''%s'' not recognized - ignoring the UDP packet.', RecvData(1));
+                        % Summary of each input: int16 min, int16 max, int32 sum and int16 tare offset.
+                        Offset = zeros(nEnabledInputs, 1);
+                        if nSummary == 10*nEnabledInputs
+                            Summary = reshape(uint8(RecvData(4:3+nSummary)), 10, nEnabledInputs);
+                            Offset = double(typecast(reshape(Summary(9:10,:),1,[]), 'int16'))';
+                        end
+                        if nSummary > 0 && ~any(mMissing(:))
+                            Summary = reshape(uint8(RecvData(4:3+nSummary)), nSummary/nEnabledInputs, nEnabledInputs);
+                            Summary = [double(typecast(reshape(Summary(1:2,:),1,[]), 'int16'))
+                                double(typecast(reshape(Summary(3:4,:),1,[]), 'int16'))
+                                double(typecast(reshape(Summary(5:8,:),1,[]), 'int32'))/obj.nADCbufferPos]';
+                        else
+                            Summary = [min(Samples,[],2) max(Samples,[],2) mean(Samples,2,'omitnan')];
+                        end
+                        obj.SummaryBuffer(iEnabledInputs,iDataWrite,:) = reshape([Summary Offset] * (obj.ADCscale / obj.ADCgain), nEnabledInputs, 1, 4);
+                        obj.SummaryBuffer(~obj.mEnabledInputs,iDataWrite,:) = NaN;
                         
-                end
+                        % Write the block to the live recording (retransmitted blocks are patched)
+                        if ~isempty(obj.LiveStore)
+                            if isempty(obj.LiveRecording)
+                                Name = obj.LiveName;
+                                if isempty(Name)
+                                    Name = datestr(now, 'yyyymmdd_HHMMSS');
+                                end
+                                obj.LiveRecording = HotRecording(obj.LiveStore, Name, obj.ADCsamplerate, ...
+                                    obj.labelADCinput(1:obj.nADCinput), obj.ADCscale/obj.ADCgain);
+                                obj.LiveRecording.Metadata = obj.LiveMetadata;
+                                obj.LiveRecording.Metadata.ADCgain = obj.ADCgain;
+                                obj.LiveRecording.Metadata.Tared = isequal(obj.DataTared, true);
+                                obj.LiveRecording.Trace = obj.Trace;
+                            end
+                            write(obj.LiveRecording, iRange(1), obj.DataBuffer(:,iRange));
+                        end
+                    end
+                    isData = true;
+                    
+                    % Flight recorder bulk packet received
+                case 'R'
+                    obj = decodeBulkPacket(obj, RecvData);
+                    
+                    % Burst packet received
+                case 'B'
+                    obj = decodeBurstPacket(obj, RecvData);
+                    
+                    % Sync event received
+                case 'Y'
+                    obj = decodeSyncPacket(obj, RecvData);
+                    
+                    % Scheduler task statistics received (22 bytes for each task, times in us)
+                case 'I'
+                    Tasks = reshape(uint8(RecvData(3:2+22*RecvData(2))), 22, []);
+                    obj.SchedulerStats = struct( ...
+                        'Name', deblank(cellstr(char(Tasks(1:8,:)')))', ...
+                        'Priority', num2cell(double(Tasks(9,:))), ...
+                        'Deferred', num2cell(Tasks(10,:) == 1), ...
+                        'Budget', num2cell(double(typecast(reshape(Tasks(11:12,:),1,[]), 'uint16'))), ...
+                        'nRuns', num2cell(double(typecast(reshape(Tasks(13:16,:),1,[]), 'uint32'))), ...
+                        'nOverruns', num2cell(double(typecast(reshape(Tasks(17:18,:),1,[]), 'uint16'))), ...
+                        'MaxLatency', num2cell(double(typecast(reshape(Tasks(19:20,:),1,[]), 'uint16'))), ...
+                        'MaxRunTime', num2cell(double(typecast(reshape(Tasks(21:22,:),1,[]), 'uint16'))));
+                    
+                    % Error received
+                case 'E'
+                    if length(RecvData) >= 2 && RecvData(2) == 'F' && ~isempty(obj.Bulk)
+                        obj.Bulk.Failed = true;
+                    end
+                    warning('Error: %s',RecvData);                        
+                    
+                otherwise
+                    warning('Command ''%s'' not recognized - ignoring the UDP packet.', RecvData(1));
+                    
             end
         end
         
@@ -337,7 +817,7 @@ classdef WiFiUDPlogger
                 mEnabledInputsLast = zeros(1,obj.nADCinput);
                 
                 nLiveWindowSize = obj.LiveWindowSize * obj.ADCsamplerate;
-                nLiveBuffer = nLiveWindowSize + obj.AddLiveBuffer*obj.ADCsamplerate;
+                nLiveBuffer = nLiveWindowSize + ~isequal(obj.DataTared, true)*obj.AddLiveBuffer*obj.ADCsamplerate;
                 
                 mLiveInputs = obj.mEnabledInputs;
                 iLiveInputs = find(mLiveInputs == 1);     
@@ -410,7 +890,9 @@ classdef WiFiUDPlogger
                 
                 % Add check box to activate/deactivate the bandpass filter
                 if isempty(obj.freqBandpass) == false
-                    if length(obj.freqBandpass) == 1
+                    if isequal(obj.DataTared, true)
+                        strBandPass = sprintf('Lowpass (%0.1f, tared)',obj.freqBandpass(end));
+                    elseif length(obj.freqBandpass) == 1
                         strBandPass = sprintf('Highpass (%0.1f)',obj.freqBandpass);
                     elseif length(obj.freqBandpass) == 2
                         strBandPass = sprintf('Bandpass (%0.1f-%0.1f)',obj.freqBandpass(1),obj.freqBandpass(2));
@@ -457,7 +939,9 @@ classdef WiFiUDPlogger
                 end
                 
                 if isempty(which('butter')) == false
-                    if length(obj.freqBandpass) == 1
+                    if isequal(obj.DataTared, true) && ~isempty(obj.freqBandpass)
+                        [b_BandPass, a_BandPass] = butter(4,obj.freqBandpass(end)/obj.ADCsamplerate*2);
+                    elseif length(obj.freqBandpass) == 1
                         [b_BandPass, a_BandPass] = butter(4,obj.freqBandpass/obj.ADCsamplerate*2,'high');
                     elseif length(obj.freqBandpass) == 2
                         [b_BandPass, a_BandPass] = butter(4,obj.freqBandpass/obj.ADCsamplerate*2);
@@ -466,11 +950,18 @@ classdef WiFiUDPlogger
                     set(hChkBandpass,'Visible','off','Value', false);
                 end
                 
+                % Prepare the circular buffers of the incremental live plot
+                Live = initLive(obj, b_Notch, a_Notch);
+                if exist('b_BandPass','var')
+                    Live.b_BandPass = b_BandPass;
+                    Live.a_BandPass = a_BandPass;
+                end
+                tLastDraw = -inf;
                 
                 %% Read and plot data
                 tic
                 iSec = 1;
-                while (RecordTime <= 0  || toc < RecordTime) && ishandle(hFig)
+                while (RecordTime <= 0  || toc < RecordTime) && ishandle(hFig) && obj.Connected
                     
                     % Update record time
                     if RecordTime > 0 && toc >= iSec
@@ -487,7 +978,7 @@ classdef WiFiUDPlogger
                         if any(mLiveInputs ~= [hChkInput.Value])
                             for iInput = 1:obj.nADCinput
                                 if mLiveInputs(iInput) ~= hChkInput(iInput).Value
-                                    fprintf(obj.hUDP,sprintf('A%i%i',iInput,hChkInput(iInput).Value));
+                                    sendCommand(obj, sprintf('A%i%i',iInput,hChkInput(iInput).Value));
                                 end
                             end
                             mLiveInputs = [hChkInput.Value];
@@ -529,7 +1020,7 @@ classdef WiFiUDPlogger
                     
                     % New data (obj.Data) have been received, plot the data.
                     if nRecvDataPackets > 0 && ishandle(hFig)
-                        nData = size(obj.Data,2);
+                        nData = obj.nDataSamples;
                         iLiveBuffer = max(nData-nLiveBuffer+1,1):nData;
                         iLiveWindow = max(length(iLiveBuffer)-nLiveWindowSize,1):length(iLiveBuffer);
                         
@@ -548,63 +1039,110 @@ classdef WiFiUDPlogger
                         end
                         
                         % Plot the data
+                        Redraw = true;
                         if hChkUpdateData.Value && UpdatePlot
                             if LoadBuffer
                                 UpdatePlot = false;
                             end
                             
-                            LiveBuffer = obj.Data(:,iLiveBuffer);
-                            
-                            % Check for saturation of the channels
-                            CurrentSat = mLiveInputs' & (max(abs(LiveBuffer(:,iLiveWindow)),[],2) > obj.thdSaturation);
-                            if any(CurrentSat ~= Saturation)
-                                Saturation = CurrentSat;
-                                SatImage = uint8(ones(size(Saturation,1),size(Saturation,2),3)*255);
+                            if obj.LiveIncremental && ~LoadBuffer
+                                % Restart the circular buffers if the filters or the enabled inputs changed
+                                LiveSettings = [exist('b_Notch','var') && hChkNotch.Value, exist('b_BandPass','var') && hChkBandpass.Value, obj.mEnabledInputs];
+                                if ~isequal(LiveSettings, Live.Settings)
+                                    Live.Settings = LiveSettings;
+                                    Live.Notch = LiveSettings(1);
+                                    Live.Bandpass = LiveSettings(2);
+                                    Live = resetLive(obj, Live);
+                                end
+                                
+                                % Append the new samples, and redraw within the frame budget
+                                if ~isempty(obj.Trace)
+                                    tFilter = tick(obj.Trace);
+                                end
+                                Live = appendLive(obj, Live);
+                                if ~isempty(obj.Trace)
+                                    record(obj.Trace, 'Filter', tFilter);
+                                end
+                                Redraw = toc - tLastDraw >= 1/obj.LiveFrameRate;
+                                if Redraw
+                                    tLastDraw = toc;
+                                    if ~isempty(obj.Trace)
+                                        tDraw = tick(obj.Trace);
+                                    end
+                                    LiveMax = drawLive(obj, Live, hAxis, hLines);
+                                    if ~isempty(obj.Trace)
+                                        record(obj.Trace, 'Draw', tDraw);
+                                    end
+                                end
+                            else
+                                if ~isempty(obj.Trace)
+                                    tFilter = tick(obj.Trace);
+                                end
+                                LiveBuffer = obj.DataBuffer(:,iLiveBuffer);
+                                if obj.ImputeEnabled
+                                    LiveBuffer = imputeGaps(obj, LiveBuffer);
+                                end
+                                LiveMax = max(abs(LiveBuffer(:,iLiveWindow) + sampleOffsets(obj, iLiveBuffer(iLiveWindow))),[],2);
+                                
+                                % Apply notch filters (the filter state is reset after gaps that could not be filled)
+                                if exist('b_Notch','var') && hChkNotch.Value
+                                    for iNotch = 1:size(b_Notch,1)
+                                        LiveBuffer(iLiveInputs,:) = WiFiUDPlogger.filterSegments(b_Notch(iNotch,:), a_Notch(iNotch,:), LiveBuffer(iLiveInputs,:));
+                                    end
+                                end
+                                
+                                % Apply bandpass filters
+                                if exist('b_BandPass','var') && hChkBandpass.Value
+                                    LiveBuffer(iLiveInputs,:) = WiFiUDPlogger.filterSegments(b_BandPass, a_BandPass, LiveBuffer(iLiveInputs,:));
+                                end
+                                
+                                if ~isempty(obj.Trace)
+                                    record(obj.Trace, 'Filter', tFilter);
+                                end
+                                
+                                % Update the plot
                                 for iInput = 1:obj.nADCinput
-                                    SatImage(1,iInput,:) = uint8(colorSat(Saturation(iInput)+1,:));
+                                    set(hLines(iInput),'XData', (iLiveBuffer(iLiveWindow)-1)/obj.ADCsamplerate, 'YData', LiveBuffer(iInput,iLiveWindow));
                                 end
-                                hSatImage.CData = SatImage;
-                            end
-                            
-                            % Apply notch filters
-                            if exist('b_Notch','var') && hChkNotch.Value
-                                LiveBuffer(isnan(LiveBuffer)) = 0;
-                                for iNotch = 1:size(b_Notch,1)
-                                    for iInput = iLiveInputs
-                                        LiveBuffer(iInput,:) = filter(b_Notch(iNotch,:), a_Notch(iNotch,:), LiveBuffer(iInput,:));
+                                
+                                % Update xlimits
+                                if LoadBuffer
+                                    xLims = [0 nData-1]/obj.ADCsamplerate;
+                                else
+                                    if length(iLiveWindow) < nLiveWindowSize
+                                        xLims = [(length(iLiveWindow)-nLiveWindowSize) iLiveBuffer(iLiveWindow(end))-1]/obj.ADCsamplerate;
+                                    else
+                                        xLims = (iLiveBuffer(iLiveWindow([1 end]))-1)/obj.ADCsamplerate;
                                     end
                                 end
+                                xlim(hAxis, xLims);
                             end
                             
-                            % Apply bandpass filters
-                            if exist('b_BandPass','var') && hChkBandpass.Value
-                                LiveBuffer(isnan(LiveBuffer)) = 0;
-                                for iInput = iLiveInputs
-                                    LiveBuffer(iInput,:) = filter(b_BandPass, a_BandPass, LiveBuffer(iInput,:));
+                            % Check for saturation of the channels
+                            if Redraw
+                                CurrentSat = mLiveInputs' & (LiveMax > obj.thdSaturation);
+                                if any(CurrentSat ~= Saturation)
+                                    Saturation = CurrentSat;
+                                    SatImage = uint8(ones(size(Saturation,1),size(Saturation,2),3)*255);
+                                    for iInput = 1:obj.nADCinput
+                                        SatImage(1,iInput,:) = uint8(colorSat(Saturation(iInput)+1,:));
+                                    end
+                                    hSatImage.CData = SatImage;
                                 end
                             end
-                            
-                            % Update the plot
-                            for iInput = 1:obj.nADCinput
-                                set(hLines(iInput),'XData', obj.TimeAxis(iLiveBuffer(iLiveWindow)), 'YData', LiveBuffer(iInput,iLiveWindow));
+                        end
+                        mEnabledInputsLast = obj.mEnabledInputs;
+                        if Redraw
+                            if ~isempty(obj.Trace)
+                                tRender = tick(obj.Trace);
                             end
-                            
-                            % Update xlimits
-                            if LoadBuffer
-                                xLims = obj.TimeAxis([1 end]);
-                            else
-                                if length(iLiveWindow) < nLiveWindowSize
-                                    xLims = [(length(iLiveWindow)-nLiveWindowSize)/obj.ADCsamplerate obj.TimeAxis(iLiveBuffer(iLiveWindow(end)))];
-                                else
-                                    xLims = obj.TimeAxis(iLiveBuffer(iLiveWindow([1 end])));
-                                end
+                            drawnow;
+                            if ~isempty(obj.Trace)
+                                record(obj.Trace, 'Render', tRender);
                             end
-                            xlim(hAxis, xLims);
                         end
-                        mEnabledInputsLast = obj.mEnabledInputs;
-                        drawnow;
                     else
-                        pause(0.01);
+                        waitForData(obj);
                     end
                 end
                 fprintf('Total record time = %0.1f\n', toc);
@@ -613,5 +1151,1014 @@ classdef WiFiUDPlogger
             end
         end
         
+        %% Fill gaps in obj.Data and update obj.DataValid.
+        function obj = imputeData(obj)
+            [Data, mValid] = imputeGaps(obj, obj.Data);
+            obj.DataBuffer(:,1:obj.nDataSamples) = Data;
+            if isequal(size(obj.DataValid), size(mValid))
+                mValid = mValid & obj.DataValid;
+            end
+            obj.DataValid = mValid;
+        end
+        
+        %% Fill gaps (NaN) in a data array [size: nInputs x nSamples].
+        % Gaps up to ImputeShortGap are filled with a cubic Hermite spline through the neighbouring samples.
+        % Gaps up to ImputeLongGap are filled with the signal one step period earlier, corrected to match both
+        % ends of the gap. Longer gaps, and gaps at the ends of the array, are left as NaN. mValid is false for
+        % every sample that was missing in the input. The steps are detected once per input, and the step period of
+        % each gap is estimated from the steps in the template window before it (the window moves forward from gap to
+        % gap), so the cost per filled sample does not grow with the length of the recording.
+        function [Data, mValid] = imputeGaps(obj, Data)
+            mValid = ~isnan(Data);
+            nShortGap = max(round(obj.ImputeShortGap*obj.ADCsamplerate), 1);
+            nLongGap = round(obj.ImputeLongGap*obj.ADCsamplerate);
+            nTemplateWindow = round(obj.ImputeTemplateWindow*obj.ADCsamplerate);
+            
+            for iInput = find(any(mValid,2) & any(~mValid,2))'
+                x = Data(iInput,:);
+                dGap = diff([false ~mValid(iInput,:) false]);
+                iGapStart = find(dGap == 1);
+                iGapEnd = find(dGap == -1) - 1;
+                Steps = detectSteps(obj, iInput, Data);
+                iStepFirst = 1;         % First step in the template window of the current gap
+                iStepLast = 0;          % Last step in the template window of the current gap
+                
+                for iGap = 1:length(iGapStart)
+                    ia = iGapStart(iGap) - 1;   % Last valid sample before the gap
+                    ib = iGapEnd(iGap) + 1;     % First valid sample after the gap
+                    nGap = ib - ia - 1;
+                    if ia < 1 || ib > length(x) || nGap > nLongGap
+                        continue;
+                    end
+                    iFill = ia+1:ib-1;
+                    
+                    % Longer gaps: copy the previous step and correct the offset at both ends of the gap.
+                    if nGap > nShortGap
+                        while iStepFirst <= length(Steps.iOnset) && Steps.iOnset(iStepFirst) <= ia-nTemplateWindow
+                            iStepFirst = iStepFirst + 1;
+                        end
+                        while iStepLast < length(Steps.iOnset) && Steps.iOnset(iStepLast+1) <= ia
+                            iStepLast = iStepLast + 1;
+                        end
+                        Period = WiFiUDPlogger.stepPeriod(Steps.iOnset(iStepFirst:iStepLast));
+                        if ~isempty(Period) && Period > nGap && ia > Period
+                            xTemplate = x([ia iFill ib] - Period);
+                            if ~any(isnan(xTemplate))
+                                w = (1:nGap)/(nGap+1);
+                                x(iFill) = xTemplate(2:end-1) + (1-w)*(x(ia)-xTemplate(1)) + w*(x(ib)-xTemplate(end));
+                                continue;
+                            end
+                        end
+                    end
+                    
+                    % Short gaps (or no step template available): cubic Hermite spline.
+                    ma = 0;
+                    mb = 0;
+                    if ia > 1 && ~isnan(x(ia-1))
+                        ma = x(ia) - x(ia-1);
+                    end
+                    if ib < length(x) && ~isnan(x(ib+1))
+                        mb = x(ib+1) - x(ib);
+                    end
+                    h = nGap + 1;
+                    s = (1:nGap)/h;
+                    x(iFill) = (2*s.^3-3*s.^2+1)*x(ia) + (s.^3-2*s.^2+s)*h*ma + (-2*s.^3+3*s.^2)*x(ib) + (s.^3-s.^2)*h*mb;
+                end
+                Data(iInput,:) = x;
+            end
+        end
+        
+        %% Detect steps on ADC input 'iInput' (parameter 'Data' is optional).
+        % A step starts when the signal rises above StepThreshold of its range, and ends when it falls below
+        % half of that level. Steps.iOnset and Steps.iOffset are sample indexes in Data.
+        function Steps = detectSteps(obj, iInput, Data)
+            if nargin < 3
+                Data = obj.Data;
+            end
+            x = Data(iInput,:);
+            Steps.iOnset = zeros(0,1);
+            Steps.iOffset = zeros(0,1);
+            
+            xSorted = sort(x(~isnan(x)));
+            if length(xSorted) < 2
+                return;
+            end
+            xLow = xSorted(max(round(0.05*length(xSorted)),1));
+            xHigh = xSorted(round(0.95*length(xSorted)));
+            thdOn = xLow + obj.StepThreshold*(xHigh-xLow);
+            thdOff = xLow + obj.StepThreshold/2*(xHigh-xLow);
+            
+            % Hysteresis: carry the last threshold crossing forward to get the loaded/unloaded state.
+            Crossing = zeros(size(x));
+            Crossing(x > thdOn) = 1;
+            Crossing(x < thdOff) = -1;
+            iLast = zeros(size(x));
+            iLast(Crossing ~= 0) = find(Crossing ~= 0);
+            iLast = cummax(iLast);
+            Loaded = false(size(x));
+            Loaded(iLast > 0) = Crossing(iLast(iLast > 0)) == 1;
+            
+            iOnset = find(diff([true Loaded]) == 1);
+            iOffset = find(diff([Loaded true]) == -1);
+            if ~isempty(iOnset)
+                iOffset(iOffset < iOnset(1)) = [];
+            end
+            nSteps = min(length(iOnset), length(iOffset));
+            Steps.iOnset = iOnset(1:nSteps)';
+            Steps.iOffset = iOffset(1:nSteps)';
+        end
+        
+        %% Filter obj.Data, detect steps and estimate the spectra (parameters 'Config' and 'Cache' are optional).
+        % Config fields (all optional, defaults from the object): freqBandpass, freqNotch, bandwidthNotch, StepInput,
+        % StepThreshold, ChunkSize [unit: seconds], Denoiser ('iir': band-pass filter, 'wavelet': wavelet denoising
+        % instead of the band-pass filter, which keeps the edges of the steps sharp, see WaveletDenoiser) and Tared
+        % (true: the data was tared on the board, and is low-pass filtered at freqBandpass(end) without warm-up, default:
+        % the tare confirmed by the board at the start of the recording, see isTared). The
+        % data is processed in chunks, each filtered from the settling time of the high-pass filter before the chunk
+        % (SettleCycles periods of freqBandpass(1), at least AddLiveBuffer seconds, none if tared, and the wavelet
+        % denoiser up to its lookahead after the chunk), and the result of each chunk is stored in the DerivedCache 'Cache' under
+        % the hash of its input samples and of Config. Only chunks that changed since a previous call are recomputed.
+        %
+        % Result.Filtered:      Filtered data [size: nInputs x nSamples]
+        % Result.Steps:         Steps detected on input StepInput of the filtered data (see detectSteps)
+        % Result.PSD:           Power spectral density of the filtered data [size: nInputs x nFrequencies, unit: V^2/Hz]
+        % Result.f:             Frequencies of Result.PSD [unit: Hz]
+        function [Result, CacheStats] = processData(obj, Config, Cache)
+            if nargin < 2
+                Config = struct();
+            end
+            if nargin < 3
+                Cache = [];
+            end
+            Defaults = struct('freqBandpass', obj.freqBandpass, 'freqNotch', obj.freqNotch, 'bandwidthNotch', obj.bandwidthNotch, ...
+                'StepInput', 1, 'StepThreshold', obj.StepThreshold, 'ChunkSize', 30, ...
+                'Denoiser', 'iir', 'Tared', isequal(obj.DataTared, true));
+            for Field = fieldnames(Defaults)'
+                if ~isfield(Config, Field{1})
+                    Config.(Field{1}) = Defaults.(Field{1});
+                end
+            end
+            tStart = tic;
+            nHits = 0;
+            
+            fs = obj.ADCsamplerate;
+            nData = obj.nDataSamples;
+            nChunk = round(Config.ChunkSize*fs);
+            tWarmup = obj.AddLiveBuffer;
+            if ~isempty(Config.freqBandpass)
+                tWarmup = max(tWarmup, obj.SettleCycles/Config.freqBandpass(1));
+            end
+            nWarmup = round(~Config.Tared*tWarmup*fs);
+            nFFT = 2^nextpow2(2*fs);
+            ConfigHash = DerivedCache.hash(Config, fs, nWarmup, nFFT);
+            
+            % Prepare the filters (as in the live plot)
+            Filters.b_Notch = zeros(0,3);
+            Filters.a_Notch = zeros(0,3);
+            if ~isempty(which('iirnotch'))
+                for iNotch = 1:length(Config.freqNotch)
+                    [Filters.b_Notch(iNotch,:), Filters.a_Notch(iNotch,:)] = iirnotch(Config.freqNotch(iNotch)/fs*2, Config.bandwidthNotch/fs*2);
+                end
+            end
+            Filters.b_BandPass = [];
+            Filters.a_BandPass = [];
+            if ~isempty(which('butter')) && Config.Tared && ~isempty(Config.freqBandpass)
+                [Filters.b_BandPass, Filters.a_BandPass] = butter(4, Config.freqBandpass(end)/fs*2);
+            elseif ~isempty(which('butter')) && length(Config.freqBandpass) == 1
+                [Filters.b_BandPass, Filters.a_BandPass] = butter(4, Config.freqBandpass/fs*2, 'high');
+            elseif ~isempty(which('butter')) && length(Config.freqBandpass) == 2
+                [Filters.b_BandPass, Filters.a_BandPass] = butter(4, Config.freqBandpass/fs*2);
+            end
+            Filters.Wavelet = [];
+            nLookahead = 0;
+            if strcmp(Config.Denoiser, 'wavelet')
+                Filters.Wavelet = WaveletDenoiser(fs);
+                nLookahead = Filters.Wavelet.Delay;
+            end
+            Filters.Window = 0.5 - 0.5*cos(2*pi*(0:nFFT-1)/nFFT);
+            
+            % Filter the chunks and sum their periodograms
+            Result.Filtered = nan(size(obj.DataBuffer,1), nData);
+            PsdSum = 0;
+            nPsd = 0;
+            ChunkKeys = cell(1, ceil(nData/nChunk));
+            for iChunk = 1:length(ChunkKeys)
+                iRange = (iChunk-1)*nChunk+1:min(iChunk*nChunk, nData);
+                iWarmup = max(iRange(1)-nWarmup, 1):min(iRange(end)+nLookahead, nData);
+                ChunkKeys{iChunk} = [DerivedCache.hash(obj.DataBuffer(:,iWarmup)) '-' ConfigHash];
+                
+                isHit = false;
+                if ~isempty(Cache)
+                    [Chunk, isHit] = get(Cache, ChunkKeys{iChunk});
+                end
+                if ~isHit
+                    if ~isempty(obj.Trace)
+                        tFilter = tick(obj.Trace);
+                    end
+                    Chunk = WiFiUDPlogger.processChunk(obj.DataBuffer(:,iWarmup), iRange(1)-iWarmup(1), iWarmup(end)-iRange(end), Filters);
+                    if ~isempty(obj.Trace)
+                        record(obj.Trace, 'Filter', tFilter, length(iRange));
+                    end
+                    if ~isempty(Cache)
+                        put(Cache, ChunkKeys{iChunk}, Chunk);
+                    end
+                end
+                nHits = nHits + isHit;
+                
+                Result.Filtered(:,iRange) = Chunk.Filtered;
+                PsdSum = PsdSum + Chunk.PsdSum;
+                nPsd = nPsd + Chunk.nPsd;
+            end
+            
+            % Steps (cached for the combination of all chunks)
+            isHit = false;
+            StepsKey = [DerivedCache.hash(ChunkKeys) '-steps'];
+            if ~isempty(Cache)
+                [Result.Steps, isHit] = get(Cache, StepsKey);
+            end
+            if ~isHit
+                StepSettings = obj;
+                StepSettings.StepThreshold = Config.StepThreshold;
+                if ~isempty(obj.Trace)
+                    tAnalytics = tick(obj.Trace);
+                end
+                Result.Steps = detectSteps(StepSettings, Config.StepInput, Result.Filtered);
+                if ~isempty(obj.Trace)
+                    record(obj.Trace, 'Analytics', tAnalytics, length(Result.Steps.iOnset));
+                end
+                if ~isempty(Cache)
+                    put(Cache, StepsKey, Result.Steps);
+                end
+            end
+            nHits = nHits + isHit;
+            
+            % One-sided power spectral density (Welch's method, Hann window, 50% overlap)
+            Result.f = (0:nFFT/2)*fs/nFFT;
+            Result.PSD = PsdSum ./ (nPsd * fs * sum(Filters.Window.^2));
+            Result.PSD(:,2:end-1) = 2*Result.PSD(:,2:end-1);
+            
+            CacheStats.nHits = nHits;
+            CacheStats.nLookups = length(ChunkKeys) + 1;
+            CacheStats.tElapsed = toc(tStart);
+        end
+        
+        %% Fetch the full rate readings around time 'tEvent' in obj.Data from the flight recorder.
+        % tWindow is the start and end of the window relative to tEvent [unit: seconds, size: 1x2]. Window holds the
+        % readings [size: nInputs x nFrames, unit: Volt] and TimeAxis the time of each frame relative to tEvent. The
+        % device only holds the last obj.FRnFrames frames (and the last obj.nADCbuffers buffers), so the window must be
+        % fetched shortly after the event (Window is empty otherwise).
+        function [obj, Window, TimeAxis] = fetchWindow(obj, tEvent, tWindow)
+            Window = [];
+            TimeAxis = [];
+            if ~obj.Connected || obj.FRdecimation == 0
+                warning('WiFiUDPlogger(): The flight recorder is not enabled in the firmware (FR_DECIMATION).');
+                return;
+            end
+            fsFull = obj.ADCsamplerate*obj.FRdecimation;
+            
+            % Wait until the end of the window is recorded
+            tStart = tic;
+            while (obj.nDataSamples - obj.nADCbufferPos)/obj.ADCsamplerate < tEvent + tWindow(2) && toc(tStart) < obj.FRtimeout
+                obj = readData(obj);
+                pause(0.001);
+            end
+            
+            % Locate the ADC buffer of the event (obj.iData is the block of buffer obj.iBufferLast). The buffer index
+            % wraps around after obj.nADCbuffers blocks, and the ring only holds the last obj.FRnFrames frames, so an
+            % older event would silently fetch the readings of another time.
+            iSample = round(tEvent*obj.ADCsamplerate) + 1;
+            iBlock = ceil(iSample/obj.nADCbufferPos);
+            nFramesBack = (obj.iData*obj.nADCbufferPos - iSample + 1)*obj.FRdecimation - round(tWindow(1)*fsFull);
+            if iBlock < 1 || iBlock > obj.iData || obj.iData - iBlock >= obj.nADCbuffers || nFramesBack > obj.FRnFrames
+                warning('WiFiUDPlogger(): The flight recorder window is no longer on the device (the event is %0.1f seconds old).', ...
+                    (obj.nDataSamples - iSample)/obj.ADCsamplerate);
+                return;
+            end
+            iBuffer = mod(obj.iBufferLast - (obj.iData - iBlock), obj.nADCbuffers);
+            Offset = (iSample - (iBlock-1)*obj.nADCbufferPos - 1)*obj.FRdecimation + round(tWindow(1)*fsFull);
+            nFrames = round(diff(tWindow)*fsFull) + 1;
+            
+            % Request the window, and receive the bulk packets (acknowledged in decodeBulkPacket)
+            obj = resetBulk(obj);
+            sendCommand(obj, ['F' iBuffer typecast(int16(Offset), 'uint8') typecast(uint16(nFrames), 'uint8')]);
+            tStart = tic;
+            while ~obj.Bulk.Failed && ~isBulkComplete(obj) && toc(tStart) < obj.FRtimeout
+                obj = readData(obj);
+            end
+            if isBulkComplete(obj)
+                [Window, TimeAxis] = assembleBulk(obj, tWindow(1));
+            else
+                warning('WiFiUDPlogger(): The flight recorder window could not be fetched.');
+                sendCommand(obj, ['F' 0 0 0 0 0]);  % Abort the transfer
+            end
+            obj.Bulk = [];
+        end
+        
+        %% Read the latency, run time and overruns of the firmware tasks (since the last call).
+        % Stats is a struct array with a task in each element [fields: Name, Priority, Deferred, Budget, nRuns,
+        % nOverruns, MaxLatency, MaxRunTime, unit of the times: us]. The maxima restart after each call.
+        function [obj, Stats] = readSchedulerStats(obj)
+            Stats = [];
+            if ~obj.Connected
+                warning('WiFiUDPlogger(): You must be connected to use the readSchedulerStats() function');
+                return;
+            end
+            obj.SchedulerStats = [];
+            sendCommand(obj, 'I');
+            tStart = tic;
+            while isempty(obj.SchedulerStats) && toc(tStart) < 1
+                obj = readData(obj);
+                pause(0.001);
+            end
+            Stats = obj.SchedulerStats;
+        end
+        
+        %% Arm a high samplerate burst on consecutive inputs (parameters 'SampleRate', 'Duration' and 'Threshold' are optional).
+        % SampleRate is the samplerate of each input [unit: Hz, 0: maximum rate] and Duration the length of the burst
+        % [unit: seconds, default: as long as the burst buffer allows]. The burst starts when the first input reaches
+        % Threshold [unit: Volt, default: start now, checked on each full rate reading]. The burst is appended to
+        % obj.Bursts when it is received. The ADC only scans the burst inputs during the burst: their regular readings
+        % are filled from the burst, while the other inputs are missing (NaN) during the burst.
+        function obj = startBurst(obj, iInputs, SampleRate, Duration, Threshold)
+            if nargin < 3
+                SampleRate = 0;
+            end
+            if nargin < 4
+                Duration = [];
+            end
+            if nargin < 5
+                Threshold = [];
+            end
+            if ~obj.Connected
+                warning('WiFiUDPlogger(): You must be connected to use the startBurst() function');
+                return;
+            end
+            if any(diff(iInputs) ~= 1)
+                error('WiFiUDPlogger(): The burst inputs must be consecutive.');
+            end
+            
+            nSamples = floor(obj.BurstSize/length(iInputs));
+            if ~isempty(Duration) && SampleRate > 0
+                nSamples = min(nSamples, round(Duration*SampleRate));
+            end
+            if isempty(Threshold)
+                RawThreshold = 32767;   % Start now (BURST_IMMEDIATE)
+            else
+                RawThreshold = max(min(round(Threshold/(obj.ADCscale/obj.ADCgain)), 32766), -32768);
+            end
+            sendCommand(obj, ['B' iInputs(1) length(iInputs) typecast(uint16(SampleRate), 'uint8') ...
+                typecast(uint16(nSamples), 'uint8') typecast(int16(RawThreshold), 'uint8')]);
+        end
+        
+        %% Map times of an external system to the time axis of obj.Data from the sync pulse edges (parameter 'SyncTimes' is optional).
+        % tEdges are the times of the sync pulse edges on the clock of the external system (e.g. the trigger input of a
+        % force plate or camera) [unit: seconds], and SyncTimes the times of the same edges on the board (default:
+        % obj.SyncTimes). A coarse clock offset is searched among the differences of a few edges to all sync edges (the
+        % offset pairing most edges by nearest time, within a quarter of the shortest edge interval), the pairs are
+        % refined by nearest time to the fitted line, and the clock offset and drift are fitted to the pairs by least
+        % squares. So either system may have missed edges, also between paired edges. An error is raised if the pairing
+        % is ambiguous: another offset pairs at least half the edges within obj.SyncTolerance, e.g. for pulses at a
+        % constant interval. Align maps external times to the time axis of obj.Data, and Fit holds [fields: Offset
+        % (unit: seconds), Drift (unit: ppm), Residual (RMS, unit: seconds), nPairs].
+        function [Align, Fit] = alignExternal(obj, tEdges, SyncTimes)
+            if nargin < 3
+                SyncTimes = obj.SyncTimes;
+            end
+            tEdges = unique(tEdges(:));
+            SyncTimes = unique(SyncTimes(:));
+            nEdges = length(tEdges);
+            nSync = length(SyncTimes);
+            if min(nEdges, nSync) < 2
+                error('WiFiUDPlogger.alignExternal(): At least two edges are needed from both systems.');
+            end
+            nMinPairs = max(2, ceil(min(nEdges, nSync)/2));
+            tCoarse = min([diff(tEdges); diff(SyncTimes)])/4;
+            
+            % Coarse offsets: the differences of a few edges (spread over the recording) to all sync edges
+            iAnchors = unique(round(linspace(1, nEdges, min(nEdges, 10))));
+            Offsets = reshape(SyncTimes' - tEdges(iAnchors), [], 1);
+            [~, iUnique] = unique(round(Offsets/tCoarse));
+            Offsets = Offsets(iUnique);
+            nCoarse = zeros(size(Offsets));
+            for iOffset = 1:length(Offsets)
+                [~, Distance] = WiFiUDPlogger.nearestEdges(SyncTimes, tEdges + Offsets(iOffset));
+                nCoarse(iOffset) = nnz(Distance < tCoarse);
+            end
+            
+            % Refine the offsets with enough coarse pairs: pair by nearest time to the fitted line, and fit again
+            Fits = struct('Coefficients', {}, 'Residual', {}, 'nPairs', {});
+            for iOffset = find(nCoarse >= nMinPairs)'
+                p = [1 Offsets(iOffset)];
+                for iRefine = 1:2
+                    [iSync, Distance] = WiFiUDPlogger.nearestEdges(SyncTimes, polyval(p, tEdges));
+                    mPaired = Distance < tCoarse;
+                    if nnz(mPaired) < 2
+                        break;
+                    end
+                    p = polyfit(tEdges(mPaired), SyncTimes(iSync(mPaired)), 1);
+                end
+                Residual = sqrt(mean((polyval(p, tEdges(mPaired)) - SyncTimes(iSync(mPaired))).^2));
+                Fits(end+1) = struct('Coefficients', p, 'Residual', Residual, 'nPairs', nnz(mPaired)); %#ok<AGROW>
+            end
+            Fits = Fits([Fits.Residual] < obj.SyncTolerance & [Fits.nPairs] >= nMinPairs);
+            if isempty(Fits)
+                error('WiFiUDPlogger.alignExternal(): No pairing of at least %i edges within the tolerance (SyncTolerance).', nMinPairs);
+            end
+            
+            % The best pairing has most pairs (then the smallest residual), and no other offset may pair as well
+            [~, iSort] = sortrows([-[Fits.nPairs]' [Fits.Residual]']);
+            Fits = Fits(iSort);
+            tMid = mean(tEdges);
+            isOther = arrayfun(@(Other) abs(polyval(Other.Coefficients, tMid) - polyval(Fits(1).Coefficients, tMid)) > tCoarse, Fits);
+            if any(isOther)
+                error('WiFiUDPlogger.alignExternal(): The pairing is ambiguous (%i and %i pairs at offsets %0.3f s apart), e.g. pulses at a constant interval.', ...
+                    Fits(1).nPairs, Fits(find(isOther,1)).nPairs, ...
+                    polyval(Fits(find(isOther,1)).Coefficients, tMid) - polyval(Fits(1).Coefficients, tMid));
+            end
+            Coefficients = Fits(1).Coefficients;
+            Fit = struct('Offset', Coefficients(2), 'Drift', (Coefficients(1)-1)*1e6, 'Residual', Fits(1).Residual, 'nPairs', Fits(1).nPairs);
+            Align = @(t) polyval(Coefficients, t);
+        end
+        
+    end
+    
+    methods (Hidden = true)
+        
+        %% Preallocate (and fault in) the data buffers for a recording of Duration seconds, so they do not grow during
+        % the recording.
+        function obj = preallocate(obj, Duration)
+            nSamples = ceil(Duration*obj.ADCsamplerate);
+            obj.DataBuffer(:,end+1:nSamples) = NaN;
+            obj.SummaryBuffer(:,end+1:ceil(nSamples/obj.nADCbufferPos),:) = NaN;
+        end
+        
+        %% Switch the MATLAB process to real-time scheduling (SCHED_RR) and pin it to obj.RealtimeCPUs (Linux).
+        % All threads of the process get the same priority, so round-robin is used instead of SCHED_FIFO (a busy-polling
+        % thread would otherwise starve the GUI thread on the same core). The settings are restored by
+        % stopRealtimeProfile(). A warning is shown if the process is not allowed to change them (CAP_SYS_NICE).
+        % Busy-polling on all cores at real-time priority would starve the rest of the system, so the 'latency' mode is
+        % only combined with real-time scheduling if RealtimeCPUs leaves cores to the other processes.
+        function obj = startRealtimeProfile(obj)
+            obj.RealtimeRestore = {};
+            if ~isunix || ismac
+                warning('WiFiUDPlogger(): The real-time profile is only supported on Linux.');
+                return;
+            end
+            [~, nCPUs] = system('getconf _NPROCESSORS_ONLN');    % Logical CPUs (feature('numcores') counts physical cores)
+            isAllCores = isempty(obj.RealtimeCPUs) || length(unique(obj.RealtimeCPUs)) >= str2double(nCPUs);
+            isPriority = ~(strcmp(obj.ReceiveMode, 'latency') && isAllCores);
+            if ~isPriority
+                warning('WiFiUDPlogger(): The ''latency'' receive mode busy-polls on all cores, so the real-time priority is not set (set RealtimeCPUs to a subset of the cores).');
+            end
+            Pid = feature('getpid');
+            [~, Affinity] = system(sprintf('taskset -p %i', Pid));
+            Affinity = regexp(Affinity, '[0-9a-fA-F]+\s*$', 'match', 'once');
+            if ~isempty(obj.RealtimeCPUs) && ~isempty(Affinity)
+                if system(sprintf('taskset -a -p -c %s %i > /dev/null', strjoin(arrayfun(@num2str, obj.RealtimeCPUs, 'UniformOutput', false), ','), Pid)) == 0
+                    obj.RealtimeRestore{end+1} = sprintf('taskset -a -p %s %i > /dev/null', strtrim(Affinity), Pid);
+                else
+                    warning('WiFiUDPlogger(): The CPU affinity could not be set.');
+                end
+            end
+            if ~isPriority
+                return;
+            end
+            if system(sprintf('chrt -a -r -p %i %i > /dev/null 2>&1', obj.RealtimePriority, Pid)) == 0
+                obj.RealtimeRestore{end+1} = sprintf('chrt -a -o -p 0 %i > /dev/null', Pid);
+            else
+                warning('WiFiUDPlogger(): The real-time priority could not be set (CAP_SYS_NICE is required, e.g. sudo setcap cap_sys_nice+ep on the MATLAB executable).');
+            end
+        end
+        
+        %% Restore the scheduling and affinity of the MATLAB process after startRealtimeProfile().
+        function obj = stopRealtimeProfile(obj)
+            for iCommand = length(obj.RealtimeRestore):-1:1
+                system(obj.RealtimeRestore{iCommand});
+            end
+            obj.RealtimeRestore = {};
+        end
+        
+        %% true: The board confirms the tare of all enabled inputs (by its last status, see setTare).
+        % A board restarted, or without the tare in its firmware, reports no tared inputs.
+        function Tared = isTared(obj)
+            Tared = ~isempty(obj.BoardTareInputs) && ~isempty(obj.mEnabledInputs) && any(obj.mEnabledInputs) && ...
+                all(ismember(find(obj.mEnabledInputs), obj.BoardTareInputs));
+        end
+        
+        %% Hand the recording over to the process which asked for it (see takeOver).
+        % The packets received until the board streams to the other process are passed on without decoding, and the
+        % connection is closed without stopping the board. Without a takeover within obj.HandoffTimeout, the recording
+        % continues here.
+        function obj = handOver(obj)
+            Files = handoffFiles(obj);
+            delete(Files.Request);
+            State = handoffState(obj);
+            LiveState = [];
+            if ~isempty(obj.LiveRecording)
+                LiveState = suspend(obj.LiveRecording);
+            end
+            tSnapshot = now;
+            save([Files.State '.tmp.mat'], 'State', 'LiveState', 'tSnapshot');
+            movefile([Files.State '.tmp.mat'], Files.State);
+            
+            % Keep the packets until the other process has taken over, and no more packets arrive
+            Packets = {};
+            tStart = tic;
+            tLast = tic;
+            isTaken = false;
+            while (isTaken && toc(tLast) < obj.HandoffQuiet) || (~isTaken && toc(tStart) < obj.HandoffTimeout)
+                if obj.hUDP.BytesAvailable > 0
+                    Packets{end+1} = fread(obj.hUDP, obj.hUDP.BytesAvailable); %#ok<AGROW>
+                    tLast = tic;
+                elseif ~isTaken && exist(Files.Taken, 'file')
+                    isTaken = true;
+                    tLast = tic;
+                else
+                    pause(0.001);
+                end
+            end
+            if ~isTaken
+                delete(Files.State);
+                if ~isempty(LiveState)
+                    obj.LiveRecording = HotRecording.resume(LiveState, obj.LiveRecording.Store);
+                end
+                for iPacket = 1:length(Packets)
+                    obj = decodePacket(obj, Packets{iPacket});
+                end
+                warning('WiFiUDPlogger.handOver(): No process took over the recording within %g seconds.', obj.HandoffTimeout);
+                return;
+            end
+            save([Files.Tail '.tmp.mat'], 'Packets');
+            movefile([Files.Tail '.tmp.mat'], Files.Tail);
+            
+            fclose(obj.hUDP);
+            delete(obj.hUDP);
+            obj.hUDP = [];
+            obj.Connected = false;
+            obj.LiveRecording = [];
+            fprintf('Recording handed over after %0.1f seconds\n', obj.nDataSamples/obj.ADCsamplerate);
+        end
+        
+        %% Receive state handed over to another process (the properties in obj.HandoffState).
+        function State = handoffState(obj)
+            State = struct();
+            for Property = obj.HandoffState
+                State.(Property{1}) = obj.(Property{1});
+            end
+        end
+        
+        %% Restore the receive state of another process (properties unknown to this version are ignored).
+        function obj = restoreState(obj, State)
+            for Property = intersect(fieldnames(State)', obj.HandoffState)
+                obj.(Property{1}) = State.(Property{1});
+            end
+            if ~isempty(obj.BurstPackets)
+                obj.BurstPackets.tLast = tic;
+            end
+        end
+        
+        %% Files of a hand-off: request (written by the new process), state, takeover mark and last packets.
+        function Files = handoffFiles(obj)
+            Files.Request = [obj.HandoffFile '.request'];
+            Files.State = [obj.HandoffFile '.mat'];
+            Files.Taken = [obj.HandoffFile '.taken'];
+            Files.Tail = [obj.HandoffFile '_tail.mat'];
+        end
+        
+        %% Send a command to the board (framed, if obj.Transport is 'serial').
+        % Command is a char array, or a char array with binary arguments (e.g. ['T' iBuffer]).
+        function sendCommand(obj, Command)
+            if isempty(obj.hUDP)
+                return;
+            end
+            Command = uint8(Command);
+            if strcmp(obj.Transport, 'serial')
+                Command = WiFiUDPlogger.frame(Command);
+            end
+            fwrite(obj.hUDP, Command);
+        end
+        
+        %% Prepare obj.Bulk for a new flight recorder bulk transfer.
+        function obj = resetBulk(obj)
+            obj.Bulk = struct('Packets', {{}}, 'nPackets', 0, 'Failed', false);
+        end
+        
+        %% Store a flight recorder bulk packet in obj.Bulk, and acknowledge all packets received in order.
+        % Packets received without a transfer in progress are acknowledged as complete, so the device releases its ring.
+        function [obj, iAck] = decodeBulkPacket(obj, RecvData)
+            iPacket = RecvData(2) + 256*RecvData(3);
+            nPackets = RecvData(4) + 256*RecvData(5);
+            iAck = nPackets;
+            if ~isempty(obj.Bulk)
+                if obj.Bulk.nPackets ~= nPackets
+                    obj.Bulk.nPackets = nPackets;
+                    obj.Bulk.Packets = cell(1, nPackets);
+                end
+                if iPacket < nPackets
+                    obj.Bulk.Packets{iPacket+1} = RecvData(:);
+                end
+                iAck = find(cellfun(@isempty, obj.Bulk.Packets), 1) - 1;
+                if isempty(iAck)
+                    iAck = nPackets;
+                end
+            end
+            sendCommand(obj, ['K' typecast(uint16(iAck), 'uint8')]);
+        end
+        
+        %% true: All packets of the bulk transfer in obj.Bulk are received.
+        function isComplete = isBulkComplete(obj)
+            isComplete = ~isempty(obj.Bulk) && obj.Bulk.nPackets > 0 && ~any(cellfun(@isempty, obj.Bulk.Packets));
+        end
+        
+        %% Readings of a complete bulk transfer [size: nInputs x nFrames, unit: Volt], and the time of each frame
+        % starting at tFirst [unit: seconds].
+        function [Window, TimeAxis] = assembleBulk(obj, tFirst)
+            mEnabled = bitget(obj.Bulk.Packets{1}(6), 1:obj.nADCinput) == 1;
+            Payload = cellfun(@(Packet) Packet(7:end), obj.Bulk.Packets, 'UniformOutput', false);
+            Samples = double(typecast(uint8(vertcat(Payload{:})), 'int16'));
+            Window = nan(obj.nADCinput, length(Samples)/nnz(mEnabled));
+            Window(mEnabled,:) = reshape(Samples, nnz(mEnabled), []) * (obj.ADCscale / obj.ADCgain);
+            TimeAxis = tFirst + (0:size(Window,2)-1)/(obj.ADCsamplerate*obj.FRdecimation);
+        end
+        
+        %% Store a burst packet in obj.BurstPackets, request the packets skipped before it, and append the burst to
+        % obj.Bursts when all packets are received.
+        function obj = decodeBurstPacket(obj, RecvData)
+            iBurst = RecvData(2);
+            iPacket = RecvData(3);
+            nPackets = RecvData(4);
+            if iPacket >= nPackets
+                return;
+            end
+            if isempty(obj.BurstPackets) || obj.BurstPackets.iBurst ~= iBurst
+                if ~isempty(obj.Bursts) && obj.Bursts(end).iBurst == iBurst
+                    return;             % Retransmitted packet of a burst that is complete
+                end
+                obj.BurstPackets = struct('iBurst', iBurst, 'Packets', {cell(1, nPackets)}, 'iLast', -1, 'tLast', tic, 'nRetries', 0);
+            end
+            obj.BurstPackets.Packets{iPacket+1} = RecvData(:);
+            obj.BurstPackets.tLast = tic;
+            obj.BurstPackets.nRetries = 0;
+            
+            % Request the packets skipped since the last packet
+            if iPacket > obj.BurstPackets.iLast
+                obj = requestBurstPackets(obj, obj.BurstPackets.iLast+2:iPacket);
+                obj.BurstPackets.iLast = iPacket;
+            end
+            if any(cellfun(@isempty, obj.BurstPackets.Packets))
+                return;
+            end
+            
+            % Assemble the burst (the samples of the burst inputs are interleaved)
+            Header = obj.BurstPackets.Packets{1};
+            iInputs = Header(5) + (0:Header(6)-1);
+            nSamples = Header(7) + 256*Header(8);
+            Duration = double(typecast(uint8(Header(9:12)), 'uint32'))*1e-6;
+            Payload = cellfun(@(Packet) Packet(18:end), obj.BurstPackets.Packets, 'UniformOutput', false);
+            Samples = double(typecast(uint8(vertcat(Payload{:})), 'int16'));
+            Burst.iBurst = iBurst;
+            Burst.Data = reshape(Samples, length(iInputs), nSamples) * (obj.ADCscale / obj.ADCgain);
+            Burst.iInputs = iInputs;
+            Burst.SampleRate = nSamples/Duration;
+            
+            % Start time from the ADC buffer and position, where the burst started (as for retransmitted data). The
+            % buffer index repeats every obj.nADCbuffers blocks, so the block is the one nearest to the start
+            % estimated from the age of the last packet (a burst and its transfer may take longer than the buffers).
+            Burst.tStart = NaN;
+            if ~isempty(obj.iBufferLast)
+                iBlock = obj.iData - mod(obj.iBufferLast - Header(13), obj.nADCbuffers);
+                iBlockEstimate = obj.iData - (RecvData(16) + 256*RecvData(17))*1e-3*obj.ADCsamplerate/obj.nADCbufferPos;
+                iBlock = iBlock - obj.nADCbuffers*max(round((iBlock - iBlockEstimate)/obj.nADCbuffers), 0);
+                Burst.tStart = ((iBlock-1)*obj.nADCbufferPos + Header(14) + 256*Header(15))/obj.ADCsamplerate;
+                
+                % Fill the regular readings of the burst inputs, that are missing during the burst, from the burst
+                % (the burst is not tared on the board, so the tare offset of the start block is subtracted)
+                iFill = find((0:obj.nDataSamples-1)/obj.ADCsamplerate >= Burst.tStart & ...
+                    (0:obj.nDataSamples-1)/obj.ADCsamplerate <= Burst.tStart + (nSamples-1)/Burst.SampleRate);
+                if ~isempty(iFill) && nSamples > 1 && iBlock >= 1
+                    Fill = interp1(Burst.tStart + (0:nSamples-1)/Burst.SampleRate, Burst.Data', (iFill-1)/obj.ADCsamplerate)';
+                    Fill = reshape(Fill, length(iInputs), []) - obj.SummaryBuffer(iInputs, iBlock, 4);
+                    mMissing = isnan(obj.DataBuffer(iInputs,iFill));
+                    Regular = obj.DataBuffer(iInputs,iFill);
+                    Regular(mMissing) = Fill(mMissing);
+                    obj.DataBuffer(iInputs,iFill) = Regular;
+                    obj.nPatched = obj.nPatched + 1;
+                end
+            end
+            if isempty(obj.Bursts)
+                obj.Bursts = Burst;
+            else
+                obj.Bursts(end+1) = Burst;
+            end
+            obj.BurstPackets = [];
+        end
+        
+        %% Append the time of a sync event to obj.SyncTimes, and request the events skipped before it.
+        % The buffer of the event is at most half the buffers from the last received data buffer.
+        function obj = decodeSyncPacket(obj, RecvData)
+            iEvent = RecvData(2);
+            if isempty(obj.iBufferLast)
+                return;
+            end
+            if isempty(obj.iSyncNext)
+                obj.iSyncNext = iEvent;
+            end
+            nSkipped = mod(iEvent - obj.iSyncNext, 256);
+            if nSkipped < 128
+                for iMissing = mod(obj.iSyncNext + (0:nSkipped-1), 256)
+                    sendCommand(obj, ['Y' iMissing]);
+                end
+                obj.SyncMissing = [obj.SyncMissing mod(obj.iSyncNext + (0:nSkipped-1), 256)];
+                obj.iSyncNext = mod(iEvent + 1, 256);
+            elseif any(obj.SyncMissing == iEvent)
+                obj.SyncMissing(obj.SyncMissing == iEvent) = [];
+            else
+                return;                 % Retransmitted event, that is received already
+            end
+            
+            dBuffer = mod(RecvData(3) - obj.iBufferLast + obj.nADCbuffers/2, obj.nADCbuffers) - obj.nADCbuffers/2;
+            iBlock = obj.iData + dBuffer;
+            tSync = ((iBlock-1)*obj.nADCbufferPos + RecvData(4) + 256*RecvData(5) + (RecvData(6) + 256*RecvData(7))/65536)/obj.ADCsamplerate;
+            obj.SyncTimes = sort([obj.SyncTimes tSync]);
+        end
+        
+        %% Request the missing packets among packets iPackets (1-based) of the burst in obj.BurstPackets.
+        function obj = requestBurstPackets(obj, iPackets)
+            for iPacket = iPackets(cellfun(@isempty, obj.BurstPackets.Packets(iPackets)))
+                sendCommand(obj, ['W' iPacket-1]);
+                if obj.dispRetransmit
+                    fprintf('Send burst retransmit, iPacket=%i\n', iPacket-1);
+                end
+            end
+            obj.BurstPackets.tLast = tic;
+        end
+        
+        %% Circular buffers of the incremental live plot (the filters are disabled until set in Live.Settings).
+        function Live = initLive(obj, b_Notch, a_Notch)
+            Live.nRing = obj.LiveWindowSize*obj.ADCsamplerate;
+            Live.nWarmup = Live.nRing + ~isequal(obj.DataTared, true)*obj.AddLiveBuffer*obj.ADCsamplerate;
+            Live.b_Notch = b_Notch;
+            Live.a_Notch = a_Notch;
+            Live.b_BandPass = [];
+            Live.a_BandPass = [];
+            Live.Notch = false;
+            Live.Bandpass = false;
+            Live.Settings = [];
+            Live = resetLive(obj, Live);
+        end
+        
+        %% Empty the circular buffers and filter states. The last nWarmup samples are appended on the next update.
+        function Live = resetLive(obj, Live)
+            nInputs = size(obj.DataBuffer,1);
+            Live.Filt = nan(nInputs, Live.nRing);
+            Live.nPlotted = max(obj.nDataSamples - Live.nWarmup, 0);
+            Live.nPatched = obj.nPatched;
+            Live.zNotch = cell(1, size(Live.b_Notch,1));
+            for iNotch = 1:size(Live.b_Notch,1)
+                Live.zNotch{iNotch} = zeros(size(Live.b_Notch,2)-1, nInputs);
+            end
+            Live.zBandPass = zeros(max(length(Live.a_BandPass),length(Live.b_BandPass))-1, nInputs);
+        end
+        
+        %% Filter the samples received since the last update and append them to the circular buffers.
+        % A block written behind the plotted samples (a retransmission within the ring) invalidates the filter states
+        % from its start, so the buffers are primed again from the last nWarmup samples.
+        function Live = appendLive(obj, Live)
+            nData = obj.nDataSamples;
+            if nData - Live.nPlotted > Live.nWarmup || obj.nPatched ~= Live.nPatched
+                Live = resetLive(obj, Live);
+            end
+            i0 = Live.nPlotted + 1;
+            if nData < i0
+                return;
+            end
+            
+            % Fill gaps using the preceding samples as context
+            X = obj.DataBuffer(:,i0:nData);
+            if obj.ImputeEnabled && any(any(isnan(X(obj.mEnabledInputs,:))))
+                nContext = min(i0-1, round(obj.ImputeTemplateWindow*obj.ADCsamplerate));
+                X = imputeGaps(obj, obj.DataBuffer(:,i0-nContext:nData));
+                X = X(:,nContext+1:end);
+            end
+            
+            if Live.Notch
+                for iNotch = 1:size(Live.b_Notch,1)
+                    [X, Live.zNotch{iNotch}] = WiFiUDPlogger.filterBlock(Live.b_Notch(iNotch,:), Live.a_Notch(iNotch,:), X, Live.zNotch{iNotch});
+                end
+            end
+            if Live.Bandpass
+                [X, Live.zBandPass] = WiFiUDPlogger.filterBlock(Live.b_BandPass, Live.a_BandPass, X, Live.zBandPass);
+            end
+            iRing = mod(i0-1:nData-1, Live.nRing) + 1;
+            iKeep = max(length(iRing)-Live.nRing+1, 1):length(iRing);
+            Live.Filt(:,iRing(iKeep)) = X(:,iKeep);
+            Live.nPlotted = nData;
+        end
+        
+        %% Draw the circular buffers, decimated to the pixel width of the axis.
+        % LiveMax is the max. abs. value of each input in the window (from the buffer summaries in obj.BlockSummary),
+        % before the tare on the board, so it can be compared with the saturation threshold of the ADC.
+        function LiveMax = drawLive(obj, Live, hAxis, hLines)
+            n = min(Live.nPlotted, Live.nRing);
+            if n == 0
+                LiveMax = zeros(size(Live.Filt,1), 1);
+                return;
+            end
+            iSample = Live.nPlotted-n+1:Live.nPlotted;
+            iRing = mod(iSample-1, Live.nRing) + 1;
+            
+            posAxis = getpixelposition(hAxis);
+            [tPlot, YPlot] = WiFiUDPlogger.minMaxDecimate((iSample-1)/obj.ADCsamplerate, Live.Filt(:,iRing), max(round(posAxis(3)),1));
+            for iInput = 1:length(hLines)
+                set(hLines(iInput), 'XData', tPlot, 'YData', YPlot(iInput,:));
+            end
+            xlim(hAxis, [Live.nPlotted-Live.nRing Live.nPlotted-1]/obj.ADCsamplerate);
+            
+            LiveMax = zeros(size(Live.Filt,1), 1);
+            iBlocks = ceil(iSample(1)/obj.nADCbufferPos):min(floor(iSample(end)/obj.nADCbufferPos), size(obj.SummaryBuffer,2));
+            if ~isempty(iBlocks)
+                Offset = obj.SummaryBuffer(:,iBlocks,4);
+                Offset(isnan(Offset)) = 0;
+                LiveMax = max(max(abs(obj.SummaryBuffer(:,iBlocks,1:2) + Offset),[],3),[],2);
+                LiveMax(isnan(LiveMax)) = 0;
+            end
+        end
+        
+        %% Offsets subtracted by the tare on the board from samples 'iSamples' [size: nADCinput x length(iSamples), unit: Volt].
+        % The offset of each sample is the offset of its buffer (0 if the buffer has no summary).
+        function Offset = sampleOffsets(obj, iSamples)
+            Offset = zeros(obj.nADCinput, length(iSamples));
+            iBlocks = ceil(iSamples/obj.nADCbufferPos);
+            mSummary = iBlocks <= size(obj.SummaryBuffer,2);
+            if any(mSummary)
+                Offset(:,mSummary) = obj.SummaryBuffer(:,iBlocks(mSummary),4);
+                Offset(isnan(Offset)) = 0;
+            end
+        end
+        
+    end
+    
+    methods (Static)
+        
+        %% Page faults and context switches of the MATLAB process (Linux, empty on other platforms).
+        % Fields: MinorFaults, MajorFaults, VoluntarySwitches and InvoluntarySwitches (counted since the process started).
+        function Stats = processStats()
+            Stats = [];
+            if ~isunix || ~exist('/proc/self/stat', 'file')
+                return;
+            end
+            Fields = strsplit(strtrim(regexprep(fileread('/proc/self/stat'), '^.*\)', '')));
+            Stats.MinorFaults = str2double(Fields{8});
+            Stats.MajorFaults = str2double(Fields{10});
+            Status = fileread('/proc/self/status');
+            Stats.VoluntarySwitches = str2double(regexp(Status, '\nvoluntary_ctxt_switches:\s*(\d+)', 'tokens', 'once'));
+            Stats.InvoluntarySwitches = str2double(regexp(Status, 'nonvoluntary_ctxt_switches:\s*(\d+)', 'tokens', 'once'));
+        end
+        
+    end
+    
+    methods (Static, Hidden = true)
+        
+        %% Frame a packet for the serial port: [165 (0xA5)][Length_LSB][Length_MSB][Packet] (type: uint8 column).
+        function Frame = frame(Packet)
+            Packet = uint8(Packet(:));
+            Frame = [uint8(165); typecast(uint16(length(Packet)), 'uint8')'; Packet];
+        end
+        
+        %% Split a received byte stream into packets (cell array of columns, as returned by fread). Bytes before a
+        % frame start are skipped (e.g. debug messages), and the bytes of an incomplete frame are returned in Rest.
+        function [Packets, Rest] = deframe(Stream)
+            Stream = double(Stream(:));
+            Packets = {};
+            iPos = 1;
+            while true
+                iStart = find(Stream(iPos:end) == 165, 1) + iPos - 1;
+                if isempty(iStart)
+                    iPos = length(Stream) + 1;
+                    break;
+                end
+                if iStart + 3 > length(Stream)
+                    iPos = iStart;
+                    break;
+                end
+                Length = Stream(iStart+1) + 256*Stream(iStart+2);
+                if Length == 0 || Length > 2048 || Stream(iStart+3) < 65 || Stream(iStart+3) > 90
+                    iPos = iStart + 1;      % Not a frame (a packet starts with an upper case letter)
+                    continue;
+                end
+                if iStart + 2 + Length > length(Stream)
+                    iPos = iStart;
+                    break;
+                end
+                Packets{end+1} = Stream(iStart+3:iStart+2+Length); %#ok<AGROW>
+                iPos = iStart + 3 + Length;
+            end
+            Rest = Stream(iPos:end);
+        end
+        
+    end
+    
+    methods (Static, Access = private)
+        
+        %% Estimate the step period [unit: samples] from the onsets of consecutive steps (empty if fewer than two steps).
+        function Period = stepPeriod(iOnset)
+            if length(iOnset) < 2
+                Period = [];
+            else
+                Period = round(median(diff(iOnset)));
+            end
+        end
+        
+        %% Filter each row of X along the samples, resetting the filter state after every NaN gap.
+        function X = filterSegments(b, a, X)
+            for iRow = 1:size(X,1)
+                dValid = diff([false ~isnan(X(iRow,:)) false]);
+                iStart = find(dValid == 1);
+                iEnd = find(dValid == -1) - 1;
+                for iSeg = 1:length(iStart)
+                    X(iRow,iStart(iSeg):iEnd(iSeg)) = filter(b, a, X(iRow,iStart(iSeg):iEnd(iSeg)));
+                end
+            end
+        end
+        
+        %% Filter each row of X along the samples, continuing from the filter state Z [size: filter order x nRows].
+        % The state is reset after every NaN gap, and rows without any valid samples are left as NaN.
+        function [X, Z] = filterBlock(b, a, X, Z)
+            mNaN = isnan(X);
+            mClean = ~any(mNaN,2);
+            if any(mClean)
+                [X(mClean,:), Z(:,mClean)] = filter(b, a, X(mClean,:), Z(:,mClean), 2);
+            end
+            for iRow = find(~mClean)'
+                dValid = diff([false ~mNaN(iRow,:) false]);
+                iStart = find(dValid == 1);
+                iEnd = find(dValid == -1) - 1;
+                z = Z(:,iRow);
+                for iSeg = 1:length(iStart)
+                    if iStart(iSeg) > 1
+                        z(:) = 0;
+                    end
+                    [X(iRow,iStart(iSeg):iEnd(iSeg)), z] = filter(b, a, X(iRow,iStart(iSeg):iEnd(iSeg)), z);
+                end
+                if mNaN(iRow,end)
+                    z(:) = 0;
+                end
+                Z(:,iRow) = z;
+            end
+        end
+        
+        %% Filter a chunk of data [size: nInputs x nSamples], whose first nWarmup samples only settle the filters and
+        % whose last nLookahead samples are the lookahead of the wavelet denoiser, and sum the periodograms of its segments.
+        function Chunk = processChunk(X, nWarmup, nLookahead, Filters)
+            for iNotch = 1:size(Filters.b_Notch,1)
+                X = WiFiUDPlogger.filterSegments(Filters.b_Notch(iNotch,:), Filters.a_Notch(iNotch,:), X);
+            end
+            if ~isempty(Filters.Wavelet)
+                X = WaveletDenoiser.denoise(X, Filters.Wavelet.Levels, Filters.Wavelet.Threshold);
+            elseif ~isempty(Filters.b_BandPass)
+                X = WiFiUDPlogger.filterSegments(Filters.b_BandPass, Filters.a_BandPass, X);
+            end
+            Chunk.Filtered = X(:,nWarmup+1:end-nLookahead);
+            
+            nFFT = length(Filters.Window);
+            Chunk.PsdSum = zeros(size(X,1), nFFT/2+1);
+            Chunk.nPsd = zeros(size(X,1), 1);
+            for iSegment = 1:nFFT/2:size(Chunk.Filtered,2)-nFFT+1
+                Segment = Chunk.Filtered(:,iSegment:iSegment+nFFT-1);
+                mValid = ~any(isnan(Segment),2);
+                Segment = fft((Segment(mValid,:) - mean(Segment(mValid,:),2)) .* Filters.Window, [], 2);
+                Chunk.PsdSum(mValid,:) = Chunk.PsdSum(mValid,:) + abs(Segment(:,1:nFFT/2+1)).^2;
+                Chunk.nPsd(mValid) = Chunk.nPsd(mValid) + 1;
+            end
+        end
+        
+        %% Index of the nearest of the sorted edges tSorted for each time t, and the distance to it [unit: seconds].
+        function [iNearest, Distance] = nearestEdges(tSorted, t)
+            iNearest = interp1(tSorted, 1:length(tSorted), t, 'nearest', 'extrap');
+            iNearest = min(max(iNearest, 1), length(tSorted));
+            Distance = abs(tSorted(iNearest) - t);
+        end
+        
+        %% Min/max decimation of Y [size: nRows x nSamples] to nBins bins, so peaks remain visible in the plot.
+        function [tPlot, YPlot] = minMaxDecimate(t, Y, nBins)
+            n = size(Y,2);
+            nBinSize = ceil(n/nBins);
+            if nBinSize <= 2
+                tPlot = t;
+                YPlot = Y;
+                return;
+            end
+            nBins = ceil(n/nBinSize);
+            Y(:,end+1:nBins*nBinSize) = NaN;
+            Y = reshape(Y, size(Y,1), nBinSize, nBins);
+            
+            YPlot = zeros(size(Y,1), 2*nBins);
+            YPlot(:,1:2:end) = reshape(min(Y,[],2), [], nBins);
+            YPlot(:,2:2:end) = reshape(max(Y,[],2), [], nBins);
+            tPlot = zeros(1, 2*nBins);
+            tPlot(1:2:end) = t(1:nBinSize:n);
+            tPlot(2:2:end) = t(min((1:nBins)*nBinSize, n));
+        end
+        
     end
 end
\ No newline at end of file